@@ -0,0 +1,148 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	bench-direct-io.c
+ * @brief	Benchmark of buffered and direct I/O format (latency and page cache footprint)
+ *
+ * Build:
+ *   gcc -O2 -D_GNU_SOURCE -Iinclude -Ilib -o bench-direct-io example/bench-direct-io.c lib/*.c
+ * Usage:
+ *   bench-direct-io [directory]
+ */
+
+#include "librefop.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_LOOP (20)
+
+static const char filename[] = "refop-bench-direct.bin";
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1000000.0;
+}
+
+// Number of pages of the file that are in the page cache.
+static long resident_pages(const char *path)
+{
+	struct stat sb;
+	unsigned char *vec = NULL;
+	void *map = NULL;
+	long pagesize = sysconf(_SC_PAGESIZE), pages = 0, resident = 0;
+	int fd = -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &sb) < 0 || sb.st_size == 0) {
+		close(fd);
+		return -1;
+	}
+
+	pages = (sb.st_size + pagesize - 1) / pagesize;
+	map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	vec = (unsigned char *) malloc(pages);
+	if (vec != NULL && mincore(map, sb.st_size, vec) == 0) {
+		for (long i = 0; i < pages; i++)
+			resident += (vec[i] & 1);
+	}
+
+	free(vec);
+	munmap(map, sb.st_size);
+
+	return resident;
+}
+
+static int run(const char *dir, int64_t size, bool direct)
+{
+	refop_handle_t handle = NULL;
+	char path[4096];
+	uint8_t *buf = NULL;
+	int64_t szr = 0;
+	double set_ms = 0.0, get_ms = 0.0, t = 0.0;
+	long after_set = 0, after_get = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, filename);
+
+	if (refop_create_redundancy_handle(&handle, dir, filename) != REFOP_SUCCESS)
+		return -1;
+	(void) refop_remove_redundancy_data(handle);
+	(void) refop_set_direct_io(handle, direct);
+
+	buf = (uint8_t *) malloc(size);
+	if (buf == NULL) {
+		refop_release_redundancy_handle(handle);
+		return -1;
+	}
+	for (int64_t i = 0; i < size; i++)
+		buf[i] = (uint8_t) (i * 7);
+
+	for (int i = 0; i < BENCH_LOOP; i++) {
+		t = now_ms();
+		if (refop_set_redundancy_data(handle, buf, size) != REFOP_SUCCESS)
+			goto error;
+		set_ms += now_ms() - t;
+	}
+	after_set = resident_pages(path);
+
+	for (int i = 0; i < BENCH_LOOP; i++) {
+		t = now_ms();
+		if (refop_get_redundancy_data(handle, buf, size, &szr) != REFOP_SUCCESS)
+			goto error;
+		get_ms += now_ms() - t;
+	}
+	after_get = resident_pages(path);
+
+	printf("%-8s %8lld KiB  set %8.3f ms  get %8.3f ms  cached pages after set %6ld  after get %6ld\n",
+	       direct ? "direct" : "buffered", (long long) (size / 1024), set_ms / BENCH_LOOP, get_ms / BENCH_LOOP,
+	       after_set, after_get);
+
+	(void) refop_remove_redundancy_data(handle);
+	refop_release_redundancy_handle(handle);
+	free(buf);
+
+	return 0;
+
+error:
+	refop_release_redundancy_handle(handle);
+	free(buf);
+
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	const int64_t sizes[] = { 64 * 1024, 512 * 1024, 1000 * 1024 };
+	const char *dir = "/tmp/refop-test";
+
+	if (argc > 1)
+		dir = argv[1];
+
+	mkdir(dir, 0777);
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if (run(dir, sizes[i], false) < 0 || run(dir, sizes[i], true) < 0) {
+			fprintf(stderr, "benchmark failed\n");
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,191 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	bench-snapshot.c
+ * @brief	Benchmark of read throughput scaling of snapshot read and get
+ *
+ * Build:
+ *   gcc -O2 -D_GNU_SOURCE -Iinclude -Ilib -o bench-snapshot example/bench-snapshot.c lib/*.c -lpthread
+ * Usage:
+ *   bench-snapshot [directory] [data size]
+ */
+
+#include "librefop.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DATA_SIZE_DEFAULT (4 * 1024)
+#define BENCH_DURATION_MS (1000)
+#define BENCH_THREADS_MAX (32)
+
+static const char filename[] = "refop-bench-snapshot.bin";
+// Sum of read bytes, it keeps reads from being optimized out.
+static volatile unsigned int g_sink;
+
+struct bench_ctx {
+	refop_handle_t handle;
+	int64_t size;
+	bool snapshot;
+	atomic_bool stop;
+	atomic_long reads;
+	atomic_long errors;
+};
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1000000.0;
+}
+
+// A reader touches first and last byte, so both ways access the value.
+static void *reader(void *arg)
+{
+	struct bench_ctx *ctx = (struct bench_ctx *) arg;
+	refop_snapshot_t snapshot = NULL;
+	const uint8_t *data = NULL;
+	uint8_t *buf = NULL;
+	int64_t szr = 0;
+	long reads = 0, errors = 0;
+	unsigned int sum = 0;
+
+	buf = malloc((size_t) ctx->size);
+	if (buf == NULL) {
+		atomic_fetch_add(&ctx->errors, 1);
+		return NULL;
+	}
+
+	while (atomic_load(&ctx->stop) == false) {
+		if (ctx->snapshot == true) {
+			if (refop_snapshot_acquire(ctx->handle, &snapshot, &data, &szr) != REFOP_SUCCESS) {
+				errors++;
+			} else {
+				sum += data[0] + data[szr - 1];
+				(void) refop_snapshot_release(snapshot);
+			}
+		} else {
+			if (refop_get_redundancy_data(ctx->handle, buf, ctx->size, &szr) != REFOP_SUCCESS)
+				errors++;
+			else
+				sum += buf[0] + buf[szr - 1];
+		}
+		reads++;
+	}
+
+	free(buf);
+	atomic_fetch_add(&ctx->reads, reads);
+	atomic_fetch_add(&ctx->errors, errors);
+	g_sink += sum;
+
+	return NULL;
+}
+
+// Readers share one handle, and one writer sets every 10 ms when writer is true.
+static int run(refop_handle_t handle, int64_t size, int threads, bool snapshot, bool writer)
+{
+	struct bench_ctx ctx;
+	pthread_t tid[BENCH_THREADS_MAX];
+	uint8_t *buf = NULL;
+	double start = 0.0, elapsed = 0.0;
+	long sets = 0;
+
+	buf = malloc((size_t) size);
+	if (buf == NULL)
+		return -1;
+
+	ctx.handle = handle;
+	ctx.size = size;
+	ctx.snapshot = snapshot;
+	atomic_init(&ctx.stop, false);
+	atomic_init(&ctx.reads, 0);
+	atomic_init(&ctx.errors, 0);
+
+	for (int i = 0; i < threads; i++) {
+		if (pthread_create(&tid[i], NULL, reader, &ctx) != 0) {
+			free(buf);
+			return -1;
+		}
+	}
+
+	start = now_ms();
+	while ((elapsed = now_ms() - start) < BENCH_DURATION_MS) {
+		if (writer == true) {
+			memset(buf, (int) sets, (size_t) size);
+			if (refop_set_redundancy_data(handle, buf, size) == REFOP_SUCCESS)
+				sets++;
+		}
+		usleep(10 * 1000);
+	}
+	atomic_store(&ctx.stop, true);
+
+	for (int i = 0; i < threads; i++)
+		pthread_join(tid[i], NULL);
+
+	printf("%2d threads %-8s %-9s %12.0f reads/s  %10.0f reads/s/thread  sets %4ld  errors %ld\n", threads,
+	       snapshot ? "snapshot" : "get", writer ? "+writer" : "",
+	       (double) atomic_load(&ctx.reads) * 1000.0 / elapsed,
+	       (double) atomic_load(&ctx.reads) * 1000.0 / elapsed / threads, sets, atomic_load(&ctx.errors));
+
+	free(buf);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const int threads[] = { 1, 2, 4, 8, 16, 32 };
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+	const char *dir = "/tmp/refop-test";
+	int64_t size = BENCH_DATA_SIZE_DEFAULT;
+	uint8_t *buf = NULL;
+	int ret = 0;
+
+	if (argc > 1)
+		dir = argv[1];
+	if (argc > 2)
+		size = atoll(argv[2]);
+	if (size <= 0)
+		size = BENCH_DATA_SIZE_DEFAULT;
+
+	mkdir(dir, 0777);
+
+	(void) refop_get_default_options(&opts);
+	opts.thread_safe = true;
+	if (refop_create_redundancy_handle_ex(&handle, dir, filename, &opts) != REFOP_SUCCESS) {
+		fprintf(stderr, "handle create failed\n");
+		return 1;
+	}
+
+	buf = calloc(1, (size_t) size);
+	if (buf == NULL || refop_set_redundancy_data(handle, buf, size) != REFOP_SUCCESS) {
+		fprintf(stderr, "initial set failed\n");
+		free(buf);
+		refop_release_redundancy_handle(handle);
+		return 1;
+	}
+	free(buf);
+
+	for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]) && ret == 0; i++)
+		ret = run(handle, size, threads[i], false, false);
+	for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]) && ret == 0; i++)
+		ret = run(handle, size, threads[i], true, false);
+	for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]) && ret == 0; i++)
+		ret = run(handle, size, threads[i], true, true);
+
+	if (ret < 0)
+		fprintf(stderr, "benchmark failed\n");
+
+	(void) refop_remove_redundancy_data(handle);
+	refop_release_redundancy_handle(handle);
+
+	return (ret < 0) ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	bench-thread.c
+ * @brief	Benchmark of get throughput scaling with a shared thread safe handle
+ *
+ * Build:
+ *   gcc -O2 -D_GNU_SOURCE -Iinclude -Ilib -o bench-thread example/bench-thread.c lib/*.c -lpthread
+ * Usage:
+ *   bench-thread [directory] [mode]
+ *   mode: 0 rotation (default), 1 ping-pong, 2 A/B slot
+ */
+
+#include "librefop.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DATA_SIZE (4 * 1024)
+#define BENCH_DURATION_MS (1000)
+#define BENCH_THREADS_MAX (32)
+
+static const char filename[] = "refop-bench-thread.bin";
+
+struct bench_ctx {
+	refop_handle_t handle;
+	atomic_bool stop;
+	atomic_long gets;
+	atomic_long errors;
+};
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1000000.0;
+}
+
+static void *reader(void *arg)
+{
+	struct bench_ctx *ctx = (struct bench_ctx *) arg;
+	uint8_t buf[BENCH_DATA_SIZE];
+	int64_t szr = 0;
+	long gets = 0, errors = 0;
+
+	while (atomic_load(&ctx->stop) == false) {
+		if (refop_get_redundancy_data(ctx->handle, buf, sizeof(buf), &szr) != REFOP_SUCCESS)
+			errors++;
+		gets++;
+	}
+
+	atomic_fetch_add(&ctx->gets, gets);
+	atomic_fetch_add(&ctx->errors, errors);
+
+	return NULL;
+}
+
+// Readers share one handle, and one writer sets every 10 ms when writer is true.
+static int run(refop_handle_t handle, int threads, bool writer)
+{
+	struct bench_ctx ctx;
+	pthread_t tid[BENCH_THREADS_MAX];
+	uint8_t buf[BENCH_DATA_SIZE];
+	double start = 0.0, elapsed = 0.0;
+	long sets = 0;
+
+	ctx.handle = handle;
+	atomic_init(&ctx.stop, false);
+	atomic_init(&ctx.gets, 0);
+	atomic_init(&ctx.errors, 0);
+
+	for (int i = 0; i < threads; i++) {
+		if (pthread_create(&tid[i], NULL, reader, &ctx) != 0)
+			return -1;
+	}
+
+	start = now_ms();
+	while ((elapsed = now_ms() - start) < BENCH_DURATION_MS) {
+		if (writer == true) {
+			memset(buf, (int) sets, sizeof(buf));
+			if (refop_set_redundancy_data(handle, buf, sizeof(buf)) == REFOP_SUCCESS)
+				sets++;
+		}
+		usleep(10 * 1000);
+	}
+	atomic_store(&ctx.stop, true);
+
+	for (int i = 0; i < threads; i++)
+		pthread_join(tid[i], NULL);
+
+	printf("%2d threads %-9s %10.0f gets/s  %8.0f gets/s/thread  sets %4ld  errors %ld\n", threads,
+	       writer ? "+writer" : "", (double) atomic_load(&ctx.gets) * 1000.0 / elapsed,
+	       (double) atomic_load(&ctx.gets) * 1000.0 / elapsed / threads, sets, atomic_load(&ctx.errors));
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const int threads[] = { 1, 2, 4, 8, 16, 32 };
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+	const char *dir = "/tmp/refop-test";
+	uint8_t buf[BENCH_DATA_SIZE];
+	int mode = 0, ret = 0;
+
+	if (argc > 1)
+		dir = argv[1];
+	if (argc > 2)
+		mode = atoi(argv[2]);
+
+	mkdir(dir, 0777);
+
+	(void) refop_get_default_options(&opts);
+	opts.thread_safe = true;
+	if (refop_create_redundancy_handle_ex(&handle, dir, filename, &opts) != REFOP_SUCCESS) {
+		fprintf(stderr, "handle create failed\n");
+		return 1;
+	}
+	(void) refop_set_slot_capacity(handle, BENCH_DATA_SIZE);
+	(void) refop_set_redundancy_mode(handle, (refop_mode_t) mode);
+
+	memset(buf, 0, sizeof(buf));
+	if (refop_set_redundancy_data(handle, buf, sizeof(buf)) != REFOP_SUCCESS) {
+		fprintf(stderr, "initial set failed\n");
+		refop_release_redundancy_handle(handle);
+		return 1;
+	}
+
+	for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]) && ret == 0; i++)
+		ret = run(handle, threads[i], false);
+	for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]) && ret == 0; i++)
+		ret = run(handle, threads[i], true);
+
+	if (ret < 0)
+		fprintf(stderr, "benchmark failed\n");
+
+	(void) refop_remove_redundancy_data(handle);
+	refop_release_redundancy_handle(handle);
+
+	return (ret < 0) ? 1 : 0;
+}
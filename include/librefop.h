@@ -8,6 +8,7 @@
 #define LIBREDUNDANCY_FILEOP_H
 //-----------------------------------------------------------------------------
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 //-----------------------------------------------------------------------------
@@ -35,19 +36,246 @@ typedef enum refop_error {
 	//! Argument error.
 	REFOP_ARGERROR = -3,
 
+	//! The target was locked by another writer until timeout.
+	REFOP_BUSY = -4,
+
 	//! Internal operation was failed such as no memory, no disk space and etc.
 	REFOP_SYSERROR = -100,
 
 } refop_error_t;
+
+/**
+ * Redundancy mode definition
+ * @enum refop_mode_t
+ */
+typedef enum refop_mode {
+	//! Latest and backup file rotation using rename (default).
+	REFOP_MODE_ROTATION = 0,
+
+	//! Alternate overwrite of two fixed files with generation number. No rename and no directory sync.
+	//! When backup count is N, N + 1 files are used as ring.
+	REFOP_MODE_PINGPONG = 1,
+
+	//! Single preallocated file that has two slots. Set overwrite older slot in place.
+	REFOP_MODE_SLOT = 2,
+
+	//! Single file that has data blocks and XOR parity blocks. Broken blocks are reconstructed by parity.
+	REFOP_MODE_PARITY = 3,
+
+	//! Delta records from previous generation are appended to a delta file. Full keyframe is written
+	//! periodically by latest and backup file rotation.
+	REFOP_MODE_DELTA = 4,
+
+	//! Full value records are appended to a journal file. The journal is compacted to latest and
+	//! backup file rotation periodically.
+	REFOP_MODE_JOURNAL = 5,
+
+	//! Data is split to content defined chunks that are stored once by SHA-256. Latest and backup
+	//! file rotation store the manifest of chunk references.
+	REFOP_MODE_CHUNK = 6,
+
+} refop_mode_t;
+
+/**
+ * Durability definition
+ * @enum refop_durability_t
+ */
+typedef enum refop_durability {
+	//! Data files and directory entries are synced by every set (default).
+	REFOP_DURABILITY_FULL = 0,
+
+	//! Data files are synced, directory sync is skipped. Power loss may return previous data.
+	REFOP_DURABILITY_DATA = 1,
+
+	//! No sync. Power loss may return previous data or broken data is detected.
+	REFOP_DURABILITY_NONE = 2,
+
+} refop_durability_t;
+
+/**
+ * I/O backend definition
+ * @enum refop_io_backend_t
+ */
+typedef enum refop_io_backend {
+	//! Buffered I/O (default).
+	REFOP_IO_BUFFERED = 0,
+
+	//! Direct I/O format and O_DIRECT (rotation mode).
+	REFOP_IO_DIRECT = 1,
+
+} refop_io_backend_t;
+
+/**
+ * Operation type of refop_batch_op_t.
+ */
+typedef enum refop_batch_type {
+	//! refop_set_redundancy_data_async()
+	REFOP_BATCH_SET = 0,
+
+	//! refop_get_redundancy_data_async()
+	REFOP_BATCH_GET = 1,
+
+	//! refop_remove_redundancy_data_async()
+	REFOP_BATCH_REMOVE = 2,
+
+	//! refop_verify_redundancy_data_async()
+	REFOP_BATCH_VERIFY = 3,
+
+} refop_batch_type_t;
+
+/** Default data size limit (byte). */
+#define REFOP_DATA_SIZE_LIMIT_DEFAULT (1 * 1024 * 1024)
+/** Maximum value of data size limit option (byte). */
+#define REFOP_DATA_SIZE_LIMIT_MAX (1024 * 1024 * 1024)
+
+/**
+ * Handle options for refop_create_redundancy_handle_ex() and refop_set_default_options().
+ * refop_create_redundancy_handle_static() takes same options except shared, a static handle could not be
+ * shared and shared = true is REFOP_ARGERROR.
+ */
+typedef struct refop_options {
+	uint64_t size_limit;		/**< Maximum data size (byte), 0 is default */
+	refop_durability_t durability;	/**< Sync policy of set operation */
+	int backup_count;		/**< Backup count of ping-pong mode (1 to 15), 0 is default */
+	uint64_t cache_budget;		/**< Maximum size of cached value in the handle (byte), 0 is no limit */
+	refop_io_backend_t io_backend;	/**< I/O backend */
+	bool thread_safe;		/**< When true, the handle can be used by multiple threads */
+	bool process_lock;		/**< When true, writers in all processes are serialized by a lock file */
+	bool shared;			/**< When true, handles of same directory and file name share one handle */
+} refop_options_t;
+/**
+ * Allocation function for refop_set_allocator().
+ *
+ * @param [in]	size	Allocation size.
+ * @param [in]	ctx	Allocator context.
+ *
+ * @return void*	Allocated memory aligned for any type, NULL is failure.
+ */
+typedef void *(*refop_alloc_fn_t)(size_t size, void *ctx);
+/**
+ * Free function for refop_set_allocator().
+ *
+ * @param [in]	ptr	Memory that was allocated by the allocation function.
+ * @param [in]	ctx	Allocator context.
+ */
+typedef void (*refop_free_fn_t)(void *ptr, void *ctx);
 //-----------------------------------------------------------------------------
 typedef struct refop_halndle *refop_handle_t;
+typedef struct refop_container *refop_container_t;
+typedef struct refop_store *refop_store_t;
+typedef struct refop_future *refop_future_t;
+typedef struct refop_snapshot *refop_snapshot_t;
+typedef struct refop_txn *refop_txn_t;
+typedef struct refop_batch *refop_batch_t;
+/**
+ * One operation of refop_batch_submit().  The array shall be valid until the batch is released.
+ */
+typedef struct refop_batch_op {
+	refop_batch_type_t type; /**< Operation type */
+	refop_handle_t handle;	 /**< Target handle */
+	uint8_t *data;		 /**< Set: write data, get: read buffer, others: not used */
+	int64_t datasize;	 /**< Size of data (byte) */
+	int64_t *getsize;	 /**< Get: readed size (byte), others: not used */
+	refop_error_t result;	 /**< Result, it is set when refop_batch_wait() returns REFOP_SUCCESS */
+} refop_batch_op_t;
+/**
+ * Completion callback of an asynchronous operation for refop_future_set_callback().
+ *
+ * @param [in]	future	Completed future.
+ * @param [in]	result	Result of the operation.
+ * @param [in]	ctx	Callback context.
+ */
+typedef void (*refop_future_cb_t)(refop_future_t future, refop_error_t result, void *ctx);
+
+/** Default number of worker threads of asynchronous operations. */
+#define REFOP_POOL_THREADS_DEFAULT (2)
+/** Maximum number of worker threads of asynchronous operations. */
+#define REFOP_POOL_THREADS_MAX (64)
+/** Default number of queued asynchronous operations. */
+#define REFOP_POOL_DEPTH_DEFAULT (64)
+/** Maximum number of queued asynchronous operations. */
+#define REFOP_POOL_DEPTH_MAX (4096)
+/** Maximum write coalescing window (ms). */
+#define REFOP_COALESCE_WINDOW_MAX (60 * 1000)
+
+/** Maximum key length of refop container. */
+#define REFOP_CONTAINER_KEY_MAX (255)
+/** Maximum key length of refop store, key is a file name without suffix. */
+#define REFOP_STORE_KEY_MAX (245)
 
 //-----------------------------------------------------------------------------
 refop_error_t refop_create_redundancy_handle(refop_handle_t *handle, const char *directry, const char *filename);
+refop_error_t refop_create_redundancy_handle_ex(
+	refop_handle_t *handle, const char *directry, const char *filename, const refop_options_t *options);
+refop_error_t refop_create_redundancy_handle_static(refop_handle_t *handle, const char *directry,
+						     const char *filename, const refop_options_t *options,
+						     void *storage, size_t storage_size, void *scratch,
+						     size_t scratch_size);
+size_t refop_handle_storage_size(const char *directry, const char *filename);
+size_t refop_handle_scratch_size(const refop_options_t *options);
+refop_error_t refop_set_default_options(const refop_options_t *options);
+refop_error_t refop_get_default_options(refop_options_t *options);
+refop_error_t refop_set_allocator(refop_alloc_fn_t alloc_fn, refop_free_fn_t free_fn, void *ctx);
 refop_error_t refop_release_redundancy_handle(refop_handle_t handle);
 refop_error_t refop_set_redundancy_data(refop_handle_t handle, uint8_t *data, int64_t datasize);
+refop_error_t refop_try_set_redundancy_data(refop_handle_t handle, uint8_t *data, int64_t datasize, int timeout_ms);
 refop_error_t refop_get_redundancy_data(refop_handle_t handle, uint8_t *data, int64_t datasize, int64_t *getsize);
 refop_error_t refop_remove_redundancy_data(refop_handle_t handle);
+refop_error_t refop_set_redundancy_mode(refop_handle_t handle, refop_mode_t mode);
+refop_error_t refop_set_slot_capacity(refop_handle_t handle, int64_t capacity);
+refop_error_t refop_set_backup_count(refop_handle_t handle, int count);
+refop_error_t refop_get_generation(refop_handle_t handle, int n, uint8_t *data, int64_t datasize, int64_t *getsize);
+refop_error_t refop_set_block_checksum(refop_handle_t handle, bool enable);
+refop_error_t refop_set_parity_overhead(refop_handle_t handle, int percent);
+refop_error_t refop_set_compression(refop_handle_t handle, bool enable);
+refop_error_t refop_set_direct_io(refop_handle_t handle, bool enable);
+refop_error_t refop_set_lazy_upgrade(refop_handle_t handle, bool enable);
+refop_error_t refop_get_redundancy_range(
+	refop_handle_t handle, int64_t offset, uint8_t *data, int64_t datasize, int64_t *getsize);
+refop_error_t refop_compact_journal(refop_handle_t handle);
+refop_error_t refop_verify_redundancy_data(refop_handle_t handle);
+
+refop_error_t refop_pool_configure(int threads, int depth);
+refop_error_t refop_set_redundancy_data_async(
+	refop_handle_t handle, uint8_t *data, int64_t datasize, refop_future_t *future);
+refop_error_t refop_get_redundancy_data_async(
+	refop_handle_t handle, uint8_t *data, int64_t datasize, int64_t *getsize, refop_future_t *future);
+refop_error_t refop_remove_redundancy_data_async(refop_handle_t handle, refop_future_t *future);
+refop_error_t refop_verify_redundancy_data_async(refop_handle_t handle, refop_future_t *future);
+refop_error_t refop_future_wait(refop_future_t future, int timeout_ms);
+refop_error_t refop_future_poll(refop_future_t future);
+refop_error_t refop_future_set_callback(refop_future_t future, refop_future_cb_t callback, void *ctx);
+refop_error_t refop_future_release(refop_future_t future);
+refop_error_t refop_batch_submit(refop_batch_op_t *ops, int count, refop_batch_t *batch);
+refop_error_t refop_batch_wait(refop_batch_t batch, int timeout_ms);
+refop_error_t refop_batch_poll(refop_batch_t batch);
+refop_error_t refop_batch_release(refop_batch_t batch);
+refop_error_t refop_set_coalesce_window(refop_handle_t handle, int window_ms);
+refop_error_t refop_flush_redundancy_data(refop_handle_t handle);
+refop_error_t refop_snapshot_acquire(refop_handle_t handle, refop_snapshot_t *snapshot, const uint8_t **data,
+				     int64_t *size);
+refop_error_t refop_snapshot_release(refop_snapshot_t snapshot);
+refop_error_t refop_set_shm_cache(refop_handle_t handle, bool enable);
+
+refop_error_t refop_txn_begin(refop_txn_t *txn);
+refop_error_t refop_txn_set(refop_txn_t txn, refop_handle_t handle, uint8_t *data, int64_t datasize);
+refop_error_t refop_txn_commit(refop_txn_t txn);
+refop_error_t refop_txn_abort(refop_txn_t txn);
+
+refop_error_t refop_container_open(refop_container_t *container, const char *directry, const char *filename);
+refop_error_t refop_container_close(refop_container_t container);
+refop_error_t refop_container_set(refop_container_t container, const char *key, uint8_t *data, int64_t datasize);
+refop_error_t refop_container_delete(refop_container_t container, const char *key);
+refop_error_t refop_container_get(
+	refop_container_t container, const char *key, uint8_t *data, int64_t datasize, int64_t *getsize);
+refop_error_t refop_container_commit(refop_container_t container);
+
+refop_error_t refop_store_open(refop_store_t *store, const char *directry, const refop_options_t *options);
+refop_error_t refop_store_close(refop_store_t store);
+refop_error_t refop_store_set(refop_store_t store, const char *key, uint8_t *data, int64_t datasize);
+refop_error_t refop_store_get(refop_store_t store, const char *key, uint8_t *data, int64_t datasize,
+			      int64_t *getsize);
+refop_error_t refop_store_remove(refop_store_t store, const char *key);
 
 //-----------------------------------------------------------------------------
 #ifdef __cplusplus
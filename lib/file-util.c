@@ -36,7 +36,7 @@ ssize_t safe_read(int fd, void *buf, size_t count)
 
 		pbuf += size;
 		ressize += size;
-	} while ((ressize < reqsize) && (size != 0));
+	} while (((size_t) ressize < reqsize) && (size != 0));
 
 	return ressize;
 }
@@ -67,7 +67,69 @@ ssize_t safe_write(int fd, void *buf, size_t count)
 
 		pbuf += size;
 		ressize += size;
-	} while ((ressize < reqsize) && (size != 0));
+	} while (((size_t) ressize < reqsize) && (size != 0));
+
+	return ressize;
+}
+
+/**
+ * INTR safe pread
+ * Interface spec is similar to pread system call.
+ */
+ssize_t safe_pread(int fd, void *buf, size_t count, off_t offset)
+{
+	ssize_t size = 0, ressize = 0;
+	size_t reqsize = 0;
+	uint8_t *pbuf = NULL;
+
+	pbuf = (uint8_t *) buf;
+	reqsize = count;
+
+	do {
+		size = pread(fd, pbuf, (reqsize - ressize), offset + ressize);
+		if (size < 0) {
+			if (errno == EINTR) {
+				continue;
+			} else {
+				ressize = size;
+				break;
+			}
+		}
+
+		pbuf += size;
+		ressize += size;
+	} while (((size_t) ressize < reqsize) && (size != 0));
+
+	return ressize;
+}
+
+/**
+ * INTR safe pwrite
+ * Interface spec is similar to pwrite system call.
+ */
+ssize_t safe_pwrite(int fd, void *buf, size_t count, off_t offset)
+{
+	ssize_t size = 0, ressize = 0;
+	size_t reqsize = 0;
+	uint8_t *pbuf = NULL;
+
+	pbuf = (uint8_t *) buf;
+	reqsize = count;
+
+	do {
+		size = pwrite(fd, pbuf, (reqsize - ressize), offset + ressize);
+		if (size < 0) {
+			if (errno == EINTR) {
+				continue;
+			} else {
+				ressize = size;
+				break;
+			}
+		}
+
+		pbuf += size;
+		ressize += size;
+	} while (((size_t) ressize < reqsize) && (size != 0));
 
 	return ressize;
 }
@@ -17,6 +17,8 @@ extern "C" {
 
 ssize_t safe_read(int fd, void *buf, size_t count);
 ssize_t safe_write(int fd, void *buf, size_t count);
+ssize_t safe_pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t safe_pwrite(int fd, void *buf, size_t count, off_t offset);
 
 //-----------------------------------------------------------------------------
 #ifdef __cplusplus
@@ -0,0 +1,524 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	fileop-block.c
+ * @brief	Block checksum file format operation functions
+ */
+#include "fileop.h"
+#include "crc16.h"
+#include "file-util.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+#include "static-configurator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+static int refop_block_load_table(int fd, s_refop_file_header_v3 *head, uint16_t **ptable);
+static int refop_block_merge(const char *backup, const uint16_t *table, uint64_t size, uint64_t first,
+			     uint64_t count, uint8_t *buf);
+
+/**
+ * Number of blocks for data size.
+ *
+ * @param [in]	size	The size of data block.
+ *
+ * @return uint64_t	Number of blocks.
+ */
+static inline uint64_t refop_block_count(uint64_t size)
+{
+	return (size + REFOP_BLOCK_SIZE - 1) / REFOP_BLOCK_SIZE;
+}
+
+/**
+ * Offset of data block in the block checksum format file.
+ *
+ * @param [in]	size	The size of data block.
+ *
+ * @return off_t	Offset of data block.
+ */
+static inline off_t refop_block_data_offset(uint64_t size)
+{
+	return (off_t)(sizeof(s_refop_file_header_v3) + refop_block_count(size) * sizeof(uint16_t));
+}
+
+/**
+ * Byte length of the indexed block.
+ *
+ * @param [in]	size	The size of data block.
+ * @param [in]	index	Block index.
+ *
+ * @return size_t	Byte length of the block.
+ */
+static inline size_t refop_block_length(uint64_t size, uint64_t index)
+{
+	uint64_t remain = size - (index * REFOP_BLOCK_SIZE);
+
+	return (size_t)((remain > REFOP_BLOCK_SIZE) ? REFOP_BLOCK_SIZE : remain);
+}
+
+/**
+ * This function create write buffer of the block checksum format.
+ * The file image is header, per block crc table and data block.
+ *
+ * @param [in]	data	Porinter to write data
+ * @param [in]	bufsize	Write dara size
+ * @param [out]	total	Size of created buffer
+ *
+ * @return uint8_t*
+ * @retval !NULL Created buffer. It shall be released by refop_free().
+ * @retval NULL Abnormal fail.
+ */
+uint8_t *refop_block_buffer_create(uint8_t *data, int64_t bufsize, size_t *total)
+{
+	uint8_t *pbuf = NULL, *pdata = NULL;
+	uint16_t *table = NULL;
+	uint64_t count = 0, i = 0;
+	off_t offset = 0;
+	uint16_t crc16value = 0, table_crc16value = 0;
+
+	count = refop_block_count((uint64_t) bufsize);
+	offset = refop_block_data_offset((uint64_t) bufsize);
+
+	pbuf = (uint8_t *) refop_malloc((size_t) offset + bufsize);
+	if (pbuf == NULL)
+		return NULL;
+
+	table = (uint16_t *) (pbuf + sizeof(s_refop_file_header_v3));
+	pdata = pbuf + offset;
+	memcpy(pdata, data, bufsize);
+
+	for (i = 0; i < count; i++)
+		table[i] = crc16(0xffff, pdata + (i * REFOP_BLOCK_SIZE), refop_block_length(bufsize, i));
+
+	crc16value = crc16(0xffff, pdata, bufsize);
+	table_crc16value = crc16(0xffff, (uint8_t *) table, count * sizeof(uint16_t));
+
+	refop_header_v3_create((s_refop_file_header_v3 *) pbuf, crc16value, bufsize, table_crc16value);
+
+	(*total) = (size_t) offset + bufsize;
+
+	return pbuf;
+}
+
+/**
+ * File read function for the block checksum format with validation.
+ * This function is called from refop_file_get_with_validation after version was detected.
+ *
+ * @param [in]	fd	File descriptor of target file.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -2 Invalid file size.
+ * @retval -3 Invalid header.
+ * @retval -5 Invalid data.
+ * @retval -6 Abnomal file responce.
+ */
+int refop_block_get_with_validation(int fd, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	s_refop_file_header_v3 head = { 0 };
+	uint16_t *table = NULL;
+	int ret = -1, result = -1;
+
+	ret = refop_block_load_table(fd, &head, &table);
+	if (ret < 0)
+		goto invalid;
+
+	// Data larger than the buffer is verified by streaming, no heap memory is used for it.
+	result = refop_data_read_verify(fd, refop_block_data_offset(head.size), head.size, head.crc16, data, bufsize);
+	if (result == -1) {
+		ret = -2;
+		goto invalid;
+	} else if (result < 0) {
+		ret = -5;
+		goto invalid;
+	}
+
+	if ((int64_t) head.size > bufsize)
+		(*readsize) = bufsize;
+	else
+		(*readsize) = head.size;
+
+	ret = 0;
+
+invalid:
+	refop_free(table);
+
+	return ret;
+}
+
+/**
+ * Block level recovery of the latest file.
+ * Broken blocks of the latest file are replaced by same range of the backup file, when the range of
+ * backup file match to block crc of the latest file. After merge, full data crc is verified.
+ *
+ * @param [in]	latest	The latest file name with path.
+ * @param [in]	backup	The backup file name with path.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Could not recover.
+ */
+int refop_block_recover(const char *latest, const char *backup, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	s_refop_file_header_v3 head = { 0 };
+	uint16_t *table = NULL;
+	uint8_t *pbuf = NULL;
+	ssize_t size = 0;
+	int ret = -1, result = -1;
+	int fd = -1;
+
+	fd = open(latest, (O_CLOEXEC | O_RDONLY | O_NOFOLLOW));
+	if (fd < 0)
+		goto invalid;
+
+	result = refop_block_load_table(fd, &head, &table);
+	if (result < 0)
+		goto invalid;
+
+	pbuf = (uint8_t *) refop_calloc(1, head.size);
+	if (pbuf == NULL)
+		goto invalid;
+
+	// Short read is acceptable, missing blocks are recovered by backup.
+	size = safe_pread(fd, pbuf, (size_t) head.size, refop_block_data_offset(head.size));
+	if (size < 0)
+		goto invalid;
+
+	result = refop_block_merge(backup, table, head.size, 0, refop_block_count(head.size), pbuf);
+	if (result < 0)
+		goto invalid;
+
+	if (head.crc16 != crc16(0xffff, pbuf, head.size))
+		goto invalid;
+
+	if (head.size > (uint64_t) bufsize) {
+		memcpy(data, pbuf, bufsize);
+		(*readsize) = bufsize;
+	} else {
+		memcpy(data, pbuf, head.size);
+		(*readsize) = head.size;
+	}
+
+	ret = 0;
+
+invalid:
+	refop_free(pbuf);
+	refop_free(table);
+
+	if (fd >= 0)
+		(void) close(fd);
+
+	return ret;
+}
+
+/**
+ * Range read function of the block checksum format.
+ * This function read and verify only blocks that cover requested range of the latest file.
+ * Broken blocks are recovered by same range of the backup file.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	offset	Offset of data (bytes).
+ * @param [in]	data	Read data buffer
+ * @param [in]	len	Read length (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval  1 succeeded with block recovery.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 Range read is not available, caller shall read full data.
+ */
+int refop_block_get_range(refop_handle_t handle, int64_t offset, uint8_t *data, int64_t len, int64_t *readsize)
+{
+	s_refop_file_header_v3 head = { 0 };
+	uint16_t *table = NULL;
+	uint8_t *pbuf = NULL;
+	uint64_t first = 0, last = 0, end = 0, rlen = 0;
+	ssize_t size = 0;
+	int ret = -2, result = -1;
+	int fd = -1;
+	char latestfile[PATH_MAX], backupfile1[PATH_MAX];
+
+	if (refop_handle_path(handle, "", latestfile) < 0 ||
+	    refop_handle_path(handle, c_bk1_suffix, backupfile1) < 0)
+		return -1;
+
+	fd = open(latestfile, (O_CLOEXEC | O_RDONLY | O_NOFOLLOW));
+	if (fd < 0)
+		goto invalid;
+
+	result = refop_block_load_table(fd, &head, &table);
+	if (result < 0)
+		goto invalid;
+
+	if ((uint64_t) offset >= head.size || len == 0) {
+		(*readsize) = 0;
+		ret = 0;
+		goto invalid;
+	}
+
+	end = (uint64_t) offset + len;
+	if (end > head.size)
+		end = head.size;
+
+	first = (uint64_t) offset / REFOP_BLOCK_SIZE;
+	last = (end - 1) / REFOP_BLOCK_SIZE;
+
+	pbuf = (uint8_t *) refop_calloc(last - first + 1, REFOP_BLOCK_SIZE);
+	if (pbuf == NULL) {
+		ret = -1;
+		goto invalid;
+	}
+
+	// Short read is acceptable, missing blocks are recovered by backup.
+	rlen = ((last + 1) * REFOP_BLOCK_SIZE > head.size) ? head.size : (last + 1) * REFOP_BLOCK_SIZE;
+	rlen -= first * REFOP_BLOCK_SIZE;
+	size = safe_pread(fd, pbuf, (size_t) rlen, refop_block_data_offset(head.size) + (off_t)(first * REFOP_BLOCK_SIZE));
+	if (size < 0) {
+		ret = -1;
+		goto invalid;
+	}
+
+	result = refop_block_merge(backupfile1, table, head.size, first, last - first + 1, pbuf);
+	if (result < 0)
+		goto invalid;
+
+	memcpy(data, pbuf + ((uint64_t) offset - (first * REFOP_BLOCK_SIZE)), end - (uint64_t) offset);
+	(*readsize) = (int64_t)(end - (uint64_t) offset);
+
+	ret = result;
+
+invalid:
+	refop_free(pbuf);
+	refop_free(table);
+
+	if (fd >= 0)
+		(void) close(fd);
+
+	return ret;
+}
+
+/**
+ * The refop header (version 3) create from args.
+ *
+ * @param [in]	head	Pointer for file header.
+ * @param [in]	crc16value	The crc value of data block.
+ * @param [in]	sizevalue	The size of data block.
+ * @param [in]	table_crc16value	The crc value of block crc table.
+ */
+void refop_header_v3_create(
+	s_refop_file_header_v3 *head, uint16_t crc16value, uint64_t sizevalue, uint16_t table_crc16value)
+{
+	head->magic = REFOP_FILE_HEADER_MAGIC;
+
+	head->version = REFOP_FILE_HEADER_VERSION_V3;
+	head->version_inv = ~head->version;
+
+	head->crc16 = crc16value;
+	head->crc16_inv = ~head->crc16;
+
+	head->size = sizevalue;
+	head->size_inv = ~head->size;
+
+	head->block_size = REFOP_BLOCK_SIZE;
+	head->block_size_inv = ~head->block_size;
+
+	head->table_crc16 = table_crc16value;
+	head->table_crc16_inv = ~head->table_crc16;
+
+	head->reserved = 0;
+}
+
+/**
+ * The refop header (version 3) validation
+ *
+ * @param [in]	head	Pointer for file header.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Invalid header.
+ */
+int refop_header_v3_validation(const s_refop_file_header_v3 *head)
+{
+	int ret = -1;
+
+	// magic check
+	if (head->magic != (uint32_t) REFOP_FILE_HEADER_MAGIC)
+		goto invalid;
+
+	// header format version check
+	if (head->version == (uint32_t)(~head->version_inv)) {
+		if (head->version != REFOP_FILE_HEADER_VERSION_V3)
+			goto invalid;
+	} else
+		goto invalid;
+
+	// crc16 value check
+	if ((head->crc16 ^ head->crc16_inv) != 0xffff)
+		goto invalid;
+
+	// data size check
+	if (head->size != (uint64_t)(~head->size_inv))
+		goto invalid;
+
+	// block size check, this version support fixed block size only.
+	if (head->block_size != (uint32_t)(~head->block_size_inv) || head->block_size != REFOP_BLOCK_SIZE)
+		goto invalid;
+
+	// table crc16 value check
+	if ((head->table_crc16 ^ head->table_crc16_inv) != 0xffff)
+		goto invalid;
+
+	ret = 0;
+
+invalid:
+	return ret;
+}
+
+/**
+ * Read and validate the header and the block crc table.
+ *
+ * @param [in]	fd	File descriptor of target file.
+ * @param [out]	head	Pointer for file header.
+ * @param [out]	ptable	Allocated block crc table. It shall be released by refop_free().
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -2 Invalid file size.
+ * @retval -3 Invalid header or table.
+ * @retval -6 Abnomal file responce.
+ */
+static int refop_block_load_table(int fd, s_refop_file_header_v3 *head, uint16_t **ptable)
+{
+	uint16_t *table = NULL;
+	size_t tablesize = 0;
+	ssize_t size = 0;
+	int ret = -1;
+
+	size = safe_pread(fd, head, sizeof(s_refop_file_header_v3), 0);
+	if (size != sizeof(s_refop_file_header_v3))
+		return -2;
+
+	if (refop_header_v3_validation(head) != 0)
+		return -3;
+
+	if (head->size > REFOP_DATA_SIZE_LIMIT_MAX)
+		return -3;
+
+	tablesize = refop_block_count(head->size) * sizeof(uint16_t);
+	table = (uint16_t *) refop_malloc(tablesize);
+	if (table == NULL)
+		return -6;
+
+	size = safe_pread(fd, table, tablesize, sizeof(s_refop_file_header_v3));
+	if (size != (ssize_t) tablesize) {
+		ret = -2;
+		goto invalid;
+	}
+
+	if (head->table_crc16 != crc16(0xffff, (uint8_t *) table, tablesize)) {
+		ret = -3;
+		goto invalid;
+	}
+
+	(*ptable) = table;
+
+	return 0;
+
+invalid:
+	refop_free(table);
+
+	return ret;
+}
+
+/**
+ * Verify blocks and replace broken blocks by same range of the backup file.
+ * The backup file may be version 1 or version 3 format.
+ *
+ * @param [in]	backup	The backup file name with path.
+ * @param [in]	table	Block crc table of the latest file.
+ * @param [in]	size	The size of data block of the latest file.
+ * @param [in]	first	First block index.
+ * @param [in]	count	Number of blocks.
+ * @param [in,out]	buf	Buffer that has count blocks from first block.
+ *
+ * @return int
+ * @retval  0 All blocks are valid.
+ * @retval  1 Broken blocks were recovered.
+ * @retval -1 Could not recover.
+ */
+static int refop_block_merge(const char *backup, const uint16_t *table, uint64_t size, uint64_t first,
+			     uint64_t count, uint8_t *buf)
+{
+	s_refop_file_header_v3 head = { 0 };
+	uint8_t *pblock = NULL;
+	uint64_t i = 0, index = 0;
+	off_t boffset = 0;
+	size_t blen = 0;
+	ssize_t rsize = 0;
+	int ret = 0;
+	int fd = -1;
+
+	for (i = 0; i < count; i++) {
+		index = first + i;
+		pblock = buf + (i * REFOP_BLOCK_SIZE);
+		blen = refop_block_length(size, index);
+
+		if (table[index] == crc16(0xffff, pblock, blen))
+			continue;
+
+		if (fd < 0) {
+			fd = open(backup, (O_CLOEXEC | O_RDONLY | O_NOFOLLOW));
+			if (fd < 0)
+				goto invalid;
+
+			rsize = safe_pread(fd, &head, sizeof(head), 0);
+			if (rsize < (ssize_t) sizeof(s_refop_file_header))
+				goto invalid;
+
+			if (refop_header_validation((s_refop_file_header *) &head) == 0)
+				boffset = sizeof(s_refop_file_header);
+			else if (rsize == sizeof(head) && refop_header_v3_validation(&head) == 0)
+				boffset = refop_block_data_offset(head.size);
+			else
+				goto invalid;
+		}
+
+		if ((index * REFOP_BLOCK_SIZE) + blen > head.size)
+			goto invalid;
+
+		rsize = safe_pread(fd, pblock, blen, boffset + (off_t)(index * REFOP_BLOCK_SIZE));
+		if (rsize != (ssize_t) blen)
+			goto invalid;
+
+		if (table[index] != crc16(0xffff, pblock, blen))
+			goto invalid;
+
+		ret = 1;
+	}
+
+	if (fd >= 0)
+		(void) close(fd);
+
+	return ret;
+
+invalid:
+	if (fd >= 0)
+		(void) close(fd);
+
+	return -1;
+}
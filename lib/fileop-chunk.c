@@ -0,0 +1,653 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	fileop-chunk.c
+ * @brief	Content defined chunk store file operation functions
+ */
+#include "fileop.h"
+#include "file-util.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+#include "sha256.h"
+#include "static-configurator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+const char c_chunk_suffix[] = ".chk";
+
+/** Length of chunk file name (hex string of SHA-256). */
+#define REFOP_CHUNK_NAME_LEN (REFOP_CHUNK_HASH_SIZE * 2)
+
+static int refop_chunk_dir_open(refop_handle_t handle, bool create);
+static int refop_chunk_store(refop_handle_t handle, int dirfd, const struct s_refop_chunk_ref *ref,
+			     const uint8_t *data, uint8_t *scratch, bool *created);
+static int refop_chunk_load(int dirfd, const struct s_refop_chunk_ref *ref, uint8_t *buf);
+static int refop_chunk_assemble(refop_handle_t handle, const uint8_t *manifest, int64_t msize, uint8_t *data,
+				int64_t bufsize, int64_t *readsize);
+static void refop_chunk_collect(refop_handle_t handle, int dirfd, const uint8_t *manifest, int64_t msize);
+
+/**
+ * Gear value of a byte for the rolling hash.
+ */
+static inline uint32_t refop_chunk_gear(uint8_t value)
+{
+	uint32_t v = ((uint32_t) value + 1) * 0x9e3779b1U;
+
+	v ^= v >> 15;
+	v *= 0x85ebca77U;
+	v ^= v >> 13;
+
+	return v;
+}
+
+/**
+ * Find the next cut point by gear rolling hash.  Each hash bit depends on preceding 32 bytes only,
+ * so an insertion moves cut points near the insertion and other chunks keep their hash.
+ *
+ * @param [in]	data	Top of remaining data.
+ * @param [in]	size	Remaining data size.
+ *
+ * @return int64_t	Size of the next chunk.
+ */
+static int64_t refop_chunk_cut(const uint8_t *data, int64_t size)
+{
+	uint32_t hash = 0;
+	int64_t limit = size;
+
+	if (size <= REFOP_CHUNK_MIN)
+		return size;
+	if (limit > REFOP_CHUNK_MAX)
+		limit = REFOP_CHUNK_MAX;
+
+	for (int64_t i = REFOP_CHUNK_MIN; i < limit; i++) {
+		hash = (hash << 1) + refop_chunk_gear(data[i]);
+		if ((hash & REFOP_CHUNK_MASK) == 0)
+			return i + 1;
+	}
+
+	return limit;
+}
+
+/**
+ * Maximum manifest size for data size limit of the handle.  A manifest of a larger value does not fit,
+ * it is rejected by the manifest check.
+ *
+ * @param [in]	handle	Refop handle.
+ */
+static int64_t refop_chunk_manifest_max(refop_handle_t handle)
+{
+	return (int64_t)(sizeof(struct s_refop_chunk_manifest) +
+			 ((refop_get_config_handle_size_limit(handle) / REFOP_CHUNK_MIN) + 1) *
+				 sizeof(struct s_refop_chunk_ref));
+}
+
+/**
+ * Create chunk file name from hash.
+ *
+ * @param [in]	hash	SHA-256 of chunk.
+ * @param [out]	name	Output buffer, it shall have REFOP_CHUNK_NAME_LEN + 5 byte.
+ */
+static void refop_chunk_name(const uint8_t *hash, char *name)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	for (int i = 0; i < REFOP_CHUNK_HASH_SIZE; i++) {
+		name[i * 2] = hex[hash[i] >> 4];
+		name[i * 2 + 1] = hex[hash[i] & 0x0f];
+	}
+	name[REFOP_CHUNK_NAME_LEN] = '\0';
+}
+
+/**
+ * Manifest validation.  The manifest file itself is protected by crc of the rotation file format.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Invalid manifest.
+ */
+static int refop_chunk_manifest_check(const uint8_t *manifest, int64_t msize)
+{
+	const struct s_refop_chunk_manifest *head = (const struct s_refop_chunk_manifest *) manifest;
+	const struct s_refop_chunk_ref *refs = NULL;
+	uint64_t total = 0;
+
+	if (msize < (int64_t) sizeof(*head) || head->magic != REFOP_CHUNK_MAGIC)
+		return -1;
+
+	if ((uint64_t) msize != sizeof(*head) + (uint64_t) head->count * sizeof(*refs) ||
+	    head->raw_size > REFOP_DATA_SIZE_LIMIT_MAX)
+		return -1;
+
+	refs = (const struct s_refop_chunk_ref *) (manifest + sizeof(*head));
+	for (uint32_t i = 0; i < head->count; i++) {
+		if (refs[i].size == 0 || refs[i].size > REFOP_CHUNK_MAX)
+			return -1;
+		total += refs[i].size;
+	}
+
+	if (total != head->raw_size)
+		return -1;
+
+	return 0;
+}
+
+/**
+ * This function split data to content defined chunks and write new chunks to the chunk directory.
+ * Chunks that already exist are verified and reused.  After all new chunks and the chunk directory
+ * were synced, the manifest is written by the file rotation, and chunks that are not referenced by
+ * the latest file and the backup file are removed.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Porinter to write data
+ * @param [in]	bufsize	Write dara size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 Lager than size limit.
+ */
+int refop_chunk_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	struct s_refop_chunk_manifest *head = NULL;
+	struct s_refop_chunk_ref *refs = NULL;
+	uint8_t *manifest = NULL, *scratch = NULL;
+	char path[PATH_MAX];
+	int64_t offset = 0, len = 0, msize = 0;
+	uint32_t count = 0;
+	int ret = -1, dirfd = -1;
+	bool created = false;
+
+	if (bufsize > (int64_t) refop_get_config_handle_size_limit(handle) || bufsize <= 0)
+		return -2;
+
+	manifest = (uint8_t *) refop_malloc(refop_chunk_manifest_max(handle));
+	scratch = (uint8_t *) refop_malloc(REFOP_CHUNK_MAX);
+	if (manifest == NULL || scratch == NULL)
+		goto out;
+
+	dirfd = refop_chunk_dir_open(handle, true);
+	if (dirfd < 0)
+		goto out;
+
+	head = (struct s_refop_chunk_manifest *) manifest;
+	refs = (struct s_refop_chunk_ref *) (manifest + sizeof(*head));
+
+	while (offset < bufsize) {
+		len = refop_chunk_cut(data + offset, bufsize - offset);
+
+		sha256(data + offset, (size_t) len, refs[count].hash);
+		refs[count].size = (uint32_t) len;
+
+		if (refop_chunk_store(handle, dirfd, &refs[count], data + offset, scratch, &created) < 0)
+			goto out;
+
+		offset += len;
+		count++;
+	}
+
+	// New chunks shall be visible before the manifest refer them.
+	if (created == true && hndl->durability == REFOP_DURABILITY_FULL && fsync(dirfd) < 0)
+		goto out;
+
+	head->magic = REFOP_CHUNK_MAGIC;
+	head->count = count;
+	head->raw_size = (uint64_t) bufsize;
+	msize = (int64_t)(sizeof(*head) + count * sizeof(*refs));
+
+	ret = refop_new_file_write(handle, manifest, msize);
+	if (ret < 0)
+		goto out;
+
+	ret = refop_file_rotation(handle);
+	if (ret < 0) {
+		if (refop_handle_path(handle, c_new_suffix, path) == 0)
+			(void) unlink(path);
+		goto out;
+	}
+
+	refop_chunk_collect(handle, dirfd, manifest, msize);
+
+out:
+	if (dirfd >= 0)
+		(void) close(dirfd);
+	refop_free(scratch);
+	refop_free(manifest);
+
+	return ret;
+}
+
+/**
+ * This function pick up newest data from the manifest and chunks.
+ * When a chunk of the latest manifest is missing or broken, the backup manifest is used.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval 1 Succeeded with recover.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_chunk_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	uint8_t *manifest = NULL;
+	int64_t msize = 0, maxsize = 0;
+	int ret = -1, aret = -1;
+
+	maxsize = refop_chunk_manifest_max(handle);
+	manifest = (uint8_t *) refop_malloc(maxsize);
+	if (manifest == NULL)
+		return -1;
+
+	ret = refop_file_pickup(handle, manifest, maxsize, &msize);
+	if (ret < 0)
+		goto out;
+
+	aret = refop_chunk_assemble(handle, manifest, msize, data, bufsize, readsize);
+	if (aret == -3 && ret == 0) {
+		// The backup manifest has own chunks for changed parts.
+		if (refop_file_get_generation(handle, 1, manifest, maxsize, &msize) == 0)
+			aret = refop_chunk_assemble(handle, manifest, msize, data, bufsize, readsize);
+		ret = 1;
+	}
+
+	if (aret < 0)
+		ret = aret;
+
+out:
+	refop_free(manifest);
+
+	return ret;
+}
+
+/**
+ * This function read indexed generation.  Generation 0 is the latest manifest and 1 is the backup
+ * manifest.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	n	Generation index. 0 is newest.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_chunk_get_generation(
+	refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	uint8_t *manifest = NULL;
+	int64_t msize = 0, maxsize = 0;
+	int ret = -1;
+
+	maxsize = refop_chunk_manifest_max(handle);
+	manifest = (uint8_t *) refop_malloc(maxsize);
+	if (manifest == NULL)
+		return -1;
+
+	ret = refop_file_get_generation(handle, n, manifest, maxsize, &msize);
+	if (ret == 0)
+		ret = refop_chunk_assemble(handle, manifest, msize, data, bufsize, readsize);
+
+	refop_free(manifest);
+
+	return ret;
+}
+
+/**
+ * This function remove manifest files, all chunks and the chunk directory.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail.
+ */
+int refop_chunk_remove(refop_handle_t handle)
+{
+	const char *suffixes[3] = { c_new_suffix, "", c_bk1_suffix };
+	char path[PATH_MAX];
+	struct dirent *ent = NULL;
+	DIR *dp = NULL;
+	int result = 0, ret = -1, dirfd = -1;
+
+	// Manifest files are removed first, chunks without manifest are garbage.
+	for (int i = 0; i < 3; i++) {
+		if (refop_handle_path(handle, suffixes[i], path) < 0) {
+			result = -1;
+			continue;
+		}
+
+		ret = unlink(path);
+		if (ret < 0) {
+			if (errno != ENOENT)
+				result = -1;
+		}
+	}
+
+	if (refop_handle_path(handle, c_chunk_suffix, path) < 0)
+		return -1;
+
+	dirfd = refop_chunk_dir_open(handle, false);
+	if (dirfd < 0)
+		return (dirfd == -2) ? result : -1;
+
+	dp = fdopendir(dirfd);
+	if (dp == NULL) {
+		(void) close(dirfd);
+		return -1;
+	}
+
+	while ((ent = readdir(dp)) != NULL) {
+		if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+			continue;
+		if (unlinkat(dirfd, ent->d_name, 0) < 0 && errno != ENOENT)
+			result = -1;
+	}
+	(void) closedir(dp);
+
+	if (rmdir(path) < 0 && errno != ENOENT)
+		result = -1;
+
+	return result;
+}
+
+/**
+ * Open the chunk directory.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	create	When true, the chunk directory is created.
+ *
+ * @return int
+ * @retval >=0 File descriptor of the chunk directory.
+ * @retval -1 Abnormal fail.
+ * @retval -2 No chunk directory.
+ */
+static int refop_chunk_dir_open(refop_handle_t handle, bool create)
+{
+	char path[PATH_MAX];
+	int fd = -1;
+
+	if (refop_handle_path(handle, c_chunk_suffix, path) < 0)
+		return -1;
+
+	if (create == true) {
+		if (mkdir(path, (S_IRUSR | S_IWUSR | S_IXUSR)) == 0)
+			(void) refop_dir_sync(handle);
+		else if (errno != EEXIST)
+			return -1;
+	}
+
+	fd = open(path, (O_CLOEXEC | O_RDONLY | O_DIRECTORY | O_NOFOLLOW));
+	if (fd < 0)
+		return (errno == ENOENT) ? -2 : -1;
+
+	return fd;
+}
+
+/**
+ * Store one chunk.  When the chunk file exists and it is valid, it is reused.
+ * New chunk is written to temporary file, synced and renamed.  The chunk directory is synced by caller.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	dirfd	File descriptor of the chunk directory.
+ * @param [in]	ref	Chunk reference.
+ * @param [in]	data	Chunk data.
+ * @param [in]	scratch	Work buffer (REFOP_CHUNK_MAX bytes).
+ * @param [out]	created	Set true when a new chunk file was created.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Abnormal fail.
+ */
+static int refop_chunk_store(refop_handle_t handle, int dirfd, const struct s_refop_chunk_ref *ref,
+			     const uint8_t *data, uint8_t *scratch, bool *created)
+{
+	char name[REFOP_CHUNK_NAME_LEN + 5], tmpname[REFOP_CHUNK_NAME_LEN + 5];
+	ssize_t wsize = 0;
+	int fd = -1;
+
+	// Shared chunk shall be valid, a broken chunk is overwritten by new one.
+	if (refop_chunk_load(dirfd, ref, scratch) == 0)
+		return 0;
+
+	refop_chunk_name(ref->hash, name);
+	// The name length is fixed, the suffix always fits.
+	memcpy(tmpname, name, REFOP_CHUNK_NAME_LEN);
+	memcpy(&tmpname[REFOP_CHUNK_NAME_LEN], ".tmp", sizeof(".tmp"));
+
+	fd = openat(dirfd, tmpname, (O_CLOEXEC | O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW), (S_IRUSR | S_IWUSR));
+	if (fd < 0)
+		return -1;
+
+	wsize = safe_write(fd, (void *) data, ref->size);
+	if (wsize != (ssize_t) ref->size || refop_fdatasync(handle, fd) < 0) {
+		(void) close(fd);
+		(void) unlinkat(dirfd, tmpname, 0);
+		return -1;
+	}
+	(void) close(fd);
+
+	if (renameat(dirfd, tmpname, dirfd, name) < 0) {
+		(void) unlinkat(dirfd, tmpname, 0);
+		return -1;
+	}
+
+	(*created) = true;
+
+	return 0;
+}
+
+/**
+ * Load one chunk with validation by SHA-256.
+ *
+ * @param [in]	dirfd	File descriptor of the chunk directory.
+ * @param [in]	ref	Chunk reference.
+ * @param [out]	buf	Read buffer (ref->size bytes).
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Abnormal fail.
+ * @retval -3 Missing or broken chunk.
+ */
+static int refop_chunk_load(int dirfd, const struct s_refop_chunk_ref *ref, uint8_t *buf)
+{
+	char name[REFOP_CHUNK_NAME_LEN + 5];
+	uint8_t hash[REFOP_CHUNK_HASH_SIZE];
+	struct stat sb;
+	ssize_t size = 0;
+	int fd = -1;
+
+	refop_chunk_name(ref->hash, name);
+
+	fd = openat(dirfd, name, (O_CLOEXEC | O_RDONLY | O_NOFOLLOW));
+	if (fd < 0)
+		return (errno == ENOENT) ? -3 : -1;
+
+	if (fstat(fd, &sb) < 0) {
+		(void) close(fd);
+		return -1;
+	}
+
+	if (sb.st_size != (off_t) ref->size) {
+		(void) close(fd);
+		return -3;
+	}
+
+	size = safe_read(fd, buf, ref->size);
+	(void) close(fd);
+	if (size != (ssize_t) ref->size)
+		return -3;
+
+	sha256(buf, ref->size, hash);
+	if (memcmp(hash, ref->hash, REFOP_CHUNK_HASH_SIZE) != 0)
+		return -3;
+
+	return 0;
+}
+
+/**
+ * Assemble data from manifest.  Chunks after bufsize are not read.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	manifest	Manifest.
+ * @param [in]	msize	Manifest size.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Abnormal fail.
+ * @retval -3 Broken manifest or chunk.
+ */
+static int refop_chunk_assemble(refop_handle_t handle, const uint8_t *manifest, int64_t msize, uint8_t *data,
+				int64_t bufsize, int64_t *readsize)
+{
+	const struct s_refop_chunk_manifest *head = (const struct s_refop_chunk_manifest *) manifest;
+	const struct s_refop_chunk_ref *refs = NULL;
+	uint8_t *scratch = NULL;
+	int64_t offset = 0;
+	int ret = 0, dirfd = -1;
+
+	if (refop_chunk_manifest_check(manifest, msize) < 0)
+		return -3;
+
+	dirfd = refop_chunk_dir_open(handle, false);
+	if (dirfd < 0)
+		return (dirfd == -2) ? -3 : -1;
+
+	refs = (const struct s_refop_chunk_ref *) (manifest + sizeof(*head));
+	for (uint32_t i = 0; i < head->count && offset < bufsize; i++) {
+		if (offset + (int64_t) refs[i].size <= bufsize) {
+			ret = refop_chunk_load(dirfd, &refs[i], data + offset);
+		} else {
+			// The last chunk for the buffer is validated by full size.
+			if (scratch == NULL)
+				scratch = (uint8_t *) refop_malloc(REFOP_CHUNK_MAX);
+			if (scratch == NULL) {
+				ret = -1;
+				break;
+			}
+			ret = refop_chunk_load(dirfd, &refs[i], scratch);
+			if (ret == 0)
+				memcpy(data + offset, scratch, bufsize - offset);
+		}
+		if (ret < 0)
+			break;
+
+		offset += refs[i].size;
+	}
+
+	if (ret == 0)
+		(*readsize) = ((int64_t) head->raw_size < bufsize) ? (int64_t) head->raw_size : bufsize;
+
+	(void) close(dirfd);
+	refop_free(scratch);
+
+	return ret;
+}
+
+/**
+ * Compare function for sort and search chunk reference by hash.
+ */
+static int refop_chunk_ref_compare(const void *a, const void *b)
+{
+	return memcmp(((const struct s_refop_chunk_ref *) a)->hash, ((const struct s_refop_chunk_ref *) b)->hash,
+		      REFOP_CHUNK_HASH_SIZE);
+}
+
+/**
+ * Remove chunks that are not referenced by the latest manifest and the backup manifest.
+ * When the backup manifest was not readable, nothing is removed.  Leftover temporary files are removed too.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	dirfd	File descriptor of the chunk directory.
+ * @param [in]	manifest	The latest manifest.
+ * @param [in]	msize	The latest manifest size.
+ */
+static void refop_chunk_collect(refop_handle_t handle, int dirfd, const uint8_t *manifest, int64_t msize)
+{
+	const size_t headsize = sizeof(struct s_refop_chunk_manifest);
+	struct s_refop_chunk_ref *refs = NULL, key;
+	struct dirent *ent = NULL;
+	uint8_t *backup = NULL;
+	int64_t bsize = 0, maxsize = 0;
+	size_t count = 0, len = 0;
+	DIR *dp = NULL;
+	int ret = -1, fd = -1;
+
+	maxsize = refop_chunk_manifest_max(handle);
+	backup = (uint8_t *) refop_malloc(maxsize);
+	refs = (struct s_refop_chunk_ref *) refop_malloc(maxsize * 2);
+	if (backup == NULL || refs == NULL)
+		goto out;
+
+	ret = refop_file_get_generation(handle, 1, backup, maxsize, &bsize);
+	if (ret == 0 && refop_chunk_manifest_check(backup, bsize) < 0)
+		goto out;
+	else if (ret != 0 && ret != -2)
+		goto out;
+
+	count = (msize - headsize) / sizeof(*refs);
+	memcpy(refs, manifest + headsize, msize - headsize);
+	if (ret == 0) {
+		memcpy(refs + count, backup + headsize, bsize - headsize);
+		count += (bsize - headsize) / sizeof(*refs);
+	}
+	qsort(refs, count, sizeof(*refs), refop_chunk_ref_compare);
+
+	fd = dup(dirfd);
+	if (fd < 0)
+		goto out;
+	dp = fdopendir(fd);
+	if (dp == NULL) {
+		(void) close(fd);
+		goto out;
+	}
+	rewinddir(dp);
+
+	while ((ent = readdir(dp)) != NULL) {
+		len = strlen(ent->d_name);
+		if (len > 4 && strcmp(ent->d_name + len - 4, ".tmp") == 0) {
+			(void) unlinkat(dirfd, ent->d_name, 0);
+			continue;
+		}
+		if (len != REFOP_CHUNK_NAME_LEN)
+			continue;
+
+		for (size_t i = 0; i < REFOP_CHUNK_HASH_SIZE; i++) {
+			if (sscanf(ent->d_name + i * 2, "%2hhx", &key.hash[i]) != 1) {
+				len = 0;
+				break;
+			}
+		}
+		if (len == 0)
+			continue;
+
+		if (bsearch(&key, refs, count, sizeof(*refs), refop_chunk_ref_compare) == NULL)
+			(void) unlinkat(dirfd, ent->d_name, 0);
+	}
+	(void) closedir(dp);
+
+out:
+	refop_free(refs);
+	refop_free(backup);
+}
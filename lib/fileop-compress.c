@@ -0,0 +1,223 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	fileop-compress.c
+ * @brief	Compressed file format operation functions
+ */
+#include "fileop.h"
+#include "crc16.h"
+#include "file-util.h"
+#include "librefop.h"
+#include "lz-codec.h"
+#include "refop-alloc.h"
+#include "static-configurator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/**
+ * This function create write buffer of the compressed format.
+ * When the data is smaller than REFOP_COMPRESS_MIN_SIZE or compression does not reduce file size,
+ * this function does not create buffer and caller shall use legacy format.
+ *
+ * @param [in]	data	Porinter to write data
+ * @param [in]	bufsize	Write dara size
+ * @param [out]	pbuf	Created buffer. It shall be released by refop_free().
+ * @param [out]	total	Size of created buffer
+ *
+ * @return int
+ * @retval  0 Succeeded.
+ * @retval  1 No gain, buffer was not created.
+ * @retval -1 Abnormal fail.
+ */
+int refop_compress_buffer_create(uint8_t *data, int64_t bufsize, uint8_t **pbuf, size_t *total)
+{
+	uint8_t *pmalloc = NULL, *pdata = NULL;
+	int64_t capacity = 0, csize = 0;
+
+	if (bufsize < REFOP_COMPRESS_MIN_SIZE)
+		return 1;
+
+	// Compressed file shall be smaller than legacy file.
+	capacity = bufsize + (int64_t) sizeof(s_refop_file_header) - (int64_t) sizeof(s_refop_file_header_v5);
+
+	pmalloc = (uint8_t *) refop_malloc(sizeof(s_refop_file_header_v5) + capacity);
+	if (pmalloc == NULL)
+		return -1;
+
+	pdata = pmalloc + sizeof(s_refop_file_header_v5);
+	csize = lz_compress(data, bufsize, pdata, capacity);
+	if (csize < 0 || csize >= capacity) {
+		refop_free(pmalloc);
+		return 1;
+	}
+
+	refop_header_v5_create((s_refop_file_header_v5 *) pmalloc, crc16(0xffff, pdata, csize), csize, bufsize,
+			       REFOP_FILE_FLAG_COMPRESS_LZ);
+
+	(*pbuf) = pmalloc;
+	(*total) = sizeof(s_refop_file_header_v5) + csize;
+
+	return 0;
+}
+
+/**
+ * File read function for the compressed format with validation.
+ * The crc is verified for stored (compressed) data before decompression.
+ * This function is called from refop_file_get_with_validation after version was detected.
+ *
+ * @param [in]	fd	File descriptor of target file.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -2 Invalid file size.
+ * @retval -3 Invalid header.
+ * @retval -5 Invalid data.
+ * @retval -6 Abnomal file responce.
+ */
+int refop_compress_get_with_validation(int fd, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	s_refop_file_header_v5 head = { 0 };
+	uint8_t *pstored = NULL, *pbuf = NULL, *pmalloc = NULL;
+	int64_t dsize = 0;
+	ssize_t size = 0;
+	int ret = -1;
+
+	size = safe_pread(fd, &head, sizeof(head), 0);
+	if (size != sizeof(head))
+		return -2;
+
+	if (refop_header_v5_validation(&head) != 0)
+		return -3;
+
+	if (head.raw_size > REFOP_DATA_SIZE_LIMIT_MAX)
+		return -3;
+
+	pstored = (uint8_t *) refop_malloc(head.size);
+	if (pstored == NULL)
+		return -6;
+
+	size = safe_pread(fd, pstored, (size_t) head.size, sizeof(head));
+	if (size < 0 || (uint64_t) size != head.size) {
+		ret = -2;
+		goto invalid;
+	}
+
+	if (head.crc16 != crc16(0xffff, pstored, head.size)) {
+		ret = -5;
+		goto invalid;
+	}
+
+	if (head.raw_size > (uint64_t) bufsize) {
+		pmalloc = (uint8_t *) refop_malloc(head.raw_size);
+		if (pmalloc == NULL) {
+			ret = -6;
+			goto invalid;
+		}
+		pbuf = pmalloc;
+	} else
+		pbuf = data;
+
+	dsize = lz_decompress(pstored, head.size, pbuf, head.raw_size);
+	if (dsize != (int64_t) head.raw_size) {
+		ret = -5;
+		goto invalid;
+	}
+
+	if (pmalloc != NULL) {
+		memcpy(data, pmalloc, bufsize);
+		(*readsize) = bufsize;
+	} else
+		(*readsize) = head.raw_size;
+
+	ret = 0;
+
+invalid:
+	refop_free(pmalloc);
+	refop_free(pstored);
+
+	return ret;
+}
+
+/**
+ * The refop header (version 5) create from args.
+ *
+ * @param [in]	head	Pointer for file header.
+ * @param [in]	crc16value	The crc value of stored data block.
+ * @param [in]	sizevalue	The size of stored data block.
+ * @param [in]	rawsizevalue	The size of data before compression.
+ * @param [in]	flags	Format flags.
+ */
+void refop_header_v5_create(s_refop_file_header_v5 *head, uint16_t crc16value, uint64_t sizevalue,
+			    uint64_t rawsizevalue, uint32_t flags)
+{
+	head->magic = REFOP_FILE_HEADER_MAGIC;
+
+	head->version = REFOP_FILE_HEADER_VERSION_V5;
+	head->version_inv = ~head->version;
+
+	head->crc16 = crc16value;
+	head->crc16_inv = ~head->crc16;
+
+	head->size = sizevalue;
+	head->size_inv = ~head->size;
+
+	head->raw_size = rawsizevalue;
+	head->raw_size_inv = ~head->raw_size;
+
+	head->flags = flags;
+	head->flags_inv = ~head->flags;
+}
+
+/**
+ * The refop header (version 5) validation
+ *
+ * @param [in]	head	Pointer for file header.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Invalid header.
+ */
+int refop_header_v5_validation(const s_refop_file_header_v5 *head)
+{
+	int ret = -1;
+
+	// magic check
+	if (head->magic != (uint32_t) REFOP_FILE_HEADER_MAGIC)
+		goto invalid;
+
+	// header format version check
+	if (head->version == (uint32_t)(~head->version_inv)) {
+		if (head->version != REFOP_FILE_HEADER_VERSION_V5)
+			goto invalid;
+	} else
+		goto invalid;
+
+	// crc16 value check
+	if ((head->crc16 ^ head->crc16_inv) != 0xffff)
+		goto invalid;
+
+	// data size check, compressed data is always smaller than raw data.
+	if (head->size != (uint64_t)(~head->size_inv) || head->raw_size != (uint64_t)(~head->raw_size_inv) ||
+	    head->size > head->raw_size)
+		goto invalid;
+
+	// flags check, this version support lz compression only.
+	if (head->flags != (uint32_t)(~head->flags_inv) || head->flags != REFOP_FILE_FLAG_COMPRESS_LZ)
+		goto invalid;
+
+	ret = 0;
+
+invalid:
+	return ret;
+}
@@ -0,0 +1,803 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	fileop-delta.c
+ * @brief	Delta encoded generation file operation functions
+ */
+#include "fileop.h"
+#include "crc16.h"
+#include "file-util.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+#include "static-configurator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+const char c_delta_suffix[] = ".dlt";
+
+/** Patch header of delta record payload: offset and length. */
+#define REFOP_DELTA_PATCH_HEADER (sizeof(uint32_t) * 2)
+/** Equal bytes shorter than this length are merged into one patch. */
+#define REFOP_DELTA_MERGE_GAP (REFOP_DELTA_PATCH_HEADER)
+
+static int refop_delta_keyframe(refop_handle_t handle, uint8_t *data, int64_t bufsize);
+static int refop_delta_append(refop_handle_t handle, uint8_t *data, int64_t bufsize, uint8_t *patch,
+			      int64_t patchsize);
+static int refop_delta_read_cached(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize);
+static int refop_delta_reconstruct(refop_handle_t handle, int limit, uint8_t **pvalue, int64_t *psize);
+static int refop_delta_cache_update(refop_handle_t handle, uint8_t *data, int64_t bufsize);
+
+/**
+ * Create binary diff.  Payload is array of patch (offset, length, bytes).
+ *
+ * @param [in]	old	Previous generation data.
+ * @param [in]	oldsize	Previous generation data size.
+ * @param [in]	new	New generation data.
+ * @param [in]	newsize	New generation data size.
+ * @param [out]	out	Output buffer.
+ * @param [in]	cap	Output buffer size.
+ *
+ * @return int64_t
+ * @retval >=0 Size of diff.
+ * @retval -1 Diff is larger than cap.
+ */
+static int64_t refop_delta_diff(
+	const uint8_t *old, int64_t oldsize, const uint8_t *new, int64_t newsize, uint8_t *out, int64_t cap)
+{
+	int64_t i = 0, j = 0, end = 0, op = 0;
+	uint32_t value = 0;
+
+	while (i < newsize) {
+		if (i < oldsize && old[i] == new[i]) {
+			i++;
+			continue;
+		}
+
+		// Extend the patch while equal run is shorter than patch header.
+		end = i + 1;
+		for (j = i + 1; j < newsize && (j - end) < (int64_t) REFOP_DELTA_MERGE_GAP; j++) {
+			if (j >= oldsize || old[j] != new[j])
+				end = j + 1;
+		}
+
+		if (op + (int64_t) REFOP_DELTA_PATCH_HEADER + (end - i) > cap)
+			return -1;
+
+		value = (uint32_t) i;
+		memcpy(out + op, &value, sizeof(value));
+		value = (uint32_t)(end - i);
+		memcpy(out + op + sizeof(value), &value, sizeof(value));
+		op += REFOP_DELTA_PATCH_HEADER;
+		memcpy(out + op, new + i, end - i);
+		op += end - i;
+
+		i = end;
+	}
+
+	return op;
+}
+
+/**
+ * Apply binary diff.
+ *
+ * @param [in]	old	Previous generation data.
+ * @param [in]	oldsize	Previous generation data size.
+ * @param [in]	patch	Diff.
+ * @param [in]	patchsize	Diff size.
+ * @param [out]	new	New generation data buffer.
+ * @param [in]	newsize	New generation data size.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Malformed diff.
+ */
+static int refop_delta_apply(
+	const uint8_t *old, int64_t oldsize, const uint8_t *patch, int64_t patchsize, uint8_t *new, int64_t newsize)
+{
+	uint32_t offset = 0, length = 0;
+	int64_t ip = 0;
+
+	memset(new, 0, newsize);
+	memcpy(new, old, (oldsize < newsize) ? oldsize : newsize);
+
+	while (ip < patchsize) {
+		if (ip + (int64_t) REFOP_DELTA_PATCH_HEADER > patchsize)
+			return -1;
+
+		memcpy(&offset, patch + ip, sizeof(offset));
+		memcpy(&length, patch + ip + sizeof(offset), sizeof(length));
+		ip += REFOP_DELTA_PATCH_HEADER;
+
+		if (ip + (int64_t) length > patchsize || (int64_t) offset + (int64_t) length > newsize)
+			return -1;
+
+		memcpy(new + offset, patch + ip, length);
+		ip += length;
+	}
+
+	return 0;
+}
+
+/**
+ * This function write new generation as delta record or keyframe.
+ * Delta record is appended to the delta file and synced by fdatasync.  When the delta chain reach
+ * REFOP_DELTA_CHAIN_MAX or the delta is larger than half of data, new keyframe is written by the
+ * file rotation and the delta file is truncated.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Porinter to write data
+ * @param [in]	bufsize	Write dara size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 Lager than size limit.
+ */
+int refop_delta_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	uint8_t *patch = NULL, *prev = NULL;
+	int64_t patchsize = -1, prevsize = 0;
+	int ret = -1;
+
+	if (bufsize > (int64_t) refop_get_config_handle_size_limit(handle) || bufsize <= 0)
+		return -2;
+
+	// The handle does not know current generation or it was not cached by budget, reconstruct it.
+	if (hndl->delta == NULL || hndl->delta->value == NULL) {
+		ret = refop_delta_reconstruct(handle, REFOP_DELTA_CHAIN_MAX, &prev, &prevsize);
+		if (ret == -1)
+			return -1;
+	}
+
+	if (hndl->delta != NULL && hndl->delta->chain < REFOP_DELTA_CHAIN_MAX) {
+		patch = (uint8_t *) refop_malloc((bufsize / 2) + 1);
+		if (patch == NULL) {
+			refop_free(prev);
+			return -1;
+		}
+
+		if (prev != NULL)
+			patchsize = refop_delta_diff(prev, prevsize, data, bufsize, patch, bufsize / 2);
+		else
+			patchsize = refop_delta_diff(hndl->delta->value, hndl->delta->size, data, bufsize, patch, bufsize / 2);
+	}
+	refop_free(prev);
+
+	if (patchsize < 0)
+		ret = refop_delta_keyframe(handle, data, bufsize);
+	else
+		ret = refop_delta_append(handle, data, bufsize, patch, patchsize);
+
+	refop_free(patch);
+
+	return ret;
+}
+
+/**
+ * This function pick up newest generation that is reconstructed from keyframe and delta records.
+ * When the newest record matches the cached generation of the handle, the cache is read.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval 1 Succeeded with recover.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_delta_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	uint8_t *value = NULL;
+	int64_t size = 0;
+	int ret = -1;
+
+	if (hndl->delta != NULL && hndl->delta->value != NULL && hndl->delta->chain > 0) {
+		ret = refop_delta_read_cached(handle, data, bufsize, readsize);
+		if (ret == 0)
+			return 0;
+	}
+
+	ret = refop_delta_reconstruct(handle, REFOP_DELTA_CHAIN_MAX, &value, &size);
+	if (ret < 0)
+		return ret;
+
+	if (size > bufsize)
+		size = bufsize;
+	memcpy(data, value, size);
+	(*readsize) = size;
+
+	refop_free(value);
+
+	return ret;
+}
+
+/**
+ * This function read indexed generation.  Generation 0 is newest and older generations are
+ * reconstructed by fewer delta records.  Generations older than the keyframe are the backup keyframe.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	n	Generation index. 0 is newest.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_delta_get_generation(
+	refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	uint8_t *value = NULL;
+	int64_t size = 0;
+	int ret = -1;
+
+	ret = refop_delta_reconstruct(handle, REFOP_DELTA_CHAIN_MAX, NULL, NULL);
+	if (ret < 0)
+		return ret;
+
+	if (n > hndl->delta->chain + 1)
+		return -2;
+	else if (n == hndl->delta->chain + 1)
+		return refop_file_get_generation(handle, 1, data, bufsize, readsize);
+
+	ret = refop_delta_reconstruct(handle, hndl->delta->chain - n, &value, &size);
+	if (ret < 0)
+		return ret;
+
+	if (size > bufsize)
+		size = bufsize;
+	memcpy(data, value, size);
+	(*readsize) = size;
+
+	refop_free(value);
+
+	return 0;
+}
+
+/**
+ * This function remove keyframe files and the delta file.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail.
+ */
+int refop_delta_remove(refop_handle_t handle)
+{
+	const char *suffixes[3] = { c_new_suffix, "", c_bk1_suffix };
+	char path[PATH_MAX];
+	int result = 0, ret = -1;
+
+	refop_delta_reset(handle);
+
+	for (int i = 0; i < 3; i++) {
+		if (refop_handle_path(handle, suffixes[i], path) < 0) {
+			result = -1;
+			continue;
+		}
+
+		ret = unlink(path);
+		if (ret < 0) {
+			if (errno != ENOENT)
+				result = -1;
+		}
+	}
+
+	ret = refop_handle_path(handle, c_delta_suffix, path);
+	if (ret == 0) {
+		ret = unlink(path);
+		if (ret < 0) {
+			if (errno != ENOENT)
+				result = -1;
+		}
+	} else
+		result = -1;
+
+	return result;
+}
+
+/**
+ * Release cached generation of delta mode.
+ *
+ * @param [in]	handle	Refop handle.
+ */
+void refop_delta_reset(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if (hndl->delta == NULL)
+		return;
+
+	refop_free(hndl->delta->value);
+	refop_free(hndl->delta);
+	hndl->delta = NULL;
+}
+
+/**
+ * The refop header (version 6) create from args.  This header is used for delta record.
+ *
+ * @param [in]	head	Pointer for record header.
+ * @param [in]	crc16value	The crc value of diff.
+ * @param [in]	sizevalue	The size of diff.
+ * @param [in]	rawsizevalue	The size of reconstructed data.
+ * @param [in]	result_crc16value	The crc value of reconstructed data.
+ * @param [in]	base_crc16value	The crc value of keyframe data.
+ * @param [in]	sequence	Sequence number from keyframe, start from 1.
+ */
+void refop_header_v6_create(s_refop_file_header_v6 *head, uint16_t crc16value, uint64_t sizevalue,
+			    uint64_t rawsizevalue, uint16_t result_crc16value, uint16_t base_crc16value,
+			    uint32_t sequence)
+{
+	head->magic = REFOP_FILE_HEADER_MAGIC;
+
+	head->version = REFOP_FILE_HEADER_VERSION_V6;
+	head->version_inv = ~head->version;
+
+	head->crc16 = crc16value;
+	head->crc16_inv = ~head->crc16;
+
+	head->size = sizevalue;
+	head->size_inv = ~head->size;
+
+	head->raw_size = rawsizevalue;
+	head->raw_size_inv = ~head->raw_size;
+
+	head->result_crc16 = result_crc16value;
+	head->result_crc16_inv = ~head->result_crc16;
+
+	head->base_crc16 = base_crc16value;
+	head->base_crc16_inv = ~head->base_crc16;
+
+	head->sequence = sequence;
+	head->sequence_inv = ~head->sequence;
+}
+
+/**
+ * The refop header (version 6) validation
+ *
+ * @param [in]	head	Pointer for record header.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Invalid header.
+ */
+int refop_header_v6_validation(const s_refop_file_header_v6 *head)
+{
+	int ret = -1;
+
+	// magic check
+	if (head->magic != (uint32_t) REFOP_FILE_HEADER_MAGIC)
+		goto invalid;
+
+	// header format version check
+	if (head->version == (uint32_t)(~head->version_inv)) {
+		if (head->version != REFOP_FILE_HEADER_VERSION_V6)
+			goto invalid;
+	} else
+		goto invalid;
+
+	// crc16 value check
+	if ((head->crc16 ^ head->crc16_inv) != 0xffff || (head->result_crc16 ^ head->result_crc16_inv) != 0xffff ||
+	    (head->base_crc16 ^ head->base_crc16_inv) != 0xffff)
+		goto invalid;
+
+	// data size check
+	if (head->size != (uint64_t)(~head->size_inv) || head->raw_size != (uint64_t)(~head->raw_size_inv) ||
+	    head->size > REFOP_DATA_SIZE_LIMIT_MAX || head->raw_size > REFOP_DATA_SIZE_LIMIT_MAX)
+		goto invalid;
+
+	// sequence check
+	if (head->sequence != (uint32_t)(~head->sequence_inv))
+		goto invalid;
+
+	ret = 0;
+
+invalid:
+	return ret;
+}
+
+/**
+ * Write new keyframe by the file rotation and truncate the delta file.
+ * The delta file is truncated after rotation.  When the truncate was not done by power loss,
+ * old delta records are ignored because those base crc do not match to new keyframe.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Porinter to write data
+ * @param [in]	bufsize	Write dara size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 Lager than size limit.
+ */
+static int refop_delta_keyframe(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	char path[PATH_MAX];
+	int ret = -1;
+
+	ret = refop_new_file_write(handle, data, bufsize);
+	if (ret < 0)
+		return ret;
+
+	ret = refop_file_rotation(handle);
+	if (ret < 0) {
+		if (refop_handle_path(handle, c_new_suffix, path) == 0)
+			(void) unlink(path);
+		refop_delta_reset(handle);
+		return -1;
+	}
+
+	ret = refop_handle_path(handle, c_delta_suffix, path);
+	if (ret < 0 || (truncate(path, 0) < 0 && errno != ENOENT)) {
+		refop_delta_reset(handle);
+		return -1;
+	}
+
+	ret = refop_delta_cache_update(handle, data, bufsize);
+	if (ret < 0)
+		return -1;
+
+	hndl->delta->base_crc16 = crc16(0xffff, data, bufsize);
+	hndl->delta->chain = 0;
+	hndl->delta->offset = 0;
+	hndl->delta->truncate = false;
+
+	return 0;
+}
+
+/**
+ * Append delta record to the delta file.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Porinter to write data
+ * @param [in]	bufsize	Write dara size
+ * @param [in]	patch	Diff from cached generation.
+ * @param [in]	patchsize	Diff size.
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ */
+static int refop_delta_append(refop_handle_t handle, uint8_t *data, int64_t bufsize, uint8_t *patch,
+			      int64_t patchsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	char path[PATH_MAX];
+	uint8_t *pbuf = NULL;
+	size_t total = 0;
+	ssize_t wsize = 0;
+	int ret = -1, fd = -1;
+	bool created = false;
+
+	ret = refop_handle_path(handle, c_delta_suffix, path);
+	if (ret < 0)
+		return -1;
+
+	total = sizeof(s_refop_file_header_v6) + (size_t) patchsize;
+	pbuf = (uint8_t *) refop_malloc(total);
+	if (pbuf == NULL)
+		return -1;
+
+	memcpy(pbuf + sizeof(s_refop_file_header_v6), patch, patchsize);
+	refop_header_v6_create((s_refop_file_header_v6 *) pbuf, crc16(0xffff, patch, patchsize), patchsize, bufsize,
+			       crc16(0xffff, data, bufsize), hndl->delta->base_crc16, hndl->delta->chain + 1);
+
+	fd = open(path, (O_CLOEXEC | O_WRONLY | O_NOFOLLOW));
+	if (fd < 0 && errno == ENOENT) {
+		// Initial write only, need to create a file.
+		fd = open(path, (O_CLOEXEC | O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW), (S_IRUSR | S_IWUSR));
+		created = true;
+	}
+	if (fd < 0) {
+		refop_free(pbuf);
+		return -1;
+	}
+
+	// Drop invalid or stale records, those shall not be followed by new record.
+	if (hndl->delta->truncate == true) {
+		if (ftruncate(fd, (off_t) hndl->delta->offset) < 0)
+			goto error;
+		hndl->delta->truncate = false;
+	}
+
+	wsize = safe_pwrite(fd, pbuf, total, (off_t) hndl->delta->offset);
+	if (wsize != (ssize_t) total)
+		goto error;
+
+	if (refop_fdatasync(handle, fd) < 0)
+		goto error;
+
+	(void) close(fd);
+	refop_free(pbuf);
+
+	if (created == true)
+		(void) refop_dir_sync(handle);
+
+	ret = refop_delta_cache_update(handle, data, bufsize);
+	if (ret < 0)
+		return -1;
+
+	hndl->delta->chain++;
+	hndl->delta->offset += (int64_t) total;
+
+	return 0;
+
+error:
+	(void) close(fd);
+	refop_free(pbuf);
+	refop_delta_reset(handle);
+
+	return -1;
+}
+
+/**
+ * Read the newest generation from the handle cache.  The keyframe and delta records are verified by
+ * streaming, so broken files are detected without reconstruction and heap memory.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 The files do not match the cache, need to reconstruct.
+ */
+static int refop_delta_read_cached(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	char path[PATH_MAX];
+	s_refop_file_header_v6 head = { 0 };
+	int64_t ressize = 0;
+	off_t offset = 0;
+	ssize_t size = 0;
+	int ret = -1, chain = 0, fd = -1;
+
+	// The keyframe is read to the data buffer only for validation, the buffer is overwritten by the cache.
+	if (refop_file_get_generation(handle, 0, data, bufsize, &ressize) != 0)
+		return -1;
+
+	if (refop_handle_path(handle, c_delta_suffix, path) < 0)
+		return -1;
+
+	fd = open(path, (O_CLOEXEC | O_RDONLY | O_NOFOLLOW));
+	if (fd < 0)
+		return -1;
+
+	for (chain = 1; chain <= hndl->delta->chain; chain++) {
+		size = safe_pread(fd, &head, sizeof(head), offset);
+		if (size != sizeof(head) || refop_header_v6_validation(&head) != 0 ||
+		    head.base_crc16 != hndl->delta->base_crc16 || head.sequence != (uint32_t) chain)
+			goto out;
+
+		if (refop_data_read_verify(fd, offset + (off_t) sizeof(head), head.size, head.crc16, NULL, 0) != 0)
+			goto out;
+
+		offset += (off_t)(sizeof(head) + head.size);
+	}
+
+	// The newest record shall reconstruct the cached value.
+	if (offset != (off_t) hndl->delta->offset || (int64_t) head.raw_size != hndl->delta->size ||
+	    head.result_crc16 != crc16(0xffff, hndl->delta->value, hndl->delta->size))
+		goto out;
+
+	if (hndl->delta->size < bufsize)
+		bufsize = hndl->delta->size;
+	memcpy(data, hndl->delta->value, bufsize);
+	(*readsize) = bufsize;
+	ret = 0;
+
+out:
+	(void) close(fd);
+
+	return ret;
+}
+
+/**
+ * Reconstruct a generation from keyframe and delta records.  The handle cache is updated when
+ * all valid records were applied.  A value larger than the size limit of the handle is not
+ * reconstructed, it is not broken.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	limit	Maximum number of delta records to apply.
+ * @param [out]	pvalue	Reconstructed data, it shall be released by refop_free().  NULL is allowed.
+ * @param [out]	psize	Reconstructed data size.  NULL is allowed.
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval 1 Succeeded with recover.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+static int refop_delta_reconstruct(refop_handle_t handle, int limit, uint8_t **pvalue, int64_t *psize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	char path[PATH_MAX];
+	s_refop_file_header_v6 head = { 0 };
+	uint8_t *cur = NULL, *next = NULL, *patch = NULL, *tmp = NULL;
+	int64_t cursize = 0, curcap = 0, nextcap = 0, limitsize = 0;
+	uint16_t base_crc16 = 0;
+	off_t offset = 0;
+	ssize_t size = 0;
+	int ret = -1, chain = 0, fd = -1;
+	bool tail_invalid = false, clean_end = false;
+
+	if (refop_handle_path(handle, c_delta_suffix, path) < 0)
+		return -1;
+
+	// Buffers are sized by the keyframe and records, a keyframe larger than the limit fails.
+	limitsize = refop_get_config_handle_size_limit(handle);
+	ret = refop_file_pickup_alloc(handle, limitsize, &cur, &cursize);
+	if (ret < 0) {
+		if (ret == -2)
+			refop_delta_reset(handle);
+		goto out;
+	}
+	curcap = cursize;
+	base_crc16 = crc16(0xffff, cur, cursize);
+
+	fd = open(path, (O_CLOEXEC | O_RDONLY | O_NOFOLLOW));
+	if (fd < 0)
+		clean_end = true;
+
+	while (fd >= 0 && chain < limit) {
+		size = safe_pread(fd, &head, sizeof(head), offset);
+		if (size == 0) {
+			clean_end = true;
+			break;
+		}
+		if (size != sizeof(head) || refop_header_v6_validation(&head) != 0) {
+			tail_invalid = true;
+			break;
+		}
+
+		// Records of old keyframe are stale, those are not broken.
+		if (head.base_crc16 != base_crc16 || head.sequence != (uint32_t)(chain + 1)) {
+			if (chain > 0)
+				tail_invalid = true;
+			break;
+		}
+
+		// A value of a handle with larger size limit can not be reconstructed by this handle.
+		if ((int64_t) head.raw_size > limitsize) {
+			ret = -1;
+			goto out;
+		}
+
+		if (next == NULL || (int64_t) head.raw_size > nextcap) {
+			refop_free(next);
+			next = (uint8_t *) refop_malloc(head.raw_size + 1);
+			if (next == NULL) {
+				ret = -1;
+				goto out;
+			}
+			nextcap = (int64_t) head.raw_size;
+		}
+
+		patch = (uint8_t *) refop_malloc(head.size + 1);
+		if (patch == NULL) {
+			ret = -1;
+			goto out;
+		}
+
+		size = safe_pread(fd, patch, (size_t) head.size, offset + (off_t) sizeof(head));
+		if (size != (ssize_t) head.size || head.crc16 != crc16(0xffff, patch, head.size) ||
+		    refop_delta_apply(cur, cursize, patch, head.size, next, head.raw_size) != 0 ||
+		    head.result_crc16 != crc16(0xffff, next, head.raw_size)) {
+			tail_invalid = true;
+			break;
+		}
+
+		refop_free(patch);
+		patch = NULL;
+
+		tmp = cur;
+		cur = next;
+		next = tmp;
+		nextcap = curcap;
+		curcap = (int64_t) head.raw_size;
+		cursize = head.raw_size;
+		offset += (off_t)(sizeof(head) + head.size);
+		chain++;
+	}
+
+	if (tail_invalid == true)
+		ret = 1;
+
+	// Cache newest generation for next delta encoding.
+	if (limit == REFOP_DELTA_CHAIN_MAX) {
+		if (refop_delta_cache_update(handle, cur, cursize) < 0) {
+			ret = -1;
+			goto out;
+		}
+		hndl->delta->base_crc16 = base_crc16;
+		hndl->delta->chain = chain;
+		hndl->delta->offset = offset;
+		hndl->delta->truncate = !clean_end;
+	}
+
+	if (pvalue != NULL) {
+		(*pvalue) = cur;
+		(*psize) = cursize;
+		cur = NULL;
+	}
+
+out:
+	if (fd >= 0)
+		(void) close(fd);
+	refop_free(patch);
+	refop_free(cur);
+	refop_free(next);
+
+	return ret;
+}
+
+/**
+ * Update cached newest generation.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Newest generation data.
+ * @param [in]	bufsize	Newest generation data size.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 No memory.
+ */
+static int refop_delta_cache_update(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	uint8_t *value = NULL;
+
+	// The state is allocated at first use, handles of other modes do not have it.
+	if (hndl->delta == NULL) {
+		hndl->delta = (struct refop_delta_state *) refop_calloc(1, sizeof(struct refop_delta_state));
+		if (hndl->delta == NULL)
+			return -1;
+	}
+
+	// Value larger than cache budget is not kept, next write reconstruct it from files.
+	if (hndl->cache_budget != 0 && (uint64_t) bufsize > hndl->cache_budget) {
+		refop_free(hndl->delta->value);
+		hndl->delta->value = NULL;
+		hndl->delta->size = bufsize;
+		return 0;
+	}
+
+	// The cached value is overwritten, so a buffer of same size is reused and others are replaced.
+	value = hndl->delta->value;
+	if (value == NULL || hndl->delta->size != bufsize) {
+		value = (uint8_t *) refop_malloc(bufsize);
+		if (value == NULL) {
+			refop_delta_reset(handle);
+			return -1;
+		}
+		refop_free(hndl->delta->value);
+	}
+
+	memcpy(value, data, bufsize);
+	hndl->delta->value = value;
+	hndl->delta->size = bufsize;
+
+	return 0;
+}
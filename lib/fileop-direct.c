@@ -0,0 +1,275 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	fileop-direct.c
+ * @brief	Direct I/O file format operation functions
+ */
+#include "fileop.h"
+#include "crc16.h"
+#include "file-util.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+#include "static-configurator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/** Round up size to alignment (alignment shall be power of 2). */
+#define REFOP_DIRECT_ROUNDUP(size, align) (((size) + (align) -1) & ~((uint64_t)(align) -1))
+
+/**
+ * Positional read for direct I/O.  When the file system reject O_DIRECT read, O_DIRECT is
+ * cleared and buffered read is used.
+ *
+ * @param [in]	fd	File descriptor of target file.
+ * @param [in]	buf	Aligned read buffer.
+ * @param [in]	count	Read size (aligned).
+ * @param [in]	offset	Read offset (aligned).
+ * @param [in,out]	direct	True when the file descriptor is O_DIRECT.
+ *
+ * @return ssize_t
+ * @retval >=0 Readed size.
+ * @retval -1 Read error.
+ */
+static ssize_t refop_direct_pread(int fd, void *buf, size_t count, off_t offset, bool *direct)
+{
+	ssize_t size = 0;
+	int flags = 0;
+
+	size = safe_pread(fd, buf, count, offset);
+	if (size < 0 && errno == EINVAL && (*direct) == true) {
+		flags = fcntl(fd, F_GETFL);
+		if (flags >= 0 && fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0) {
+			(*direct) = false;
+			size = safe_pread(fd, buf, count, offset);
+		}
+	}
+
+	return size;
+}
+
+/**
+ * This function create new data file of the direct I/O format and write it by O_DIRECT.
+ * The header is padded to REFOP_DIRECT_ALIGN and the data is padded by zero to REFOP_DIRECT_ALIGN,
+ * so every write is aligned.  When the file system does not support O_DIRECT, this function use
+ * buffered write and drop written pages from the page cache.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	file	File name with path.
+ * @param [in]	data	Porinter to write data
+ * @param [in]	bufsize	Write dara size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ */
+int refop_direct_file_write(refop_handle_t handle, const char *file, uint8_t *data, int64_t bufsize)
+{
+	void *pbuf = NULL;
+	size_t total = 0;
+	ssize_t wsize = 0;
+	int fd = -1;
+	bool direct = true;
+
+	total = REFOP_DIRECT_ALIGN + REFOP_DIRECT_ROUNDUP((uint64_t) bufsize, REFOP_DIRECT_ALIGN);
+	pbuf = refop_aligned_alloc(REFOP_DIRECT_ALIGN, total);
+	if (pbuf == NULL)
+		return -1;
+
+	// Bounce buffer: header page, data and zero tail.
+	memset(pbuf, 0, REFOP_DIRECT_ALIGN);
+	memcpy((uint8_t *) pbuf + REFOP_DIRECT_ALIGN, data, bufsize);
+	memset((uint8_t *) pbuf + REFOP_DIRECT_ALIGN + bufsize, 0, total - REFOP_DIRECT_ALIGN - bufsize);
+	refop_header_v7_create((s_refop_file_header_v7 *) pbuf, crc16(0xffff, data, bufsize), bufsize,
+			       REFOP_DIRECT_ALIGN);
+
+	fd = open(file, (O_CLOEXEC | O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_DIRECT), (S_IRUSR | S_IWUSR));
+	if (fd < 0 && errno == EINVAL) {
+		// File system does not support O_DIRECT.
+		fd = open(file, (O_CLOEXEC | O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW), (S_IRUSR | S_IWUSR));
+		direct = false;
+	}
+	if (fd < 0) {
+		refop_aligned_free(pbuf);
+		return -1;
+	}
+
+	// O_DIRECT does not flush device cache and metadata.
+	wsize = safe_write(fd, pbuf, total);
+	if (wsize != (ssize_t) total || refop_fsync(handle, fd) < 0) {
+		(void) close(fd);
+		refop_aligned_free(pbuf);
+		return -1;
+	}
+
+	if (direct == false)
+		(void) posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+	(void) close(fd);
+	refop_aligned_free(pbuf);
+
+	return 0;
+}
+
+/**
+ * File read function for the direct I/O format with validation.
+ * This function switch the file descriptor to O_DIRECT and read header page and data by aligned
+ * bounce buffer.  This function is called from refop_file_get_with_validation after version was detected.
+ *
+ * @param [in]	fd	File descriptor of target file.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -2 Invalid file size.
+ * @retval -3 Invalid header.
+ * @retval -5 Invalid data.
+ * @retval -6 Abnomal file responce.
+ */
+int refop_direct_get_with_validation(int fd, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	const s_refop_file_header_v7 *head = NULL;
+	void *pbuf = NULL, *phead = NULL;
+	uint64_t alignedsize = 0;
+	ssize_t size = 0;
+	int flags = 0, ret = -1;
+	bool direct = false;
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags >= 0 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0)
+		direct = true;
+
+	phead = refop_aligned_alloc(REFOP_DIRECT_ALIGN, REFOP_DIRECT_ALIGN);
+	if (phead == NULL)
+		return -6;
+
+	size = refop_direct_pread(fd, phead, REFOP_DIRECT_ALIGN, 0, &direct);
+	if (size != REFOP_DIRECT_ALIGN) {
+		ret = -2;
+		goto invalid;
+	}
+
+	head = (const s_refop_file_header_v7 *) phead;
+	if (refop_header_v7_validation(head) != 0) {
+		ret = -3;
+		goto invalid;
+	}
+
+	if (head->size > REFOP_DATA_SIZE_LIMIT_MAX) {
+		ret = -3;
+		goto invalid;
+	}
+
+	alignedsize = REFOP_DIRECT_ROUNDUP(head->size, REFOP_DIRECT_ALIGN);
+	pbuf = refop_aligned_alloc(REFOP_DIRECT_ALIGN, alignedsize + REFOP_DIRECT_ALIGN);
+	if (pbuf == NULL) {
+		ret = -6;
+		goto invalid;
+	}
+
+	size = refop_direct_pread(fd, pbuf, alignedsize, (off_t) head->data_offset, &direct);
+	if (size < (ssize_t) head->size) {
+		ret = -2;
+		goto invalid;
+	}
+
+	if (head->crc16 != crc16(0xffff, (uint8_t *) pbuf, head->size)) {
+		ret = -5;
+		goto invalid;
+	}
+
+	if ((int64_t) head->size < bufsize)
+		bufsize = (int64_t) head->size;
+	memcpy(data, pbuf, bufsize);
+	(*readsize) = bufsize;
+	ret = 0;
+
+invalid:
+	// The header was read by buffered read before O_DIRECT, drop it.
+	(void) posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+	refop_aligned_free(pbuf);
+	refop_aligned_free(phead);
+
+	return ret;
+}
+
+/**
+ * The refop header (version 7) create from args.  This header is used for direct I/O format.
+ *
+ * @param [in]	head	Pointer for file header.
+ * @param [in]	crc16value	The crc value of data block.
+ * @param [in]	sizevalue	The size of data block (without padding).
+ * @param [in]	align	The alignment of header page and data block.
+ */
+void refop_header_v7_create(s_refop_file_header_v7 *head, uint16_t crc16value, uint64_t sizevalue, uint32_t align)
+{
+	head->magic = REFOP_FILE_HEADER_MAGIC;
+
+	head->version = REFOP_FILE_HEADER_VERSION_V7;
+	head->version_inv = ~head->version;
+
+	head->crc16 = crc16value;
+	head->crc16_inv = ~head->crc16;
+
+	head->size = sizevalue;
+	head->size_inv = ~head->size;
+
+	head->data_offset = align;
+	head->data_offset_inv = ~head->data_offset;
+
+	head->align = align;
+	head->align_inv = ~head->align;
+}
+
+/**
+ * The refop header (version 7) validation
+ *
+ * @param [in]	head	Pointer for file header.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Invalid header.
+ */
+int refop_header_v7_validation(const s_refop_file_header_v7 *head)
+{
+	int ret = -1;
+
+	// magic check
+	if (head->magic != (uint32_t) REFOP_FILE_HEADER_MAGIC)
+		goto invalid;
+
+	// header format version check
+	if (head->version == (uint32_t)(~head->version_inv)) {
+		if (head->version != REFOP_FILE_HEADER_VERSION_V7)
+			goto invalid;
+	} else
+		goto invalid;
+
+	// crc16 value check
+	if ((head->crc16 ^ head->crc16_inv) != 0xffff)
+		goto invalid;
+
+	// data size check
+	if (head->size != (uint64_t)(~head->size_inv))
+		goto invalid;
+
+	// alignment check, header page shall be read by REFOP_DIRECT_ALIGN
+	if (head->align != (uint32_t)(~head->align_inv) || head->data_offset != (uint32_t)(~head->data_offset_inv) ||
+	    head->align != REFOP_DIRECT_ALIGN || head->data_offset != REFOP_DIRECT_ALIGN)
+		goto invalid;
+
+	ret = 0;
+
+invalid:
+	return ret;
+}
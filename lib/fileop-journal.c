@@ -0,0 +1,582 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	fileop-journal.c
+ * @brief	Log-structured journal file operation functions
+ */
+#include "fileop.h"
+#include "crc16.h"
+#include "file-util.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+#include "static-configurator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+const char c_journal_suffix[] = ".jnl";
+
+static int refop_journal_base_write(refop_handle_t handle, uint8_t *data, int64_t bufsize);
+static int refop_journal_append(refop_handle_t handle, uint8_t *data, int64_t bufsize);
+static int refop_journal_read_tail(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize);
+static int refop_journal_replay(refop_handle_t handle, int limit, uint8_t **pvalue, int64_t *psize);
+static int refop_journal_state_alloc(refop_handle_t handle);
+
+/**
+ * This function append new value to the journal file.
+ * One set operation is one record append and one fdatasync.  When the journal reach
+ * REFOP_JOURNAL_RECORDS_MAX records, the journal is compacted to new base file.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Porinter to write data
+ * @param [in]	bufsize	Write dara size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 Lager than size limit.
+ */
+int refop_journal_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	int ret = -1;
+
+	if (bufsize > (int64_t) refop_get_config_handle_size_limit(handle) || bufsize <= 0)
+		return -2;
+
+	// The handle does not know the journal tail, replay once.
+	if (hndl->journal == NULL) {
+		ret = refop_journal_replay(handle, REFOP_JOURNAL_RECORDS_MAX, NULL, NULL);
+		if (ret == -1)
+			return -1;
+	}
+
+	// No valid base file or full journal, new base file is written.
+	if (hndl->journal == NULL || hndl->journal->records >= REFOP_JOURNAL_RECORDS_MAX)
+		return refop_journal_base_write(handle, data, bufsize);
+
+	return refop_journal_append(handle, data, bufsize);
+}
+
+/**
+ * This function pick up newest value from the journal.  When the handle know the journal tail,
+ * only the newest record is read.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval 1 Succeeded with recover.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_journal_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	uint8_t *value = NULL;
+	int64_t size = 0;
+	int ret = -1;
+
+	if (hndl->journal != NULL && hndl->journal->tail >= 0) {
+		ret = refop_journal_read_tail(handle, data, bufsize, readsize);
+		if (ret == 0)
+			return 0;
+	}
+
+	ret = refop_journal_replay(handle, REFOP_JOURNAL_RECORDS_MAX, &value, &size);
+	if (ret < 0)
+		return ret;
+
+	if (size > bufsize)
+		size = bufsize;
+	memcpy(data, value, size);
+	(*readsize) = size;
+
+	refop_free(value);
+
+	return ret;
+}
+
+/**
+ * This function read indexed generation.  Generation 0 is newest record, and generations older
+ * than the first record are the base file and the backup base file.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	n	Generation index. 0 is newest.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_journal_get_generation(
+	refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	uint8_t *value = NULL;
+	int64_t size = 0;
+	int ret = -1;
+
+	ret = refop_journal_replay(handle, REFOP_JOURNAL_RECORDS_MAX, NULL, NULL);
+	if (ret < 0)
+		return ret;
+
+	if (n > hndl->journal->records + 1)
+		return -2;
+	else if (n == hndl->journal->records + 1)
+		return refop_file_get_generation(handle, 1, data, bufsize, readsize);
+
+	ret = refop_journal_replay(handle, hndl->journal->records - n, &value, &size);
+	if (ret < 0)
+		return ret;
+
+	if (size > bufsize)
+		size = bufsize;
+	memcpy(data, value, size);
+	(*readsize) = size;
+
+	refop_free(value);
+
+	return 0;
+}
+
+/**
+ * This function compact the journal.  The newest value is written to new base file by the file
+ * rotation and the journal file is truncated.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_journal_compact(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	uint8_t *value = NULL;
+	int64_t size = 0;
+	int ret = -1;
+
+	ret = refop_journal_replay(handle, REFOP_JOURNAL_RECORDS_MAX, &value, &size);
+	if (ret < 0)
+		return ret;
+
+	// Nothing to compact.
+	if (hndl->journal->records == 0 && hndl->journal->truncate == false) {
+		refop_free(value);
+		return 0;
+	}
+
+	ret = refop_journal_base_write(handle, value, size);
+	refop_free(value);
+
+	return (ret < 0) ? -1 : 0;
+}
+
+/**
+ * This function remove base files and the journal file.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail.
+ */
+int refop_journal_remove(refop_handle_t handle)
+{
+	const char *suffixes[3] = { c_new_suffix, "", c_bk1_suffix };
+	char path[PATH_MAX];
+	int result = 0, ret = -1;
+
+	refop_journal_reset(handle);
+
+	for (int i = 0; i < 3; i++) {
+		if (refop_handle_path(handle, suffixes[i], path) < 0) {
+			result = -1;
+			continue;
+		}
+
+		ret = unlink(path);
+		if (ret < 0) {
+			if (errno != ENOENT)
+				result = -1;
+		}
+	}
+
+	ret = refop_handle_path(handle, c_journal_suffix, path);
+	if (ret == 0) {
+		ret = unlink(path);
+		if (ret < 0) {
+			if (errno != ENOENT)
+				result = -1;
+		}
+	} else
+		result = -1;
+
+	return result;
+}
+
+/**
+ * Release the journal tail state of the handle.
+ *
+ * @param [in]	handle	Refop handle.
+ */
+void refop_journal_reset(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	refop_free(hndl->journal);
+	hndl->journal = NULL;
+}
+
+/**
+ * Write new base file by the file rotation and truncate the journal file.
+ * The journal file is truncated after rotation.  When the truncate was not done by power loss,
+ * old records are ignored because those base crc do not match to new base file.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Porinter to write data
+ * @param [in]	bufsize	Write dara size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 Lager than size limit.
+ */
+static int refop_journal_base_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	char path[PATH_MAX];
+	int ret = -1;
+
+	ret = refop_new_file_write(handle, data, bufsize);
+	if (ret < 0)
+		return ret;
+
+	ret = refop_file_rotation(handle);
+	if (ret < 0) {
+		if (refop_handle_path(handle, c_new_suffix, path) == 0)
+			(void) unlink(path);
+		refop_journal_reset(handle);
+		return -1;
+	}
+
+	ret = refop_handle_path(handle, c_journal_suffix, path);
+	if (ret < 0 || (truncate(path, 0) < 0 && errno != ENOENT)) {
+		refop_journal_reset(handle);
+		return -1;
+	}
+
+	if (refop_journal_state_alloc(handle) < 0)
+		return -1;
+
+	hndl->journal->truncate = false;
+	hndl->journal->records = 0;
+	hndl->journal->base_crc16 = crc16(0xffff, data, bufsize);
+	hndl->journal->offset = 0;
+	hndl->journal->tail = -1;
+
+	return 0;
+}
+
+/**
+ * Append one journal record.  The record header is version 6 header, the record has full value.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Porinter to write data
+ * @param [in]	bufsize	Write dara size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ */
+static int refop_journal_append(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	char path[PATH_MAX];
+	uint8_t *pbuf = NULL;
+	uint16_t crc16value = 0;
+	size_t total = 0;
+	ssize_t wsize = 0;
+	int ret = -1, fd = -1;
+	bool created = false;
+
+	ret = refop_handle_path(handle, c_journal_suffix, path);
+	if (ret < 0)
+		return -1;
+
+	total = sizeof(s_refop_file_header_v6) + (size_t) bufsize;
+	pbuf = (uint8_t *) refop_malloc(total);
+	if (pbuf == NULL)
+		return -1;
+
+	memcpy(pbuf + sizeof(s_refop_file_header_v6), data, bufsize);
+	crc16value = crc16(0xffff, data, bufsize);
+	refop_header_v6_create((s_refop_file_header_v6 *) pbuf, crc16value, bufsize, bufsize, crc16value,
+			       hndl->journal->base_crc16, hndl->journal->records + 1);
+
+	fd = open(path, (O_CLOEXEC | O_WRONLY | O_NOFOLLOW));
+	if (fd < 0 && errno == ENOENT) {
+		// Initial write only, need to create a file.
+		fd = open(path, (O_CLOEXEC | O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW), (S_IRUSR | S_IWUSR));
+		created = true;
+	}
+	if (fd < 0) {
+		refop_free(pbuf);
+		return -1;
+	}
+
+	// Drop invalid or stale records, those shall not be followed by new record.
+	if (hndl->journal->truncate == true) {
+		if (ftruncate(fd, (off_t) hndl->journal->offset) < 0)
+			goto error;
+		hndl->journal->truncate = false;
+	}
+
+	wsize = safe_pwrite(fd, pbuf, total, (off_t) hndl->journal->offset);
+	if (wsize != (ssize_t) total)
+		goto error;
+
+	if (refop_fdatasync(handle, fd) < 0)
+		goto error;
+
+	(void) close(fd);
+	refop_free(pbuf);
+
+	if (created == true)
+		(void) refop_dir_sync(handle);
+
+	hndl->journal->records++;
+	hndl->journal->tail = hndl->journal->offset;
+	hndl->journal->offset += (int64_t) total;
+
+	return 0;
+
+error:
+	(void) close(fd);
+	refop_free(pbuf);
+	refop_journal_reset(handle);
+
+	return -1;
+}
+
+/**
+ * Read the newest record by the tail pointer of the handle.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 The tail record was not valid, need to replay.
+ */
+static int refop_journal_read_tail(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	char path[PATH_MAX];
+	s_refop_file_header_v6 head = { 0 };
+	uint8_t *value = NULL;
+	ssize_t size = 0;
+	int ret = -1, fd = -1;
+
+	if (refop_handle_path(handle, c_journal_suffix, path) < 0)
+		return -1;
+
+	fd = open(path, (O_CLOEXEC | O_RDONLY | O_NOFOLLOW));
+	if (fd < 0)
+		return -1;
+
+	size = safe_pread(fd, &head, sizeof(head), (off_t) hndl->journal->tail);
+	if (size != sizeof(head) || refop_header_v6_validation(&head) != 0 ||
+	    head.base_crc16 != hndl->journal->base_crc16 || head.sequence != (uint32_t) hndl->journal->records)
+		goto out;
+
+	value = (uint8_t *) refop_malloc(head.size + 1);
+	if (value == NULL)
+		goto out;
+
+	size = safe_pread(fd, value, (size_t) head.size, (off_t) hndl->journal->tail + (off_t) sizeof(head));
+	if (size != (ssize_t) head.size || head.crc16 != crc16(0xffff, value, head.size))
+		goto out;
+
+	if ((int64_t) head.size < bufsize)
+		bufsize = (int64_t) head.size;
+	memcpy(data, value, bufsize);
+	(*readsize) = bufsize;
+	ret = 0;
+
+out:
+	(void) close(fd);
+	refop_free(value);
+
+	return ret;
+}
+
+/**
+ * Replay the journal from base file.  The handle tail state is updated when all valid records
+ * were replayed.  A value larger than the size limit of the handle is not replayed, it is not broken.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	limit	Maximum number of records to replay.
+ * @param [out]	pvalue	Replayed data, it shall be released by refop_free().  NULL is allowed.
+ * @param [out]	psize	Replayed data size.  NULL is allowed.
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval 1 Succeeded with recover.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+static int refop_journal_replay(refop_handle_t handle, int limit, uint8_t **pvalue, int64_t *psize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	char path[PATH_MAX];
+	s_refop_file_header_v6 head = { 0 };
+	uint8_t *cur = NULL, *next = NULL, *tmp = NULL;
+	int64_t cursize = 0, curcap = 0, nextcap = 0, limitsize = 0, tail = -1;
+	uint16_t base_crc16 = 0;
+	off_t offset = 0;
+	ssize_t size = 0;
+	int ret = -1, records = 0, fd = -1;
+	bool tail_invalid = false, clean_end = false;
+
+	if (refop_handle_path(handle, c_journal_suffix, path) < 0)
+		return -1;
+
+	// Buffers are sized by the base file and records, a base file larger than the limit fails.
+	limitsize = refop_get_config_handle_size_limit(handle);
+	ret = refop_file_pickup_alloc(handle, limitsize, &cur, &cursize);
+	if (ret < 0) {
+		refop_journal_reset(handle);
+		goto out;
+	}
+	curcap = cursize;
+	base_crc16 = crc16(0xffff, cur, cursize);
+
+	fd = open(path, (O_CLOEXEC | O_RDONLY | O_NOFOLLOW));
+	if (fd < 0)
+		clean_end = true;
+
+	while (fd >= 0 && records < limit) {
+		size = safe_pread(fd, &head, sizeof(head), offset);
+		if (size == 0) {
+			clean_end = true;
+			break;
+		}
+		if (size != sizeof(head) || refop_header_v6_validation(&head) != 0) {
+			tail_invalid = true;
+			break;
+		}
+
+		// Records of old base file are stale, those are not broken.
+		if (head.base_crc16 != base_crc16 || head.sequence != (uint32_t)(records + 1)) {
+			if (records > 0)
+				tail_invalid = true;
+			break;
+		}
+
+		// A value of a handle with larger size limit can not be replayed by this handle.
+		if ((int64_t) head.size > limitsize) {
+			ret = -1;
+			goto out;
+		}
+
+		if (next == NULL || (int64_t) head.size > nextcap) {
+			refop_free(next);
+			next = (uint8_t *) refop_malloc(head.size + 1);
+			if (next == NULL) {
+				ret = -1;
+				goto out;
+			}
+			nextcap = (int64_t) head.size;
+		}
+
+		size = safe_pread(fd, next, (size_t) head.size, offset + (off_t) sizeof(head));
+		if (size != (ssize_t) head.size || head.crc16 != crc16(0xffff, next, head.size)) {
+			tail_invalid = true;
+			break;
+		}
+
+		tmp = cur;
+		cur = next;
+		next = tmp;
+		nextcap = curcap;
+		curcap = (int64_t) head.size;
+		cursize = head.size;
+		tail = offset;
+		offset += (off_t)(sizeof(head) + head.size);
+		records++;
+	}
+
+	if (tail_invalid == true)
+		ret = 1;
+
+	if (limit == REFOP_JOURNAL_RECORDS_MAX) {
+		if (refop_journal_state_alloc(handle) < 0) {
+			ret = -1;
+			goto out;
+		}
+		hndl->journal->truncate = !clean_end;
+		hndl->journal->records = records;
+		hndl->journal->base_crc16 = base_crc16;
+		hndl->journal->offset = offset;
+		hndl->journal->tail = tail;
+	}
+
+	if (pvalue != NULL) {
+		(*pvalue) = cur;
+		(*psize) = cursize;
+		cur = NULL;
+	}
+
+out:
+	if (fd >= 0)
+		(void) close(fd);
+	refop_free(cur);
+	refop_free(next);
+
+	return ret;
+}
+
+/**
+ * Allocate the journal tail state of the handle.  The state is allocated at first use,
+ * handles of other modes do not have it.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 No memory.
+ */
+static int refop_journal_state_alloc(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if (hndl->journal == NULL) {
+		hndl->journal = (struct refop_journal_state *) refop_calloc(1, sizeof(struct refop_journal_state));
+		if (hndl->journal == NULL)
+			return -1;
+	}
+
+	return 0;
+}
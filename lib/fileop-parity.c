@@ -0,0 +1,521 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	fileop-parity.c
+ * @brief	Parity file operation functions
+ */
+#include "fileop.h"
+#include "crc16.h"
+#include "file-util.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+#include "static-configurator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+const char c_parity_suffix[] = ".par";
+
+static int refop_parity_load_table(int fd, off_t fsize, s_refop_file_header_v4 *head, uint16_t **ptable);
+
+/**
+ * Number of blocks for data size.
+ *
+ * @param [in]	size	The size of data block.
+ *
+ * @return uint64_t	Number of blocks.
+ */
+static inline uint64_t refop_parity_block_count(uint64_t size)
+{
+	return (size + REFOP_BLOCK_SIZE - 1) / REFOP_BLOCK_SIZE;
+}
+
+/**
+ * Number of parity blocks for data size.
+ *
+ * @param [in]	size	The size of data block.
+ * @param [in]	group	Number of data blocks per parity block.
+ *
+ * @return uint64_t	Number of parity blocks.
+ */
+static inline uint64_t refop_parity_group_count(uint64_t size, uint64_t group)
+{
+	return (refop_parity_block_count(size) + group - 1) / group;
+}
+
+/**
+ * XOR src to dst.  The loop use 64 bit word operation, it is vectorized by compiler.
+ *
+ * @param [in,out]	dst	Destination block.
+ * @param [in]	src	Source block.
+ * @param [in]	len	Length (bytes), shall be multiple of 8.
+ */
+static void refop_parity_xor(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	uint64_t d = 0, s = 0;
+
+	for (size_t i = 0; i < len; i += sizeof(uint64_t)) {
+		memcpy(&d, dst + i, sizeof(uint64_t));
+		memcpy(&s, src + i, sizeof(uint64_t));
+		d ^= s;
+		memcpy(dst + i, &d, sizeof(uint64_t));
+	}
+}
+
+/**
+ * This function write new data to parity file.
+ * The file image is header, crc table, data blocks, parity blocks, crc table and header.
+ * The header and the crc table are stored twice, the copy is at end of file.
+ * New file is written to temporary file and renamed, so there is no backup file.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Porinter to write data
+ * @param [in]	bufsize	Write dara size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 Lager than size limit.
+ */
+int refop_parity_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	char path[PATH_MAX], newfile[PATH_MAX];
+	uint8_t *pbuf = NULL, *pdata = NULL, *pparity = NULL, *pblock = NULL;
+	uint16_t *table = NULL;
+	uint64_t group = 0, nblocks = 0, ngroups = 0, i = 0;
+	size_t tablesize = 0, total = 0, blen = 0;
+	ssize_t wsize = 0;
+	int ret = -1, fd = -1;
+
+	if (bufsize > (int64_t) refop_get_config_handle_size_limit(handle) || bufsize <= 0)
+		return -2;
+
+	ret = refop_handle_path(handle, c_parity_suffix, path);
+	if (ret < 0)
+		return -1;
+
+	ret = refop_handle_path(handle, c_new_suffix, newfile);
+	if (ret < 0)
+		return -1;
+
+	group = (hndl->parity_group > 0) ? (uint64_t) hndl->parity_group : REFOP_PARITY_GROUP_DEFAULT;
+	nblocks = refop_parity_block_count((uint64_t) bufsize);
+	ngroups = refop_parity_group_count((uint64_t) bufsize, group);
+	tablesize = (nblocks + ngroups) * sizeof(uint16_t);
+	total = (sizeof(s_refop_file_header_v4) + tablesize) * 2 + (size_t) bufsize + ngroups * REFOP_BLOCK_SIZE;
+
+	// Fource remove new file - success and noent are both ok.
+	ret = unlink(newfile);
+	if (ret < 0) {
+		if (errno != ENOENT)
+			return -1;
+	}
+
+	// Create write buffer. To reduce sync write operation
+	pbuf = (uint8_t *) refop_calloc(1, total);
+	if (pbuf == NULL)
+		return -1;
+
+	table = (uint16_t *) (pbuf + sizeof(s_refop_file_header_v4));
+	pdata = pbuf + sizeof(s_refop_file_header_v4) + tablesize;
+	pparity = pdata + bufsize;
+	memcpy(pdata, data, bufsize);
+
+	for (i = 0; i < nblocks; i++) {
+		pblock = pdata + (i * REFOP_BLOCK_SIZE);
+		blen = ((i + 1) * REFOP_BLOCK_SIZE > (uint64_t) bufsize) ? (size_t)(bufsize - (i * REFOP_BLOCK_SIZE))
+									   : REFOP_BLOCK_SIZE;
+		table[i] = crc16(0xffff, pblock, blen);
+
+		// The last block is padded by zero in parity calculation.
+		if (blen == REFOP_BLOCK_SIZE) {
+			refop_parity_xor(pparity + ((i / group) * REFOP_BLOCK_SIZE), pblock, REFOP_BLOCK_SIZE);
+		} else {
+			for (size_t k = 0; k < blen; k++)
+				pparity[((i / group) * REFOP_BLOCK_SIZE) + k] ^= pblock[k];
+		}
+	}
+
+	for (i = 0; i < ngroups; i++)
+		table[nblocks + i] = crc16(0xffff, pparity + (i * REFOP_BLOCK_SIZE), REFOP_BLOCK_SIZE);
+
+	refop_header_v4_create((s_refop_file_header_v4 *) pbuf, crc16(0xffff, pdata, bufsize), bufsize,
+			       crc16(0xffff, (uint8_t *) table, tablesize), (uint16_t) group);
+
+	// Copy of crc table and header at end of file.
+	memcpy(pparity + (ngroups * REFOP_BLOCK_SIZE), table, tablesize);
+	memcpy(pparity + (ngroups * REFOP_BLOCK_SIZE) + tablesize, pbuf, sizeof(s_refop_file_header_v4));
+
+	fd = open(newfile, (O_CLOEXEC | O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW), (S_IRUSR | S_IWUSR));
+	if (fd < 0) {
+		refop_free(pbuf);
+		return -1;
+	}
+
+	wsize = safe_write(fd, pbuf, total);
+	refop_free(pbuf);
+	if (wsize != (ssize_t) total) {
+		(void) close(fd);
+		(void) unlink(newfile);
+		return -1;
+	}
+
+	// sync and close
+	(void) refop_fsync(handle, fd);
+	(void) close(fd);
+
+	ret = rename(newfile, path);
+	if (ret < 0) {
+		(void) unlink(newfile);
+		return -1;
+	}
+
+	(void) refop_dir_sync(handle);
+
+	return 0;
+}
+
+/**
+ * This function pick up data from parity file.
+ * When a data block was broken, it is reconstructed from parity block and other data blocks in
+ * same parity group.  One broken block per parity group is recoverable.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval 1 Succeeded with recover.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_parity_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	char path[PATH_MAX];
+	s_refop_file_header_v4 head = { 0 };
+	struct stat sb;
+	uint16_t *table = NULL;
+	uint8_t *pbuf = NULL, *pparity = NULL;
+	uint64_t group = 0, nblocks = 0, ngroups = 0, g = 0, i = 0, broken = 0;
+	off_t offset = 0;
+	size_t blen = 0;
+	ssize_t size = 0;
+	int ret = -3, result = -1, fd = -1;
+	int recovered = 0;
+
+	result = refop_handle_path(handle, c_parity_suffix, path);
+	if (result < 0)
+		return -1;
+
+	fd = open(path, (O_CLOEXEC | O_RDONLY | O_NOFOLLOW));
+	if (fd < 0) {
+		if (errno == ENOENT)
+			return -2;
+		return -3;
+	}
+
+	if (fstat(fd, &sb) < 0) {
+		ret = -1;
+		goto invalid;
+	}
+
+	result = refop_parity_load_table(fd, sb.st_size, &head, &table);
+	if (result < 0)
+		goto invalid;
+	else if (result == 1)
+		recovered = 1;
+
+	group = head.parity_group;
+	nblocks = refop_parity_block_count(head.size);
+	ngroups = refop_parity_group_count(head.size, group);
+	offset = (off_t)(sizeof(s_refop_file_header_v4) + (nblocks + ngroups) * sizeof(uint16_t));
+
+	// Data buffer is aligned to block size, padding area is zero.
+	pbuf = (uint8_t *) refop_calloc(nblocks + 1, REFOP_BLOCK_SIZE);
+	if (pbuf == NULL) {
+		ret = -1;
+		goto invalid;
+	}
+	pparity = pbuf + (nblocks * REFOP_BLOCK_SIZE);
+
+	// Short read is acceptable, missing blocks are reconstructed by parity.
+	size = safe_pread(fd, pbuf, (size_t) head.size, offset);
+	if (size < 0) {
+		ret = -1;
+		goto invalid;
+	}
+
+	if (head.crc16 == crc16(0xffff, pbuf, head.size))
+		goto valid;
+
+	for (g = 0; g < ngroups; g++) {
+		broken = nblocks;
+		for (i = g * group; i < nblocks && i < (g + 1) * group; i++) {
+			blen = ((i + 1) * REFOP_BLOCK_SIZE > head.size) ? (size_t)(head.size - (i * REFOP_BLOCK_SIZE))
+									: REFOP_BLOCK_SIZE;
+			if (table[i] == crc16(0xffff, pbuf + (i * REFOP_BLOCK_SIZE), blen))
+				continue;
+			if (broken != nblocks)
+				goto invalid; // Two or more broken blocks in a group, unrecoverable.
+			broken = i;
+		}
+		if (broken == nblocks)
+			continue;
+
+		size = safe_pread(fd, pparity, REFOP_BLOCK_SIZE,
+				  offset + (off_t) head.size + (off_t)(g * REFOP_BLOCK_SIZE));
+		if (size != REFOP_BLOCK_SIZE || table[nblocks + g] != crc16(0xffff, pparity, REFOP_BLOCK_SIZE))
+			goto invalid;
+
+		// Reconstruct broken block = parity xor other blocks.
+		for (i = g * group; i < nblocks && i < (g + 1) * group; i++) {
+			if (i != broken)
+				refop_parity_xor(pparity, pbuf + (i * REFOP_BLOCK_SIZE), REFOP_BLOCK_SIZE);
+		}
+
+		blen = ((broken + 1) * REFOP_BLOCK_SIZE > head.size) ? (size_t)(head.size - (broken * REFOP_BLOCK_SIZE))
+								     : REFOP_BLOCK_SIZE;
+		if (table[broken] != crc16(0xffff, pparity, blen))
+			goto invalid;
+
+		memcpy(pbuf + (broken * REFOP_BLOCK_SIZE), pparity, blen);
+		recovered = 1;
+	}
+
+	if (head.crc16 != crc16(0xffff, pbuf, head.size))
+		goto invalid;
+
+valid:
+	if ((int64_t) head.size > bufsize) {
+		memcpy(data, pbuf, bufsize);
+		(*readsize) = bufsize;
+	} else {
+		memcpy(data, pbuf, head.size);
+		(*readsize) = head.size;
+	}
+
+	ret = recovered;
+
+invalid:
+	refop_free(pbuf);
+	refop_free(table);
+	(void) close(fd);
+
+	return ret;
+}
+
+/**
+ * This function read indexed generation from parity file.
+ * The parity file has one generation only.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	n	Generation index. 0 is newest.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_parity_get_generation(
+	refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	int ret = -1;
+
+	if (n != 0)
+		return -2;
+
+	ret = refop_parity_pickup(handle, data, bufsize, readsize);
+	if (ret == 1)
+		ret = 0;
+
+	return ret;
+}
+
+/**
+ * This function remove parity file.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail.
+ */
+int refop_parity_remove(refop_handle_t handle)
+{
+	char path[PATH_MAX];
+	int result = 0, ret = -1;
+
+	ret = refop_handle_path(handle, c_new_suffix, path);
+	if (ret == 0) {
+		ret = unlink(path);
+		if (ret < 0) {
+			if (errno != ENOENT)
+				result = -1;
+		}
+	} else
+		result = -1;
+
+	ret = refop_handle_path(handle, c_parity_suffix, path);
+	if (ret == 0) {
+		ret = unlink(path);
+		if (ret < 0) {
+			if (errno != ENOENT)
+				result = -1;
+		}
+	} else
+		result = -1;
+
+	return result;
+}
+
+/**
+ * The refop header (version 4) create from args.
+ *
+ * @param [in]	head	Pointer for file header.
+ * @param [in]	crc16value	The crc value of data block.
+ * @param [in]	sizevalue	The size of data block.
+ * @param [in]	table_crc16value	The crc value of block crc table.
+ * @param [in]	group	Number of data blocks per parity block.
+ */
+void refop_header_v4_create(s_refop_file_header_v4 *head, uint16_t crc16value, uint64_t sizevalue,
+			    uint16_t table_crc16value, uint16_t group)
+{
+	head->magic = REFOP_FILE_HEADER_MAGIC;
+
+	head->version = REFOP_FILE_HEADER_VERSION_V4;
+	head->version_inv = ~head->version;
+
+	head->crc16 = crc16value;
+	head->crc16_inv = ~head->crc16;
+
+	head->size = sizevalue;
+	head->size_inv = ~head->size;
+
+	head->block_size = REFOP_BLOCK_SIZE;
+	head->block_size_inv = ~head->block_size;
+
+	head->table_crc16 = table_crc16value;
+	head->table_crc16_inv = ~head->table_crc16;
+
+	head->parity_group = group;
+	head->parity_group_inv = ~head->parity_group;
+}
+
+/**
+ * The refop header (version 4) validation
+ *
+ * @param [in]	head	Pointer for file header.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Invalid header.
+ */
+int refop_header_v4_validation(const s_refop_file_header_v4 *head)
+{
+	int ret = -1;
+
+	// magic check
+	if (head->magic != (uint32_t) REFOP_FILE_HEADER_MAGIC)
+		goto invalid;
+
+	// header format version check
+	if (head->version == (uint32_t)(~head->version_inv)) {
+		if (head->version != REFOP_FILE_HEADER_VERSION_V4)
+			goto invalid;
+	} else
+		goto invalid;
+
+	// crc16 value check
+	if ((head->crc16 ^ head->crc16_inv) != 0xffff)
+		goto invalid;
+
+	// data size check
+	if (head->size != (uint64_t)(~head->size_inv) || head->size > REFOP_DATA_SIZE_LIMIT_MAX)
+		goto invalid;
+
+	// block size check, this version support fixed block size only.
+	if (head->block_size != (uint32_t)(~head->block_size_inv) || head->block_size != REFOP_BLOCK_SIZE)
+		goto invalid;
+
+	// table crc16 value check
+	if ((head->table_crc16 ^ head->table_crc16_inv) != 0xffff)
+		goto invalid;
+
+	// parity group check
+	if ((head->parity_group ^ head->parity_group_inv) != 0xffff || head->parity_group == 0)
+		goto invalid;
+
+	ret = 0;
+
+invalid:
+	return ret;
+}
+
+/**
+ * Read and validate the header and the crc table.  When the copy at top of file was broken,
+ * the copy at end of file is used.
+ *
+ * @param [in]	fd	File descriptor of target file.
+ * @param [in]	fsize	File size.
+ * @param [out]	head	Pointer for file header.
+ * @param [out]	ptable	Allocated crc table. It shall be released by refop_free().
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval  1 succeeded using the copy at end of file.
+ * @retval -1 Abnormal fail.
+ * @retval -3 Invalid header or table.
+ */
+static int refop_parity_load_table(int fd, off_t fsize, s_refop_file_header_v4 *head, uint16_t **ptable)
+{
+	uint16_t *table = NULL;
+	size_t tablesize = 0;
+	off_t hoffset = 0, toffset = 0;
+	ssize_t size = 0;
+
+	for (int copy = 0; copy < 2; copy++) {
+		hoffset = (copy == 0) ? 0 : fsize - (off_t) sizeof(s_refop_file_header_v4);
+		if (hoffset < 0)
+			break;
+
+		size = safe_pread(fd, head, sizeof(s_refop_file_header_v4), hoffset);
+		if (size != sizeof(s_refop_file_header_v4) || refop_header_v4_validation(head) != 0)
+			continue;
+
+		tablesize = (refop_parity_block_count(head->size) + refop_parity_group_count(head->size, head->parity_group)) *
+			    sizeof(uint16_t);
+		toffset = (copy == 0) ? (off_t) sizeof(s_refop_file_header_v4) : hoffset - (off_t) tablesize;
+		if (toffset < 0)
+			continue;
+
+		table = (uint16_t *) refop_malloc(tablesize);
+		if (table == NULL)
+			return -1;
+
+		size = safe_pread(fd, table, tablesize, toffset);
+		if (size == (ssize_t) tablesize && head->table_crc16 == crc16(0xffff, (uint8_t *) table, tablesize)) {
+			(*ptable) = table;
+			return copy;
+		}
+
+		refop_free(table);
+		table = NULL;
+	}
+
+	return -3;
+}
@@ -0,0 +1,476 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	fileop-pingpong.c
+ * @brief	ping-pong file operation functions
+ */
+#include "fileop.h"
+#include "crc16.h"
+#include "file-util.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+#include "static-configurator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+static int refop_pingpong_count(refop_handle_t handle);
+static int refop_pingpong_path(refop_handle_t handle, int index, char *path);
+static int refop_pingpong_open(const char *path, s_refop_file_header_v2 *head, int *pfd);
+static int refop_pingpong_read_data(
+	int fd, const s_refop_file_header_v2 *head, uint8_t *data, int64_t bufsize, int64_t *readsize);
+static int refop_pingpong_scan(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize);
+static void refop_pingpong_close(int *fd, int count);
+
+/**
+ * This function write new data to oldest file of ping-pong files.
+ * Default ping-pong files are two files (one backup). When the backup count is N,
+ * N + 1 files are used as ring and the generation number decides those order.
+ * The oldest file is overwritten in place and only that file is synced.
+ * There are no rename and no directory sync in steady state.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Porinter to write data
+ * @param [in]	bufsize	Write dara size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 Lager than size limit.
+ */
+int refop_pingpong_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	char path[PATH_MAX];
+	uint8_t *pbuf = NULL;
+	uint64_t generation = 0;
+	size_t total = 0;
+	ssize_t wsize = 0;
+	int ret = -1, fd = -1, target = 0;
+	bool created = false;
+
+	if (bufsize > (int64_t) refop_get_config_handle_size_limit(handle) || bufsize <= 0)
+		return -2;
+
+	// The handle does not know current file state, check once.
+	if (hndl->slot_cached == false) {
+		ret = refop_pingpong_scan(handle, NULL, 0, NULL);
+		if (ret == -1)
+			return -1;
+	}
+
+	// Overwrite target is the oldest or the broken file, never a newest valid file.
+	if (hndl->slot_cached == true)
+		target = hndl->slot_next;
+	generation = hndl->generation + 1;
+
+	ret = refop_pingpong_path(handle, target, path);
+	if (ret < 0)
+		return -1;
+
+	// Create write buffer. To reduce sync write operation
+	total = (size_t) bufsize + sizeof(s_refop_file_header_v2);
+	pbuf = refop_scratch_alloc(handle, total);
+	if (pbuf == NULL)
+		return -1;
+
+	memcpy(pbuf + sizeof(s_refop_file_header_v2), data, bufsize);
+	refop_header_v2_create(
+		(s_refop_file_header_v2 *) pbuf,
+		crc16(0xffff, pbuf + sizeof(s_refop_file_header_v2), bufsize),
+		bufsize,
+		generation);
+
+	fd = open(path, (O_CLOEXEC | O_WRONLY | O_NOFOLLOW));
+	if (fd < 0 && errno == ENOENT) {
+		// Initial write only, need to create a file.
+		fd = open(path, (O_CLOEXEC | O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW), (S_IRUSR | S_IWUSR));
+		created = true;
+	}
+	if (fd < 0) {
+		refop_scratch_free(handle, pbuf);
+		return -1;
+	}
+
+	wsize = safe_write(fd, pbuf, total);
+	refop_scratch_free(handle, pbuf);
+	if (wsize != (ssize_t) total)
+		goto error;
+
+	// When new data is smaller than old data, drop old tail.
+	if (ftruncate(fd, (off_t) total) < 0)
+		goto error;
+
+	if (refop_fsync(handle, fd) < 0)
+		goto error;
+
+	(void) close(fd);
+
+	if (created == true)
+		(void) refop_dir_sync(handle);
+
+	hndl->slot_latest = target;
+	hndl->slot_next = (target + 1) % refop_pingpong_count(handle);
+	hndl->generation = generation;
+	hndl->slot_cached = true;
+
+	return 0;
+
+error:
+	(void) close(fd);
+	return -1;
+}
+
+/**
+ * This function pick up newest valid data from ping-pong files.
+ * The newest valid data is selected by generation number.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval 1 Succeeded with recover.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_pingpong_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return refop_pingpong_scan(handle, data, bufsize, readsize);
+}
+
+/**
+ * This function read indexed generation from ping-pong files.
+ * Files are ordered by generation number in the header, and the data of n-th newest file is read.
+ * Only n + 1 headers and one data block are read.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	n	Generation index. 0 is newest.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_pingpong_get_generation(
+	refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	s_refop_file_header_v2 head[REFOP_PINGPONG_FILES_MAX];
+	int fd[REFOP_PINGPONG_FILES_MAX], state[REFOP_PINGPONG_FILES_MAX];
+	char path[PATH_MAX];
+	int count = 0, index = -1, ret = -1;
+
+	count = refop_pingpong_count(handle);
+	if (n < 0 || n >= count)
+		return -2;
+
+	for (int i = 0; i < count; i++) {
+		fd[i] = -1;
+		state[i] = -1;
+		if (refop_pingpong_path(handle, i, path) == 0)
+			state[i] = refop_pingpong_open(path, &head[i], &fd[i]);
+	}
+
+	// Select n-th newest file in valid header files.
+	for (int k = 0; k <= n; k++) {
+		index = -1;
+		for (int i = 0; i < count; i++) {
+			if (state[i] != 0)
+				continue;
+			if (index < 0 || head[i].generation > head[index].generation)
+				index = i;
+		}
+		if (index < 0)
+			break;
+		if (k < n)
+			state[index] = 1; // Skip
+	}
+
+	if (index < 0) {
+		ret = -2;
+	} else {
+		ret = refop_pingpong_read_data(fd[index], &head[index], data, bufsize, readsize);
+		if (ret == -2)
+			ret = -3;
+	}
+
+	refop_pingpong_close(fd, count);
+
+	return ret;
+}
+
+/**
+ * This function remove all files of ping-pong files.
+ * Files that are over the current backup count are removed too.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail.
+ */
+int refop_pingpong_remove(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	char path[PATH_MAX];
+	int result = 0, ret = -1;
+
+	for (int i = 0; i < REFOP_PINGPONG_FILES_MAX; i++) {
+		ret = refop_pingpong_path(handle, i, path);
+		if (ret < 0) {
+			result = -1;
+			continue;
+		}
+
+		ret = unlink(path);
+		if (ret < 0) {
+			if (errno != ENOENT)
+				result = -1;
+		}
+	}
+
+	hndl->slot_cached = false;
+	hndl->generation = 0;
+
+	return result;
+}
+
+/**
+ * Number of ping-pong files of the handle.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return int	Number of files (backup count + 1).
+ */
+static int refop_pingpong_count(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if (hndl->backup_count <= 0)
+		return REFOP_PINGPONG_FILES;
+
+	return hndl->backup_count + 1;
+}
+
+/**
+ * Close all opened file descriptors.
+ *
+ * @param [in]	fd	File descriptor array.
+ * @param [in]	count	Number of file descriptors.
+ */
+static void refop_pingpong_close(int *fd, int count)
+{
+	for (int i = 0; i < count; i++) {
+		if (fd[i] >= 0)
+			(void) close(fd[i]);
+	}
+}
+
+/**
+ * Create a file path of ping-pong file.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	index	File index.
+ * @param [out]	path	Output buffer, it shall have PATH_MAX byte.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Too long path.
+ */
+static int refop_pingpong_path(refop_handle_t handle, int index, char *path)
+{
+	char suffix[16];
+
+	(void) snprintf(suffix, sizeof(suffix), ".g%d", index);
+
+	return refop_handle_path(handle, suffix, path);
+}
+
+/**
+ * Open a ping-pong file and read the header.
+ * When the header is valid, the file descriptor is returned via pfd.
+ *
+ * @param [in]	path	File name with path.
+ * @param [out]	head	Read header.
+ * @param [out]	pfd	Opened file descriptor.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 No file entry.
+ * @retval -2 Invalid file.
+ */
+static int refop_pingpong_open(const char *path, s_refop_file_header_v2 *head, int *pfd)
+{
+	ssize_t size = 0;
+	int fd = -1;
+
+	(*pfd) = -1;
+
+	fd = open(path, (O_CLOEXEC | O_RDONLY | O_NOFOLLOW));
+	if (fd < 0) {
+		if (errno == ENOENT)
+			return -1;
+		return -2;
+	}
+
+	size = safe_read(fd, head, sizeof(s_refop_file_header_v2));
+	if (size != sizeof(s_refop_file_header_v2) || refop_header_v2_validation(head) != 0) {
+		(void) close(fd);
+		return -2;
+	}
+
+	(*pfd) = fd;
+
+	return 0;
+}
+
+/**
+ * Read data block of ping-pong file with validation.
+ * When data is NULL, this function does only validation.
+ *
+ * @param [in]	fd	File descriptor that is positioned to data block.
+ * @param [in]	head	Validated header.
+ * @param [in]	data	Read data buffer (nullable).
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size (nullable).
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Abnormal fail.
+ * @retval -2 Invalid data.
+ */
+static int refop_pingpong_read_data(
+	int fd, const s_refop_file_header_v2 *head, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	int ret = -1;
+
+	if (head->size > REFOP_DATA_SIZE_LIMIT_MAX)
+		return -2;
+
+	// Data larger than buffer is verified by streaming, no heap memory is needed.
+	ret = refop_data_read_verify(fd, -1, head->size, head->crc16, data, bufsize);
+	if (ret < 0)
+		return -2;
+
+	if (data != NULL) {
+		if ((int64_t) head->size > bufsize)
+			(*readsize) = bufsize;
+		else
+			(*readsize) = head->size;
+	}
+
+	return 0;
+}
+
+/**
+ * Scan ping-pong files and select the newest valid one.
+ * This function update the file state cache in the handle.
+ * Next write target is a missing or broken file that is nearest to the newest valid file in ring
+ * order.  When all files are valid, the next write target is the oldest file.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Read data buffer (nullable).
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size (nullable).
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval 1 Succeeded with recover.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+static int refop_pingpong_scan(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	s_refop_file_header_v2 head[REFOP_PINGPONG_FILES_MAX];
+	int fd[REFOP_PINGPONG_FILES_MAX], state[REFOP_PINGPONG_FILES_MAX];
+	char path[PATH_MAX];
+	uint64_t maxgen = 0;
+	int result = -2, ret = -1, index = -1, next = -1, count = 0;
+	bool broken = false;
+
+	count = refop_pingpong_count(handle);
+
+	for (int i = 0; i < count; i++) {
+		fd[i] = -1;
+		state[i] = -1;
+		if (refop_pingpong_path(handle, i, path) == 0)
+			state[i] = refop_pingpong_open(path, &head[i], &fd[i]);
+
+		if (state[i] == 0) {
+			if (head[i].generation > maxgen)
+				maxgen = head[i].generation;
+		} else if (state[i] == -2)
+			broken = true;
+	}
+
+	// Try valid header files in order of generation, newer first.
+	for (;;) {
+		index = -1;
+		for (int i = 0; i < count; i++) {
+			if (state[i] != 0)
+				continue;
+			if (index < 0 || head[i].generation > head[index].generation)
+				index = i;
+		}
+		if (index < 0)
+			break;
+
+		ret = refop_pingpong_read_data(fd[index], &head[index], data, bufsize, readsize);
+		if (ret == 0) {
+			result = (broken == true) ? 1 : 0;
+			break;
+		} else if (ret == -1) {
+			result = -1;
+			break;
+		}
+		state[index] = -2;
+		broken = true;
+	}
+
+	refop_pingpong_close(fd, count);
+
+	if (result >= 0) {
+		// Select next write target.
+		for (int k = 1; k < count; k++) {
+			int i = (index + k) % count;
+			if (state[i] != 0) {
+				next = i;
+				break;
+			}
+			if (next < 0 || head[i].generation < head[next].generation)
+				next = i;
+		}
+	} else if (result == -2 && broken == true)
+		result = -3;
+
+	// Concurrent gets of thread safe handle scan at same time.
+	refop_handle_cache_lock(handle);
+	if (result >= 0) {
+		hndl->slot_latest = index;
+		hndl->slot_next = next;
+		hndl->slot_cached = true;
+	}
+
+	// Next generation shall be larger than all of existing generation.
+	if (result != -1 && maxgen > hndl->generation)
+		hndl->generation = maxgen;
+	refop_handle_cache_unlock(handle);
+
+	return result;
+}
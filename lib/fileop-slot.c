@@ -0,0 +1,473 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	fileop-slot.c
+ * @brief	A/B slot file operation functions
+ */
+#include "fileop.h"
+#include "crc16.h"
+#include "file-util.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+#include "static-configurator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+const char c_slot_suffix[] = ".ab";
+
+static int refop_slot_open(refop_handle_t handle, bool create, int *pfd, int64_t *pstride);
+static int refop_slot_create(refop_handle_t handle, const char *path);
+static int refop_slot_scan(
+	refop_handle_t handle, int fd, int64_t stride, uint8_t *data, int64_t bufsize, int64_t *readsize);
+
+/**
+ * This function write new data to older slot of A/B slot file.
+ * The slot file is preallocated at first write, after that set operation is only
+ * pwrite and fdatasync.  The file extent never change.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Porinter to write data
+ * @param [in]	bufsize	Write dara size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 Lager than size limit or slot capacity.
+ */
+int refop_slot_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	uint8_t *pbuf = NULL;
+	uint64_t generation = 0;
+	int64_t stride = 0;
+	size_t total = 0;
+	ssize_t wsize = 0;
+	int ret = -1, fd = -1, target = 0;
+
+	if (bufsize > (int64_t) refop_get_config_handle_size_limit(handle) || bufsize <= 0)
+		return -2;
+
+	ret = refop_slot_open(handle, true, &fd, &stride);
+	if (ret < 0)
+		return (ret == -3) ? -2 : -1;
+
+	total = (size_t) bufsize + sizeof(s_refop_file_header_v2);
+	if ((int64_t) total > stride) {
+		(void) close(fd);
+		return -2;
+	}
+
+	// The handle does not know current slot state, check once.
+	if (hndl->slot_cached == false) {
+		ret = refop_slot_scan(handle, fd, stride, NULL, 0, NULL);
+		if (ret == -1) {
+			(void) close(fd);
+			return -1;
+		}
+	}
+
+	// Overwrite target is not a newest valid slot.
+	if (hndl->slot_cached == true)
+		target = (hndl->slot_latest + 1) % REFOP_SLOT_COUNT;
+	generation = hndl->generation + 1;
+
+	// Create write buffer. To reduce sync write operation
+	pbuf = refop_scratch_alloc(handle, total);
+	if (pbuf == NULL) {
+		(void) close(fd);
+		return -1;
+	}
+
+	memcpy(pbuf + sizeof(s_refop_file_header_v2), data, bufsize);
+	refop_header_v2_create(
+		(s_refop_file_header_v2 *) pbuf,
+		crc16(0xffff, pbuf + sizeof(s_refop_file_header_v2), bufsize),
+		bufsize,
+		generation);
+
+	wsize = safe_pwrite(fd, pbuf, total, (off_t)(stride * target));
+	refop_scratch_free(handle, pbuf);
+	if (wsize != (ssize_t) total)
+		goto error;
+
+	if (refop_fdatasync(handle, fd) < 0)
+		goto error;
+
+	(void) close(fd);
+
+	hndl->slot_latest = target;
+	hndl->generation = generation;
+	hndl->slot_cached = true;
+
+	return 0;
+
+error:
+	(void) close(fd);
+	return -1;
+}
+
+/**
+ * This function pick up newest valid data from A/B slot file.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval 1 Succeeded with recover.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_slot_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	int64_t stride = 0;
+	int ret = -1, fd = -1;
+
+	ret = refop_slot_open(handle, false, &fd, &stride);
+	if (ret == -1)
+		return -2;
+	else if (ret < 0)
+		return -3;
+
+	ret = refop_slot_scan(handle, fd, stride, data, bufsize, readsize);
+	(void) close(fd);
+
+	return ret;
+}
+
+/**
+ * This function read indexed generation from A/B slot file.
+ * Slots are ordered by generation number in the header, and the data of n-th newest slot is read.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	n	Generation index. 0 is newest.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_slot_get_generation(
+	refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	s_refop_file_header_v2 head[REFOP_SLOT_COUNT];
+	int64_t stride = 0;
+	ssize_t size = 0;
+	int order[REFOP_SLOT_COUNT];
+	int valid = 0, index = -1, ret = -1, fd = -1;
+
+	if (n < 0 || n >= REFOP_SLOT_COUNT)
+		return -2;
+
+	ret = refop_slot_open(handle, false, &fd, &stride);
+	if (ret == -1)
+		return -2;
+	else if (ret < 0)
+		return -3;
+
+	// Collect valid slots in order of generation, newer first.
+	for (int i = 0; i < REFOP_SLOT_COUNT; i++) {
+		size = safe_pread(fd, &head[i], sizeof(s_refop_file_header_v2), (off_t)(stride * i));
+		if (size != sizeof(s_refop_file_header_v2) || refop_header_v2_validation(&head[i]) != 0)
+			continue;
+		if ((int64_t) head[i].size > stride - (int64_t) sizeof(s_refop_file_header_v2))
+			continue;
+
+		order[valid] = i;
+		for (int k = valid; k > 0 && head[order[k]].generation > head[order[k - 1]].generation; k--) {
+			int tmp = order[k];
+			order[k] = order[k - 1];
+			order[k - 1] = tmp;
+		}
+		valid++;
+	}
+
+	if (n >= valid) {
+		(void) close(fd);
+		return -2;
+	}
+	index = order[n];
+
+	ret = -3;
+	if (refop_data_read_verify(fd, (off_t)(stride * index + (int64_t) sizeof(s_refop_file_header_v2)),
+				   head[index].size, head[index].crc16, data, bufsize) == 0) {
+		if ((int64_t) head[index].size > bufsize)
+			(*readsize) = bufsize;
+		else
+			(*readsize) = head[index].size;
+		ret = 0;
+	}
+
+	(void) close(fd);
+
+	return ret;
+}
+
+/**
+ * This function remove A/B slot file.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail.
+ */
+int refop_slot_remove(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	char path[PATH_MAX];
+	int result = 0, ret = -1;
+
+	ret = refop_handle_path(handle, c_new_suffix, path);
+	if (ret == 0) {
+		ret = unlink(path);
+		if (ret < 0) {
+			if (errno != ENOENT)
+				result = -1;
+		}
+	} else
+		result = -1;
+
+	ret = refop_handle_path(handle, c_slot_suffix, path);
+	if (ret == 0) {
+		ret = unlink(path);
+		if (ret < 0) {
+			if (errno != ENOENT)
+				result = -1;
+		}
+	} else
+		result = -1;
+
+	hndl->slot_cached = false;
+	hndl->generation = 0;
+
+	return result;
+}
+
+/**
+ * Open the A/B slot file.  The slot stride is decided by file size.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	create	When true and no file, the slot file is created.
+ * @param [out]	pfd	Opened file descriptor.
+ * @param [out]	pstride	Slot stride (bytes).
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 No file entry.
+ * @retval -2 Abnormal fail or invalid file geometry.
+ * @retval -3 Could not create, slot capacity was not set.
+ */
+static int refop_slot_open(refop_handle_t handle, bool create, int *pfd, int64_t *pstride)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	char path[PATH_MAX];
+	struct stat sb;
+	int ret = -1, fd = -1;
+
+	ret = refop_handle_path(handle, c_slot_suffix, path);
+	if (ret < 0)
+		return -2;
+
+	fd = open(path, (O_CLOEXEC | O_RDWR | O_NOFOLLOW));
+	if (fd < 0 && errno == ENOENT && create == true) {
+		if (hndl->slot_capacity <= 0)
+			return -3;
+
+		// Initial write only, preallocate the slot file.
+		ret = refop_slot_create(handle, path);
+		if (ret < 0)
+			return -2;
+
+		fd = open(path, (O_CLOEXEC | O_RDWR | O_NOFOLLOW));
+	}
+	if (fd < 0) {
+		if (errno == ENOENT)
+			return -1;
+		return -2;
+	}
+
+	ret = fstat(fd, &sb);
+	if (ret < 0 || sb.st_size <= 0 || (sb.st_size % REFOP_SLOT_COUNT) != 0) {
+		(void) close(fd);
+		return -2;
+	}
+
+	(*pfd) = fd;
+	(*pstride) = sb.st_size / REFOP_SLOT_COUNT;
+
+	return 0;
+}
+
+/**
+ * Create preallocated A/B slot file.
+ * The file is created in the new file name and renamed to the slot file name.
+ * Therefore, interrupted creation never leave a incomplete slot file.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	path	Slot file name with path.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Abnormal fail.
+ */
+static int refop_slot_create(refop_handle_t handle, const char *path)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	int64_t stride = 0;
+	int ret = -1, fd = -1;
+	char newfile[PATH_MAX];
+
+	stride = (int64_t) sizeof(s_refop_file_header_v2) + hndl->slot_capacity;
+	stride = (stride + REFOP_SLOT_ALIGN - 1) / REFOP_SLOT_ALIGN * REFOP_SLOT_ALIGN;
+
+	if (refop_handle_path(handle, c_new_suffix, newfile) < 0)
+		return -1;
+
+	// Fource remove new file - success and noent are both ok.
+	ret = unlink(newfile);
+	if (ret < 0) {
+		if (errno != ENOENT)
+			return -1;
+	}
+
+	fd = open(newfile, (O_CLOEXEC | O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW), (S_IRUSR | S_IWUSR));
+	if (fd < 0)
+		return -1;
+
+	ret = posix_fallocate(fd, 0, (off_t)(stride * REFOP_SLOT_COUNT));
+	if (ret != 0)
+		goto error;
+
+	if (refop_fsync(handle, fd) < 0)
+		goto error;
+
+	(void) close(fd);
+
+	ret = rename(newfile, path);
+	if (ret < 0) {
+		(void) unlink(newfile);
+		return -1;
+	}
+
+	(void) refop_dir_sync(handle);
+
+	return 0;
+
+error:
+	(void) close(fd);
+	(void) unlink(newfile);
+	return -1;
+}
+
+/**
+ * Scan A/B slots and select the newest valid one.
+ * This function update the slot state cache in the handle.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	fd	Slot file descriptor.
+ * @param [in]	stride	Slot stride (bytes).
+ * @param [in]	data	Read data buffer (nullable).
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size (nullable).
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval 1 Succeeded with recover.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+static int refop_slot_scan(
+	refop_handle_t handle, int fd, int64_t stride, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	static const s_refop_file_header_v2 c_empty_header = { 0 };
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	s_refop_file_header_v2 head[REFOP_SLOT_COUNT];
+	int state[REFOP_SLOT_COUNT];
+	uint64_t maxgen = 0;
+	ssize_t size = 0;
+	int result = -2, index = -1;
+	bool broken = false;
+
+	for (int i = 0; i < REFOP_SLOT_COUNT; i++) {
+		state[i] = -2;
+		size = safe_pread(fd, &head[i], sizeof(s_refop_file_header_v2), (off_t)(stride * i));
+		if (size != sizeof(s_refop_file_header_v2))
+			state[i] = -2;
+		else if (memcmp(&head[i], &c_empty_header, sizeof(c_empty_header)) == 0)
+			state[i] = -1; // Never written slot
+		else if (refop_header_v2_validation(&head[i]) == 0) {
+			if ((int64_t) head[i].size > stride - (int64_t) sizeof(s_refop_file_header_v2))
+				state[i] = -2;
+			else
+				state[i] = 0;
+		}
+
+		if (state[i] == 0) {
+			if (head[i].generation > maxgen)
+				maxgen = head[i].generation;
+		} else if (state[i] == -2)
+			broken = true;
+	}
+
+	// Try valid slots in order of generation, newer first.
+	for (;;) {
+		index = -1;
+		for (int i = 0; i < REFOP_SLOT_COUNT; i++) {
+			if (state[i] != 0)
+				continue;
+			if (index < 0 || head[i].generation > head[index].generation)
+				index = i;
+		}
+		if (index < 0)
+			break;
+
+		if (refop_data_read_verify(fd, (off_t)(stride * index + (int64_t) sizeof(s_refop_file_header_v2)),
+					   head[index].size, head[index].crc16, data, bufsize) == 0) {
+			if (data != NULL) {
+				if ((int64_t) head[index].size > bufsize)
+					(*readsize) = bufsize;
+				else
+					(*readsize) = head[index].size;
+			}
+			result = (broken == true) ? 1 : 0;
+			break;
+		}
+
+		state[index] = -2;
+		broken = true;
+	}
+
+	if (result == -2 && broken == true)
+		result = -3;
+
+	// Concurrent gets of thread safe handle scan at same time.
+	refop_handle_cache_lock(handle);
+	if (result >= 0) {
+		hndl->slot_latest = index;
+		hndl->slot_cached = true;
+	}
+
+	// Next generation shall be larger than all of existing generation.
+	if (result != -1 && maxgen > hndl->generation)
+		hndl->generation = maxgen;
+	refop_handle_cache_unlock(handle);
+
+	return result;
+}
@@ -8,6 +8,7 @@
 #include "crc16.h"
 #include "file-util.h"
 #include "librefop.h"
+#include "refop-alloc.h"
 #include "static-configurator.h"
 
 #include <stdio.h>
@@ -23,7 +24,6 @@
 
 int refop_file_get_with_validation(const char *file, uint8_t *data, int64_t bufsize, int64_t *readsize);
 void refop_header_create(s_refop_file_header *head, uint16_t crc16value, uint64_t sizevalue);
-int refop_header_validation(const s_refop_file_header *head);
 int refop_file_test(const char *filename);
 
 /**
@@ -45,56 +45,156 @@ int refop_new_file_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
 	ssize_t wsize = 0;
 	uint8_t *pbuf = NULL, *pdata = NULL;
 	uint16_t crc16value = 0;
-	int new_state = 0;
+	size_t total = 0;
+	char newfile[PATH_MAX];
 
-	if (bufsize > refop_get_config_data_size_limit() || bufsize <= 0)
+	if (bufsize > (int64_t) refop_get_config_handle_size_limit(handle) || bufsize <= 0)
 		return -2;
 
+	if (refop_handle_path(handle, c_new_suffix, newfile) < 0)
+		return -1;
+
 	// Fource remove new file - success and noent are both ok.
-	ret = unlink(hndl->newfile);
+	ret = unlink(newfile);
 	if (ret < 0) {
 		if (errno != ENOENT)
 			return -1;
 	}
 
+	// Direct I/O format use aligned buffer and O_DIRECT write.
+	if (hndl->direct_io == true)
+		return refop_direct_file_write(handle, newfile, data, bufsize);
+
 	// Create write buffer. To reduce sync write operation
-	pbuf = (uint8_t *) malloc(bufsize + sizeof(s_refop_file_header));
-	if (pbuf == NULL)
-		return -1;
+	if (hndl->compression == true) {
+		// When compression has no gain, buffer is not created and other format is used.
+		if (refop_compress_buffer_create(data, bufsize, &pbuf, &total) < 0)
+			return -1;
+	}
 
-	// Create write data
-	pdata = pbuf + sizeof(s_refop_file_header);
-	memcpy(pdata, data, bufsize);
-	crc16value = crc16(0xffff, pdata, bufsize);
+	if (pbuf == NULL && hndl->block_checksum == true) {
+		pbuf = refop_block_buffer_create(data, bufsize, &total);
+		if (pbuf == NULL)
+			return -1;
+	} else if (pbuf == NULL) {
+		total = bufsize + sizeof(s_refop_file_header);
+		pbuf = refop_scratch_alloc(handle, total);
+		if (pbuf == NULL)
+			return -1;
 
-	refop_header_create((s_refop_file_header *) pbuf, crc16value, bufsize);
+		// Create write data
+		pdata = pbuf + sizeof(s_refop_file_header);
+		memcpy(pdata, data, bufsize);
+		crc16value = crc16(0xffff, pdata, bufsize);
 
-	fd = open(hndl->newfile, (O_CLOEXEC | O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW), (S_IRUSR | S_IWUSR));
+		refop_header_create((s_refop_file_header *) pbuf, crc16value, bufsize);
+	}
+
+	fd = open(newfile, (O_CLOEXEC | O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW), (S_IRUSR | S_IWUSR));
 	if (fd < 0) {
 		// All open error couldnt recover.
-		free(pbuf);
+		refop_scratch_free(handle, pbuf);
 		return -1;
 	}
 
-	wsize = safe_write(fd, pbuf, bufsize + sizeof(s_refop_file_header));
+	wsize = safe_write(fd, pbuf, total);
 	if (wsize < 0) {
 		(void) close(fd);
-		free(pbuf);
+		refop_scratch_free(handle, pbuf);
 		return -1;
 	}
 
 	// sync and close
-	(void) fsync(fd);
+	(void) refop_fsync(handle, fd);
 	(void) close(fd);
-	free(pbuf);
+	refop_scratch_free(handle, pbuf);
 
 	return 0;
 }
 
 
+/**
+ * Probe the files of rotation mode and classify the recovery state (ac1 to ac7 in README file).
+ * The result is cached in the handle and it is kept by following file rotation.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return int
+ * @retval 1-7 Recovery state, 1 is ac1 (no data).
+ * @retval -1 Abnormal fail. The cached state is cleared.
+ */
+int refop_file_state_probe(refop_handle_t handle)
+{
+	// Index is the state bits of latest, backup and new file.
+	static const int8_t c_recovery_state[] = { 1, 2, 3, 4, 1, 5, 6, 7 };
+	const char *suffixes[] = { "", c_bk1_suffix, c_new_suffix };
+	const uint8_t bits[] = { REFOP_FILE_STATE_LATEST, REFOP_FILE_STATE_BACKUP, REFOP_FILE_STATE_NEW };
+	char path[PATH_MAX];
+	uint8_t state = REFOP_FILE_STATE_VALID;
+	int ret = -1;
+
+	handle->file_state = 0;
+
+	for (int i = 0; i < 3; i++) {
+		if (refop_handle_path(handle, suffixes[i], path) < 0)
+			return -1;
+
+		ret = refop_file_test(path);
+		if (ret <= -2)
+			return -1;
+		if (ret == 0)
+			state |= bits[i];
+	}
+
+	handle->file_state = state;
+
+	return c_recovery_state[state & (REFOP_FILE_STATE_LATEST | REFOP_FILE_STATE_BACKUP | REFOP_FILE_STATE_NEW)];
+}
+
+/**
+ * File rotation by the cached file state.  The state is validated by the result of rename, so it does
+ * not need stat.  When the latest file was removed by another process, rename of the latest file fails.
+ * When the latest file was created by another process, rename without replace fails.  The backup file
+ * is replaced by the rename, it is kept when the rename fails.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	latestfile	Latest file path.
+ * @param [in]	backupfile1	Backup file path.
+ * @param [in]	newfile	New file path.
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 The cached state was not valid, nothing was renamed.
+ */
+static int refop_file_rotation_cached(refop_handle_t handle, const char *latestfile, const char *backupfile1,
+				      const char *newfile)
+{
+	uint8_t state = handle->file_state;
+
+	if ((state & REFOP_FILE_STATE_LATEST) != 0) {
+		// a1 or a2
+		if (rename(latestfile, backupfile1) < 0)
+			return -1;
+		state = REFOP_FILE_STATE_BACKUP;
+	} else {
+		// a3 or a4, the latest file shall not be overwritten when it appeared.
+		if (renameat2(AT_FDCWD, newfile, AT_FDCWD, latestfile, RENAME_NOREPLACE) < 0)
+			return -1;
+		handle->file_state = REFOP_FILE_STATE_VALID | REFOP_FILE_STATE_LATEST |
+				     (state & REFOP_FILE_STATE_BACKUP);
+		return 0;
+	}
+
+	(void) rename(newfile, latestfile);
+	handle->file_state = REFOP_FILE_STATE_VALID | REFOP_FILE_STATE_LATEST | state;
+
+	return 0;
+}
+
 /**
  * This function is implemented file rotation algorithm.
  * The detail of file rotation algorithm describe in README file.
+ * When the handle has the cached file state, files are not probed by stat.
  *
  * @param [in]	handle	Refop handle.
  *
@@ -104,13 +204,23 @@ int refop_new_file_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
  */
 int refop_file_rotation(refop_handle_t handle)
 {
-	struct refop_halndle *hndl = (struct refop_halndle *) handle;
 	int latest_state = -1, backup_state = -1;
-	int fd = -1;
+	char latestfile[PATH_MAX], backupfile1[PATH_MAX], newfile[PATH_MAX];
+
+	if (refop_handle_path(handle, "", latestfile) < 0 ||
+	    refop_handle_path(handle, c_bk1_suffix, backupfile1) < 0 ||
+	    refop_handle_path(handle, c_new_suffix, newfile) < 0)
+		return -1;
+
+	if ((handle->file_state & REFOP_FILE_STATE_VALID) != 0) {
+		if (refop_file_rotation_cached(handle, latestfile, backupfile1, newfile) == 0)
+			goto out;
+	}
+	handle->file_state = 0;
 
 	// Get all file state
-	latest_state = refop_file_test(hndl->latestfile);
-	backup_state = refop_file_test(hndl->backupfile1);
+	latest_state = refop_file_test(latestfile);
+	backup_state = refop_file_test(backupfile1);
 
 	if (latest_state <= -2 || backup_state <= -2)
 		return -1;
@@ -127,37 +237,37 @@ int refop_file_rotation(refop_handle_t handle)
 	if (latest_state == 0) {
 		// a1 or a2
 		if (backup_state == 0) {
-			// a1
-			(void) unlink(hndl->backupfile1);
-			(void) rename(hndl->latestfile, hndl->backupfile1);
-			(void) rename(hndl->newfile, hndl->latestfile);
+			// a1, the backup file is replaced by rename.
+			// nop (void)unlink(backupfile1);
+			(void) rename(latestfile, backupfile1);
+			(void) rename(newfile, latestfile);
 		} else {
 			// a2
-			// nop (void)unlink(hndl->backupfile1);
-			(void) rename(hndl->latestfile, hndl->backupfile1);
-			(void) rename(hndl->newfile, hndl->latestfile);
+			// nop (void)unlink(backupfile1);
+			(void) rename(latestfile, backupfile1);
+			(void) rename(newfile, latestfile);
 		}
+		handle->file_state = REFOP_FILE_STATE_VALID | REFOP_FILE_STATE_LATEST | REFOP_FILE_STATE_BACKUP;
 	} else {
 		// a3 or a4
 		if (backup_state == 0) {
 			// a3
-			// nop (void)unlink(hndl->backupfile1);
-			// nop (void)rename(hndl->latestfile, hndl->backupfile1);
-			(void) rename(hndl->newfile, hndl->latestfile);
+			// nop (void)unlink(backupfile1);
+			// nop (void)rename(latestfile, backupfile1);
+			(void) rename(newfile, latestfile);
+			handle->file_state = REFOP_FILE_STATE_VALID | REFOP_FILE_STATE_LATEST | REFOP_FILE_STATE_BACKUP;
 		} else {
 			// a4
-			// nop (void)unlink(hndl->backupfile1);
-			// nop (void)rename(hndl->latestfile, hndl->backupfile1);
-			(void) rename(hndl->newfile, hndl->latestfile);
+			// nop (void)unlink(backupfile1);
+			// nop (void)rename(latestfile, backupfile1);
+			(void) rename(newfile, latestfile);
+			handle->file_state = REFOP_FILE_STATE_VALID | REFOP_FILE_STATE_LATEST;
 		}
 	}
 
+out:
 	// directry sync
-	fd = open(hndl->basedir, (O_CLOEXEC | O_DIRECTORY | O_NOFOLLOW));
-	if (fd >= 0) {
-		(void) fsync(fd);
-		(void) close(fd);
-	}
+	(void) refop_dir_sync(handle);
 
 	return 0;
 }
@@ -165,6 +275,7 @@ int refop_file_rotation(refop_handle_t handle)
 /**
  * This function is implemented file pick up algorithm that is including validation.
  * The detail of file rotation algorithm describe in README file.
+ * Only files with broken size, header or data are removed, a file that could not be read is kept.
  *
  * @param [in]	handle	Refop handle.
  *
@@ -177,37 +288,149 @@ int refop_file_rotation(refop_handle_t handle)
  */
 int refop_file_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
 {
-	struct refop_halndle *hndl = (struct refop_halndle *) handle;
 	int ret1 = -1, ret2 = -1;
 	int64_t ressize = 0;
+	char latestfile[PATH_MAX], backupfile1[PATH_MAX];
 
+	if (refop_handle_path(handle, "", latestfile) < 0 ||
+	    refop_handle_path(handle, c_bk1_suffix, backupfile1) < 0)
+		return -1;
 
-	ret1 = refop_file_get_with_validation(hndl->latestfile, data, bufsize, &ressize);
+	ret1 = refop_file_get_with_validation(latestfile, data, bufsize, &ressize);
 	if (ret1 == 0) {
 		// got valid data
 		(*readsize) = ressize;
 		return 0;
-	} else if (ret1 < -1) {
-		// latest file was broken, file remove
-		(void) unlink(hndl->latestfile);
+	} else if (ret1 < -1 && ret1 != -6) {
+		// latest file was broken (short, header or data), try block level recovery (block checksum format
+		// only), then file remove.  Abnormal file responce is not broken data, it is kept.
+		if (refop_block_recover(latestfile, backupfile1, data, bufsize, &ressize) == 0) {
+			(*readsize) = ressize;
+			return 1;
+		}
+		(void) unlink(latestfile);
+		handle->file_state = 0;
 	}
 
-	ret2 = refop_file_get_with_validation(hndl->backupfile1, data, bufsize, &ressize);
+	ret2 = refop_file_get_with_validation(backupfile1, data, bufsize, &ressize);
 	if (ret2 == 0) {
 		// got valid data
 		(*readsize) = ressize;
 		return 1;
-	} else if (ret2 < -1) {
+	} else if (ret2 < -1 && ret2 != -6 && ret1 != -6) {
 		// backup file was broken, file remove
-		(void) unlink(hndl->latestfile);
+		(void) unlink(latestfile);
+		handle->file_state = 0;
 	}
 
+	if (ret1 == -6 || ret2 == -6)
+		return -1;
+
 	if (ret1 == -1 && ret2 == -1)
 		return -2; // No data
 
 	return -3; // Broken data
 }
 
+/**
+ * This function pick up from the latest file and the backup file to an allocated buffer.
+ * The buffer grows from a small size up to the stored data size, the size limit is not allocated.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	limitsize	Maximum data size (bytes).
+ * @param [out]	pdata	Read data, it shall be released by refop_free().
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval 1 Succeeded with recover.
+ * @retval -1 Abnormal fail or larger than limitsize. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_file_pickup_alloc(refop_handle_t handle, int64_t limitsize, uint8_t **pdata, int64_t *readsize)
+{
+	uint8_t *data = NULL;
+	int64_t bufsize = REFOP_VERIFY_CHUNK_SIZE, ressize = 0;
+	int ret = -1, recovered = 0;
+
+	while (1) {
+		// One more byte than limitsize detects data that is larger than the limit.
+		if (bufsize > limitsize + 1)
+			bufsize = limitsize + 1;
+
+		refop_free(data);
+		data = (uint8_t *) refop_malloc(bufsize);
+		if (data == NULL)
+			return -1;
+
+		ret = refop_file_pickup(handle, data, bufsize, &ressize);
+		if (ret < 0)
+			goto out;
+		if (ret == 1)
+			recovered = 1;
+
+		if (ressize < bufsize)
+			break;
+		if (bufsize > limitsize) {
+			ret = -1;
+			goto out;
+		}
+		bufsize = bufsize * 2;
+	}
+
+	(*pdata) = data;
+	(*readsize) = ressize;
+
+	return recovered;
+
+out:
+	refop_free(data);
+
+	return ret;
+}
+
+/**
+ * This function read indexed generation from the latest file and the backup file.
+ * Generation index 0 is the latest file and 1 is the backup file.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	n	Generation index. 0 is newest.
+ * @param [in]	data	Read data buffer
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ * @param [out]	readsize	Readed size
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval -1 Abnormal fail. Shall not continue.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+int refop_file_get_generation(
+	refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	char path[PATH_MAX];
+	int64_t ressize = 0;
+	int ret = -1;
+
+	if (n < 0 || n > 1)
+		return -2;
+
+	// Generation 0 is the latest file and 1 is the backup file.
+	if (refop_handle_path(handle, (n == 0) ? "" : c_bk1_suffix, path) < 0)
+		return -1;
+
+	ret = refop_file_get_with_validation(path, data, bufsize, &ressize);
+
+	if (ret == 0) {
+		(*readsize) = ressize;
+		return 0;
+	} else if (ret == -1)
+		return -2;
+
+	return -3;
+}
+
 /**
  * Confirmation of existence of target file.
  *
@@ -235,9 +458,67 @@ int refop_file_test(const char *filename)
 	return 0;
 }
 
+/**
+ * Read data block with crc16 verification.  The data block is read to the data buffer up to bufsize,
+ * and the rest is read to a small stack buffer only for crc calculation.  No heap memory is used
+ * even if the data block is larger than the data buffer.
+ *
+ * @param [in]	fd	File descriptor.
+ * @param [in]	offset	Offset of data block, -1 is current file offset.
+ * @param [in]	size	Data block size.
+ * @param [in]	crc16value	Expected crc16 of data block.
+ * @param [out]	data	Read data buffer (nullable, when NULL this function does only validation).
+ * @param [in]	bufsize	Buffer size for read data buffer (bytes).
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Short read.
+ * @retval -2 Invalid data.
+ */
+int refop_data_read_verify(int fd, off_t offset, uint64_t size, uint16_t crc16value, uint8_t *data, int64_t bufsize)
+{
+	uint8_t chunk[REFOP_VERIFY_CHUNK_SIZE];
+	uint8_t *pbuf = NULL;
+	uint64_t done = 0, len = 0;
+	uint16_t crc16calc = 0xffff;
+	ssize_t rsize = 0;
+
+	if (data == NULL)
+		bufsize = 0;
+
+	while (done < size) {
+		if (done < (uint64_t) bufsize) {
+			// Head of data block is read to the data buffer.
+			pbuf = data + done;
+			len = (uint64_t) bufsize - done;
+		} else {
+			pbuf = chunk;
+			len = sizeof(chunk);
+		}
+		if (len > size - done)
+			len = size - done;
+
+		if (offset < 0)
+			rsize = safe_read(fd, pbuf, (size_t) len);
+		else
+			rsize = safe_pread(fd, pbuf, (size_t) len, offset + (off_t) done);
+		if (rsize != (ssize_t) len)
+			return -1;
+
+		crc16calc = crc16(crc16calc, pbuf, (size_t) len);
+		done += len;
+	}
+
+	if (crc16calc != crc16value)
+		return -2;
+
+	return 0;
+}
+
 /**
  * File read function with validation.
  * File validation use invert value verification and data verification using crc16.
+ * Valid data larger than the buffer is verified in full and the head of data is read.
  *
  * @param [in]	file	File name with path.
  * @param [in]	data	Read data buffer
@@ -249,15 +530,12 @@ int refop_file_test(const char *filename)
  * @retval -1 No file entry.
  * @retval -2 Invalid file size.
  * @retval -3 Invalid header.
- * @retval -4 Abnomal request size (smaller than real size)
  * @retval -5 Invalid data.
  * @retval -6 Abnomal file responce.
  */
 int refop_file_get_with_validation(const char *file, uint8_t *data, int64_t bufsize, int64_t *readsize)
 {
 	s_refop_file_header head = { 0 };
-	uint8_t *pbuf = NULL, *pmalloc = NULL;
-	uint16_t crc16value = 0;
 	ssize_t size = 0;
 	int result = -1, ret = -1;
 	int fd = -1;
@@ -278,42 +556,47 @@ int refop_file_get_with_validation(const char *file, uint8_t *data, int64_t bufs
 		goto invalid;
 	}
 
+	if (head.version == (uint32_t)(~head.version_inv) &&
+	    (head.version == REFOP_FILE_HEADER_VERSION_V3 || head.version == REFOP_FILE_HEADER_VERSION_V5 ||
+	     head.version == REFOP_FILE_HEADER_VERSION_V7)) {
+		if (head.version == REFOP_FILE_HEADER_VERSION_V3) // block checksum format
+			ret = refop_block_get_with_validation(fd, data, bufsize, readsize);
+		else if (head.version == REFOP_FILE_HEADER_VERSION_V5) // compressed format
+			ret = refop_compress_get_with_validation(fd, data, bufsize, readsize);
+		else // direct I/O format
+			ret = refop_direct_get_with_validation(fd, data, bufsize, readsize);
+		if (ret < 0)
+			goto invalid;
+
+		(void) close(fd);
+
+		return 0;
+	}
+
 	result = refop_header_validation(&head);
 	if (result != 0) {
 		ret = -3;
 		goto invalid;
 	}
 
-	if (head.size > bufsize) {
-		if (head.size <= refop_get_config_data_size_limit()) {
-			pmalloc = (uint8_t *) malloc(head.size);
-			pbuf = pmalloc;
-		} else {
-			ret = -4;
-			goto invalid;
-		}
-	} else {
-		pbuf = data;
+	// No handle writes larger data, the size is a part of header validation.
+	if (head.size > REFOP_DATA_SIZE_LIMIT_MAX) {
+		ret = -3;
+		goto invalid;
 	}
 
-	size = safe_read(fd, pbuf, (size_t) head.size);
-	if (size != head.size) {
+	result = refop_data_read_verify(fd, -1, head.size, head.crc16, data, bufsize);
+	if (result == -1) {
 		ret = -2;
 		goto invalid;
-	}
-
-	crc16value = crc16(0xffff, pbuf, head.size);
-	if (head.crc16 != crc16value) {
+	} else if (result < 0) {
 		ret = -5;
 		goto invalid;
 	}
 
-	if (pmalloc != NULL) {
-		memcpy(data, pmalloc, bufsize);
-		free(pmalloc);
-		pmalloc = NULL;
+	if ((int64_t) head.size > bufsize)
 		(*readsize) = bufsize;
-	} else
+	else
 		(*readsize) = head.size;
 
 	(void) close(fd);
@@ -321,8 +604,6 @@ int refop_file_get_with_validation(const char *file, uint8_t *data, int64_t bufs
 	return 0;
 
 invalid:
-	free(pmalloc); // free is NULL safe
-
 	if (fd >= 0)
 		(void) close(fd);
 
@@ -375,7 +656,7 @@ int refop_header_validation(const s_refop_file_header *head)
 		goto invalid;
 
 	// crc16 value check
-	if (head->crc16 != (uint16_t)(~head->crc16_inv))
+	if ((head->crc16 ^ head->crc16_inv) != 0xffff)
 		goto invalid;
 
 	// data size check
@@ -387,3 +668,155 @@ int refop_header_validation(const s_refop_file_header *head)
 invalid:
 	return ret;
 }
+
+/**
+ * The refop header (version 2) create from args.
+ *
+ * @param [in]	head	Pointer for file header.
+ * @param [in]	crc16value	The crc value of data block.
+ * @param [in]	sizevalue	The size of data block.
+ * @param [in]	generation	The generation number of data block.
+ */
+void refop_header_v2_create(
+	s_refop_file_header_v2 *head, uint16_t crc16value, uint64_t sizevalue, uint64_t generation)
+{
+	head->magic = REFOP_FILE_HEADER_MAGIC;
+
+	head->version = REFOP_FILE_HEADER_VERSION_V2;
+	head->version_inv = ~head->version;
+
+	head->crc16 = crc16value;
+	head->crc16_inv = ~head->crc16;
+
+	head->size = sizevalue;
+	head->size_inv = ~head->size;
+
+	head->generation = generation;
+	head->generation_inv = ~head->generation;
+}
+
+/**
+ * The refop header (version 2) validation
+ *
+ * @param [in]	head	Pointer for file header.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Invalid header.
+ */
+int refop_header_v2_validation(const s_refop_file_header_v2 *head)
+{
+	int ret = -1;
+
+	// magic check
+	if (head->magic != (uint32_t) REFOP_FILE_HEADER_MAGIC)
+		goto invalid;
+
+	// header format version check
+	if (head->version == (uint32_t)(~head->version_inv)) {
+		if (head->version != REFOP_FILE_HEADER_VERSION_V2)
+			goto invalid;
+	} else
+		goto invalid;
+
+	// crc16 value check
+	if ((head->crc16 ^ head->crc16_inv) != 0xffff)
+		goto invalid;
+
+	// data size check
+	if (head->size != (uint64_t)(~head->size_inv))
+		goto invalid;
+
+	// generation check
+	if (head->generation != (uint64_t)(~head->generation_inv))
+		goto invalid;
+
+	ret = 0;
+
+invalid:
+	return ret;
+}
+
+/** When true, syncs of this thread are skipped, the caller syncs the file system once. */
+static __thread bool g_refop_sync_deferred;
+
+/**
+ * Defer syncs of this thread.  It is used by a transaction that applies many sets and syncs the file
+ * system once after them.
+ *
+ * @param [in]	defer	When true, syncs are skipped until it is set false.
+ */
+void refop_sync_defer(bool defer)
+{
+	g_refop_sync_deferred = defer;
+}
+
+/**
+ * Sync the base directory of refop handle.  It is skipped when durability is not REFOP_DURABILITY_FULL.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Abnormal fail.
+ */
+int refop_dir_sync(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	int fd = -1;
+
+	// A key of store is synced by the store, sets of many keys share one directory sync.
+	if (hndl->durability != REFOP_DURABILITY_FULL || hndl->dir_sync_deferred == true ||
+	    g_refop_sync_deferred == true)
+		return 0;
+
+	fd = open(hndl->dir->path, (O_CLOEXEC | O_DIRECTORY | O_NOFOLLOW));
+	if (fd < 0)
+		return -1;
+
+	(void) fsync(fd);
+	(void) close(fd);
+
+	return 0;
+}
+
+/**
+ * Sync data and metadata of a file.  It is skipped when durability is REFOP_DURABILITY_NONE or syncs
+ * are deferred.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	fd	File descriptor of target file.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Abnormal fail.
+ */
+int refop_fsync(refop_handle_t handle, int fd)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if ((hndl != NULL && hndl->durability == REFOP_DURABILITY_NONE) || g_refop_sync_deferred == true)
+		return 0;
+
+	return fsync(fd);
+}
+
+/**
+ * Sync data of a file.  It is skipped when durability is REFOP_DURABILITY_NONE or syncs are deferred.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	fd	File descriptor of target file.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Abnormal fail.
+ */
+int refop_fdatasync(refop_handle_t handle, int fd)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if ((hndl != NULL && hndl->durability == REFOP_DURABILITY_NONE) || g_refop_sync_deferred == true)
+		return 0;
+
+	return fdatasync(fd);
+}
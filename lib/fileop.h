@@ -9,9 +9,11 @@
 //-----------------------------------------------------------------------------
 #include <librefop.h>
 #include <linux/limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 //-----------------------------------------------------------------------------
 #ifdef __cplusplus
@@ -28,22 +30,525 @@ struct __attribute__((packed)) s_refop_file_header_v1 {
 	uint64_t size_inv; /* 32 */    /**< Data block size (inversion value) */
 };
 
+struct __attribute__((packed)) s_refop_file_header_v2 {
+	uint32_t magic; /*  4 */          /**< Magic code */
+	uint32_t version; /*  8 */        /**< Data format version */
+	uint32_t version_inv; /* 12 */    /**< Data format version (inversion value) */
+	uint16_t crc16; /* 14 */          /**< Data block crc */
+	uint16_t crc16_inv; /* 16 */      /**< Data block crc (inversion value) */
+	uint64_t size; /* 24 */           /**< Data block size */
+	uint64_t size_inv; /* 32 */       /**< Data block size (inversion value) */
+	uint64_t generation; /* 40 */     /**< Generation number, increased by every write */
+	uint64_t generation_inv; /* 48 */ /**< Generation number (inversion value) */
+};
+
+struct __attribute__((packed)) s_refop_file_header_v3 {
+	uint32_t magic; /*  4 */           /**< Magic code */
+	uint32_t version; /*  8 */         /**< Data format version */
+	uint32_t version_inv; /* 12 */     /**< Data format version (inversion value) */
+	uint16_t crc16; /* 14 */           /**< Data block crc */
+	uint16_t crc16_inv; /* 16 */       /**< Data block crc (inversion value) */
+	uint64_t size; /* 24 */            /**< Data block size */
+	uint64_t size_inv; /* 32 */        /**< Data block size (inversion value) */
+	uint32_t block_size; /* 36 */      /**< Checksum block size */
+	uint32_t block_size_inv; /* 40 */  /**< Checksum block size (inversion value) */
+	uint16_t table_crc16; /* 42 */     /**< Block crc table crc */
+	uint16_t table_crc16_inv; /* 44 */ /**< Block crc table crc (inversion value) */
+	uint32_t reserved; /* 48 */        /**< Reserved, shall be 0 */
+};
+
+struct __attribute__((packed)) s_refop_file_header_v4 {
+	uint32_t magic; /*  4 */            /**< Magic code */
+	uint32_t version; /*  8 */          /**< Data format version */
+	uint32_t version_inv; /* 12 */      /**< Data format version (inversion value) */
+	uint16_t crc16; /* 14 */            /**< Data block crc */
+	uint16_t crc16_inv; /* 16 */        /**< Data block crc (inversion value) */
+	uint64_t size; /* 24 */             /**< Data block size */
+	uint64_t size_inv; /* 32 */         /**< Data block size (inversion value) */
+	uint32_t block_size; /* 36 */       /**< Checksum and parity block size */
+	uint32_t block_size_inv; /* 40 */   /**< Checksum and parity block size (inversion value) */
+	uint16_t table_crc16; /* 42 */      /**< Block crc table crc */
+	uint16_t table_crc16_inv; /* 44 */  /**< Block crc table crc (inversion value) */
+	uint16_t parity_group; /* 46 */     /**< Number of data blocks per parity block */
+	uint16_t parity_group_inv; /* 48 */ /**< Number of data blocks per parity block (inversion value) */
+};
+
+struct __attribute__((packed)) s_refop_file_header_v5 {
+	uint32_t magic; /*  4 */        /**< Magic code */
+	uint32_t version; /*  8 */      /**< Data format version */
+	uint32_t version_inv; /* 12 */  /**< Data format version (inversion value) */
+	uint16_t crc16; /* 14 */        /**< Stored data block crc */
+	uint16_t crc16_inv; /* 16 */    /**< Stored data block crc (inversion value) */
+	uint64_t size; /* 24 */         /**< Stored data block size */
+	uint64_t size_inv; /* 32 */     /**< Stored data block size (inversion value) */
+	uint64_t raw_size; /* 40 */     /**< Data size before compression */
+	uint64_t raw_size_inv; /* 48 */ /**< Data size before compression (inversion value) */
+	uint32_t flags; /* 52 */        /**< Format flags */
+	uint32_t flags_inv; /* 56 */    /**< Format flags (inversion value) */
+};
+
+struct __attribute__((packed)) s_refop_file_header_v6 {
+	uint32_t magic; /*  4 */            /**< Magic code */
+	uint32_t version; /*  8 */          /**< Data format version */
+	uint32_t version_inv; /* 12 */      /**< Data format version (inversion value) */
+	uint16_t crc16; /* 14 */            /**< Diff crc */
+	uint16_t crc16_inv; /* 16 */        /**< Diff crc (inversion value) */
+	uint64_t size; /* 24 */             /**< Diff size */
+	uint64_t size_inv; /* 32 */         /**< Diff size (inversion value) */
+	uint64_t raw_size; /* 40 */         /**< Reconstructed data size */
+	uint64_t raw_size_inv; /* 48 */     /**< Reconstructed data size (inversion value) */
+	uint16_t result_crc16; /* 50 */     /**< Reconstructed data crc */
+	uint16_t result_crc16_inv; /* 52 */ /**< Reconstructed data crc (inversion value) */
+	uint16_t base_crc16; /* 54 */       /**< Keyframe data crc */
+	uint16_t base_crc16_inv; /* 56 */   /**< Keyframe data crc (inversion value) */
+	uint32_t sequence; /* 60 */         /**< Sequence number from keyframe */
+	uint32_t sequence_inv; /* 64 */     /**< Sequence number from keyframe (inversion value) */
+};
+
+struct __attribute__((packed)) s_refop_file_header_v7 {
+	uint32_t magic; /*  4 */           /**< Magic code */
+	uint32_t version; /*  8 */         /**< Data format version */
+	uint32_t version_inv; /* 12 */     /**< Data format version (inversion value) */
+	uint16_t crc16; /* 14 */           /**< Data block crc */
+	uint16_t crc16_inv; /* 16 */       /**< Data block crc (inversion value) */
+	uint64_t size; /* 24 */            /**< Data block size (without padding) */
+	uint64_t size_inv; /* 32 */        /**< Data block size (inversion value) */
+	uint32_t data_offset; /* 36 */     /**< Data block offset (padded header size) */
+	uint32_t data_offset_inv; /* 40 */ /**< Data block offset (inversion value) */
+	uint32_t align; /* 44 */           /**< Alignment of data block and file size */
+	uint32_t align_inv; /* 48 */       /**< Alignment (inversion value) */
+};
+
 #define REFOP_FILE_HEADER_MAGIC ((uint32_t) 0x96962323)
 #define REFOP_FILE_HEADER_VERSION_V1 ((uint32_t) 0x00000001)
+#define REFOP_FILE_HEADER_VERSION_V2 ((uint32_t) 0x00000002)
+#define REFOP_FILE_HEADER_VERSION_V3 ((uint32_t) 0x00000003)
+#define REFOP_FILE_HEADER_VERSION_V4 ((uint32_t) 0x00000004)
+#define REFOP_FILE_HEADER_VERSION_V5 ((uint32_t) 0x00000005)
+#define REFOP_FILE_HEADER_VERSION_V6 ((uint32_t) 0x00000006)
+#define REFOP_FILE_HEADER_VERSION_V7 ((uint32_t) 0x00000007)
+
+/** Format flag, data block is compressed by LZ4 block format. */
+#define REFOP_FILE_FLAG_COMPRESS_LZ ((uint32_t) 0x00000001)
 
 typedef struct s_refop_file_header_v1 s_refop_file_header;
+typedef struct s_refop_file_header_v2 s_refop_file_header_v2;
+typedef struct s_refop_file_header_v3 s_refop_file_header_v3;
+typedef struct s_refop_file_header_v4 s_refop_file_header_v4;
+typedef struct s_refop_file_header_v5 s_refop_file_header_v5;
+typedef struct s_refop_file_header_v6 s_refop_file_header_v6;
+typedef struct s_refop_file_header_v7 s_refop_file_header_v7;
+
+/** Number of fixed files that are used by ping-pong mode (default, one backup). */
+#define REFOP_PINGPONG_FILES (2)
+/** Maximum backup count of ping-pong mode. */
+#define REFOP_BACKUP_COUNT_MAX (15)
+/** Maximum number of files that are used by ping-pong mode. */
+#define REFOP_PINGPONG_FILES_MAX (REFOP_BACKUP_COUNT_MAX + 1)
+/** Number of slots in the A/B slot file. */
+#define REFOP_SLOT_COUNT (2)
+/** Alignment of the slot stride in the A/B slot file. */
+#define REFOP_SLOT_ALIGN (4096)
+/** Checksum block size of the block checksum format (version 3 header). */
+#define REFOP_BLOCK_SIZE (4096)
+/** Default number of data blocks per parity block (25% overhead). */
+#define REFOP_PARITY_GROUP_DEFAULT (4)
+/** Data smaller than this size is not compressed. */
+#define REFOP_COMPRESS_MIN_SIZE (64)
+/** Maximum number of delta records after keyframe (delta mode). */
+#define REFOP_DELTA_CHAIN_MAX (16)
+/** Maximum number of journal records after base file (journal mode). */
+#define REFOP_JOURNAL_RECORDS_MAX (256)
+/** Alignment of header page, data block and file size of the direct I/O format. */
+#define REFOP_DIRECT_ALIGN (4096)
+/** Minimum chunk size of chunk mode (except the last chunk). */
+#define REFOP_CHUNK_MIN (2048)
+/** Maximum chunk size of chunk mode. */
+#define REFOP_CHUNK_MAX (65536)
+/** Cut point mask of content defined chunking (13 bits of rolling hash, about 8 KiB after minimum). */
+#define REFOP_CHUNK_MASK ((uint32_t) 0xfff80000)
+/** Magic code of the chunk manifest. */
+#define REFOP_CHUNK_MAGIC ((uint32_t) 0x4b484352)
+/** Size of chunk hash (SHA-256). */
+#define REFOP_CHUNK_HASH_SIZE (32)
+/** Header space of the scratch buffer, it is not smaller than the header of plain formats. */
+#define REFOP_SCRATCH_HEADER_SIZE (64)
+/** Stack buffer size of streaming data verification. */
+#define REFOP_VERIFY_CHUNK_SIZE (4096)
+/** Round up to pointer alignment, it is used for layout of static handle storage. */
+#define REFOP_STORAGE_ALIGN(x) (((x) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+/** Initial value of refop_hash_update(). */
+#define REFOP_HASH_INIT (2166136261u)
+/** Initial number of hash buckets of a store, power of 2. */
+#define REFOP_STORE_BUCKETS_MIN (64)
+/** Default size of the value cache of a store (byte). */
+#define REFOP_STORE_CACHE_DEFAULT (1 * 1024 * 1024)
+
+/** Cached file state of rotation mode: the latest file exists. */
+#define REFOP_FILE_STATE_LATEST (0x01)
+/** Cached file state of rotation mode: the backup file exists. */
+#define REFOP_FILE_STATE_BACKUP (0x02)
+/** Cached file state of rotation mode: the new file exists. */
+#define REFOP_FILE_STATE_NEW (0x04)
+/** Cached file state of rotation mode: other bits are valid. */
+#define REFOP_FILE_STATE_VALID (0x80)
+
+/**
+ * Operation of the worker pool.
+ */
+typedef enum refop_op {
+	REFOP_OP_SET = 0,    /**< refop_set_redundancy_data() */
+	REFOP_OP_GET = 1,    /**< refop_get_redundancy_data() */
+	REFOP_OP_REMOVE = 2, /**< refop_remove_redundancy_data() */
+	REFOP_OP_VERIFY = 3, /**< refop_verify_redundancy_data() */
+} refop_op_t;
+
+struct refop_delta_state {
+	bool truncate;	     /**< When true, the delta file has invalid records after offset */
+	int chain;	     /**< Number of delta records after keyframe */
+	uint16_t base_crc16; /**< The crc of keyframe data */
+	int64_t offset;	     /**< End of valid delta records */
+	int64_t size;	     /**< Size of cached value */
+	uint8_t *value;	     /**< Cached newest generation, NULL when it is over cache budget */
+};
+
+/** Magic code of the transaction manifest. */
+#define REFOP_TXN_MAGIC ((uint32_t) 0x32585452)
+
+/** Record flag: the handle writes block checksum format. */
+#define REFOP_TXN_FLAG_BLOCK_CHECKSUM ((uint8_t) 0x01)
+/** Record flag: the handle writes compressed format. */
+#define REFOP_TXN_FLAG_COMPRESSION ((uint8_t) 0x02)
+/** Record flag: the handle writes direct I/O format. */
+#define REFOP_TXN_FLAG_DIRECT_IO ((uint8_t) 0x04)
+/** Record flag: the handle holds the cross-process writer lock. */
+#define REFOP_TXN_FLAG_PROCESS_LOCK ((uint8_t) 0x08)
+
+struct __attribute__((packed)) s_refop_txn_manifest {
+	uint32_t magic; /*  4 */ /**< Transaction manifest magic code */
+	uint32_t count; /*  8 */ /**< Number of records */
+	uint64_t size; /* 16 */	 /**< Size of records */
+	uint16_t crc16; /* 18 */ /**< The crc of records */
+	uint16_t crc16_inv; /* 20 */ /**< Inverted crc */
+};
+
+struct __attribute__((packed)) s_refop_txn_record {
+	uint64_t size; /*  8 */	     /**< Data size, the data follows the file name */
+	uint64_t size_limit; /* 16 */    /**< Size limit of the handle */
+	int64_t slot_capacity; /* 24 */  /**< Slot capacity of the handle (A/B slot mode) */
+	uint16_t name_size; /* 26 */     /**< File name size (not terminated) */
+	uint8_t mode; /* 27 */	     /**< Redundancy mode of the handle */
+	uint8_t flags; /* 28 */	     /**< Format flags of the handle (REFOP_TXN_FLAG_*) */
+	int8_t backup_count; /* 29 */    /**< Backup count of the handle (ping-pong mode) */
+	int8_t parity_group; /* 30 */    /**< Parity group of the handle (parity mode) */
+	uint16_t reserved; /* 32 */      /**< Reserved, 0 */
+};
+
+typedef struct s_refop_txn_manifest s_refop_txn_manifest;
+typedef struct s_refop_txn_record s_refop_txn_record;
+
+/** Magic code of the container image. */
+#define REFOP_CONTAINER_MAGIC ((uint32_t) 0x52434e54)
+
+struct __attribute__((packed)) s_refop_container_head {
+	uint32_t magic; /*  4 */ /**< Container magic code */
+	uint32_t count; /*  8 */ /**< Number of index entries */
+};
+
+struct __attribute__((packed)) s_refop_container_entry {
+	uint32_t key_offset; /*  4 */   /**< Key offset from container image top */
+	uint32_t value_offset; /*  8 */ /**< Value offset from container image top */
+	uint32_t value_size; /* 12 */   /**< Value size */
+	uint16_t key_size; /* 14 */     /**< Key size (not terminated) */
+	uint16_t crc16; /* 16 */        /**< Record crc over key and value */
+};
+
+struct refop_container_pending {
+	char *key;	/**< Key string */
+	uint8_t *value; /**< Staged value */
+	int64_t size;	/**< Staged value size, -1 is delete */
+};
+
+struct refop_container {
+	refop_handle_t handle;				    /**< Ping-pong mode handle of the container file */
+	uint8_t *map;					    /**< Mapped container file */
+	size_t mapsize;					    /**< Mapped size */
+	const uint8_t *image;				    /**< Container image in mapped file */
+	uint64_t imagesize;				    /**< Container image size */
+	const struct s_refop_container_head *head;	    /**< Container head in mapped file */
+	const struct s_refop_container_entry *index;	    /**< Sorted index in mapped file */
+	struct refop_container_pending *pending;	    /**< Staged set and delete */
+	int npending;					    /**< Number of staged items */
+	int cpending;					    /**< Capacity of staged items */
+};
+
+/**
+ * Key of a store.  The key name is the file name of the handle.
+ */
+struct refop_store_entry {
+	struct refop_store_entry *next;	    /**< Next entry in the hash bucket */
+	struct refop_store_entry *lru_prev; /**< More recently used entry in the cache */
+	struct refop_store_entry *lru_next; /**< Less recently used entry in the cache */
+	refop_handle_t handle;		    /**< Handle of the key */
+	uint8_t *cache;			    /**< Cached value, NULL is not cached */
+	int64_t cache_size;		    /**< Size of cached value */
+	pthread_mutex_t lock;		    /**< Serialize file operations of the key */
+	uint32_t hash;			    /**< Hash of the key */
+};
 
+/**
+ * Store of keys in one directory.
+ */
+struct refop_store {
+	struct refop_dir *dir;			/**< Shared base directory */
+	struct refop_store_entry **buckets;	/**< Hash buckets of keys */
+	struct refop_store_entry *lru_head;	/**< Most recently used entry in the cache */
+	struct refop_store_entry *lru_tail;	/**< Least recently used entry in the cache */
+	refop_options_t options;		/**< Options of key handles */
+	uint64_t cache_budget;			/**< Maximum total size of cached values */
+	uint64_t cache_used;			/**< Total size of cached values */
+	uint64_t sync_requested;		/**< Number of sets that requested directory sync */
+	uint64_t sync_done;			/**< Number of sets that were covered by directory sync */
+	size_t nbuckets;			/**< Number of hash buckets */
+	size_t nkeys;				/**< Number of keys */
+	pthread_mutex_t lock;			/**< Protect keys and cache */
+	pthread_mutex_t sync_lock;		/**< Protect directory sync state */
+	pthread_cond_t sync_cond;		/**< Signaled when a directory sync completed */
+	int dirfd;				/**< Fd of the directory */
+	bool syncing;				/**< When true, a directory sync is running */
+};
+
+struct __attribute__((packed)) s_refop_chunk_manifest {
+	uint32_t magic; /*  4 */    /**< Chunk manifest magic code */
+	uint32_t count; /*  8 */    /**< Number of chunk references */
+	uint64_t raw_size; /* 16 */ /**< Data size, sum of chunk size */
+};
+
+struct __attribute__((packed)) s_refop_chunk_ref {
+	uint8_t hash[REFOP_CHUNK_HASH_SIZE]; /* 32 */ /**< SHA-256 of chunk, it is the chunk file name */
+	uint32_t size; /* 36 */			     /**< Chunk size */
+};
+
+struct refop_journal_state {
+	bool truncate;	     /**< When true, the journal file has invalid records after offset */
+	int records;	     /**< Number of journal records after base file */
+	uint16_t base_crc16; /**< The crc of base file data */
+	int64_t offset;	     /**< End of valid journal records */
+	int64_t tail;	     /**< Offset of the newest valid record, -1 is base file */
+};
+
+/** Number of reader counter stripes of snapshot read, power of 2. */
+#define REFOP_SNAPSHOT_STRIPES (8)
+
+/**
+ * Immutable snapshot of a validated value.  It is released by the last holder, the published
+ * pointer of the handle holds one reference.
+ */
+struct refop_snapshot {
+	long refcount; /**< Number of holders */
+	int64_t size;  /**< Data size */
+	uint8_t data[]; /**< Data */
+};
+
+/**
+ * Reader counter of snapshot read.  It is padded to a cache line, so readers in other stripes do not
+ * share it.
+ */
+struct refop_snapshot_readers {
+	unsigned long count;		     /**< Readers that are taking a reference */
+	char pad[64 - sizeof(unsigned long)]; /**< Padding to a cache line */
+};
+
+/**
+ * Lock of thread safe handle.  Get operations share rwlock, set and other operations that change
+ * files or configuration hold it exclusively.  Shared holders update the cached file state under
+ * cache mutex.  The published snapshot is replaced under cache mutex and read without lock.
+ */
+struct refop_handle_lock {
+	pthread_rwlock_t rwlock;	    /**< Operation lock */
+	pthread_mutex_t cache;		    /**< Cached file state lock for shared holders */
+	struct refop_snapshot *snapshot;    /**< Published snapshot, NULL is not published */
+	uint64_t snapshot_version;	    /**< Increased by every publish and retire */
+	int64_t snapshot_hint;		    /**< Size of the last loaded value, it sizes the next load */
+	unsigned int snapshot_epoch;	    /**< Reader counter parity of new readers */
+	struct refop_snapshot_readers readers[2][REFOP_SNAPSHOT_STRIPES]; /**< Reader counters by parity */
+};
+
+/**
+ * Shared base directory of refop handles.  Handles in one directory refer one interned entry,
+ * so a directory path is stored once per process.
+ */
+struct refop_dir {
+	struct refop_dir *next; /**< Next entry of the interned directory list */
+	unsigned int refcount;	/**< Number of handles that refer this directory */
+	bool txn_checked;	/**< When true, the transaction manifest was recovered by this process */
+	size_t len;		/**< Length of path */
+	char path[];		/**< Directory path terminated by '/' */
+};
+
+/**
+ * Refop handle.  File names are not kept in the handle, those are derived on demand from the shared
+ * directory and the file name by refop_handle_path().  Members are ordered by size to keep the
+ * handle small.
+ */
 struct refop_halndle {
-	char latestfile[PATH_MAX];  /**< Internal buffer for the latest file name */
-	char backupfile1[PATH_MAX]; /**< Internal buffer for the backup file name */
-	char newfile[PATH_MAX];	    /**< Internal buffer for the new file name */
-	char basedir[PATH_MAX];	    /**< Internal buffer for the file operation base dir */
+	struct refop_dir *dir;		     /**< Shared base directory */
+	struct refop_delta_state *delta;     /**< Cached generation of delta mode, NULL is not cached */
+	struct refop_journal_state *journal; /**< Tail pointer of journal mode, NULL is not cached */
+	uint8_t *scratch;		     /**< Caller supplied work buffer of static handle, NULL is heap */
+	struct refop_handle_lock *lock;	     /**< Internal lock of thread safe handle, NULL is not thread safe */
+	uint64_t generation;		     /**< Generation number of the newest valid data */
+	int64_t slot_capacity;		     /**< Maximum data size of one slot (A/B slot mode) */
+	uint64_t size_limit;		     /**< Maximum data size of this handle, 0 is the default */
+	uint64_t cache_budget;		     /**< Maximum size of cached value, 0 is no limit */
+	refop_mode_t mode;		     /**< Redundancy mode */
+	refop_durability_t durability;	     /**< Sync policy of set operation */
+	int8_t slot_latest;  /**< Index of the file/slot that has the newest valid data */
+	int8_t slot_next;    /**< Index of the next write target file (ping-pong mode) */
+	int8_t backup_count; /**< Number of backup generation (ping-pong mode), 0 is default */
+	int8_t parity_group; /**< Number of data blocks per parity block (parity mode), 0 is default */
+	uint8_t file_state;  /**< Cached files of rotation mode (REFOP_FILE_STATE_*), 0 is unknown */
+	bool slot_cached;    /**< When true, slot_latest and generation are valid */
+	bool block_checksum; /**< When true, rotation mode write block checksum format */
+	bool compression;    /**< When true, rotation mode write compressed format */
+	bool direct_io;	     /**< When true, rotation mode write direct I/O format by O_DIRECT */
+	bool lazy_upgrade;   /**< When true, data of rotation mode is read until first set */
+	bool upgrade_done;   /**< When true, files of rotation mode were removed by lazy upgrade */
+	bool scratch_busy;   /**< When true, the scratch buffer is in use */
+	bool static_storage; /**< When true, the handle is in caller supplied storage */
+	bool process_lock;   /**< When true, set and remove hold the cross-process writer lock */
+	bool shared;	     /**< When true, the handle is in the shared handle registry */
+	bool dir_sync_deferred; /**< When true, directory sync of set is done by the owner store */
+	char name[];	     /**< Target file name */
 };
 
 //-----------------------------------------------------------------------------
 int refop_new_file_write(refop_handle_t handle, uint8_t *data, int64_t bufsize);
 int refop_file_rotation(refop_handle_t handle);
+int refop_file_state_probe(refop_handle_t handle);
+bool refop_options_valid(const refop_options_t *options);
+refop_error_t refop_handle_create_nocheck(
+	refop_handle_t *handle, const char *directry, const char *filename, const refop_options_t *options);
 int refop_file_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize);
+int refop_file_pickup_alloc(refop_handle_t handle, int64_t limitsize, uint8_t **pdata, int64_t *readsize);
+int refop_file_get_generation(
+	refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize);
+
+int refop_pingpong_write(refop_handle_t handle, uint8_t *data, int64_t bufsize);
+int refop_pingpong_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize);
+int refop_pingpong_remove(refop_handle_t handle);
+int refop_pingpong_get_generation(
+	refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize);
+
+int refop_slot_write(refop_handle_t handle, uint8_t *data, int64_t bufsize);
+int refop_slot_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize);
+int refop_slot_remove(refop_handle_t handle);
+int refop_slot_get_generation(
+	refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize);
+
+int refop_parity_write(refop_handle_t handle, uint8_t *data, int64_t bufsize);
+int refop_parity_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize);
+int refop_parity_remove(refop_handle_t handle);
+int refop_parity_get_generation(
+	refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize);
+
+int refop_delta_write(refop_handle_t handle, uint8_t *data, int64_t bufsize);
+int refop_delta_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize);
+int refop_delta_remove(refop_handle_t handle);
+int refop_delta_get_generation(
+	refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize);
+void refop_delta_reset(refop_handle_t handle);
+
+int refop_journal_write(refop_handle_t handle, uint8_t *data, int64_t bufsize);
+int refop_journal_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize);
+int refop_journal_remove(refop_handle_t handle);
+int refop_journal_get_generation(
+	refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize);
+int refop_journal_compact(refop_handle_t handle);
+void refop_journal_reset(refop_handle_t handle);
+
+int refop_chunk_write(refop_handle_t handle, uint8_t *data, int64_t bufsize);
+int refop_chunk_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize);
+int refop_chunk_remove(refop_handle_t handle);
+int refop_chunk_get_generation(
+	refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize);
+
+int refop_compress_buffer_create(uint8_t *data, int64_t bufsize, uint8_t **pbuf, size_t *total);
+int refop_compress_get_with_validation(int fd, uint8_t *data, int64_t bufsize, int64_t *readsize);
+
+int refop_direct_file_write(refop_handle_t handle, const char *file, uint8_t *data, int64_t bufsize);
+int refop_direct_get_with_validation(int fd, uint8_t *data, int64_t bufsize, int64_t *readsize);
+
+uint8_t *refop_block_buffer_create(uint8_t *data, int64_t bufsize, size_t *total);
+int refop_block_get_with_validation(int fd, uint8_t *data, int64_t bufsize, int64_t *readsize);
+int refop_block_recover(const char *latest, const char *backup, uint8_t *data, int64_t bufsize, int64_t *readsize);
+int refop_block_get_range(refop_handle_t handle, int64_t offset, uint8_t *data, int64_t len, int64_t *readsize);
+
+int refop_header_validation(const s_refop_file_header *head);
+void refop_header_v2_create(
+	s_refop_file_header_v2 *head, uint16_t crc16value, uint64_t sizevalue, uint64_t generation);
+int refop_header_v2_validation(const s_refop_file_header_v2 *head);
+void refop_header_v3_create(
+	s_refop_file_header_v3 *head, uint16_t crc16value, uint64_t sizevalue, uint16_t table_crc16value);
+int refop_header_v3_validation(const s_refop_file_header_v3 *head);
+void refop_header_v4_create(s_refop_file_header_v4 *head, uint16_t crc16value, uint64_t sizevalue,
+			    uint16_t table_crc16value, uint16_t group);
+int refop_header_v4_validation(const s_refop_file_header_v4 *head);
+void refop_header_v5_create(s_refop_file_header_v5 *head, uint16_t crc16value, uint64_t sizevalue,
+			    uint64_t rawsizevalue, uint32_t flags);
+int refop_header_v5_validation(const s_refop_file_header_v5 *head);
+void refop_header_v6_create(s_refop_file_header_v6 *head, uint16_t crc16value, uint64_t sizevalue,
+			    uint64_t rawsizevalue, uint16_t result_crc16value, uint16_t base_crc16value,
+			    uint32_t sequence);
+int refop_header_v6_validation(const s_refop_file_header_v6 *head);
+void refop_header_v7_create(s_refop_file_header_v7 *head, uint16_t crc16value, uint64_t sizevalue, uint32_t align);
+int refop_header_v7_validation(const s_refop_file_header_v7 *head);
+
+extern const char c_bk1_suffix[];
+extern const char c_new_suffix[];
+extern const char c_lock_suffix[];
+extern const char c_shm_prefix[];
+size_t refop_dir_size(const char *directry);
+void refop_dir_init(struct refop_dir *dir, const char *directry);
+struct refop_dir *refop_dir_get(const char *directry);
+void refop_dir_put(struct refop_dir *dir);
+int refop_handle_path(refop_handle_t handle, const char *suffix, char *path);
+int refop_data_read_verify(int fd, off_t offset, uint64_t size, uint16_t crc16value, uint8_t *data, int64_t bufsize);
+int refop_dir_sync(refop_handle_t handle);
+int refop_handle_lock_create(refop_handle_t handle);
+void refop_handle_lock_destroy(refop_handle_t handle);
+void refop_handle_rdlock(refop_handle_t handle);
+void refop_handle_wrlock(refop_handle_t handle);
+void refop_handle_unlock(refop_handle_t handle);
+void refop_handle_cache_lock(refop_handle_t handle);
+void refop_handle_cache_unlock(refop_handle_t handle);
+int64_t refop_lock_clock_ms(void);
+int refop_handle_wrlock_timeout(refop_handle_t handle, int timeout_ms);
+int refop_process_lock(refop_handle_t handle, int timeout_ms, int *pfd);
+void refop_process_unlock(int fd);
+uint32_t refop_hash_update(uint32_t hash, const void *data, size_t len);
+refop_handle_t refop_registry_get(const char *directry, const char *filename);
+refop_handle_t refop_registry_add(refop_handle_t handle);
+bool refop_registry_put(refop_handle_t handle);
+refop_error_t refop_op_execute(
+	refop_handle_t handle, refop_op_t op, uint8_t *data, int64_t datasize, int64_t *getsize);
+void refop_pool_drain(refop_handle_t handle);
+bool refop_pool_pending_get(refop_handle_t handle, uint8_t *data, int64_t datasize, int64_t *getsize);
+void refop_snapshot_update(refop_handle_t handle, const uint8_t *data, int64_t size);
+void refop_snapshot_retire(refop_handle_t handle);
+int refop_shm_path(refop_handle_t handle, char *path);
+int refop_shm_get(refop_handle_t handle, uint8_t *data, int64_t datasize, int64_t *getsize,
+		  uint64_t *generation);
+void refop_shm_publish(refop_handle_t handle, uint64_t generation, const uint8_t *data, int64_t size);
+int refop_shm_write_begin(refop_handle_t handle);
+void refop_shm_remove(refop_handle_t handle);
+void refop_shm_write_end(refop_handle_t handle, int fd);
+void refop_shm_invalidate(refop_handle_t handle);
+int refop_fsync(refop_handle_t handle, int fd);
+int refop_fdatasync(refop_handle_t handle, int fd);
+void refop_sync_defer(bool defer);
+void refop_txn_recover(refop_handle_t handle);
 
 //-----------------------------------------------------------------------------
 #ifdef __cplusplus
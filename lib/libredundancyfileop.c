@@ -6,6 +6,8 @@
  */
 #include "fileop.h"
 #include "librefop.h"
+#include "refop-alloc.h"
+#include "static-configurator.h"
 
 #include <errno.h>
 #include <sys/stat.h>
@@ -15,13 +17,26 @@
 #include <stdlib.h>
 #include <string.h>
 
-const char c_bk1_suffix[] = ".bk1";
-const char c_new_suffix[] = ".tmp";
+static bool refop_upgrade_target(refop_handle_t handle);
+static void refop_upgrade_cleanup(refop_handle_t handle);
+static refop_error_t refop_directry_check(const char *directry);
+static refop_error_t refop_handle_new(
+	refop_handle_t *handle, const char *directry, const char *filename, const refop_options_t *options);
+static int refop_options_apply(struct refop_halndle *hndl, const refop_options_t *options);
+static refop_error_t refop_data_set(refop_handle_t handle, uint8_t *data, int64_t datasize);
+static refop_error_t refop_data_set_locked(refop_handle_t handle, uint8_t *data, int64_t datasize,
+					   int timeout_ms);
+static refop_error_t refop_data_get(refop_handle_t handle, uint8_t *data, int64_t datasize, int64_t *getsize);
+static refop_error_t refop_data_get_cached(refop_handle_t handle, uint8_t *data, int64_t datasize,
+					   int64_t *getsize);
+static refop_error_t refop_data_remove(refop_handle_t handle);
+static void refop_handle_read_lock(refop_handle_t handle);
 
 /**
  * The refop handle create function.
  * When you use refop, you shall call this function initially.
  * The refop handle need to create per one file.
+ * The handle use process wide default options that are set by refop_set_default_options().
  *
  * @param [out]	handle	Created refop handle
  * @param [in]	directry	Terget directry
@@ -35,61 +50,371 @@ const char c_new_suffix[] = ".tmp";
  */
 refop_error_t refop_create_redundancy_handle(refop_handle_t *handle, const char *directry, const char *filename)
 {
-	struct stat sb;
-	struct refop_halndle *hndl = NULL;
-	int ret = -1;
-	size_t dirlen = 0, filelen = 0;
+	return refop_create_redundancy_handle_ex(handle, directry, filename, NULL);
+}
+
+/**
+ * The refop handle create function with options.
+ * Options are applied to this handle only.  When options is NULL, process wide default options are used.
+ * When size_limit of options is 0, the default size limit is used.  Size limit is applied to set
+ * operation and read buffers of this handle, so a few handles can have large limit while other handles
+ * keep small limit.
+ * With shared option, a handle of same directory and file name that is already open is returned and its
+ * reference count is increased.  The options of the first creator are used for the shared handle.
+ *
+ * @param [out]	handle	Created refop handle
+ * @param [in]	directry	Terget directry
+ * @param [in]	filename	Target file name.
+ * @param [in]	options	Handle options. NULL is allowed.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_NOENT The target file/directroy was nothing.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+refop_error_t refop_create_redundancy_handle_ex(
+	refop_handle_t *handle, const char *directry, const char *filename, const refop_options_t *options)
+{
+	struct refop_halndle *hndl = NULL, *shared_hndl = NULL;
 	refop_error_t refop_error = REFOP_SYSERROR;
+	refop_options_t defaults;
+	bool shared = false;
 
 	if ((handle == NULL) || (directry == NULL) || (filename == NULL))
 		return REFOP_ARGERROR;
 
+	if (options != NULL && refop_options_valid(options) == false)
+		return REFOP_ARGERROR;
+
+	// A shared handle that is already open is found without file system access and heap memory.
+	if (options != NULL) {
+		shared = options->shared;
+	} else {
+		refop_get_config_default_options(&defaults);
+		shared = defaults.shared;
+	}
+	if (shared == true && directry[0] != '\0') {
+		(*handle) = refop_registry_get(directry, filename);
+		if ((*handle) != NULL)
+			return REFOP_SUCCESS;
+	}
+
 	// Check a directry
-	ret = stat(directry, &sb);
-	if (ret < 0) {
-		if ((errno == EACCES) || (errno == ELOOP) || (errno == ENOENT) || (errno == ENOTDIR))
-			return REFOP_NOENT;
-		else if (errno == ENAMETOOLONG)
-			return REFOP_ARGERROR;
-		else
-			return REFOP_SYSERROR;
+	refop_error = refop_directry_check(directry);
+	if (refop_error != REFOP_SUCCESS)
+		return refop_error;
+
+	refop_error = refop_handle_new(&hndl, directry, filename, options);
+	if (refop_error != REFOP_SUCCESS)
+		return refop_error;
+
+	if (shared == true) {
+		// Another thread may register same key while this handle is created, then that one is used.
+		shared_hndl = refop_registry_add(hndl);
+		if (shared_hndl != hndl) {
+			(void) refop_release_redundancy_handle(hndl);
+			if (shared_hndl == NULL)
+				return REFOP_SYSERROR;
+			hndl = shared_hndl;
+		} else {
+			hndl->shared = true;
+		}
 	}
 
-	// Handle memory allocate
-	hndl = (struct refop_halndle *) malloc(sizeof(struct refop_halndle));
+	(*handle) = hndl;
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * Create a handle without the directory check.  It is used for keys of a store, those directory was
+ * checked by the store.
+ *
+ * @param [out]	handle	Created refop handle
+ * @param [in]	directry	Terget directry
+ * @param [in]	filename	Target file name.
+ * @param [in]	options	Handle options. NULL is allowed.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+refop_error_t refop_handle_create_nocheck(
+	refop_handle_t *handle, const char *directry, const char *filename, const refop_options_t *options)
+{
+	if (options != NULL && refop_options_valid(options) == false)
+		return REFOP_ARGERROR;
+
+	return refop_handle_new(handle, directry, filename, options);
+}
+
+/**
+ * Allocate and initialize a heap handle.
+ *
+ * @param [out]	handle	Created refop handle
+ * @param [in]	directry	Terget directry
+ * @param [in]	filename	Target file name.
+ * @param [in]	options	Validated handle options. NULL is allowed.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+static refop_error_t refop_handle_new(
+	refop_handle_t *handle, const char *directry, const char *filename, const refop_options_t *options)
+{
+	struct refop_halndle *hndl = NULL;
+	size_t dirlen = 0, filelen = 0;
+
+	// Handle memory allocate, file name is stored after the handle.
+	dirlen = strnlen(directry, PATH_MAX);
+	filelen = strnlen(filename, PATH_MAX);
+	hndl = (struct refop_halndle *) refop_malloc(sizeof(struct refop_halndle) + filelen + 1);
 	if (hndl == NULL)
 		return REFOP_SYSERROR;
 	memset(hndl, 0, sizeof(struct refop_halndle));
 
-	// Create file path
-	dirlen = strnlen(directry, PATH_MAX);
-	filelen = strnlen(filename, PATH_MAX);
+	// Check file path
 	if ((dirlen + filelen + 10 + 1) > PATH_MAX || (dirlen == 0) ||
 	    (filelen == 0)) { // file suffix = max 10 byte, / = max 1 byte
 		// Path error
-		free(hndl);
+		refop_free(hndl);
 		return REFOP_ARGERROR;
 	}
 
 	// string length was checked, safe.
-	(void) strncpy(hndl->latestfile, directry, PATH_MAX);
-	if (hndl->latestfile[dirlen - 1] != '/')
-		(void) strcat(hndl->latestfile, "/");
+	memcpy(hndl->name, filename, filelen + 1);
+
+	// Handles in same directory share one directory reference.
+	hndl->dir = refop_dir_get(directry);
+	if (hndl->dir == NULL) {
+		refop_free(hndl);
+		return REFOP_SYSERROR;
+	}
+
+	if (refop_options_apply(hndl, options) < 0) {
+		refop_dir_put(hndl->dir);
+		refop_free(hndl);
+		return REFOP_SYSERROR;
+	}
+
+	// Recovery state is classified once, then it is kept by set operations.
+	(void) refop_file_state_probe(hndl);
+
+	(*handle) = hndl;
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * Get the storage size for refop_create_redundancy_handle_static().
+ *
+ * @param [in]	directry	Terget directry
+ * @param [in]	filename	Target file name.
+ *
+ * @return size_t
+ * @retval 0 Argument error.
+ * @retval >0 Storage size (byte).
+ */
+size_t refop_handle_storage_size(const char *directry, const char *filename)
+{
+	size_t filelen = 0;
+
+	if ((directry == NULL) || (filename == NULL) || (directry[0] == '\0'))
+		return 0;
+
+	// Handle, file name and private directory entry that is aligned to pointer size.
+	filelen = strnlen(filename, PATH_MAX);
+
+	return REFOP_STORAGE_ALIGN(sizeof(struct refop_halndle) + filelen + 1) + refop_dir_size(directry);
+}
+
+/**
+ * Get the scratch buffer size for refop_create_redundancy_handle_static().
+ * The scratch buffer can hold a file image of plain formats up to the size limit.
+ *
+ * @param [in]	options	Handle options. NULL is process wide default options.
+ *
+ * @return size_t
+ * @retval 0 Argument error.
+ * @retval >0 Scratch buffer size (byte).
+ */
+size_t refop_handle_scratch_size(const refop_options_t *options)
+{
+	refop_options_t opts;
+
+	if (options != NULL && refop_options_valid(options) == false)
+		return 0;
+
+	refop_get_config_default_options(&opts);
+	if (options != NULL && options->size_limit != 0)
+		opts.size_limit = options->size_limit;
+
+	return (size_t) opts.size_limit + REFOP_SCRATCH_HEADER_SIZE;
+}
+
+/**
+ * The refop handle create function in caller supplied memory.
+ * The handle is placed in storage and it does not use heap memory.  The scratch buffer is used as
+ * the write buffer of set operation, so set and get of rotation mode, ping-pong mode and A/B slot mode
+ * in plain format run without heap allocation.  Other modes and formats use the library allocator.
+ * Storage and scratch shall be kept until refop_release_redundancy_handle().
+ * The handle could not be shared, shared option is an argument error and shared of the default options
+ * is not applied.
+ *
+ * @param [out]	handle	Created refop handle
+ * @param [in]	directry	Terget directry
+ * @param [in]	filename	Target file name.
+ * @param [in]	options	Handle options. NULL is allowed.
+ * @param [in]	storage	Handle storage, aligned to pointer size.
+ * @param [in]	storage_size	Storage size, it shall not be smaller than refop_handle_storage_size().
+ * @param [in]	scratch	Scratch buffer. NULL is allowed, then write buffer is allocated.
+ * @param [in]	scratch_size	Scratch buffer size, it shall not be smaller than refop_handle_scratch_size().
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_NOENT The target file/directroy was nothing.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed.
+ */
+refop_error_t refop_create_redundancy_handle_static(refop_handle_t *handle, const char *directry,
+						     const char *filename, const refop_options_t *options,
+						     void *storage, size_t storage_size, void *scratch,
+						     size_t scratch_size)
+{
+	struct refop_halndle *hndl = NULL;
+	size_t dirlen = 0, filelen = 0, required = 0;
+	refop_error_t refop_error = REFOP_SYSERROR;
+
+	if ((handle == NULL) || (directry == NULL) || (filename == NULL) || (storage == NULL))
+		return REFOP_ARGERROR;
+
+	if (((uintptr_t) storage % sizeof(void *)) != 0)
+		return REFOP_ARGERROR;
+
+	// A handle in caller storage has one owner, it could not be shared.
+	if (options != NULL && (refop_options_valid(options) == false || options->shared == true))
+		return REFOP_ARGERROR;
 
-	(void) strncpy(hndl->basedir, hndl->latestfile, PATH_MAX);
+	// Check a directry
+	refop_error = refop_directry_check(directry);
+	if (refop_error != REFOP_SUCCESS)
+		return refop_error;
+
+	// Check file path
+	dirlen = strnlen(directry, PATH_MAX);
+	filelen = strnlen(filename, PATH_MAX);
+	if ((dirlen + filelen + 10 + 1) > PATH_MAX || (dirlen == 0) ||
+	    (filelen == 0)) { // file suffix = max 10 byte, / = max 1 byte
+		return REFOP_ARGERROR;
+	}
 
-	(void) strcat(hndl->latestfile, filename);
+	required = refop_handle_storage_size(directry, filename);
+	if (storage_size < required)
+		return REFOP_ARGERROR;
+
+	if (scratch != NULL && scratch_size < refop_handle_scratch_size(options))
+		return REFOP_ARGERROR;
+
+	// Storage layout: handle, file name and private directory entry.
+	memset(storage, 0, required);
+	hndl = (struct refop_halndle *) storage;
+	memcpy(hndl->name, filename, filelen + 1);
+	hndl->dir = (struct refop_dir *) ((uint8_t *) storage + (required - refop_dir_size(directry)));
+	refop_dir_init(hndl->dir, directry);
+	hndl->scratch = (uint8_t *) scratch;
+	hndl->static_storage = true;
 
-	(void) strncpy(hndl->backupfile1, hndl->latestfile, PATH_MAX);
-	(void) strcat(hndl->backupfile1, c_bk1_suffix);
+	if (refop_options_apply(hndl, options) < 0)
+		return REFOP_SYSERROR;
 
-	(void) strncpy(hndl->newfile, hndl->latestfile, PATH_MAX);
-	(void) strcat(hndl->newfile, c_new_suffix);
+	(void) refop_file_state_probe(hndl);
 
 	(*handle) = hndl;
 
 	return REFOP_SUCCESS;
 }
+/**
+ * The process wide default options setting function.
+ * The default options are applied to handles that are created after this call by
+ * refop_create_redundancy_handle() and refop_create_redundancy_handle_ex() without options.
+ * When size_limit is 0 or options is NULL, the built-in default (1 MiB) is used.
+ * This function shall be called before other threads use refop.
+ *
+ * @param [in]	options	Default options. NULL reset to built-in default.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_set_default_options(const refop_options_t *options)
+{
+	refop_options_t opts = { 0 };
+
+	if (options != NULL) {
+		if (refop_options_valid(options) == false)
+			return REFOP_ARGERROR;
+		opts = (*options);
+	}
+
+	if (opts.size_limit == 0)
+		opts.size_limit = REFOP_DATA_SIZE_LIMIT_DEFAULT;
+
+	refop_set_config_default_options(&opts);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The process wide default options get function.
+ * It is useful to change a part of the default options.
+ *
+ * @param [out]	options	Current default options.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_get_default_options(refop_options_t *options)
+{
+	if (options == NULL)
+		return REFOP_ARGERROR;
+
+	refop_get_config_default_options(options);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The library allocator setting function.
+ * All heap memory of refop is allocated by alloc_fn and released by free_fn after this call.  The allocator
+ * is useful for arena, pool or TLSF allocator of embedded systems.
+ * This function shall be called before any handle and container are created, and shall not be called
+ * while those exist.
+ *
+ * @param [in]	alloc_fn	Allocation function. NULL reset to malloc of libc.
+ * @param [in]	free_fn	Free function. NULL reset to free of libc.
+ * @param [in]	ctx	Context that is passed to alloc_fn and free_fn.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error, one of alloc_fn and free_fn is NULL.
+ */
+refop_error_t refop_set_allocator(refop_alloc_fn_t alloc_fn, refop_free_fn_t free_fn, void *ctx)
+{
+	if ((alloc_fn == NULL) != (free_fn == NULL))
+		return REFOP_ARGERROR;
+
+	g_refop_allocator.alloc = alloc_fn;
+	g_refop_allocator.free = free_fn;
+	g_refop_allocator.ctx = (alloc_fn == NULL) ? NULL : ctx;
+
+	return REFOP_SUCCESS;
+}
+
 /**
  * The refop handle release function.
  * When you completed refop operation, you shall call this release function to release allocated memory.
@@ -105,7 +430,26 @@ refop_error_t refop_release_redundancy_handle(refop_handle_t handle)
 	if (handle == NULL)
 		return REFOP_ARGERROR;
 
-	free(handle);
+	// A shared handle is destroyed by the last release.
+	if (handle->shared == true && refop_registry_put(handle) == false)
+		return REFOP_SUCCESS;
+
+	// Pending and queued asynchronous operations are done before destroy.
+	(void) refop_set_coalesce_window(handle, 0);
+	(void) refop_set_shm_cache(handle, false);
+	refop_pool_drain(handle);
+
+	refop_delta_reset(handle);
+	refop_journal_reset(handle);
+	refop_snapshot_retire(handle);
+	refop_handle_lock_destroy(handle);
+
+	// Storage of static handle is owned by the caller.
+	if (handle->static_storage == true)
+		return REFOP_SUCCESS;
+
+	refop_dir_put(handle->dir);
+	refop_free(handle);
 
 	return REFOP_SUCCESS;
 }
@@ -115,8 +459,11 @@ refop_error_t refop_release_redundancy_handle(refop_handle_t handle)
  * When you want to write file, you call this function.
  * This function is not support partial and append write,only to support all overwrite for file.
  * If you write new data smaller than existing data, new data file truncated to new data file size.
- * This function is not support multi threaded set and get with same handle.
+ * This function is not support multi threaded set and get with same handle, except a handle that was
+ * created with thread_safe option.  Sets of thread safe handle are serialized and gets run concurrently,
+ * a get returns the data before or after a concurrent set.
  * In case of multi threaded set and get using separate handle, these operation is support.
+ * A handle that was created with process_lock option waits for writers of the same file in other processes.
  *
  * @param [in]	handle	Refop handle
  * @param [in]	data	Write data for set data.
@@ -129,110 +476,1097 @@ refop_error_t refop_release_redundancy_handle(refop_handle_t handle)
  */
 refop_error_t refop_set_redundancy_data(refop_handle_t handle, uint8_t *data, int64_t datasize)
 {
-	struct refop_halndle *hndl = (struct refop_halndle *) handle;
-	int ret = -1;
-
 	if (handle == NULL || data == NULL || datasize < 0)
 		return REFOP_ARGERROR;
 
-	ret = refop_new_file_write(handle, data, datasize);
-	if (ret < 0) {
-		if (ret == -1)
-			return REFOP_SYSERROR;
-		else
-			return REFOP_ARGERROR;
-	}
-
-	ret = refop_file_rotation(handle);
-	if (ret < 0) {
-		(void) unlink(hndl->newfile);
-		return REFOP_SYSERROR;
-	}
+	refop_pool_drain(handle);
 
-	return REFOP_SUCCESS;
+	return refop_op_execute(handle, REFOP_OP_SET, data, datasize, NULL);
 }
+
 /**
- * The data get function of refop.
- * When you want to read file, you call this function.
- * When you set data size that smaller than existing file, this function read requested data size.
- * When you set data size that larger than existing file, this function read existing file data size.
- * How many data was reading, this function set to getsize.
- * This function is not support multi threaded set and get with same handle.
- * In case of multi threaded set and get using separate handle, these operation is support.
+ * The data set function of refop with lock timeout.
+ * It is same as refop_set_redundancy_data(), but it does not wait for another writer longer than timeout.
+ * The handle lock of thread safe handle and the cross-process writer lock are waited for.  The
+ * cross-process writer lock is used even if the handle was not created with process_lock option.
  *
  * @param [in]	handle	Refop handle
- * @param [in]	data	Read buffer for get data.
- * @param [in]	datasize	Read buffer size (byte).
- * @param [out]	getsize	Readed size (byte).
+ * @param [in]	data	Write data for set data.
+ * @param [in]	datasize	Write data size (byte).
+ * @param [in]	timeout_ms	Lock timeout (ms), 0 is try once.
  *
  * @return refop_error_t
  * @retval REFOP_SUCCESS This operation was succeeded.
- * @retval REFOP_RECOVER This operation was succeeded within recovery.
- * @retval REFOP_NOENT The target file/directroy was nothing.
- * @retval REFOP_BROKEN This operation was failed. Because all recovery method was failed.
+ * @retval REFOP_BUSY Another writer had the lock until timeout.
  * @retval REFOP_ARGERROR Argument error.
  * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
  */
-
-refop_error_t refop_get_redundancy_data(refop_handle_t handle, uint8_t *data, int64_t datasize, int64_t *getsize)
+refop_error_t refop_try_set_redundancy_data(refop_handle_t handle, uint8_t *data, int64_t datasize, int timeout_ms)
 {
 	refop_error_t result = REFOP_SYSERROR;
-	int ret = -1;
+	int64_t remain = 0, deadline = 0;
 
-	if (handle == NULL || data == NULL || datasize < 0 || getsize == NULL)
+	if (handle == NULL || data == NULL || datasize < 0 || timeout_ms < 0)
 		return REFOP_ARGERROR;
 
-	ret = refop_file_pickup(handle, data, datasize, getsize);
-	if (ret == 0)
-		result = REFOP_SUCCESS;
-	else if (ret == 1)
-		result = REFOP_RECOVER;
-	else if (ret == -2)
-		result = REFOP_NOENT;
-	else if (ret == -3)
-		result = REFOP_BROKEN;
-	else
-		result = REFOP_SYSERROR;
+	refop_pool_drain(handle);
+
+	refop_txn_recover(handle);
+
+	deadline = refop_lock_clock_ms() + timeout_ms;
+	if (refop_handle_wrlock_timeout(handle, timeout_ms) < 0)
+		return REFOP_BUSY;
+
+	remain = deadline - refop_lock_clock_ms();
+	if (remain < 0)
+		remain = 0;
+
+	result = refop_data_set_locked(handle, data, datasize, (int) remain);
+	refop_handle_unlock(handle);
 
 	return result;
 }
 
 /**
- * The function of refop all file clean.
+ * The data set function under the cross-process writer lock.  The lock is used when the handle has
+ * process_lock option or timeout is not infinite.
  *
- * @param [in]	handle	refop handle
+ * @param [in]	handle	Refop handle
+ * @param [in]	data	Write data for set data.
+ * @param [in]	datasize	Write data size (byte).
+ * @param [in]	timeout_ms	Lock timeout (ms), -1 is infinite.
  *
  * @return refop_error_t
  * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_BUSY Another writer had the lock until timeout.
  * @retval REFOP_ARGERROR Argument error.
  * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
  */
-refop_error_t refop_remove_redundancy_data(refop_handle_t handle)
+static refop_error_t refop_data_set_locked(refop_handle_t handle, uint8_t *data, int64_t datasize,
+					   int timeout_ms)
 {
-	struct refop_halndle *hndl = (struct refop_halndle *) handle;
-	refop_error_t errorret = REFOP_SUCCESS;
-	int ret = -1;
-
-	if (handle == NULL)
-		return REFOP_ARGERROR;
+	refop_error_t result = REFOP_SYSERROR;
+	int fd = -1, shmfd = -1, ret = -1;
 
-	ret = unlink(hndl->newfile);
-	if (ret < 0) {
-		if (errno != ENOENT)
-			errorret = REFOP_SYSERROR;
+	if (handle->process_lock == true || timeout_ms >= 0) {
+		ret = refop_process_lock(handle, timeout_ms, &fd);
+		if (ret < 0)
+			return (ret == -2) ? REFOP_BUSY : REFOP_SYSERROR;
 	}
 
-	ret = unlink(hndl->latestfile);
-	if (ret < 0) {
-		if (errno != ENOENT)
-			errorret = REFOP_SYSERROR;
+	// Without the cache segment lock, readers of the cache could take the old value after the change.
+	shmfd = refop_shm_write_begin(handle);
+	if (shmfd != -2) {
+		result = refop_data_set(handle, data, datasize);
+		refop_shm_write_end(handle, shmfd);
 	}
+	refop_process_unlock(fd);
 
-	ret = unlink(hndl->backupfile1);
+	// Snapshot readers see the new value without get.
+	if (result == REFOP_SUCCESS)
+		refop_snapshot_update(handle, data, datasize);
+	else
+		refop_snapshot_retire(handle);
+
+	return result;
+}
+
+/**
+ * The data set function without handle lock.
+ *
+ * @param [in]	handle	Refop handle
+ * @param [in]	data	Write data for set data.
+ * @param [in]	datasize	Write data size (byte).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+static refop_error_t refop_data_set(refop_handle_t handle, uint8_t *data, int64_t datasize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	char path[PATH_MAX];
+	int ret = -1;
+
+	switch (hndl->mode) {
+	case REFOP_MODE_PINGPONG:
+		ret = refop_pingpong_write(handle, data, datasize);
+		break;
+	case REFOP_MODE_SLOT:
+		ret = refop_slot_write(handle, data, datasize);
+		break;
+	case REFOP_MODE_PARITY:
+		ret = refop_parity_write(handle, data, datasize);
+		break;
+	case REFOP_MODE_DELTA:
+		ret = refop_delta_write(handle, data, datasize);
+		break;
+	case REFOP_MODE_JOURNAL:
+		ret = refop_journal_write(handle, data, datasize);
+		break;
+	case REFOP_MODE_CHUNK:
+		ret = refop_chunk_write(handle, data, datasize);
+		break;
+	default:
+		ret = refop_new_file_write(handle, data, datasize);
+		break;
+	}
+	if (ret < 0) {
+		if (ret == -1)
+			return REFOP_SYSERROR;
+		else
+			return REFOP_ARGERROR;
+	}
+
+	// Other modes do not need file rotation.
+	if (hndl->mode != REFOP_MODE_ROTATION) {
+		if (refop_upgrade_target(handle) == true)
+			refop_upgrade_cleanup(handle);
+		return REFOP_SUCCESS;
+	}
+
+	ret = refop_file_rotation(handle);
+	if (ret < 0) {
+		if (refop_handle_path(handle, c_new_suffix, path) == 0)
+			(void) unlink(path);
+		return REFOP_SYSERROR;
+	}
+
+	return REFOP_SUCCESS;
+}
+/**
+ * The data get function of refop.
+ * When you want to read file, you call this function.
+ * When you set data size that smaller than existing file, this function read requested data size.
+ * When you set data size that larger than existing file, this function read existing file data size.
+ * How many data was reading, this function set to getsize.
+ * This function is not support multi threaded set and get with same handle, except a handle that was
+ * created with thread_safe option.  Sets of thread safe handle are serialized and gets run concurrently,
+ * a get returns the data before or after a concurrent set.
+ * In case of multi threaded set and get using separate handle, these operation is support.
+ *
+ * @param [in]	handle	Refop handle
+ * @param [in]	data	Read buffer for get data.
+ * @param [in]	datasize	Read buffer size (byte).
+ * @param [out]	getsize	Readed size (byte).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_RECOVER This operation was succeeded within recovery.
+ * @retval REFOP_NOENT The target file/directroy was nothing.
+ * @retval REFOP_BROKEN This operation was failed. Because all recovery method was failed.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+
+refop_error_t refop_get_redundancy_data(refop_handle_t handle, uint8_t *data, int64_t datasize, int64_t *getsize)
+{
+	if (handle == NULL || data == NULL || datasize < 0 || getsize == NULL)
+		return REFOP_ARGERROR;
+
+	// Pending value of write coalescing is newer than files.
+	if (refop_pool_pending_get(handle, data, datasize, getsize) == true)
+		return REFOP_SUCCESS;
+
+	refop_pool_drain(handle);
+
+	return refop_op_execute(handle, REFOP_OP_GET, data, datasize, getsize);
+}
+
+/**
+ * The data get function without handle lock.
+ *
+ * @param [in]	handle	Refop handle
+ * @param [in]	data	Read buffer for get data.
+ * @param [in]	datasize	Read buffer size (byte).
+ * @param [out]	getsize	Readed size (byte).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_RECOVER This operation was succeeded within recovery.
+ * @retval REFOP_NOENT The target file/directroy was nothing.
+ * @retval REFOP_BROKEN This operation was failed. Because all recovery method was failed.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+static refop_error_t refop_data_get(refop_handle_t handle, uint8_t *data, int64_t datasize, int64_t *getsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	refop_error_t result = REFOP_SYSERROR;
+	int ret = -1;
+
+	switch (hndl->mode) {
+	case REFOP_MODE_PINGPONG:
+		ret = refop_pingpong_pickup(handle, data, datasize, getsize);
+		break;
+	case REFOP_MODE_SLOT:
+		ret = refop_slot_pickup(handle, data, datasize, getsize);
+		break;
+	case REFOP_MODE_PARITY:
+		ret = refop_parity_pickup(handle, data, datasize, getsize);
+		break;
+	case REFOP_MODE_DELTA:
+		ret = refop_delta_pickup(handle, data, datasize, getsize);
+		break;
+	case REFOP_MODE_JOURNAL:
+		ret = refop_journal_pickup(handle, data, datasize, getsize);
+		break;
+	case REFOP_MODE_CHUNK:
+		ret = refop_chunk_pickup(handle, data, datasize, getsize);
+		break;
+	default:
+		ret = refop_file_pickup(handle, data, datasize, getsize);
+		break;
+	}
+
+	// Data of rotation mode is used until first set of new mode.
+	if (ret == -2 && refop_upgrade_target(handle) == true && hndl->upgrade_done == false)
+		ret = refop_file_pickup(handle, data, datasize, getsize);
+
+	if (ret == 0)
+		result = REFOP_SUCCESS;
+	else if (ret == 1)
+		result = REFOP_RECOVER;
+	else if (ret == -2)
+		result = REFOP_NOENT;
+	else if (ret == -3)
+		result = REFOP_BROKEN;
+	else
+		result = REFOP_SYSERROR;
+
+	return result;
+}
+
+/**
+ * The data get function without handle lock that uses the shared memory cache.  When the cache has no
+ * valid value, the full value is read from files and published for other processes.
+ *
+ * @param [in]	handle	Refop handle
+ * @param [in]	data	Read buffer for get data.
+ * @param [in]	datasize	Read buffer size (byte).
+ * @param [out]	getsize	Readed size (byte).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_RECOVER This operation was succeeded within recovery.
+ * @retval REFOP_NOENT The target file/directroy was nothing.
+ * @retval REFOP_BROKEN This operation was failed. Because all recovery method was failed.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+static refop_error_t refop_data_get_cached(refop_handle_t handle, uint8_t *data, int64_t datasize,
+					   int64_t *getsize)
+{
+	refop_error_t result = REFOP_SYSERROR;
+	uint64_t generation = 0;
+	uint8_t *pbuf = NULL;
+	int64_t limit = 0, readsize = 0;
+	int ret = -1;
+
+	ret = refop_shm_get(handle, data, datasize, getsize, &generation);
+	if (ret == 0)
+		return REFOP_SUCCESS;
+
+	limit = (int64_t) refop_get_config_handle_size_limit(handle);
+	if (ret == -1 || datasize >= limit)
+		pbuf = data;
+	else
+		pbuf = (uint8_t *) refop_malloc((size_t) limit);
+
+	// Without memory, the caller buffer is used and the value is not published.
+	if (pbuf == NULL)
+		return refop_data_get(handle, data, datasize, getsize);
+
+	result = refop_data_get(handle, pbuf, (pbuf == data) ? datasize : limit, &readsize);
+	if (ret == -2 && (result == REFOP_SUCCESS || result == REFOP_RECOVER) && readsize < limit)
+		refop_shm_publish(handle, generation, pbuf, readsize);
+
+	if (pbuf != data) {
+		if (readsize > datasize)
+			readsize = datasize;
+		(void) memcpy(data, pbuf, (size_t) readsize);
+		refop_free(pbuf);
+	}
+	(*getsize) = readsize;
+
+	return result;
+}
+
+/**
+ * The function of refop all file clean.
+ *
+ * @param [in]	handle	refop handle
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+refop_error_t refop_remove_redundancy_data(refop_handle_t handle)
+{
+	if (handle == NULL)
+		return REFOP_ARGERROR;
+
+	refop_pool_drain(handle);
+
+	return refop_op_execute(handle, REFOP_OP_REMOVE, NULL, 0, NULL);
+}
+
+/**
+ * The data verify function of refop.
+ * It reads and validates the newest data like refop_get_redundancy_data(), without copy to the caller.
+ * A work buffer of the data size limit is allocated.
+ *
+ * @param [in]	handle	Refop handle
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS The data is valid.
+ * @retval REFOP_RECOVER The data is valid within recovery.
+ * @retval REFOP_NOENT The target file/directroy was nothing.
+ * @retval REFOP_BROKEN All recovery method was failed.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+refop_error_t refop_verify_redundancy_data(refop_handle_t handle)
+{
+	if (handle == NULL)
+		return REFOP_ARGERROR;
+
+	refop_pool_drain(handle);
+
+	return refop_op_execute(handle, REFOP_OP_VERIFY, NULL, 0, NULL);
+}
+
+/**
+ * Execute an operation with the handle lock.  Synchronous functions and workers of asynchronous
+ * operations use this function, so both have the same behavior.
+ *
+ * @param [in]	handle	Refop handle
+ * @param [in]	op	Operation.
+ * @param [in]	data	Set: write data, get: read buffer, others: not used.
+ * @param [in]	datasize	Size of data (byte).
+ * @param [out]	getsize	Get: readed size (byte), others: not used.
+ *
+ * @return refop_error_t	Result of the operation.
+ */
+refop_error_t refop_op_execute(
+	refop_handle_t handle, refop_op_t op, uint8_t *data, int64_t datasize, int64_t *getsize)
+{
+	refop_error_t result = REFOP_SYSERROR;
+	uint8_t *pbuf = NULL;
+	int64_t readsize = 0;
+	int fd = -1, shmfd = -1;
+
+	// An interrupted transaction of the directory is finished before the handle lock.
+	refop_txn_recover(handle);
+
+	switch (op) {
+	case REFOP_OP_SET:
+		refop_handle_wrlock(handle);
+		result = refop_data_set_locked(handle, data, datasize, -1);
+		refop_handle_unlock(handle);
+		break;
+	case REFOP_OP_GET:
+		refop_handle_read_lock(handle);
+		result = refop_data_get_cached(handle, data, datasize, getsize);
+		refop_handle_unlock(handle);
+		break;
+	case REFOP_OP_REMOVE:
+		refop_handle_wrlock(handle);
+		if (handle->process_lock == false || refop_process_lock(handle, -1, &fd) == 0) {
+			shmfd = refop_shm_write_begin(handle);
+			if (shmfd != -2) {
+				result = refop_data_remove(handle);
+				if (result == REFOP_SUCCESS)
+					refop_shm_remove(handle);
+				refop_shm_write_end(handle, shmfd);
+			}
+			refop_process_unlock(fd);
+		}
+		refop_snapshot_retire(handle);
+		refop_handle_unlock(handle);
+		break;
+	default:
+		pbuf = (uint8_t *) refop_malloc(refop_get_config_handle_size_limit(handle));
+		if (pbuf == NULL)
+			break;
+		refop_handle_read_lock(handle);
+		result = refop_data_get(handle, pbuf, (int64_t) refop_get_config_handle_size_limit(handle), &readsize);
+		refop_handle_unlock(handle);
+		refop_free(pbuf);
+		break;
+	}
+
+	return result;
+}
+
+/**
+ * The data remove function without handle lock.
+ *
+ * @param [in]	handle	Refop handle
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+static refop_error_t refop_data_remove(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	refop_error_t errorret = REFOP_SUCCESS;
+	char latestfile[PATH_MAX], backupfile1[PATH_MAX], newfile[PATH_MAX];
+	int ret = -1;
+
+	if (hndl->mode != REFOP_MODE_ROTATION) {
+		// Keyframe, base and manifest files are removed by each mode.
+		hndl->file_state = 0;
+		if (hndl->mode == REFOP_MODE_PINGPONG)
+			ret = refop_pingpong_remove(handle);
+		else if (hndl->mode == REFOP_MODE_PARITY)
+			ret = refop_parity_remove(handle);
+		else if (hndl->mode == REFOP_MODE_DELTA)
+			ret = refop_delta_remove(handle);
+		else if (hndl->mode == REFOP_MODE_JOURNAL)
+			ret = refop_journal_remove(handle);
+		else if (hndl->mode == REFOP_MODE_CHUNK)
+			ret = refop_chunk_remove(handle);
+		else
+			ret = refop_slot_remove(handle);
+		if (ret < 0)
+			errorret = REFOP_SYSERROR;
+
+		// Old data shall not be visible after remove.
+		if (refop_upgrade_target(handle) == true) {
+			hndl->upgrade_done = false;
+			refop_upgrade_cleanup(handle);
+		}
+
+		return errorret;
+	}
+
+	if (refop_handle_path(handle, "", latestfile) < 0 ||
+	    refop_handle_path(handle, c_bk1_suffix, backupfile1) < 0 ||
+	    refop_handle_path(handle, c_new_suffix, newfile) < 0)
+		return REFOP_SYSERROR;
+
+	ret = unlink(newfile);
+	if (ret < 0) {
+		if (errno != ENOENT)
+			errorret = REFOP_SYSERROR;
+	}
+
+	ret = unlink(latestfile);
+	if (ret < 0) {
+		if (errno != ENOENT)
+			errorret = REFOP_SYSERROR;
+	}
+
+	ret = unlink(backupfile1);
 	if (ret < 0) {
 		if (errno != ENOENT)
 			errorret = REFOP_SYSERROR;
 	}
 
+	// No file is known state, next set does not need probing.
+	hndl->file_state = (errorret == REFOP_SUCCESS) ? REFOP_FILE_STATE_VALID : 0;
+
 	return errorret;
 }
+
+/**
+ * The function of refop redundancy mode setting.
+ * The default mode is REFOP_MODE_ROTATION.
+ * In case of REFOP_MODE_PINGPONG, this library overwrite older file of two fixed files that have
+ * generation number in header.  Set operation do not need any rename and directory sync.
+ * In case of REFOP_MODE_SLOT, this library use one preallocated file that has two slots.  Set operation
+ * overwrite older slot by pwrite and fdatasync.  Slot capacity shall be set by refop_set_slot_capacity().
+ * In case of REFOP_MODE_PARITY, this library store data once with XOR parity blocks instead of backup file.
+ * In case of REFOP_MODE_DELTA, this library append binary diff from previous generation to a delta file,
+ * and write full keyframe by file rotation periodically.
+ * In case of REFOP_MODE_JOURNAL, this library append full value record to a journal file, and compact the
+ * journal to file rotation periodically or by refop_compact_journal().
+ * In case of REFOP_MODE_CHUNK, this library split data to content defined chunks that are stored once in a
+ * chunk directory, and write the manifest of chunk references by file rotation.
+ * Data files are not compatible between each mode. This setting shall be done before first set/get.
+ *
+ * @param [in]	handle	refop handle
+ * @param [in]	mode	Redundancy mode
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_set_redundancy_mode(refop_handle_t handle, refop_mode_t mode)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if (handle == NULL)
+		return REFOP_ARGERROR;
+
+	if (mode != REFOP_MODE_ROTATION && mode != REFOP_MODE_PINGPONG && mode != REFOP_MODE_SLOT &&
+	    mode != REFOP_MODE_PARITY && mode != REFOP_MODE_DELTA && mode != REFOP_MODE_JOURNAL &&
+	    mode != REFOP_MODE_CHUNK)
+		return REFOP_ARGERROR;
+
+	refop_pool_drain(handle);
+	refop_handle_wrlock(handle);
+	refop_delta_reset(handle);
+	refop_journal_reset(handle);
+	refop_snapshot_retire(handle);
+	refop_shm_invalidate(handle);
+	hndl->mode = mode;
+	hndl->upgrade_done = false;
+	hndl->slot_cached = false;
+	hndl->generation = 0;
+	refop_handle_unlock(handle);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The function of refop slot capacity setting for REFOP_MODE_SLOT.
+ * The slot file is preallocated by this capacity at first set operation.
+ * The slot size including header is rounded up to 4 KiB alignment.
+ * When the slot file was already existing, capacity of existing file is used.
+ *
+ * @param [in]	handle	refop handle
+ * @param [in]	capacity	Maximum data size of one slot (byte).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_set_slot_capacity(refop_handle_t handle, int64_t capacity)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if (handle == NULL || capacity <= 0 || capacity > (int64_t) refop_get_config_handle_size_limit(handle))
+		return REFOP_ARGERROR;
+
+	refop_pool_drain(handle);
+	refop_handle_wrlock(handle);
+	hndl->slot_capacity = capacity;
+	refop_handle_unlock(handle);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The function of refop backup count setting for REFOP_MODE_PINGPONG.
+ * Ping-pong mode use count + 1 files as ring. The oldest file is overwritten by set operation.
+ * The default backup count is 1. Data files are not changed by this setting, therefore
+ * when this setting reduced, files that are over the count are ignored until remove.
+ *
+ * @param [in]	handle	refop handle
+ * @param [in]	count	Backup count (1 to 15).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_set_backup_count(refop_handle_t handle, int count)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if (handle == NULL || count < 1 || count > REFOP_BACKUP_COUNT_MAX)
+		return REFOP_ARGERROR;
+
+	refop_pool_drain(handle);
+	refop_handle_wrlock(handle);
+	hndl->backup_count = count;
+	hndl->slot_cached = false;
+	refop_handle_unlock(handle);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The function of refop parity overhead setting for REFOP_MODE_PARITY.
+ * One parity block is added per 100 / percent data blocks (4 KiB).  One broken block per parity group
+ * is recoverable.  The default is 25 percent.  This setting is applied from next set operation.
+ *
+ * @param [in]	handle	refop handle
+ * @param [in]	percent	Parity overhead (5 to 50 percent).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_set_parity_overhead(refop_handle_t handle, int percent)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if (handle == NULL || percent < 5 || percent > 50)
+		return REFOP_ARGERROR;
+
+	refop_pool_drain(handle);
+	refop_handle_wrlock(handle);
+	hndl->parity_group = 100 / percent;
+	refop_handle_unlock(handle);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The indexed generation get function of refop.
+ * This function read n-th newest generation without recovery. The generation 0 is newest.
+ * It is useful for diagnostics and rollback.  This function does not read other generations data block.
+ * In case of REFOP_MODE_ROTATION, generation 0 is latest file and generation 1 is backup file.
+ *
+ * @param [in]	handle	Refop handle
+ * @param [in]	n	Generation index.
+ * @param [in]	data	Read buffer for get data.
+ * @param [in]	datasize	Read buffer size (byte).
+ * @param [out]	getsize	Readed size (byte).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_NOENT The target generation was nothing.
+ * @retval REFOP_BROKEN The target generation was broken.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+refop_error_t refop_get_generation(refop_handle_t handle, int n, uint8_t *data, int64_t datasize, int64_t *getsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	refop_error_t result = REFOP_SYSERROR;
+	int ret = -1;
+
+	if (handle == NULL || n < 0 || data == NULL || datasize < 0 || getsize == NULL)
+		return REFOP_ARGERROR;
+
+	refop_pool_drain(handle);
+	refop_handle_read_lock(handle);
+	switch (hndl->mode) {
+	case REFOP_MODE_PINGPONG:
+		ret = refop_pingpong_get_generation(handle, n, data, datasize, getsize);
+		break;
+	case REFOP_MODE_SLOT:
+		ret = refop_slot_get_generation(handle, n, data, datasize, getsize);
+		break;
+	case REFOP_MODE_PARITY:
+		ret = refop_parity_get_generation(handle, n, data, datasize, getsize);
+		break;
+	case REFOP_MODE_DELTA:
+		ret = refop_delta_get_generation(handle, n, data, datasize, getsize);
+		break;
+	case REFOP_MODE_JOURNAL:
+		ret = refop_journal_get_generation(handle, n, data, datasize, getsize);
+		break;
+	case REFOP_MODE_CHUNK:
+		ret = refop_chunk_get_generation(handle, n, data, datasize, getsize);
+		break;
+	default:
+		ret = refop_file_get_generation(handle, n, data, datasize, getsize);
+		break;
+	}
+	refop_handle_unlock(handle);
+
+	if (ret == 0)
+		result = REFOP_SUCCESS;
+	else if (ret == -2)
+		result = REFOP_NOENT;
+	else if (ret == -3)
+		result = REFOP_BROKEN;
+	else
+		result = REFOP_SYSERROR;
+
+	return result;
+}
+
+/**
+ * The function of refop block checksum format setting for REFOP_MODE_ROTATION.
+ * When enabled, set operation write a data file that has crc table of every 4 KiB block after header.
+ * It enable range read by refop_get_redundancy_range() and block level recovery that merge valid blocks
+ * of the latest file and the backup file.  Get operation can read both formats regardless of this setting.
+ *
+ * @param [in]	handle	refop handle
+ * @param [in]	enable	true: block checksum format, false: legacy format (default).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_set_block_checksum(refop_handle_t handle, bool enable)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if (handle == NULL)
+		return REFOP_ARGERROR;
+
+	refop_pool_drain(handle);
+	refop_handle_wrlock(handle);
+	hndl->block_checksum = enable;
+	refop_handle_unlock(handle);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The function of refop compression setting for REFOP_MODE_ROTATION.
+ * When enabled, set operation compress data by LZ4 block format and write it with version 5 header.
+ * The crc covers compressed data, so corruption is detected before decompression.  When data is
+ * small or compression has no gain, data is written without compression.  Compression has priority
+ * over block checksum format.  Get operation can read all formats regardless of this setting.
+ *
+ * @param [in]	handle	refop handle
+ * @param [in]	enable	true: compression enabled, false: disabled (default).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_set_compression(refop_handle_t handle, bool enable)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if (handle == NULL)
+		return REFOP_ARGERROR;
+
+	refop_pool_drain(handle);
+	refop_handle_wrlock(handle);
+	hndl->compression = enable;
+	refop_handle_unlock(handle);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The function of refop direct I/O setting for REFOP_MODE_ROTATION.
+ * When enabled, set operation write the direct I/O format that has a header padded to 4 KiB and data
+ * padded to 4 KiB, and the file is written by O_DIRECT.  Get operation read the direct I/O format by
+ * O_DIRECT regardless of this setting, so large data do not stay in the page cache.  When the file system
+ * does not support O_DIRECT, buffered I/O is used and the pages are dropped from the page cache.
+ * Direct I/O has priority over compression and block checksum format.
+ *
+ * @param [in]	handle	refop handle
+ * @param [in]	enable	true: direct I/O enabled, false: disabled (default).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_set_direct_io(refop_handle_t handle, bool enable)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if (handle == NULL)
+		return REFOP_ARGERROR;
+
+	refop_pool_drain(handle);
+	refop_handle_wrlock(handle);
+	hndl->direct_io = enable;
+	refop_handle_unlock(handle);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The function of refop lazy upgrade setting.
+ * When enabled, a handle of REFOP_MODE_PINGPONG, REFOP_MODE_SLOT or REFOP_MODE_PARITY read data from the
+ * files of REFOP_MODE_ROTATION (all formats) until first set.  First successful set in new mode remove
+ * the old files, so existing data is upgraded on its next set without migration step.
+ * Other modes use the files of REFOP_MODE_ROTATION as base, so the data is already readable.
+ *
+ * @param [in]	handle	refop handle
+ * @param [in]	enable	true: lazy upgrade enabled, false: disabled (default).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_set_lazy_upgrade(refop_handle_t handle, bool enable)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if (handle == NULL)
+		return REFOP_ARGERROR;
+
+	refop_pool_drain(handle);
+	refop_handle_wrlock(handle);
+	refop_snapshot_retire(handle);
+	refop_shm_invalidate(handle);
+	hndl->lazy_upgrade = enable;
+	hndl->upgrade_done = false;
+	refop_handle_unlock(handle);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The range data get function of refop.
+ * This function read datasize bytes from offset of stored data.
+ * In case of block checksum format, only blocks that cover requested range are read and verified.
+ * In other case, this function read full data with recovery and copy requested range.
+ * When offset is larger than existing data size, getsize is 0.
+ *
+ * @param [in]	handle	Refop handle
+ * @param [in]	offset	Offset of stored data (byte).
+ * @param [in]	data	Read buffer for get data.
+ * @param [in]	datasize	Read size (byte).
+ * @param [out]	getsize	Readed size (byte).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_RECOVER This operation was succeeded within recovery.
+ * @retval REFOP_NOENT The target file/directroy was nothing.
+ * @retval REFOP_BROKEN This operation was failed. Because all recovery method was failed.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+refop_error_t refop_get_redundancy_range(
+	refop_handle_t handle, int64_t offset, uint8_t *data, int64_t datasize, int64_t *getsize)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	refop_error_t result = REFOP_SYSERROR;
+	uint8_t *pbuf = NULL;
+	int64_t bufsize = 0, readsize = 0;
+	int ret = -1;
+
+	if (handle == NULL || offset < 0 || data == NULL || datasize < 0 || getsize == NULL)
+		return REFOP_ARGERROR;
+
+	// Other modes use fallback.
+	ret = -2;
+	refop_pool_drain(handle);
+	refop_handle_rdlock(handle);
+	if (hndl->mode == REFOP_MODE_ROTATION)
+		ret = refop_block_get_range(handle, offset, data, datasize, getsize);
+	refop_handle_unlock(handle);
+
+	if (ret == 0)
+		return REFOP_SUCCESS;
+	else if (ret == 1)
+		return REFOP_RECOVER;
+	else if (ret == -1)
+		return REFOP_SYSERROR;
+
+	// Fallback, read full data.
+	if (offset >= (int64_t) refop_get_config_handle_size_limit(handle)) {
+		(*getsize) = 0;
+		return REFOP_SUCCESS;
+	}
+
+	bufsize = offset + datasize;
+	if (bufsize > (int64_t) refop_get_config_handle_size_limit(handle))
+		bufsize = (int64_t) refop_get_config_handle_size_limit(handle);
+
+	pbuf = (uint8_t *) refop_malloc(bufsize);
+	if (pbuf == NULL)
+		return REFOP_SYSERROR;
+
+	result = refop_get_redundancy_data(handle, pbuf, bufsize, &readsize);
+	if (result == REFOP_SUCCESS || result == REFOP_RECOVER) {
+		if (readsize > offset) {
+			memcpy(data, pbuf + offset, readsize - offset);
+			(*getsize) = readsize - offset;
+		} else
+			(*getsize) = 0;
+	}
+
+	refop_free(pbuf);
+
+	return result;
+}
+
+/**
+ * The journal compaction function of refop for REFOP_MODE_JOURNAL.
+ * The newest value is written to new latest file by file rotation, and the journal file is truncated.
+ * Set operation compact the journal automatically when the journal is full, but the application can
+ * call this function from idle time or a background thread to keep set operation short.
+ *
+ * @param [in]	handle	Refop handle
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_NOENT The target file/directroy was nothing.
+ * @retval REFOP_BROKEN This operation was failed. Because all recovery method was failed.
+ * @retval REFOP_ARGERROR Argument error or the handle is not journal mode.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+refop_error_t refop_compact_journal(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	int ret = -1;
+
+	if (handle == NULL)
+		return REFOP_ARGERROR;
+
+	refop_pool_drain(handle);
+	refop_handle_wrlock(handle);
+	if (hndl->mode == REFOP_MODE_JOURNAL)
+		ret = refop_journal_compact(handle);
+	else
+		ret = -4;
+	refop_handle_unlock(handle);
+
+	if (ret == -4)
+		return REFOP_ARGERROR;
+	else if (ret == 0)
+		return REFOP_SUCCESS;
+	else if (ret == -2)
+		return REFOP_NOENT;
+	else if (ret == -3)
+		return REFOP_BROKEN;
+
+	return REFOP_SYSERROR;
+}
+
+/**
+ * Check the handle need lazy upgrade from files of rotation mode.
+ *
+ * @param [in]	handle	Refop handle
+ *
+ * @return bool
+ * @retval true Lazy upgrade is enabled and the mode does not use files of rotation mode.
+ * @retval false Lazy upgrade is not needed.
+ */
+static bool refop_upgrade_target(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if (hndl->lazy_upgrade == false)
+		return false;
+
+	return (hndl->mode == REFOP_MODE_PINGPONG || hndl->mode == REFOP_MODE_SLOT || hndl->mode == REFOP_MODE_PARITY);
+}
+
+/**
+ * Remove files of rotation mode after first set of new mode.
+ * When remove was lost by power loss, files of new mode are used before old files.
+ *
+ * @param [in]	handle	Refop handle
+ */
+static void refop_upgrade_cleanup(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	const char *suffixes[3] = { c_new_suffix, "", c_bk1_suffix };
+	char path[PATH_MAX];
+
+	if (hndl->upgrade_done == true)
+		return;
+
+	for (int i = 0; i < 3; i++) {
+		if (refop_handle_path(handle, suffixes[i], path) == 0)
+			(void) unlink(path);
+	}
+	hndl->file_state = 0;
+	hndl->upgrade_done = true;
+}
+
+/**
+ * Options validation.
+ *
+ * @param [in]	options	Handle options.
+ *
+ * @return bool
+ * @retval true Valid options.
+ * @retval false Invalid options.
+ */
+bool refop_options_valid(const refop_options_t *options)
+{
+	if (options->size_limit > REFOP_DATA_SIZE_LIMIT_MAX)
+		return false;
+
+	if (options->durability != REFOP_DURABILITY_FULL && options->durability != REFOP_DURABILITY_DATA &&
+	    options->durability != REFOP_DURABILITY_NONE)
+		return false;
+
+	if (options->backup_count < 0 || options->backup_count > REFOP_BACKUP_COUNT_MAX)
+		return false;
+
+	if (options->io_backend != REFOP_IO_BUFFERED && options->io_backend != REFOP_IO_DIRECT)
+		return false;
+
+	return true;
+}
+
+/**
+ * Check the target directry of a new handle.
+ *
+ * @param [in]	directry	Terget directry
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS The directry exists.
+ * @retval REFOP_NOENT The target directroy was nothing.
+ * @retval REFOP_ARGERROR Too long path.
+ * @retval REFOP_SYSERROR Other error.
+ */
+static refop_error_t refop_directry_check(const char *directry)
+{
+	struct stat sb;
+	int ret = -1;
+
+	ret = stat(directry, &sb);
+	if (ret < 0) {
+		if ((errno == EACCES) || (errno == ELOOP) || (errno == ENOENT) || (errno == ENOTDIR))
+			return REFOP_NOENT;
+		else if (errno == ENAMETOOLONG)
+			return REFOP_ARGERROR;
+		else
+			return REFOP_SYSERROR;
+	}
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * Apply handle options to a new handle.  Fields that are not set by options are the process wide
+ * default options.
+ *
+ * @param [in]	hndl	New refop handle.
+ * @param [in]	options	Validated handle options. NULL is allowed.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 The lock of thread safe handle could not be created.
+ */
+static int refop_options_apply(struct refop_halndle *hndl, const refop_options_t *options)
+{
+	refop_options_t opts;
+
+	refop_get_config_default_options(&opts);
+	if (options != NULL) {
+		if (options->size_limit != 0)
+			opts.size_limit = options->size_limit;
+		opts.durability = options->durability;
+		opts.backup_count = options->backup_count;
+		opts.cache_budget = options->cache_budget;
+		opts.io_backend = options->io_backend;
+		opts.thread_safe = options->thread_safe;
+		opts.process_lock = options->process_lock;
+		opts.shared = options->shared;
+	}
+	// A handle in caller storage is never registered as shared handle.
+	if (hndl->static_storage == true)
+		opts.shared = false;
+	hndl->size_limit = opts.size_limit;
+	hndl->durability = opts.durability;
+	hndl->backup_count = opts.backup_count;
+	hndl->cache_budget = opts.cache_budget;
+	hndl->direct_io = (opts.io_backend == REFOP_IO_DIRECT);
+	hndl->process_lock = opts.process_lock;
+
+	// Users of a shared handle do not know each other, so it is always thread safe.
+	if (opts.thread_safe == true || opts.shared == true)
+		return refop_handle_lock_create(hndl);
+
+	return 0;
+}
+
+/**
+ * Lock the handle for get operation.  Gets of most modes share the handle lock.  Delta mode and
+ * journal mode reconstruct and cache the value by get, so those are exclusive.
+ *
+ * @param [in]	handle	Refop handle.
+ */
+static void refop_handle_read_lock(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	refop_handle_rdlock(handle);
+
+	// Mode is changed under exclusive lock, so it is stable here.
+	if (hndl->mode == REFOP_MODE_DELTA || hndl->mode == REFOP_MODE_JOURNAL) {
+		refop_handle_unlock(handle);
+		refop_handle_wrlock(handle);
+	}
+}
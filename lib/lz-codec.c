@@ -0,0 +1,215 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	lz-codec.c
+ * @brief	LZ4 block format compatible codec
+ *
+ * Simple greedy single pass compressor that output LZ4 block format, and bounds checked decompressor.
+ * Compression ratio is lower than reference implementation, but output is readable by any LZ4 block
+ * decoder.
+ */
+#include "lz-codec.h"
+
+#include <string.h>
+
+#define LZ_HASH_LOG (12)
+#define LZ_MIN_MATCH (4)
+#define LZ_LAST_LITERALS (5)
+#define LZ_MFLIMIT (12)
+#define LZ_MAX_OFFSET (65535)
+
+static inline uint32_t lz_read32(const uint8_t *p)
+{
+	uint32_t v = 0;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - LZ_HASH_LOG);
+}
+
+/**
+ * Write LZ4 length extension bytes.
+ *
+ * @return int64_t	New output position, -1 is overflow.
+ */
+static int64_t lz_put_length(uint8_t *dst, int64_t op, int64_t dstcap, int64_t len)
+{
+	for (; len >= 255; len -= 255) {
+		if (op >= dstcap)
+			return -1;
+		dst[op++] = 255;
+	}
+
+	if (op >= dstcap)
+		return -1;
+	dst[op++] = (uint8_t) len;
+
+	return op;
+}
+
+/**
+ * Write one sequence.  When mlen is 0, only literals are written (last sequence).
+ *
+ * @return int64_t	New output position, -1 is overflow.
+ */
+static int64_t lz_put_sequence(uint8_t *dst, int64_t op, int64_t dstcap, const uint8_t *lit, int64_t litlen,
+			       uint32_t offset, int64_t mlen)
+{
+	int64_t token = 0;
+
+	if (op >= dstcap)
+		return -1;
+
+	token = op++;
+	dst[token] = (uint8_t)(((litlen >= 15) ? 15 : litlen) << 4);
+	if (litlen >= 15) {
+		op = lz_put_length(dst, op, dstcap, litlen - 15);
+		if (op < 0)
+			return -1;
+	}
+
+	if (op + litlen > dstcap)
+		return -1;
+	memcpy(dst + op, lit, litlen);
+	op += litlen;
+
+	if (mlen == 0)
+		return op;
+
+	if (op + 2 > dstcap)
+		return -1;
+	dst[op++] = (uint8_t)(offset & 0xff);
+	dst[op++] = (uint8_t)(offset >> 8);
+
+	mlen -= LZ_MIN_MATCH;
+	dst[token] |= (uint8_t)((mlen >= 15) ? 15 : mlen);
+	if (mlen >= 15) {
+		op = lz_put_length(dst, op, dstcap, mlen - 15);
+		if (op < 0)
+			return -1;
+	}
+
+	return op;
+}
+
+/**
+ * Compress to LZ4 block format.
+ *
+ * @param [in]	src	Source data.
+ * @param [in]	srclen	Source data size (bytes).
+ * @param [out]	dst	Output buffer.
+ * @param [in]	dstcap	Output buffer size (bytes).
+ *
+ * @return int64_t
+ * @retval >=0 Compressed size.
+ * @retval -1 Output buffer is too small.
+ */
+int64_t lz_compress(const uint8_t *src, int64_t srclen, uint8_t *dst, int64_t dstcap)
+{
+	uint32_t table[1 << LZ_HASH_LOG];
+	int64_t ip = 0, anchor = 0, op = 0, ref = 0, mlen = 0, mlimit = 0;
+	uint32_t seq = 0, h = 0;
+
+	memset(table, 0, sizeof(table));
+
+	if (srclen > LZ_MFLIMIT) {
+		mlimit = srclen - LZ_LAST_LITERALS;
+
+		while (ip < srclen - LZ_MFLIMIT) {
+			seq = lz_read32(src + ip);
+			h = lz_hash(seq);
+			ref = table[h];
+			table[h] = (uint32_t) ip;
+
+			if (ref >= ip || (ip - ref) > LZ_MAX_OFFSET || lz_read32(src + ref) != seq) {
+				ip++;
+				continue;
+			}
+
+			mlen = LZ_MIN_MATCH;
+			while (ip + mlen < mlimit && src[ref + mlen] == src[ip + mlen])
+				mlen++;
+
+			op = lz_put_sequence(dst, op, dstcap, src + anchor, ip - anchor, (uint32_t)(ip - ref), mlen);
+			if (op < 0)
+				return -1;
+
+			ip += mlen;
+			anchor = ip;
+		}
+	}
+
+	return lz_put_sequence(dst, op, dstcap, src + anchor, srclen - anchor, 0, 0);
+}
+
+/**
+ * Decompress LZ4 block format with bounds check.
+ *
+ * @param [in]	src	Compressed data.
+ * @param [in]	srclen	Compressed data size (bytes).
+ * @param [out]	dst	Output buffer.
+ * @param [in]	dstcap	Output buffer size (bytes).
+ *
+ * @return int64_t
+ * @retval >=0 Decompressed size.
+ * @retval -1 Malformed data or output buffer is too small.
+ */
+int64_t lz_decompress(const uint8_t *src, int64_t srclen, uint8_t *dst, int64_t dstcap)
+{
+	int64_t ip = 0, op = 0, len = 0, offset = 0;
+	uint8_t token = 0, b = 0;
+
+	while (ip < srclen) {
+		token = src[ip++];
+
+		// literals
+		len = token >> 4;
+		if (len == 15) {
+			do {
+				if (ip >= srclen)
+					return -1;
+				b = src[ip++];
+				len += b;
+			} while (b == 255);
+		}
+		if (ip + len > srclen || op + len > dstcap)
+			return -1;
+		memcpy(dst + op, src + ip, len);
+		ip += len;
+		op += len;
+
+		// last sequence has literals only
+		if (ip == srclen)
+			break;
+
+		// match
+		if (ip + 2 > srclen)
+			return -1;
+		offset = (int64_t) src[ip] | ((int64_t) src[ip + 1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > op)
+			return -1;
+
+		len = (token & 0x0f) + LZ_MIN_MATCH;
+		if ((token & 0x0f) == 15) {
+			do {
+				if (ip >= srclen)
+					return -1;
+				b = src[ip++];
+				len += b;
+			} while (b == 255);
+		}
+		if (op + len > dstcap)
+			return -1;
+
+		// byte copy, match may overlap output
+		for (int64_t i = 0; i < len; i++, op++)
+			dst[op] = dst[op - offset];
+	}
+
+	return op;
+}
@@ -0,0 +1,26 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	lz-codec.h
+ * @brief	LZ4 block format compatible codec
+ */
+#ifndef REFOP_LZ_CODEC_H
+#define REFOP_LZ_CODEC_H
+//-----------------------------------------------------------------------------
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+#ifdef __cplusplus
+extern "C" {
+#endif
+//-----------------------------------------------------------------------------
+
+int64_t lz_compress(const uint8_t *src, int64_t srclen, uint8_t *dst, int64_t dstcap);
+int64_t lz_decompress(const uint8_t *src, int64_t srclen, uint8_t *dst, int64_t dstcap);
+
+//-----------------------------------------------------------------------------
+#ifdef __cplusplus
+}
+#endif
+//-----------------------------------------------------------------------------
+#endif //#ifndef REFOP_LZ_CODEC_H
@@ -0,0 +1,208 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	refop-alloc.h
+ * @brief	Heap allocation wrapper of refop library
+ */
+#ifndef REFOP_ALLOC_H
+#define REFOP_ALLOC_H
+//-----------------------------------------------------------------------------
+#include "fileop.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+#ifdef __cplusplus
+extern "C" {
+#endif
+//-----------------------------------------------------------------------------
+/**
+ * Allocator of refop library.  When alloc is NULL, malloc and free of libc are used.
+ */
+struct refop_allocator {
+	refop_alloc_fn_t alloc; /**< Allocation function set by refop_set_allocator() */
+	refop_free_fn_t free;	/**< Free function set by refop_set_allocator() */
+	void *ctx;		/**< Context of allocator functions */
+};
+
+extern struct refop_allocator g_refop_allocator;
+
+/**
+ * Allocate memory by the library allocator.
+ *
+ * @param [in]	size	Allocation size.
+ *
+ * @return void*	Allocated memory, NULL is failure.
+ */
+static __inline void *refop_malloc(size_t size)
+{
+	if (g_refop_allocator.alloc != NULL)
+		return g_refop_allocator.alloc(size, g_refop_allocator.ctx);
+
+	return malloc(size);
+}
+
+/**
+ * Release memory that was allocated by refop_malloc().  NULL is allowed.
+ *
+ * @param [in]	ptr	Allocated memory.
+ */
+static __inline void refop_free(void *ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	if (g_refop_allocator.free != NULL)
+		g_refop_allocator.free(ptr, g_refop_allocator.ctx);
+	else
+		free(ptr);
+}
+
+/**
+ * Allocate zero cleared memory by the library allocator.
+ *
+ * @param [in]	nmemb	Number of elements.
+ * @param [in]	size	Element size.
+ *
+ * @return void*	Allocated memory, NULL is failure.
+ */
+static __inline void *refop_calloc(size_t nmemb, size_t size)
+{
+	void *ptr = NULL;
+
+	if (size != 0 && nmemb > (SIZE_MAX / size))
+		return NULL;
+
+	ptr = refop_malloc(nmemb * size);
+	if (ptr != NULL)
+		(void) memset(ptr, 0, nmemb * size);
+
+	return ptr;
+}
+
+/**
+ * Resize memory by the library allocator.  User allocator does not have realloc, so the old size is
+ * needed for copy.
+ *
+ * @param [in]	ptr	Allocated memory, NULL is allowed.
+ * @param [in]	oldsize	Size of ptr.
+ * @param [in]	size	New size.
+ *
+ * @return void*	Resized memory, NULL is failure and ptr is not released.
+ */
+static __inline void *refop_realloc(void *ptr, size_t oldsize, size_t size)
+{
+	void *newptr = NULL;
+
+	newptr = refop_malloc(size);
+	if (newptr == NULL)
+		return NULL;
+
+	if (ptr != NULL) {
+		(void) memcpy(newptr, ptr, (oldsize < size) ? oldsize : size);
+		refop_free(ptr);
+	}
+
+	return newptr;
+}
+
+/**
+ * Duplicate string by the library allocator.
+ *
+ * @param [in]	str	String.
+ *
+ * @return char*	Duplicated string, NULL is failure.
+ */
+static __inline char *refop_strdup(const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *dup = NULL;
+
+	dup = (char *) refop_malloc(len);
+	if (dup != NULL)
+		(void) memcpy(dup, str, len);
+
+	return dup;
+}
+
+/**
+ * Allocate aligned memory by the library allocator.  The original pointer is kept just before the
+ * aligned pointer, so it shall be released by refop_aligned_free().
+ *
+ * @param [in]	align	Alignment, power of 2.
+ * @param [in]	size	Allocation size.
+ *
+ * @return void*	Aligned memory, NULL is failure.
+ */
+static __inline void *refop_aligned_alloc(size_t align, size_t size)
+{
+	uint8_t *raw = NULL;
+	uintptr_t aligned = 0;
+
+	if (size > (SIZE_MAX - align - sizeof(void *)))
+		return NULL;
+
+	raw = (uint8_t *) refop_malloc(size + align + sizeof(void *));
+	if (raw == NULL)
+		return NULL;
+
+	aligned = ((uintptr_t) raw + sizeof(void *) + align - 1) & ~((uintptr_t) align - 1);
+	((void **) aligned)[-1] = raw;
+
+	return (void *) aligned;
+}
+
+/**
+ * Release memory that was allocated by refop_aligned_alloc().  NULL is allowed.
+ *
+ * @param [in]	ptr	Aligned memory.
+ */
+static __inline void refop_aligned_free(void *ptr)
+{
+	if (ptr != NULL)
+		refop_free(((void **) ptr)[-1]);
+}
+
+/**
+ * Get a work buffer for a file image.  The scratch buffer of a static handle is used when it is
+ * free and large enough, otherwise it is allocated by the library allocator.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	size	Buffer size.
+ *
+ * @return uint8_t*	Work buffer, NULL is failure.
+ */
+static __inline uint8_t *refop_scratch_alloc(refop_handle_t handle, size_t size)
+{
+	if (handle->scratch != NULL && handle->scratch_busy == false &&
+	    size <= (handle->size_limit + REFOP_SCRATCH_HEADER_SIZE)) {
+		handle->scratch_busy = true;
+		return handle->scratch;
+	}
+
+	return (uint8_t *) refop_malloc(size);
+}
+
+/**
+ * Release a work buffer that was got by refop_scratch_alloc().  NULL is allowed.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	buf	Work buffer.
+ */
+static __inline void refop_scratch_free(refop_handle_t handle, uint8_t *buf)
+{
+	if (buf != NULL && buf == handle->scratch) {
+		handle->scratch_busy = false;
+		return;
+	}
+
+	refop_free(buf);
+}
+
+//-----------------------------------------------------------------------------
+#ifdef __cplusplus
+}
+#endif
+//-----------------------------------------------------------------------------
+#endif //#ifndef REFOP_ALLOC_H
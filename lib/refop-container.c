@@ -0,0 +1,619 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	refop-container.c
+ * @brief	The multi-key container of the redundancy file operation library
+ */
+#include "fileop.h"
+#include "crc16.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+#include "static-configurator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Key and value reference that is used by commit.
+ */
+struct refop_container_ref {
+	const uint8_t *key; /**< Key string (not terminated) */
+	const uint8_t *value; /**< Value */
+	uint32_t value_size; /**< Value size */
+	uint16_t key_size; /**< Key size */
+	uint8_t pending; /**< 1: pending item, 0: committed item */
+	uint8_t deleted; /**< 1: deleted by pending item */
+};
+
+static int refop_container_load(struct refop_container *cntr);
+static void refop_container_unload(struct refop_container *cntr);
+static int refop_container_lookup(struct refop_container *cntr, const char *key, size_t keylen);
+static int refop_container_pending_find(struct refop_container *cntr, const char *key);
+static int refop_container_pending_add(struct refop_container *cntr, const char *key, uint8_t *data, int64_t datasize);
+static int refop_container_ref_compare(const void *a, const void *b);
+
+/**
+ * The refop container open function.
+ * The container pack many small keys into one redundancy file that use ping-pong mode.
+ * The newest valid container file is mapped by mmap, and key lookup is binary search of sorted index.
+ *
+ * @param [out]	container	Created container
+ * @param [in]	directry	Terget directry
+ * @param [in]	filename	Container file name.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_RECOVER This operation was succeeded within recovery.
+ * @retval REFOP_NOENT The target directroy was nothing.
+ * @retval REFOP_BROKEN The container file was broken.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+refop_error_t refop_container_open(refop_container_t *container, const char *directry, const char *filename)
+{
+	struct refop_container *cntr = NULL;
+	refop_error_t result = REFOP_SYSERROR;
+	int ret = -1;
+
+	if (container == NULL)
+		return REFOP_ARGERROR;
+
+	cntr = (struct refop_container *) refop_calloc(1, sizeof(struct refop_container));
+	if (cntr == NULL)
+		return REFOP_SYSERROR;
+
+	result = refop_create_redundancy_handle(&cntr->handle, directry, filename);
+	if (result != REFOP_SUCCESS) {
+		refop_free(cntr);
+		return result;
+	}
+
+	(void) refop_set_redundancy_mode(cntr->handle, REFOP_MODE_PINGPONG);
+
+	ret = refop_container_load(cntr);
+	if (ret < 0 && ret != -2) {
+		(void) refop_release_redundancy_handle(cntr->handle);
+		refop_free(cntr);
+		return (ret == -3) ? REFOP_BROKEN : REFOP_SYSERROR;
+	}
+
+	(*container) = cntr;
+
+	return (ret == 1) ? REFOP_RECOVER : REFOP_SUCCESS;
+}
+
+/**
+ * The refop container close function.
+ * Pending set and delete that are not committed are discarded.
+ *
+ * @param [in]	container	Refop container
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_container_close(refop_container_t container)
+{
+	struct refop_container *cntr = (struct refop_container *) container;
+
+	if (container == NULL)
+		return REFOP_ARGERROR;
+
+	refop_container_unload(cntr);
+
+	for (int i = 0; i < cntr->npending; i++) {
+		refop_free(cntr->pending[i].key);
+		refop_free(cntr->pending[i].value);
+	}
+	refop_free(cntr->pending);
+
+	(void) refop_release_redundancy_handle(cntr->handle);
+	refop_free(cntr);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The key set function of refop container.
+ * This function only stage the value.  Staged values are written by refop_container_commit().
+ *
+ * @param [in]	container	Refop container
+ * @param [in]	key	Key string (1 to REFOP_CONTAINER_KEY_MAX byte).
+ * @param [in]	data	Write data.
+ * @param [in]	datasize	Write data size (byte).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+refop_error_t refop_container_set(refop_container_t container, const char *key, uint8_t *data, int64_t datasize)
+{
+	struct refop_container *cntr = (struct refop_container *) container;
+	size_t keylen = 0;
+
+	if (container == NULL || key == NULL || data == NULL || datasize < 0)
+		return REFOP_ARGERROR;
+
+	keylen = strnlen(key, REFOP_CONTAINER_KEY_MAX + 1);
+	if (keylen == 0 || keylen > REFOP_CONTAINER_KEY_MAX ||
+	    (uint64_t) datasize > refop_get_config_handle_size_limit(cntr->handle))
+		return REFOP_ARGERROR;
+
+	if (refop_container_pending_add(cntr, key, data, datasize) < 0)
+		return REFOP_SYSERROR;
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The key delete function of refop container.
+ * This function only stage the delete.  Staged deletes are written by refop_container_commit().
+ *
+ * @param [in]	container	Refop container
+ * @param [in]	key	Key string.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+refop_error_t refop_container_delete(refop_container_t container, const char *key)
+{
+	struct refop_container *cntr = (struct refop_container *) container;
+	size_t keylen = 0;
+
+	if (container == NULL || key == NULL)
+		return REFOP_ARGERROR;
+
+	keylen = strnlen(key, REFOP_CONTAINER_KEY_MAX + 1);
+	if (keylen == 0 || keylen > REFOP_CONTAINER_KEY_MAX)
+		return REFOP_ARGERROR;
+
+	if (refop_container_pending_add(cntr, key, NULL, -1) < 0)
+		return REFOP_SYSERROR;
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The key get function of refop container.
+ * Staged value is returned before commit.  The record crc is verified for each get.
+ *
+ * @param [in]	container	Refop container
+ * @param [in]	key	Key string.
+ * @param [in]	data	Read buffer for get data.
+ * @param [in]	datasize	Read buffer size (byte).
+ * @param [out]	getsize	Readed size (byte).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_NOENT The key was nothing.
+ * @retval REFOP_BROKEN The record was broken.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_container_get(
+	refop_container_t container, const char *key, uint8_t *data, int64_t datasize, int64_t *getsize)
+{
+	struct refop_container *cntr = (struct refop_container *) container;
+	const struct s_refop_container_entry *entry = NULL;
+	const uint8_t *pkey = NULL, *pvalue = NULL;
+	int64_t size = 0;
+	size_t keylen = 0;
+	int index = -1;
+
+	if (container == NULL || key == NULL || data == NULL || datasize < 0 || getsize == NULL)
+		return REFOP_ARGERROR;
+
+	keylen = strnlen(key, REFOP_CONTAINER_KEY_MAX + 1);
+	if (keylen == 0 || keylen > REFOP_CONTAINER_KEY_MAX)
+		return REFOP_ARGERROR;
+
+	index = refop_container_pending_find(cntr, key);
+	if (index >= 0) {
+		if (cntr->pending[index].size < 0)
+			return REFOP_NOENT;
+
+		size = (cntr->pending[index].size > datasize) ? datasize : cntr->pending[index].size;
+		memcpy(data, cntr->pending[index].value, size);
+		(*getsize) = size;
+
+		return REFOP_SUCCESS;
+	}
+
+	index = refop_container_lookup(cntr, key, keylen);
+	if (index < 0)
+		return REFOP_NOENT;
+
+	entry = &cntr->index[index];
+	pkey = cntr->image + entry->key_offset;
+	pvalue = cntr->image + entry->value_offset;
+	if (entry->crc16 != crc16(crc16(0xffff, pkey, entry->key_size), pvalue, entry->value_size))
+		return REFOP_BROKEN;
+
+	size = ((int64_t) entry->value_size > datasize) ? datasize : (int64_t) entry->value_size;
+	memcpy(data, pvalue, size);
+	(*getsize) = size;
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The commit function of refop container.
+ * All staged set and delete are written by one file write and one flush.
+ *
+ * @param [in]	container	Refop container
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error or container size is larger than size limit.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+refop_error_t refop_container_commit(refop_container_t container)
+{
+	struct refop_container *cntr = (struct refop_container *) container;
+	struct refop_container_ref *refs = NULL;
+	struct s_refop_container_head *head = NULL;
+	struct s_refop_container_entry *entries = NULL;
+	uint8_t *image = NULL;
+	uint64_t total = 0, offset = 0;
+	uint32_t count = 0, nrefs = 0, committed = 0;
+	refop_error_t result = REFOP_SYSERROR;
+	int ret = -1;
+
+	if (container == NULL)
+		return REFOP_ARGERROR;
+
+	if (cntr->npending == 0)
+		return REFOP_SUCCESS;
+
+	if (cntr->head != NULL)
+		committed = cntr->head->count;
+
+	refs = (struct refop_container_ref *) refop_malloc(sizeof(struct refop_container_ref) * (committed + cntr->npending));
+	if (refs == NULL)
+		return REFOP_SYSERROR;
+
+	for (uint32_t i = 0; i < committed; i++) {
+		refs[nrefs].key = cntr->image + cntr->index[i].key_offset;
+		refs[nrefs].key_size = cntr->index[i].key_size;
+		refs[nrefs].value = cntr->image + cntr->index[i].value_offset;
+		refs[nrefs].value_size = cntr->index[i].value_size;
+		refs[nrefs].pending = 0;
+		refs[nrefs].deleted = 0;
+		nrefs++;
+	}
+	for (int i = 0; i < cntr->npending; i++) {
+		refs[nrefs].key = (const uint8_t *) cntr->pending[i].key;
+		refs[nrefs].key_size = (uint16_t) strlen(cntr->pending[i].key);
+		refs[nrefs].value = cntr->pending[i].value;
+		refs[nrefs].value_size = (cntr->pending[i].size < 0) ? 0 : (uint32_t) cntr->pending[i].size;
+		refs[nrefs].pending = 1;
+		refs[nrefs].deleted = (cntr->pending[i].size < 0) ? 1 : 0;
+		nrefs++;
+	}
+
+	// Sorted by key, pending item is placed before committed item of same key.
+	qsort(refs, nrefs, sizeof(struct refop_container_ref), refop_container_ref_compare);
+
+	total = sizeof(struct s_refop_container_head);
+	for (uint32_t i = 0; i < nrefs; i++) {
+		if (i > 0 && refs[i - 1].key_size == refs[i].key_size &&
+		    memcmp(refs[i - 1].key, refs[i].key, refs[i].key_size) == 0) {
+			refs[i].deleted = 1; // Shadowed by pending item
+			continue;
+		}
+		if (refs[i].deleted == 0)
+			total += sizeof(struct s_refop_container_entry) + refs[i].key_size + refs[i].value_size;
+	}
+
+	if (total > refop_get_config_handle_size_limit(cntr->handle)) {
+		result = REFOP_ARGERROR;
+		goto out;
+	}
+
+	image = (uint8_t *) refop_malloc(total);
+	if (image == NULL)
+		goto out;
+
+	for (uint32_t i = 0; i < nrefs; i++) {
+		if (refs[i].deleted == 0)
+			count++;
+	}
+
+	head = (struct s_refop_container_head *) image;
+	head->magic = REFOP_CONTAINER_MAGIC;
+	head->count = count;
+	entries = (struct s_refop_container_entry *) (image + sizeof(struct s_refop_container_head));
+	offset = sizeof(struct s_refop_container_head) + sizeof(struct s_refop_container_entry) * count;
+
+	count = 0;
+	for (uint32_t i = 0; i < nrefs; i++) {
+		if (refs[i].deleted != 0)
+			continue;
+
+		entries[count].key_offset = (uint32_t) offset;
+		entries[count].key_size = refs[i].key_size;
+		memcpy(image + offset, refs[i].key, refs[i].key_size);
+		offset += refs[i].key_size;
+
+		entries[count].value_offset = (uint32_t) offset;
+		entries[count].value_size = refs[i].value_size;
+		memcpy(image + offset, refs[i].value, refs[i].value_size);
+		offset += refs[i].value_size;
+
+		entries[count].crc16 = crc16(crc16(0xffff, refs[i].key, refs[i].key_size), refs[i].value, refs[i].value_size);
+		count++;
+	}
+
+	ret = refop_pingpong_write(cntr->handle, image, (int64_t) total);
+	if (ret < 0) {
+		result = (ret == -2) ? REFOP_ARGERROR : REFOP_SYSERROR;
+		goto out;
+	}
+
+	for (int i = 0; i < cntr->npending; i++) {
+		refop_free(cntr->pending[i].key);
+		refop_free(cntr->pending[i].value);
+	}
+	cntr->npending = 0;
+
+	// Map new container file.
+	refop_container_unload(cntr);
+	ret = refop_container_load(cntr);
+	result = (ret < 0) ? REFOP_SYSERROR : REFOP_SUCCESS;
+
+out:
+	refop_free(image);
+	refop_free(refs);
+
+	return result;
+}
+
+/**
+ * Map the newest valid container file and validate the index.
+ *
+ * @param [in]	cntr	Refop container.
+ *
+ * @return int
+ * @retval 0 Succeeded.
+ * @retval 1 Succeeded with recover.
+ * @retval -1 Abnormal fail.
+ * @retval -2 No data.
+ * @retval -3 Broken data.
+ */
+static int refop_container_load(struct refop_container *cntr)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) cntr->handle;
+	const s_refop_file_header_v2 *filehead = NULL;
+	const struct s_refop_container_entry *entry = NULL;
+	char suffix[16], path[PATH_MAX];
+	struct stat sb;
+	void *map = NULL;
+	int result = -1, fd = -1;
+
+	// Select and validate the newest valid file.
+	result = refop_pingpong_pickup(cntr->handle, NULL, 0, NULL);
+	if (result < 0)
+		return result;
+
+	(void) snprintf(suffix, sizeof(suffix), ".g%d", hndl->slot_latest);
+	if (refop_handle_path(cntr->handle, suffix, path) < 0)
+		return -1;
+
+	fd = open(path, (O_CLOEXEC | O_RDONLY | O_NOFOLLOW));
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &sb) < 0 || sb.st_size < (off_t) sizeof(s_refop_file_header_v2)) {
+		(void) close(fd);
+		return -3;
+	}
+
+	map = mmap(NULL, (size_t) sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	(void) close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	cntr->map = (uint8_t *) map;
+	cntr->mapsize = (size_t) sb.st_size;
+
+	// Validate mapped image again, the file may be changed after pick up.
+	filehead = (const s_refop_file_header_v2 *) cntr->map;
+	if (refop_header_v2_validation(filehead) != 0 ||
+	    filehead->size + sizeof(s_refop_file_header_v2) > cntr->mapsize ||
+	    filehead->size < sizeof(struct s_refop_container_head))
+		goto invalid;
+
+	cntr->image = cntr->map + sizeof(s_refop_file_header_v2);
+	cntr->imagesize = filehead->size;
+	if (filehead->crc16 != crc16(0xffff, cntr->image, cntr->imagesize))
+		goto invalid;
+
+	cntr->head = (const struct s_refop_container_head *) cntr->image;
+	if (cntr->head->magic != REFOP_CONTAINER_MAGIC ||
+	    (uint64_t) cntr->head->count * sizeof(struct s_refop_container_entry) + sizeof(struct s_refop_container_head) >
+		    cntr->imagesize)
+		goto invalid;
+
+	// Index bounds are checked once, lookup is safe after that.
+	cntr->index = (const struct s_refop_container_entry *) (cntr->image + sizeof(struct s_refop_container_head));
+	for (uint32_t i = 0; i < cntr->head->count; i++) {
+		entry = &cntr->index[i];
+		if ((uint64_t) entry->key_offset + entry->key_size > cntr->imagesize ||
+		    (uint64_t) entry->value_offset + entry->value_size > cntr->imagesize)
+			goto invalid;
+	}
+
+	return result;
+
+invalid:
+	refop_container_unload(cntr);
+	return -3;
+}
+
+/**
+ * Unmap the container file.
+ *
+ * @param [in]	cntr	Refop container.
+ */
+static void refop_container_unload(struct refop_container *cntr)
+{
+	if (cntr->map != NULL)
+		(void) munmap(cntr->map, cntr->mapsize);
+
+	cntr->map = NULL;
+	cntr->mapsize = 0;
+	cntr->image = NULL;
+	cntr->imagesize = 0;
+	cntr->head = NULL;
+	cntr->index = NULL;
+}
+
+/**
+ * Binary search of the sorted index.
+ *
+ * @param [in]	cntr	Refop container.
+ * @param [in]	key	Key string.
+ * @param [in]	keylen	Key length.
+ *
+ * @return int
+ * @retval >=0 Index of the key.
+ * @retval -1 Not found.
+ */
+static int refop_container_lookup(struct refop_container *cntr, const char *key, size_t keylen)
+{
+	struct refop_container_ref target = { 0 }, ref = { 0 };
+	int64_t low = 0, high = 0, mid = 0;
+	int cmp = 0;
+
+	if (cntr->head == NULL)
+		return -1;
+
+	target.key = (const uint8_t *) key;
+	target.key_size = (uint16_t) keylen;
+
+	high = (int64_t) cntr->head->count - 1;
+	while (low <= high) {
+		mid = (low + high) / 2;
+		ref.key = cntr->image + cntr->index[mid].key_offset;
+		ref.key_size = cntr->index[mid].key_size;
+
+		cmp = refop_container_ref_compare(&target, &ref);
+		if (cmp == 0)
+			return (int) mid;
+		else if (cmp < 0)
+			high = mid - 1;
+		else
+			low = mid + 1;
+	}
+
+	return -1;
+}
+
+/**
+ * Find pending item.
+ *
+ * @param [in]	cntr	Refop container.
+ * @param [in]	key	Key string.
+ *
+ * @return int
+ * @retval >=0 Index of pending item.
+ * @retval -1 Not found.
+ */
+static int refop_container_pending_find(struct refop_container *cntr, const char *key)
+{
+	for (int i = 0; i < cntr->npending; i++) {
+		if (strcmp(cntr->pending[i].key, key) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/**
+ * Add or replace pending item.
+ *
+ * @param [in]	cntr	Refop container.
+ * @param [in]	key	Key string.
+ * @param [in]	data	Value, NULL is delete.
+ * @param [in]	datasize	Value size, -1 is delete.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 No memory.
+ */
+static int refop_container_pending_add(struct refop_container *cntr, const char *key, uint8_t *data, int64_t datasize)
+{
+	struct refop_container_pending *pending = NULL;
+	uint8_t *value = NULL;
+	int index = -1;
+
+	if (datasize >= 0) {
+		value = (uint8_t *) refop_malloc(datasize + 1);
+		if (value == NULL)
+			return -1;
+		memcpy(value, data, datasize);
+	}
+
+	index = refop_container_pending_find(cntr, key);
+	if (index < 0) {
+		if (cntr->npending == cntr->cpending) {
+			pending = (struct refop_container_pending *) refop_realloc(
+				cntr->pending, sizeof(struct refop_container_pending) * cntr->cpending,
+				sizeof(struct refop_container_pending) * (cntr->cpending + 16));
+			if (pending == NULL) {
+				refop_free(value);
+				return -1;
+			}
+			cntr->pending = pending;
+			cntr->cpending += 16;
+		}
+
+		index = cntr->npending;
+		cntr->pending[index].key = refop_strdup(key);
+		if (cntr->pending[index].key == NULL) {
+			refop_free(value);
+			return -1;
+		}
+		cntr->npending++;
+	} else
+		refop_free(cntr->pending[index].value);
+
+	cntr->pending[index].value = value;
+	cntr->pending[index].size = datasize;
+
+	return 0;
+}
+
+/**
+ * Compare function of key reference.  Keys are ordered by byte compare, and then length.
+ * When keys are same, pending item is ordered before committed item and -1 is returned.
+ */
+static int refop_container_ref_compare(const void *a, const void *b)
+{
+	const struct refop_container_ref *ra = (const struct refop_container_ref *) a;
+	const struct refop_container_ref *rb = (const struct refop_container_ref *) b;
+	uint16_t len = (ra->key_size < rb->key_size) ? ra->key_size : rb->key_size;
+	int cmp = 0;
+
+	cmp = memcmp(ra->key, rb->key, len);
+	if (cmp != 0)
+		return (cmp < 0) ? -2 : 2;
+
+	if (ra->key_size != rb->key_size)
+		return (ra->key_size < rb->key_size) ? -2 : 2;
+
+	if (ra->pending != rb->pending)
+		return (ra->pending > rb->pending) ? -1 : 1;
+
+	return 0;
+}
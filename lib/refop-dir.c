@@ -0,0 +1,153 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	refop-dir.c
+ * @brief	Shared directory reference and file name derivation of refop handle
+ */
+#include "fileop.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char c_bk1_suffix[] = ".bk1";
+const char c_new_suffix[] = ".tmp";
+
+/** Interned directory list.  It is protected by g_refop_dir_lock. */
+static struct refop_dir *g_refop_dir_list = NULL;
+static pthread_mutex_t g_refop_dir_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Get the memory size of a directory entry.
+ *
+ * @param [in]	directry	Directory path. It shall not be empty string.
+ *
+ * @return size_t	 Size of struct refop_dir with path.
+ */
+size_t refop_dir_size(const char *directry)
+{
+	size_t len = strlen(directry);
+
+	// The path is stored with trailing '/' and terminator.
+	return sizeof(struct refop_dir) + len + ((directry[len - 1] == '/') ? 1 : 2);
+}
+
+/**
+ * Initialize a directory entry that is not interned.  It is used for a handle in caller supplied
+ * storage, and it shall not be released by refop_dir_put().
+ *
+ * @param [out]	dir	Directory entry, it shall have refop_dir_size() byte.
+ * @param [in]	directry	Directory path. It shall not be empty string.
+ */
+void refop_dir_init(struct refop_dir *dir, const char *directry)
+{
+	size_t len = 0, dirlen = 0;
+
+	len = strlen(directry);
+	dirlen = (directry[len - 1] == '/') ? len : len + 1;
+
+	memcpy(dir->path, directry, len);
+	dir->path[dirlen - 1] = '/';
+	dir->path[dirlen] = '\0';
+	dir->len = dirlen;
+	dir->refcount = 1;
+	dir->txn_checked = false;
+	dir->next = NULL;
+}
+
+/**
+ * Get a shared directory reference.  When the directory was already interned, the reference count
+ * is increased and same entry is returned.  "/dir" and "/dir/" are same directory.
+ *
+ * @param [in]	directry	Directory path. It shall not be empty string.
+ *
+ * @return struct refop_dir*
+ * @retval !NULL Directory reference, it shall be released by refop_dir_put().
+ * @retval NULL No memory.
+ */
+struct refop_dir *refop_dir_get(const char *directry)
+{
+	struct refop_dir *dir = NULL;
+	size_t len = 0, dirlen = 0;
+
+	len = strlen(directry);
+	dirlen = (directry[len - 1] == '/') ? len : len + 1;
+
+	(void) pthread_mutex_lock(&g_refop_dir_lock);
+
+	for (dir = g_refop_dir_list; dir != NULL; dir = dir->next) {
+		if (dir->len == dirlen && memcmp(dir->path, directry, len) == 0) {
+			dir->refcount++;
+			goto out;
+		}
+	}
+
+	dir = (struct refop_dir *) refop_malloc(refop_dir_size(directry));
+	if (dir == NULL)
+		goto out;
+
+	refop_dir_init(dir, directry);
+	dir->next = g_refop_dir_list;
+	g_refop_dir_list = dir;
+
+out:
+	(void) pthread_mutex_unlock(&g_refop_dir_lock);
+
+	return dir;
+}
+
+/**
+ * Release a shared directory reference.  The entry is freed when last reference was released.
+ *
+ * @param [in]	dir	Directory reference from refop_dir_get(). NULL is allowed.
+ */
+void refop_dir_put(struct refop_dir *dir)
+{
+	struct refop_dir **pdir = NULL;
+
+	if (dir == NULL)
+		return;
+
+	(void) pthread_mutex_lock(&g_refop_dir_lock);
+
+	dir->refcount--;
+	if (dir->refcount == 0) {
+		for (pdir = &g_refop_dir_list; (*pdir) != NULL; pdir = &(*pdir)->next) {
+			if ((*pdir) == dir) {
+				(*pdir) = dir->next;
+				break;
+			}
+		}
+		refop_free(dir);
+	}
+
+	(void) pthread_mutex_unlock(&g_refop_dir_lock);
+}
+
+/**
+ * Create a file path that is the latest file name with suffix.  Use c_bk1_suffix for the backup
+ * file, c_new_suffix for the new file and empty string for the latest file.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	suffix	File name suffix (max 10 byte).
+ * @param [out]	path	Output buffer, it shall have PATH_MAX byte.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Too long path.
+ */
+int refop_handle_path(refop_handle_t handle, const char *suffix, char *path)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	int ret = -1;
+
+	ret = snprintf(path, PATH_MAX, "%s%s%s", hndl->dir->path, hndl->name, suffix);
+	if (ret < 0 || ret >= PATH_MAX)
+		return -1;
+
+	return 0;
+}
+
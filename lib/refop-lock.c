@@ -0,0 +1,263 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	refop-lock.c
+ * @brief	Internal synchronization of thread safe handle and cross-process writer lock
+ */
+#include "fileop.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string.h>
+
+/** Suffix of the writer lock file. */
+const char c_lock_suffix[] = ".lck";
+
+/**
+ * Create the lock of thread safe handle.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 No memory or no resource.
+ */
+int refop_handle_lock_create(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+	struct refop_handle_lock *lock = NULL;
+	pthread_rwlockattr_t attr;
+	int ret = -1;
+
+	lock = (struct refop_handle_lock *) refop_calloc(1, sizeof(struct refop_handle_lock));
+	if (lock == NULL)
+		return -1;
+
+	// Writer is preferred, a set is not starved by continuous gets.
+	(void) pthread_rwlockattr_init(&attr);
+	(void) pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+	ret = pthread_rwlock_init(&lock->rwlock, &attr);
+	(void) pthread_rwlockattr_destroy(&attr);
+	if (ret != 0) {
+		refop_free(lock);
+		return -1;
+	}
+
+	if (pthread_mutex_init(&lock->cache, NULL) != 0) {
+		(void) pthread_rwlock_destroy(&lock->rwlock);
+		refop_free(lock);
+		return -1;
+	}
+
+	hndl->lock = lock;
+
+	return 0;
+}
+
+/**
+ * Destroy the lock of thread safe handle.  NULL lock is allowed.
+ *
+ * @param [in]	handle	Refop handle.
+ */
+void refop_handle_lock_destroy(refop_handle_t handle)
+{
+	struct refop_halndle *hndl = (struct refop_halndle *) handle;
+
+	if (hndl->lock == NULL)
+		return;
+
+	(void) pthread_mutex_destroy(&hndl->lock->cache);
+	(void) pthread_rwlock_destroy(&hndl->lock->rwlock);
+	refop_free(hndl->lock);
+	hndl->lock = NULL;
+}
+
+/**
+ * Get current time of monotonic clock.
+ *
+ * @return int64_t	 Current time (ms).
+ */
+int64_t refop_lock_clock_ms(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t) ts.tv_sec * 1000 + (int64_t) ts.tv_nsec / 1000000;
+}
+
+/**
+ * Lock the handle for exclusive operation with timeout.  It does nothing for a handle that is not
+ * thread safe.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	timeout_ms	Timeout (ms), 0 is try once.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -2 Timeout.
+ */
+int refop_handle_wrlock_timeout(refop_handle_t handle, int timeout_ms)
+{
+	struct timespec ts;
+
+	if (handle->lock == NULL)
+		return 0;
+
+	if (timeout_ms == 0)
+		return (pthread_rwlock_trywrlock(&handle->lock->rwlock) == 0) ? 0 : -2;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	return (pthread_rwlock_clockwrlock(&handle->lock->rwlock, CLOCK_MONOTONIC, &ts) == 0) ? 0 : -2;
+}
+
+/**
+ * Acquire the cross-process writer lock of the handle.  The lock is an open file description lock
+ * on the lock file (file name with ".lck"), so it is held by this fd only and is released by
+ * refop_process_unlock() or process exit.  Readers do not use this lock.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	timeout_ms	Timeout (ms), -1 is infinite and 0 is try once.
+ * @param [out]	pfd	Fd of the lock file.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Abnormal fail.
+ * @retval -2 Timeout, another writer has the lock.
+ */
+int refop_process_lock(refop_handle_t handle, int timeout_ms, int *pfd)
+{
+	struct flock fl;
+	char path[PATH_MAX];
+	int64_t deadline = 0;
+	useconds_t wait = 1000;
+	int fd = -1;
+
+	if (refop_handle_path(handle, c_lock_suffix, path) < 0)
+		return -1;
+
+	fd = open(path, (O_CLOEXEC | O_RDWR | O_CREAT | O_NOFOLLOW), (S_IRUSR | S_IWUSR));
+	if (fd < 0)
+		return -1;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = 0;
+	fl.l_len = 1;
+
+	if (timeout_ms < 0) {
+		while (fcntl(fd, F_OFD_SETLKW, &fl) < 0) {
+			if (errno != EINTR)
+				goto error;
+		}
+		(*pfd) = fd;
+		return 0;
+	}
+
+	// OFD lock has no timed wait, poll with short backoff.
+	deadline = refop_lock_clock_ms() + timeout_ms;
+	while (fcntl(fd, F_OFD_SETLK, &fl) < 0) {
+		if (errno != EAGAIN && errno != EACCES && errno != EINTR)
+			goto error;
+
+		if (refop_lock_clock_ms() >= deadline) {
+			(void) close(fd);
+			return -2;
+		}
+
+		(void) usleep(wait);
+		if (wait < 8000)
+			wait *= 2;
+	}
+
+	(*pfd) = fd;
+
+	return 0;
+
+error:
+	(void) close(fd);
+	return -1;
+}
+
+/**
+ * Release the cross-process writer lock.  Closing the fd releases the open file description lock.
+ *
+ * @param [in]	fd	Fd of the lock file from refop_process_lock().
+ */
+void refop_process_unlock(int fd)
+{
+	if (fd >= 0)
+		(void) close(fd);
+}
+
+/**
+ * Lock the handle for shared operation.  It does nothing for a handle that is not thread safe.
+ *
+ * @param [in]	handle	Refop handle.
+ */
+void refop_handle_rdlock(refop_handle_t handle)
+{
+	if (handle->lock != NULL)
+		(void) pthread_rwlock_rdlock(&handle->lock->rwlock);
+}
+
+/**
+ * Lock the handle for exclusive operation.  It does nothing for a handle that is not thread safe.
+ *
+ * @param [in]	handle	Refop handle.
+ */
+void refop_handle_wrlock(refop_handle_t handle)
+{
+	if (handle->lock != NULL)
+		(void) pthread_rwlock_wrlock(&handle->lock->rwlock);
+}
+
+/**
+ * Unlock the handle that was locked by refop_handle_rdlock() or refop_handle_wrlock().
+ *
+ * @param [in]	handle	Refop handle.
+ */
+void refop_handle_unlock(refop_handle_t handle)
+{
+	if (handle->lock != NULL)
+		(void) pthread_rwlock_unlock(&handle->lock->rwlock);
+}
+
+/**
+ * Lock the cached file state of the handle.  Shared holders of the handle lock shall update the
+ * cached file state under this lock.
+ *
+ * @param [in]	handle	Refop handle.
+ */
+void refop_handle_cache_lock(refop_handle_t handle)
+{
+	if (handle->lock != NULL)
+		(void) pthread_mutex_lock(&handle->lock->cache);
+}
+
+/**
+ * Unlock the cached file state of the handle.
+ *
+ * @param [in]	handle	Refop handle.
+ */
+void refop_handle_cache_unlock(refop_handle_t handle)
+{
+	if (handle->lock != NULL)
+		(void) pthread_mutex_unlock(&handle->lock->cache);
+}
@@ -0,0 +1,1218 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	refop-pool.c
+ * @brief	Worker pool and futures of asynchronous refop operations
+ */
+#include "fileop.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/** Number of hash buckets of handle queues, power of 2. */
+#define REFOP_POOL_BUCKETS (64)
+
+/**
+ * Asynchronous operation.  It is referred by the caller until refop_future_release() and by the pool
+ * until completion.
+ */
+struct refop_future {
+	struct refop_future *next;  /**< Next operation of the same handle */
+	refop_handle_t handle;	    /**< Target handle */
+	uint8_t *data;		    /**< Set: copy of write data, get: caller buffer */
+	int64_t datasize;	    /**< Size of data */
+	int64_t *getsize;	    /**< Get: caller read size */
+	struct refop_future *waiters; /**< Coalesced write: futures of sets that it replaced */
+	refop_future_cb_t callback; /**< Completion callback, NULL is none */
+	void *ctx;		    /**< Context of callback */
+	refop_op_t op;		    /**< Operation */
+	refop_error_t result;	    /**< Result of completed operation */
+	int refcount;		    /**< Number of references */
+	bool done;		    /**< When true, the operation was completed */
+};
+
+/**
+ * FIFO queue of operations of one handle.  One worker runs the head operation at a time, so operations
+ * of a handle are done in submit order.  The queue is freed when it becomes empty.
+ */
+struct refop_pool_queue {
+	struct refop_pool_queue *next;	     /**< Next queue in the hash bucket */
+	struct refop_pool_queue *ready_next; /**< Next queue that waits for a worker */
+	refop_handle_t handle;		     /**< Target handle */
+	struct refop_future *head;	     /**< Oldest operation, it is running when running is true */
+	struct refop_future *tail;	     /**< Newest operation */
+	bool running;			     /**< When true, a worker runs the head operation */
+};
+
+/**
+ * Write coalescing state of a handle.  Asynchronous sets replace the pending write, and the pending
+ * write is queued once per window.
+ */
+struct refop_coalesce {
+	struct refop_coalesce *next;  /**< Next handle that has coalescing */
+	refop_handle_t handle;	      /**< Target handle */
+	struct refop_future *pending; /**< Pending write, NULL is none */
+	int64_t due_ms;		      /**< Time to queue the pending write */
+	int64_t last_ms;	      /**< Start time of current window */
+	int window_ms;		      /**< Window (ms) */
+};
+
+/**
+ * Worker pool.  Idle workers take any handle queue that has a waiting operation, so a busy handle
+ * does not block operations of other handles.
+ */
+struct refop_pool {
+	pthread_mutex_t lock;				   /**< Protect the pool and futures */
+	pthread_cond_t work_cond;			   /**< Signaled when a queue became ready */
+	pthread_cond_t space_cond;			   /**< Signaled when queue depth was decreased */
+	pthread_cond_t done_cond;			   /**< Signaled when an operation completed */
+	struct refop_pool_queue *buckets[REFOP_POOL_BUCKETS]; /**< Hash buckets of handle queues */
+	struct refop_pool_queue *ready_head;		   /**< First queue that waits for a worker */
+	struct refop_pool_queue *ready_tail;		   /**< Last queue that waits for a worker */
+	struct refop_coalesce *coalesce;		   /**< Handles that have coalescing */
+	pthread_t *threads;				   /**< Worker threads */
+	int nthreads;					   /**< Number of running workers, 0 is not started */
+	int threads_config;				   /**< Number of workers of next start */
+	int depth;					   /**< Maximum number of queued operations */
+	int queued;					   /**< Number of not completed operations */
+	int pending;					   /**< Number of pending coalesced writes */
+	bool stop;					   /**< When true, workers exit or pool is reconfigured */
+};
+
+static struct refop_pool g_refop_pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work_cond = PTHREAD_COND_INITIALIZER,
+	.space_cond = PTHREAD_COND_INITIALIZER,
+	.done_cond = PTHREAD_COND_INITIALIZER,
+	.threads_config = REFOP_POOL_THREADS_DEFAULT,
+	.depth = REFOP_POOL_DEPTH_DEFAULT,
+};
+
+/** When true, current thread is a worker of the pool. */
+static __thread bool g_refop_pool_worker = false;
+
+static void *refop_pool_worker(void *arg);
+
+/**
+ * Find the queue of a handle.  The pool lock shall be held.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [out]	pprev	Link to the queue, NULL is allowed.
+ *
+ * @return struct refop_pool_queue*	 Queue, NULL is no operation of the handle.
+ */
+static struct refop_pool_queue *refop_pool_queue_find(refop_handle_t handle, struct refop_pool_queue ***pprev)
+{
+	struct refop_pool_queue **link = NULL;
+
+	link = &g_refop_pool.buckets[((uintptr_t) handle >> 4) & (REFOP_POOL_BUCKETS - 1)];
+	for (; (*link) != NULL; link = &(*link)->next) {
+		if ((*link)->handle == handle)
+			break;
+	}
+
+	if (pprev != NULL)
+		(*pprev) = link;
+
+	return (*link);
+}
+
+/**
+ * Add a queue to the tail of ready queues.  The pool lock shall be held.
+ *
+ * @param [in]	queue	Queue that has a waiting operation.
+ */
+static void refop_pool_ready_push(struct refop_pool_queue *queue)
+{
+	queue->ready_next = NULL;
+	if (g_refop_pool.ready_tail != NULL)
+		g_refop_pool.ready_tail->ready_next = queue;
+	else
+		g_refop_pool.ready_head = queue;
+	g_refop_pool.ready_tail = queue;
+
+	(void) pthread_cond_signal(&g_refop_pool.work_cond);
+}
+
+/**
+ * Release a reference of a future.  The pool lock shall be held.
+ *
+ * @param [in]	future	Future.
+ */
+static void refop_future_put(struct refop_future *future)
+{
+	future->refcount--;
+	if (future->refcount > 0)
+		return;
+
+	if (future->op == REFOP_OP_SET)
+		refop_free(future->data);
+	refop_free(future);
+}
+
+/**
+ * Complete a future and the futures that it replaced.  The pool lock shall be held, it is released
+ * while a callback runs.  The pool reference of the future is released.
+ *
+ * @param [in]	future	Future.
+ * @param [in]	result	Result of the operation.
+ */
+static void refop_future_complete(struct refop_future *future, refop_error_t result)
+{
+	struct refop_future *waiter = future->waiters, *next = NULL;
+	refop_future_cb_t callback = NULL;
+	void *ctx = NULL;
+
+	future->waiters = NULL;
+	future->result = result;
+	future->done = true;
+	callback = future->callback;
+	ctx = future->ctx;
+	(void) pthread_cond_broadcast(&g_refop_pool.done_cond);
+
+	if (callback != NULL) {
+		(void) pthread_mutex_unlock(&g_refop_pool.lock);
+		callback(future, result, ctx);
+		(void) pthread_mutex_lock(&g_refop_pool.lock);
+	}
+
+	refop_future_put(future);
+
+	for (; waiter != NULL; waiter = next) {
+		next = waiter->next;
+		refop_future_complete(waiter, result);
+	}
+}
+
+/**
+ * Add an operation to the queue of its handle.  The pool lock shall be held.
+ *
+ * @param [in]	future	Operation, refcount shall be set.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 No memory.
+ */
+static int refop_pool_enqueue(struct refop_future *future)
+{
+	struct refop_pool_queue *queue = NULL, **link = NULL;
+
+	queue = refop_pool_queue_find(future->handle, &link);
+	if (queue == NULL) {
+		queue = (struct refop_pool_queue *) refop_calloc(1, sizeof(struct refop_pool_queue));
+		if (queue == NULL)
+			return -1;
+		queue->handle = future->handle;
+		(*link) = queue;
+	}
+
+	if (queue->head != NULL) {
+		queue->tail->next = future;
+	} else {
+		queue->head = future;
+		refop_pool_ready_push(queue);
+	}
+	queue->tail = future;
+	__atomic_store_n(&g_refop_pool.queued, g_refop_pool.queued + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/**
+ * Find the coalescing state of a handle.  The pool lock shall be held.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [out]	pprev	Link to the state, NULL is allowed.
+ *
+ * @return struct refop_coalesce*	 State, NULL is no coalescing.
+ */
+static struct refop_coalesce *refop_coalesce_find(refop_handle_t handle, struct refop_coalesce ***pprev)
+{
+	struct refop_coalesce **link = NULL;
+
+	for (link = &g_refop_pool.coalesce; (*link) != NULL; link = &(*link)->next) {
+		if ((*link)->handle == handle)
+			break;
+	}
+
+	if (pprev != NULL)
+		(*pprev) = link;
+
+	return (*link);
+}
+
+/**
+ * Queue the pending write of a handle now and start next window.  The pool lock shall be held, it can
+ * be released while callbacks of a failed write run.
+ *
+ * @param [in]	rec	Coalescing state that has a pending write.
+ */
+static void refop_coalesce_promote(struct refop_coalesce *rec)
+{
+	struct refop_future *flush = rec->pending;
+
+	rec->pending = NULL;
+	rec->due_ms = 0;
+	rec->last_ms = refop_lock_clock_ms();
+	__atomic_store_n(&g_refop_pool.pending, g_refop_pool.pending - 1, __ATOMIC_RELEASE);
+
+	if (refop_pool_enqueue(flush) < 0)
+		refop_future_complete(flush, REFOP_SYSERROR);
+}
+
+/**
+ * Queue a pending write whose window was ended.  The pool lock shall be held.
+ *
+ * @param [out]	next_due	Time of the nearest pending write when nothing was queued.
+ *
+ * @return bool
+ * @retval true A pending write was queued.
+ * @retval false No pending write was due.
+ */
+static bool refop_coalesce_due(int64_t *next_due)
+{
+	struct refop_coalesce *rec = NULL;
+	int64_t now = refop_lock_clock_ms();
+
+	(*next_due) = INT64_MAX;
+	for (rec = g_refop_pool.coalesce; rec != NULL; rec = rec->next) {
+		if (rec->pending == NULL)
+			continue;
+		if (rec->due_ms <= now) {
+			refop_coalesce_promote(rec);
+			return true;
+		}
+		if (rec->due_ms < (*next_due))
+			(*next_due) = rec->due_ms;
+	}
+
+	return false;
+}
+
+/**
+ * Replace the pending write of a handle by an asynchronous set.  The pool lock shall be held.
+ * A new pending write is queued at the end of current window.  The future of the set is completed
+ * with the result of the pending write that includes it.
+ *
+ * @param [in]	rec	Coalescing state.
+ * @param [in]	future	Set operation, its data is moved to the pending write.
+ * @param [out]	pfuture	Future for the caller, NULL is no future.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 No memory.
+ */
+static int refop_coalesce_set(struct refop_coalesce *rec, struct refop_future *future, refop_future_t *pfuture)
+{
+	struct refop_future *flush = rec->pending;
+	int64_t now = 0;
+
+	if (flush == NULL) {
+		flush = (struct refop_future *) refop_calloc(1, sizeof(struct refop_future));
+		if (flush == NULL)
+			return -1;
+		flush->handle = rec->handle;
+		flush->op = REFOP_OP_SET;
+		flush->result = REFOP_SYSERROR;
+		flush->refcount = 1;
+
+		now = refop_lock_clock_ms();
+		rec->pending = flush;
+		rec->due_ms = rec->last_ms + rec->window_ms;
+		if (rec->due_ms < now)
+			rec->due_ms = now;
+		__atomic_store_n(&g_refop_pool.pending, g_refop_pool.pending + 1, __ATOMIC_RELEASE);
+		(void) pthread_cond_broadcast(&g_refop_pool.work_cond);
+	}
+
+	// Latest value wins.
+	refop_free(flush->data);
+	flush->data = future->data;
+	flush->datasize = future->datasize;
+	future->data = NULL;
+
+	if (pfuture != NULL) {
+		future->refcount = 2;
+		future->next = flush->waiters;
+		flush->waiters = future;
+		(*pfuture) = future;
+	} else {
+		refop_free(future);
+	}
+
+	return 0;
+}
+
+/**
+ * Start workers.  The pool lock shall be held.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 No memory or no thread was created.
+ */
+static int refop_pool_start(void)
+{
+	pthread_t *threads = NULL;
+	int n = 0;
+
+	threads = (pthread_t *) refop_calloc((size_t) g_refop_pool.threads_config, sizeof(pthread_t));
+	if (threads == NULL)
+		return -1;
+
+	for (n = 0; n < g_refop_pool.threads_config; n++) {
+		if (pthread_create(&threads[n], NULL, refop_pool_worker, NULL) != 0)
+			break;
+	}
+
+	// Less workers are still usable.
+	if (n == 0) {
+		refop_free(threads);
+		return -1;
+	}
+
+	g_refop_pool.threads = threads;
+	g_refop_pool.nthreads = n;
+
+	return 0;
+}
+
+/**
+ * Worker thread.  It runs the head operation of ready queues until the pool is stopped.
+ *
+ * @param [in]	arg	Not used.
+ *
+ * @return void*	 NULL.
+ */
+static void *refop_pool_worker(void *arg)
+{
+	struct refop_pool_queue *queue = NULL, **link = NULL;
+	struct refop_future *future = NULL;
+	refop_error_t result = REFOP_SYSERROR;
+	struct timespec ts;
+	int64_t next_due = 0;
+
+	(void) arg;
+	g_refop_pool_worker = true;
+
+	(void) pthread_mutex_lock(&g_refop_pool.lock);
+
+	for (;;) {
+		next_due = INT64_MAX;
+		if (g_refop_pool.pending > 0 && refop_coalesce_due(&next_due) == true)
+			continue;
+
+		queue = g_refop_pool.ready_head;
+		if (queue == NULL) {
+			if (g_refop_pool.stop == true)
+				break;
+
+			if (next_due == INT64_MAX) {
+				(void) pthread_cond_wait(&g_refop_pool.work_cond, &g_refop_pool.lock);
+			} else {
+				// Wake up at the end of the nearest window.
+				ts.tv_sec = next_due / 1000;
+				ts.tv_nsec = (long) (next_due % 1000) * 1000000L;
+				(void) pthread_cond_clockwait(&g_refop_pool.work_cond, &g_refop_pool.lock, CLOCK_MONOTONIC,
+							      &ts);
+			}
+			continue;
+		}
+
+		g_refop_pool.ready_head = queue->ready_next;
+		if (g_refop_pool.ready_head == NULL)
+			g_refop_pool.ready_tail = NULL;
+		queue->running = true;
+		future = queue->head;
+
+		(void) pthread_mutex_unlock(&g_refop_pool.lock);
+
+		result = refop_op_execute(future->handle, future->op, future->data, future->datasize, future->getsize);
+
+		(void) pthread_mutex_lock(&g_refop_pool.lock);
+
+		queue->running = false;
+		queue->head = future->next;
+		if (queue->head != NULL) {
+			refop_pool_ready_push(queue);
+		} else {
+			(void) refop_pool_queue_find(queue->handle, &link);
+			(*link) = queue->next;
+			refop_free(queue);
+		}
+
+		__atomic_store_n(&g_refop_pool.queued, g_refop_pool.queued - 1, __ATOMIC_RELEASE);
+		(void) pthread_cond_broadcast(&g_refop_pool.space_cond);
+		refop_future_complete(future, result);
+	}
+
+	(void) pthread_mutex_unlock(&g_refop_pool.lock);
+
+	return NULL;
+}
+
+/**
+ * Queue an operation.  The caller waits while the pool has maximum queued operations.  Workers are
+ * started by first operation.
+ *
+ * @param [in]	future	New operation.
+ * @param [out]	pfuture	Future for the caller, NULL is no future.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_SYSERROR No memory or no thread.
+ */
+static refop_error_t refop_pool_submit(struct refop_future *future, refop_future_t *pfuture)
+{
+	struct refop_coalesce *rec = NULL;
+	refop_error_t result = REFOP_SYSERROR;
+
+	(void) pthread_mutex_lock(&g_refop_pool.lock);
+
+	// A worker shall not wait for itself, a callback can exceed the depth.  While the pool is stopped,
+	// reconfiguration joins the worker, so a callback does not wait for the restart either.  A coalesced
+	// set does not use the queue.
+	for (;;) {
+		rec = refop_coalesce_find(future->handle, NULL);
+		if (g_refop_pool_worker == true ||
+		    (g_refop_pool.stop == false &&
+		     ((rec != NULL && future->op == REFOP_OP_SET) || g_refop_pool.queued < g_refop_pool.depth)))
+			break;
+		(void) pthread_cond_wait(&g_refop_pool.space_cond, &g_refop_pool.lock);
+	}
+
+	if (g_refop_pool.nthreads == 0 && g_refop_pool.stop == false && refop_pool_start() < 0)
+		goto out;
+
+	// While the pool is stopped, a set of a callback is queued at once, the worker runs it before exit.
+	if (rec != NULL && future->op == REFOP_OP_SET && g_refop_pool.stop == false) {
+		if (refop_coalesce_set(rec, future, pfuture) == 0)
+			result = REFOP_SUCCESS;
+		goto out;
+	}
+
+	// Other operations are ordered after the pending write.
+	if (rec != NULL && rec->pending != NULL)
+		refop_coalesce_promote(rec);
+
+	future->refcount = (pfuture != NULL) ? 2 : 1;
+	if (refop_pool_enqueue(future) < 0)
+		goto out;
+
+	if (pfuture != NULL)
+		(*pfuture) = future;
+	result = REFOP_SUCCESS;
+
+out:
+	(void) pthread_mutex_unlock(&g_refop_pool.lock);
+
+	return result;
+}
+
+/**
+ * Create an operation.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	op	Operation.
+ *
+ * @return struct refop_future*	 Future, NULL is no memory.
+ */
+static struct refop_future *refop_future_new(refop_handle_t handle, refop_op_t op)
+{
+	struct refop_future *future = NULL;
+
+	future = (struct refop_future *) refop_calloc(1, sizeof(struct refop_future));
+	if (future == NULL)
+		return NULL;
+
+	future->handle = handle;
+	future->op = op;
+	future->result = REFOP_SYSERROR;
+
+	return future;
+}
+
+/**
+ * Wait for queued operations of a handle.  Synchronous operations call it first, so those are ordered
+ * after asynchronous operations that were queued before.  A pending coalesced write is queued at once.
+ * It does nothing in a worker thread and it does not take the pool lock while no operation is queued.
+ *
+ * @param [in]	handle	Refop handle.
+ */
+void refop_pool_drain(refop_handle_t handle)
+{
+	struct refop_coalesce *rec = NULL;
+
+	if ((__atomic_load_n(&g_refop_pool.queued, __ATOMIC_ACQUIRE) == 0 &&
+	     __atomic_load_n(&g_refop_pool.pending, __ATOMIC_ACQUIRE) == 0) ||
+	    g_refop_pool_worker == true)
+		return;
+
+	(void) pthread_mutex_lock(&g_refop_pool.lock);
+	rec = refop_coalesce_find(handle, NULL);
+	if (rec != NULL && rec->pending != NULL)
+		refop_coalesce_promote(rec);
+	while (refop_pool_queue_find(handle, NULL) != NULL)
+		(void) pthread_cond_wait(&g_refop_pool.done_cond, &g_refop_pool.lock);
+	(void) pthread_mutex_unlock(&g_refop_pool.lock);
+}
+
+/**
+ * Configure the worker pool of asynchronous operations.
+ * Running workers finish all queued operations and exit, new workers are started by next operation.
+ * Operations that completion callbacks submit meanwhile are finished before the workers exit.
+ * It shall not be called by a completion callback.
+ *
+ * @param [in]	threads	Number of workers (1 to REFOP_POOL_THREADS_MAX), 0 is default.
+ * @param [in]	depth	Maximum number of queued operations (1 to REFOP_POOL_DEPTH_MAX), 0 is default.
+ *			A new operation waits while the pool has maximum operations.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_BUSY Called by a worker.
+ */
+refop_error_t refop_pool_configure(int threads, int depth)
+{
+	struct refop_coalesce *rec = NULL;
+	pthread_t *workers = NULL;
+	int nthreads = 0;
+
+	if (threads < 0 || threads > REFOP_POOL_THREADS_MAX || depth < 0 || depth > REFOP_POOL_DEPTH_MAX)
+		return REFOP_ARGERROR;
+
+	if (g_refop_pool_worker == true)
+		return REFOP_BUSY;
+
+	(void) pthread_mutex_lock(&g_refop_pool.lock);
+
+	while (g_refop_pool.stop == true)
+		(void) pthread_cond_wait(&g_refop_pool.space_cond, &g_refop_pool.lock);
+
+	// New operations wait until workers are restarted.
+	g_refop_pool.stop = true;
+	for (rec = g_refop_pool.coalesce; rec != NULL;) {
+		if (rec->pending != NULL) {
+			refop_coalesce_promote(rec);
+			rec = g_refop_pool.coalesce;
+			continue;
+		}
+		rec = rec->next;
+	}
+	while (g_refop_pool.queued > 0)
+		(void) pthread_cond_wait(&g_refop_pool.done_cond, &g_refop_pool.lock);
+
+	(void) pthread_cond_broadcast(&g_refop_pool.work_cond);
+	workers = g_refop_pool.threads;
+	nthreads = g_refop_pool.nthreads;
+	g_refop_pool.threads = NULL;
+	g_refop_pool.nthreads = 0;
+
+	(void) pthread_mutex_unlock(&g_refop_pool.lock);
+
+	for (int i = 0; i < nthreads; i++)
+		(void) pthread_join(workers[i], NULL);
+	refop_free(workers);
+
+	(void) pthread_mutex_lock(&g_refop_pool.lock);
+	g_refop_pool.threads_config = (threads != 0) ? threads : REFOP_POOL_THREADS_DEFAULT;
+	g_refop_pool.depth = (depth != 0) ? depth : REFOP_POOL_DEPTH_DEFAULT;
+	g_refop_pool.stop = false;
+	(void) pthread_cond_broadcast(&g_refop_pool.space_cond);
+	(void) pthread_mutex_unlock(&g_refop_pool.lock);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * Copy the pending coalesced write of a handle.  It does not take the pool lock while no write is
+ * pending.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [out]	data	Read buffer.
+ * @param [in]	datasize	Read buffer size (byte).
+ * @param [out]	getsize	Readed size (byte).
+ *
+ * @return bool
+ * @retval true The pending value was copied.
+ * @retval false No pending write.
+ */
+bool refop_pool_pending_get(refop_handle_t handle, uint8_t *data, int64_t datasize, int64_t *getsize)
+{
+	struct refop_coalesce *rec = NULL;
+	int64_t size = 0;
+	bool found = false;
+
+	if (__atomic_load_n(&g_refop_pool.pending, __ATOMIC_ACQUIRE) == 0)
+		return false;
+
+	(void) pthread_mutex_lock(&g_refop_pool.lock);
+
+	rec = refop_coalesce_find(handle, NULL);
+	if (rec != NULL && rec->pending != NULL) {
+		size = (datasize < rec->pending->datasize) ? datasize : rec->pending->datasize;
+		memcpy(data, rec->pending->data, (size_t) size);
+		(*getsize) = size;
+		found = true;
+	}
+
+	(void) pthread_mutex_unlock(&g_refop_pool.lock);
+
+	return found;
+}
+
+/**
+ * The write coalescing setting function of refop.
+ * With coalescing, asynchronous sets of the handle replace the pending write in memory, and one write
+ * of the newest value is done per window.  Gets return the pending value.  Other operations of the
+ * handle, refop_flush_redundancy_data() and release write the pending value at once.
+ *
+ * @param [in]	handle	Refop handle
+ * @param [in]	window_ms	Window (1 to REFOP_COALESCE_WINDOW_MAX ms), 0 is no coalescing.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+refop_error_t refop_set_coalesce_window(refop_handle_t handle, int window_ms)
+{
+	struct refop_coalesce *rec = NULL, **link = NULL;
+
+	if (handle == NULL || window_ms < 0 || window_ms > REFOP_COALESCE_WINDOW_MAX)
+		return REFOP_ARGERROR;
+
+	(void) pthread_mutex_lock(&g_refop_pool.lock);
+
+	rec = refop_coalesce_find(handle, &link);
+	if (window_ms == 0) {
+		if (rec != NULL && rec->pending != NULL) {
+			refop_coalesce_promote(rec);
+			rec = refop_coalesce_find(handle, &link);
+		}
+		if (rec != NULL) {
+			(*link) = rec->next;
+			refop_free(rec);
+		}
+	} else {
+		if (rec == NULL) {
+			rec = (struct refop_coalesce *) refop_calloc(1, sizeof(struct refop_coalesce));
+			if (rec == NULL) {
+				(void) pthread_mutex_unlock(&g_refop_pool.lock);
+				return REFOP_SYSERROR;
+			}
+			rec->handle = handle;
+			rec->last_ms = refop_lock_clock_ms();
+			(*link) = rec;
+		}
+		rec->window_ms = window_ms;
+		if (rec->pending != NULL) {
+			rec->due_ms = rec->last_ms + window_ms;
+			(void) pthread_cond_broadcast(&g_refop_pool.work_cond);
+		}
+	}
+
+	(void) pthread_mutex_unlock(&g_refop_pool.lock);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The flush function of refop for write coalescing.
+ * The pending write of the handle is done at once, and this function waits for it.
+ * In a completion callback, the write is queued and this function does not wait.
+ *
+ * @param [in]	handle	Refop handle
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded or no write was pending.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+refop_error_t refop_flush_redundancy_data(refop_handle_t handle)
+{
+	struct refop_coalesce *rec = NULL;
+	struct refop_future *flush = NULL;
+	refop_error_t result = REFOP_SUCCESS;
+
+	if (handle == NULL)
+		return REFOP_ARGERROR;
+
+	if (__atomic_load_n(&g_refop_pool.pending, __ATOMIC_ACQUIRE) == 0)
+		return REFOP_SUCCESS;
+
+	(void) pthread_mutex_lock(&g_refop_pool.lock);
+
+	rec = refop_coalesce_find(handle, NULL);
+	if (rec != NULL && rec->pending != NULL) {
+		flush = rec->pending;
+		flush->refcount++;
+		refop_coalesce_promote(rec);
+		if (g_refop_pool_worker == false) {
+			while (flush->done == false)
+				(void) pthread_cond_wait(&g_refop_pool.done_cond, &g_refop_pool.lock);
+			result = flush->result;
+		}
+		refop_future_put(flush);
+	}
+
+	(void) pthread_mutex_unlock(&g_refop_pool.lock);
+
+	return result;
+}
+
+/**
+ * The asynchronous data set function of refop.
+ * The data is copied, so the caller can reuse the buffer at return.  Operations of a handle are done
+ * in submit order, and synchronous operations of the handle wait for queued operations.
+ *
+ * @param [in]	handle	Refop handle
+ * @param [in]	data	Write data for set data.
+ * @param [in]	datasize	Write data size (byte).
+ * @param [out]	future	Future of the operation, NULL is fire and forget.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS The operation was queued, the result is got from the future.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+refop_error_t refop_set_redundancy_data_async(
+	refop_handle_t handle, uint8_t *data, int64_t datasize, refop_future_t *future)
+{
+	struct refop_future *newfuture = NULL;
+	refop_error_t result = REFOP_SYSERROR;
+
+	if (handle == NULL || data == NULL || datasize < 0)
+		return REFOP_ARGERROR;
+
+	newfuture = refop_future_new(handle, REFOP_OP_SET);
+	if (newfuture == NULL)
+		return REFOP_SYSERROR;
+
+	// Zero size data is copied to one byte buffer.
+	newfuture->data = (uint8_t *) refop_malloc((datasize > 0) ? (size_t) datasize : 1);
+	if (newfuture->data == NULL)
+		goto error;
+	memcpy(newfuture->data, data, (size_t) datasize);
+	newfuture->datasize = datasize;
+
+	result = refop_pool_submit(newfuture, future);
+	if (result != REFOP_SUCCESS)
+		goto error;
+
+	return REFOP_SUCCESS;
+
+error:
+	refop_free(newfuture->data);
+	refop_free(newfuture);
+
+	return REFOP_SYSERROR;
+}
+
+/**
+ * The asynchronous data get function of refop.
+ * The buffer and getsize shall be valid until the operation completed.
+ *
+ * @param [in]	handle	Refop handle
+ * @param [out]	data	Read buffer for get data.
+ * @param [in]	datasize	Read buffer size (byte).
+ * @param [out]	getsize	Readed size (byte), it is set at completion.
+ * @param [out]	future	Future of the operation.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS The operation was queued, the result is got from the future.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+refop_error_t refop_get_redundancy_data_async(
+	refop_handle_t handle, uint8_t *data, int64_t datasize, int64_t *getsize, refop_future_t *future)
+{
+	struct refop_future *newfuture = NULL;
+
+	if (handle == NULL || data == NULL || datasize < 0 || getsize == NULL || future == NULL)
+		return REFOP_ARGERROR;
+
+	newfuture = refop_future_new(handle, REFOP_OP_GET);
+	if (newfuture == NULL)
+		return REFOP_SYSERROR;
+
+	newfuture->data = data;
+	newfuture->datasize = datasize;
+	newfuture->getsize = getsize;
+
+	// Pending coalesced value is returned at once.
+	if (refop_pool_pending_get(handle, data, datasize, getsize) == true) {
+		newfuture->result = REFOP_SUCCESS;
+		newfuture->done = true;
+		newfuture->refcount = 1;
+		(*future) = newfuture;
+		return REFOP_SUCCESS;
+	}
+
+	if (refop_pool_submit(newfuture, future) != REFOP_SUCCESS) {
+		refop_free(newfuture);
+		return REFOP_SYSERROR;
+	}
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The asynchronous data remove function of refop.
+ *
+ * @param [in]	handle	Refop handle
+ * @param [out]	future	Future of the operation, NULL is fire and forget.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS The operation was queued, the result is got from the future.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+refop_error_t refop_remove_redundancy_data_async(refop_handle_t handle, refop_future_t *future)
+{
+	struct refop_future *newfuture = NULL;
+
+	if (handle == NULL)
+		return REFOP_ARGERROR;
+
+	newfuture = refop_future_new(handle, REFOP_OP_REMOVE);
+	if (newfuture == NULL)
+		return REFOP_SYSERROR;
+
+	if (refop_pool_submit(newfuture, future) != REFOP_SUCCESS) {
+		refop_free(newfuture);
+		return REFOP_SYSERROR;
+	}
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The asynchronous data verify function of refop.
+ *
+ * @param [in]	handle	Refop handle
+ * @param [out]	future	Future of the operation.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS The operation was queued, the result is got from the future.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+refop_error_t refop_verify_redundancy_data_async(refop_handle_t handle, refop_future_t *future)
+{
+	struct refop_future *newfuture = NULL;
+
+	if (handle == NULL || future == NULL)
+		return REFOP_ARGERROR;
+
+	newfuture = refop_future_new(handle, REFOP_OP_VERIFY);
+	if (newfuture == NULL)
+		return REFOP_SYSERROR;
+
+	if (refop_pool_submit(newfuture, future) != REFOP_SUCCESS) {
+		refop_free(newfuture);
+		return REFOP_SYSERROR;
+	}
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * Make the deadline of a wait for completion.
+ *
+ * @param [in]	timeout_ms	Timeout (ms), it shall be positive.
+ * @param [out]	ts	Deadline by CLOCK_MONOTONIC.
+ */
+static void refop_pool_deadline(int timeout_ms, struct timespec *ts)
+{
+	(void) clock_gettime(CLOCK_MONOTONIC, ts);
+	ts->tv_sec += timeout_ms / 1000;
+	ts->tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+/**
+ * Wait for completion of an asynchronous operation.
+ * A completion callback shall not wait for a later operation of the same handle.
+ *
+ * @param [in]	future	Future.
+ * @param [in]	timeout_ms	Timeout (ms), -1 is infinite and 0 is poll.
+ *
+ * @return refop_error_t
+ * @retval REFOP_BUSY The operation was not completed until timeout.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval other Result of the operation.
+ */
+refop_error_t refop_future_wait(refop_future_t future, int timeout_ms)
+{
+	struct timespec ts;
+	refop_error_t result = REFOP_BUSY;
+
+	if (future == NULL || timeout_ms < -1)
+		return REFOP_ARGERROR;
+
+	if (timeout_ms > 0)
+		refop_pool_deadline(timeout_ms, &ts);
+
+	(void) pthread_mutex_lock(&g_refop_pool.lock);
+
+	while (future->done == false && timeout_ms != 0) {
+		if (timeout_ms < 0) {
+			(void) pthread_cond_wait(&g_refop_pool.done_cond, &g_refop_pool.lock);
+		} else if (pthread_cond_clockwait(&g_refop_pool.done_cond, &g_refop_pool.lock, CLOCK_MONOTONIC, &ts) ==
+			   ETIMEDOUT) {
+			break;
+		}
+	}
+
+	if (future->done == true)
+		result = future->result;
+
+	(void) pthread_mutex_unlock(&g_refop_pool.lock);
+
+	return result;
+}
+
+/**
+ * Poll an asynchronous operation without wait.
+ *
+ * @param [in]	future	Future.
+ *
+ * @return refop_error_t
+ * @retval REFOP_BUSY The operation was not completed.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval other Result of the operation.
+ */
+refop_error_t refop_future_poll(refop_future_t future)
+{
+	return refop_future_wait(future, 0);
+}
+
+/**
+ * Set the completion callback of an asynchronous operation.  The callback is called once by a worker
+ * at completion.  When the operation was already completed, it is called by this function.
+ * The future is valid in the callback until the caller releases it.
+ *
+ * @param [in]	future	Future.
+ * @param [in]	callback	Completion callback.
+ * @param [in]	ctx	Context of callback.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error or callback was already set.
+ */
+refop_error_t refop_future_set_callback(refop_future_t future, refop_future_cb_t callback, void *ctx)
+{
+	refop_error_t result = REFOP_SYSERROR;
+	bool done = false;
+
+	if (future == NULL || callback == NULL)
+		return REFOP_ARGERROR;
+
+	(void) pthread_mutex_lock(&g_refop_pool.lock);
+
+	if (future->callback != NULL) {
+		(void) pthread_mutex_unlock(&g_refop_pool.lock);
+		return REFOP_ARGERROR;
+	}
+
+	future->callback = callback;
+	future->ctx = ctx;
+	done = future->done;
+	result = future->result;
+
+	(void) pthread_mutex_unlock(&g_refop_pool.lock);
+
+	if (done == true)
+		callback(future, result, ctx);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * Release a future.  A not completed operation is still done, and its result is discarded.
+ *
+ * @param [in]	future	Future.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_future_release(refop_future_t future)
+{
+	if (future == NULL)
+		return REFOP_ARGERROR;
+
+	(void) pthread_mutex_lock(&g_refop_pool.lock);
+	refop_future_put(future);
+	(void) pthread_mutex_unlock(&g_refop_pool.lock);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * Batch of asynchronous operations.
+ */
+struct refop_batch {
+	refop_batch_op_t *ops;	  /**< Operations of the caller */
+	int count;		  /**< Number of operations */
+	refop_future_t futures[]; /**< Futures of operations */
+};
+
+/**
+ * The batch submit function of refop.
+ * Operations are queued in array order by the asynchronous functions, so operations of one handle are
+ * done in array order.  When the submit fails, operations that were queued before are still done and
+ * their results are discarded.
+ *
+ * @param [in]	ops	Operations, the array shall be valid until the batch is released.
+ * @param [in]	count	Number of operations.
+ * @param [out]	batch	Batch of the operations.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS The operations were queued, the results are got by refop_batch_wait().
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+refop_error_t refop_batch_submit(refop_batch_op_t *ops, int count, refop_batch_t *batch)
+{
+	struct refop_batch *newbatch = NULL;
+	refop_batch_op_t *op = NULL;
+	refop_future_t *pfuture = NULL;
+	refop_error_t result = REFOP_SUCCESS;
+	int i = 0;
+
+	if (ops == NULL || count <= 0 || batch == NULL)
+		return REFOP_ARGERROR;
+
+	for (i = 0; i < count; i++) {
+		if (ops[i].handle == NULL || (uint32_t) ops[i].type > REFOP_BATCH_VERIFY)
+			return REFOP_ARGERROR;
+	}
+
+	newbatch = (struct refop_batch *) refop_calloc(
+		1, sizeof(struct refop_batch) + sizeof(refop_future_t) * (size_t) count);
+	if (newbatch == NULL)
+		return REFOP_SYSERROR;
+	newbatch->ops = ops;
+
+	for (i = 0; i < count && result == REFOP_SUCCESS; i++) {
+		op = &ops[i];
+		pfuture = &newbatch->futures[i];
+		if (op->type == REFOP_BATCH_SET)
+			result = refop_set_redundancy_data_async(op->handle, op->data, op->datasize, pfuture);
+		else if (op->type == REFOP_BATCH_GET)
+			result = refop_get_redundancy_data_async(op->handle, op->data, op->datasize, op->getsize, pfuture);
+		else if (op->type == REFOP_BATCH_REMOVE)
+			result = refop_remove_redundancy_data_async(op->handle, pfuture);
+		else
+			result = refop_verify_redundancy_data_async(op->handle, pfuture);
+		if (result == REFOP_SUCCESS)
+			newbatch->count++;
+	}
+
+	if (result != REFOP_SUCCESS) {
+		(void) refop_batch_release(newbatch);
+		return result;
+	}
+
+	(*batch) = newbatch;
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * Wait for completion of all operations of a batch.  When all operations were completed, the result
+ * of each operation is set to the result member of the operation array.
+ *
+ * @param [in]	batch	Batch.
+ * @param [in]	timeout_ms	Timeout (ms), -1 is infinite and 0 is poll.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS All operations were completed.
+ * @retval REFOP_BUSY An operation was not completed until timeout.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_batch_wait(refop_batch_t batch, int timeout_ms)
+{
+	struct timespec ts;
+	int i = 0;
+
+	if (batch == NULL || timeout_ms < -1)
+		return REFOP_ARGERROR;
+
+	if (timeout_ms > 0)
+		refop_pool_deadline(timeout_ms, &ts);
+
+	(void) pthread_mutex_lock(&g_refop_pool.lock);
+
+	// Completed operations are skipped, so each wakeup checks the rest only.
+	while (i < batch->count) {
+		if (batch->futures[i]->done == true) {
+			i++;
+		} else if (timeout_ms == 0) {
+			break;
+		} else if (timeout_ms < 0) {
+			(void) pthread_cond_wait(&g_refop_pool.done_cond, &g_refop_pool.lock);
+		} else if (pthread_cond_clockwait(&g_refop_pool.done_cond, &g_refop_pool.lock, CLOCK_MONOTONIC, &ts) ==
+			   ETIMEDOUT) {
+			break;
+		}
+	}
+
+	if (i == batch->count) {
+		for (i = 0; i < batch->count; i++)
+			batch->ops[i].result = batch->futures[i]->result;
+	}
+
+	(void) pthread_mutex_unlock(&g_refop_pool.lock);
+
+	return (i == batch->count) ? REFOP_SUCCESS : REFOP_BUSY;
+}
+
+/**
+ * Poll a batch without wait.
+ *
+ * @param [in]	batch	Batch.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS All operations were completed, the results were set.
+ * @retval REFOP_BUSY An operation was not completed.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_batch_poll(refop_batch_t batch)
+{
+	return refop_batch_wait(batch, 0);
+}
+
+/**
+ * Release a batch.  Not completed operations are still done, and their results are discarded.
+ *
+ * @param [in]	batch	Batch.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_batch_release(refop_batch_t batch)
+{
+	if (batch == NULL)
+		return REFOP_ARGERROR;
+
+	(void) pthread_mutex_lock(&g_refop_pool.lock);
+	for (int i = 0; i < batch->count; i++)
+		refop_future_put(batch->futures[i]);
+	(void) pthread_mutex_unlock(&g_refop_pool.lock);
+
+	refop_free(batch);
+
+	return REFOP_SUCCESS;
+}
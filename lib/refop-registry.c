@@ -0,0 +1,268 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	refop-registry.c
+ * @brief	Process wide registry of shared refop handles
+ */
+#include "fileop.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Initial number of hash buckets of the registry, power of 2.  It doubles when entries exceed buckets. */
+#define REFOP_REGISTRY_BUCKETS_MIN (64)
+
+/**
+ * Registry entry of a shared handle.
+ */
+struct refop_registry_entry {
+	struct refop_registry_entry *next; /**< Next entry in the bucket */
+	struct refop_halndle *handle;	   /**< Shared handle */
+	uint32_t hash;			   /**< Hash of directory and file name */
+	unsigned int refcount;		   /**< Number of creators that have not released the handle */
+};
+
+/** Initial hash buckets, the registry works without heap memory until it grows. */
+static struct refop_registry_entry *g_refop_registry_initial[REFOP_REGISTRY_BUCKETS_MIN];
+/** Hash buckets of shared handles.  Those are protected by g_refop_registry_lock. */
+static struct refop_registry_entry **g_refop_registry = g_refop_registry_initial;
+static size_t g_refop_registry_nbuckets = REFOP_REGISTRY_BUCKETS_MIN;
+static size_t g_refop_registry_nentries = 0;
+static pthread_mutex_t g_refop_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Update FNV-1a hash by data.
+ *
+ * @param [in]	hash	Current hash, REFOP_HASH_INIT for first data.
+ * @param [in]	data	Data.
+ * @param [in]	len	Data length.
+ *
+ * @return uint32_t	 Updated hash value.
+ */
+uint32_t refop_hash_update(uint32_t hash, const void *data, size_t len)
+{
+	const uint8_t *p = (const uint8_t *) data;
+
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ p[i]) * 16777619u;
+
+	return hash;
+}
+
+/**
+ * Calculate the registry hash of a key.  "/dir" and "/dir/" have same hash.
+ *
+ * @param [in]	directry	Directory path.
+ * @param [in]	dirlen	Length of directory path without trailing '/'.
+ * @param [in]	filename	File name.
+ *
+ * @return uint32_t	 Hash value.
+ */
+static uint32_t refop_registry_hash(const char *directry, size_t dirlen, const char *filename)
+{
+	uint32_t hash = REFOP_HASH_INIT;
+
+	hash = refop_hash_update(hash, directry, dirlen);
+	hash = refop_hash_update(hash, "/", 1);
+
+	return refop_hash_update(hash, filename, strlen(filename));
+}
+
+/**
+ * Get the directory length without trailing '/'.
+ *
+ * @param [in]	directry	Directory path.
+ *
+ * @return size_t	 Length.
+ */
+static size_t refop_registry_dirlen(const char *directry)
+{
+	size_t len = strlen(directry);
+
+	return (len > 0 && directry[len - 1] == '/') ? len - 1 : len;
+}
+
+/**
+ * Find an entry in the registry.  The registry lock shall be held.
+ *
+ * @param [in]	hash	Hash value of the key.
+ * @param [in]	directry	Directory path.
+ * @param [in]	dirlen	Length of directory path without trailing '/'.
+ * @param [in]	filename	File name.
+ *
+ * @return struct refop_registry_entry*	 Entry, NULL is not registered.
+ */
+static struct refop_registry_entry *refop_registry_find(uint32_t hash, const char *directry, size_t dirlen,
+							 const char *filename)
+{
+	struct refop_registry_entry *entry = NULL;
+	struct refop_dir *dir = NULL;
+
+	for (entry = g_refop_registry[hash & (g_refop_registry_nbuckets - 1)]; entry != NULL; entry = entry->next) {
+		dir = entry->handle->dir;
+		if (entry->hash == hash && dir->len == (dirlen + 1) && memcmp(dir->path, directry, dirlen) == 0 &&
+		    strcmp(entry->handle->name, filename) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/**
+ * Double the hash buckets.  The registry lock shall be held.  When no memory, buckets are not changed.
+ */
+static void refop_registry_rehash(void)
+{
+	struct refop_registry_entry **buckets = NULL, *entry = NULL, *next = NULL;
+	size_t nbuckets = g_refop_registry_nbuckets * 2;
+
+	buckets = (struct refop_registry_entry **) refop_calloc(nbuckets, sizeof(struct refop_registry_entry *));
+	if (buckets == NULL)
+		return;
+
+	for (size_t i = 0; i < g_refop_registry_nbuckets; i++) {
+		for (entry = g_refop_registry[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			entry->next = buckets[entry->hash & (nbuckets - 1)];
+			buckets[entry->hash & (nbuckets - 1)] = entry;
+		}
+	}
+
+	if (g_refop_registry != g_refop_registry_initial)
+		refop_free(g_refop_registry);
+	g_refop_registry = buckets;
+	g_refop_registry_nbuckets = nbuckets;
+}
+
+/**
+ * Get a shared handle that is already open.  When it is found, the reference count is increased.
+ * This function does not use file system and heap memory.
+ *
+ * @param [in]	directry	Directory path.
+ * @param [in]	filename	File name.
+ *
+ * @return refop_handle_t
+ * @retval !NULL Shared handle, it shall be released by refop_registry_put().
+ * @retval NULL Not registered.
+ */
+refop_handle_t refop_registry_get(const char *directry, const char *filename)
+{
+	struct refop_registry_entry *entry = NULL;
+	refop_handle_t handle = NULL;
+	size_t dirlen = 0;
+	uint32_t hash = 0;
+
+	dirlen = refop_registry_dirlen(directry);
+	hash = refop_registry_hash(directry, dirlen, filename);
+
+	(void) pthread_mutex_lock(&g_refop_registry_lock);
+
+	entry = refop_registry_find(hash, directry, dirlen, filename);
+	if (entry != NULL) {
+		entry->refcount++;
+		handle = entry->handle;
+	}
+
+	(void) pthread_mutex_unlock(&g_refop_registry_lock);
+
+	return handle;
+}
+
+/**
+ * Register a new shared handle.  When another thread registered same key first, that handle is
+ * returned with increased reference count and the new handle is not registered.
+ *
+ * @param [in]	handle	New shared handle.
+ *
+ * @return refop_handle_t
+ * @retval handle The new handle was registered.
+ * @retval other Handle that was registered by another thread.
+ * @retval NULL No memory.
+ */
+refop_handle_t refop_registry_add(refop_handle_t handle)
+{
+	struct refop_registry_entry *entry = NULL, *newentry = NULL;
+	refop_handle_t result = NULL;
+	size_t dirlen = 0;
+	uint32_t hash = 0;
+
+	dirlen = handle->dir->len - 1;
+	hash = refop_registry_hash(handle->dir->path, dirlen, handle->name);
+
+	newentry = (struct refop_registry_entry *) refop_malloc(sizeof(struct refop_registry_entry));
+	if (newentry == NULL)
+		return NULL;
+
+	(void) pthread_mutex_lock(&g_refop_registry_lock);
+
+	entry = refop_registry_find(hash, handle->dir->path, dirlen, handle->name);
+	if (entry != NULL) {
+		entry->refcount++;
+		result = entry->handle;
+		goto out;
+	}
+
+	newentry->handle = handle;
+	newentry->hash = hash;
+	newentry->refcount = 1;
+	newentry->next = g_refop_registry[hash & (g_refop_registry_nbuckets - 1)];
+	g_refop_registry[hash & (g_refop_registry_nbuckets - 1)] = newentry;
+	g_refop_registry_nentries++;
+	if (g_refop_registry_nentries > g_refop_registry_nbuckets)
+		refop_registry_rehash();
+	newentry = NULL;
+	result = handle;
+
+out:
+	(void) pthread_mutex_unlock(&g_refop_registry_lock);
+	refop_free(newentry);
+
+	return result;
+}
+
+/**
+ * Release a reference of a shared handle.  The handle is removed from the registry when last
+ * reference was released, then the caller shall destroy the handle.
+ *
+ * @param [in]	handle	Shared handle.
+ *
+ * @return bool
+ * @retval true Last reference was released.
+ * @retval false Other references remain.
+ */
+bool refop_registry_put(refop_handle_t handle)
+{
+	struct refop_registry_entry **pentry = NULL, *entry = NULL;
+	bool last = true;
+	uint32_t hash = 0;
+
+	hash = refop_registry_hash(handle->dir->path, handle->dir->len - 1, handle->name);
+
+	(void) pthread_mutex_lock(&g_refop_registry_lock);
+
+	for (pentry = &g_refop_registry[hash & (g_refop_registry_nbuckets - 1)]; (*pentry) != NULL;
+	     pentry = &(*pentry)->next) {
+		if ((*pentry)->handle == handle) {
+			entry = (*pentry);
+			break;
+		}
+	}
+
+	if (entry != NULL) {
+		entry->refcount--;
+		if (entry->refcount > 0) {
+			last = false;
+		} else {
+			(*pentry) = entry->next;
+			g_refop_registry_nentries--;
+			refop_free(entry);
+		}
+	}
+
+	(void) pthread_mutex_unlock(&g_refop_registry_lock);
+
+	return last;
+}
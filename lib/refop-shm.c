@@ -0,0 +1,594 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	refop-shm.c
+ * @brief	Cross-process shared memory cache of validated values
+ */
+#include "fileop.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+#include "static-configurator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/** Prefix of the cache segment path. */
+const char c_shm_prefix[] = "/dev/shm/refop-";
+
+/** Magic code of the cache segment header. */
+#define REFOP_SHM_MAGIC (0x4d485352u)
+/** Size of the cache segment header, the value follows it. */
+#define REFOP_SHM_HEADER_SIZE (4096)
+/** Number of hash buckets of attached handles, power of 2. */
+#define REFOP_SHM_BUCKETS (64)
+/** Retry count of a writer that moves to the segment that replaced a removed one. */
+#define REFOP_SHM_REMAP_RETRY (3)
+
+/**
+ * Header of the cache segment.  The value is valid when valid_generation is generation.  A writer
+ * increases generation before and after a change of files, and a publisher makes sequence odd while
+ * it updates the value.  Both are done under the segment lock, readers do not lock.
+ * The segment file holds the header and the published value only, it grows by publish up to capacity.
+ * A remove of the data unlinks the segment and sets removed, handles that still map it do not use it.
+ */
+struct refop_shm_header {
+	uint32_t magic;		   /**< REFOP_SHM_MAGIC */
+	uint32_t removed;	   /**< Not 0 after the segment was unlinked */
+	uint64_t capacity;	   /**< Maximum value size, size of the value area of the mapping */
+	uint64_t sequence;	   /**< Odd while the value is updated */
+	uint64_t generation;	   /**< Increased by writers */
+	uint64_t valid_generation; /**< Generation of the value */
+	uint64_t size;		   /**< Value size */
+	char name[NAME_MAX + 1];   /**< Target file name */
+};
+
+/**
+ * Cache segment of a handle.  The segment is mapped read-only, the header page is also mapped
+ * writable for writers and publishers.
+ */
+struct refop_shm_entry {
+	struct refop_shm_entry *next;	 /**< Next entry in the bucket */
+	refop_handle_t handle;		 /**< Target handle */
+	const struct refop_shm_header *head; /**< Read-only mapping of the segment */
+	struct refop_shm_header *whead;	 /**< Writable mapping of the header */
+	size_t mapsize;			 /**< Size of the read-only mapping */
+	dev_t dev;			 /**< Device of the mapped segment file */
+	ino_t ino;			 /**< Inode of the mapped segment file */
+	char path[];			 /**< Segment path */
+};
+
+/** Hash buckets of attached handles.  It is protected by g_refop_shm_lock. */
+static struct refop_shm_entry *g_refop_shm[REFOP_SHM_BUCKETS];
+static pthread_mutex_t g_refop_shm_lock = PTHREAD_MUTEX_INITIALIZER;
+/** Number of attached handles, handles are not looked up while it is 0. */
+static unsigned int g_refop_shm_count;
+
+/**
+ * Get the hash bucket of a handle.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return struct refop_shm_entry**	 Bucket.
+ */
+static struct refop_shm_entry **refop_shm_bucket(refop_handle_t handle)
+{
+	return &g_refop_shm[((uintptr_t) handle >> 4) & (REFOP_SHM_BUCKETS - 1)];
+}
+
+/**
+ * Find the cache segment of a handle.  The entry is removed only by refop_set_shm_cache() under the
+ * exclusive handle lock, so it is stable while the caller holds the handle lock.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return struct refop_shm_entry*	 Entry, NULL is not attached.
+ */
+static struct refop_shm_entry *refop_shm_find(refop_handle_t handle)
+{
+	struct refop_shm_entry *entry = NULL;
+
+	if (__atomic_load_n(&g_refop_shm_count, __ATOMIC_ACQUIRE) == 0)
+		return NULL;
+
+	(void) pthread_mutex_lock(&g_refop_shm_lock);
+	for (entry = (*refop_shm_bucket(handle)); entry != NULL; entry = entry->next) {
+		if (entry->handle == handle)
+			break;
+	}
+	(void) pthread_mutex_unlock(&g_refop_shm_lock);
+
+	return entry;
+}
+
+/**
+ * Make the cache segment path of a handle.  The segment is keyed by the identity of the directory
+ * (device and inode) and the file name, so all paths of one file share the segment.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [out]	path	Segment path, PATH_MAX bytes.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 The directory is not found.
+ */
+int refop_shm_path(refop_handle_t handle, char *path)
+{
+	struct stat sb;
+	uint32_t hash = 0;
+
+	if (stat(handle->dir->path, &sb) < 0)
+		return -1;
+
+	hash = refop_hash_update(REFOP_HASH_INIT, handle->name, strlen(handle->name));
+	(void) snprintf(path, PATH_MAX, "%s%llx-%llx-%08x", c_shm_prefix, (unsigned long long) sb.st_dev,
+			(unsigned long long) sb.st_ino, hash);
+
+	return 0;
+}
+
+/**
+ * Acquire the segment lock.  The segment is opened for each lock, so the open file description lock
+ * serializes threads of one process too.
+ *
+ * @param [in]	path	Segment path.
+ * @param [in]	wait	When true, wait for the lock.  Otherwise try once.
+ *
+ * @return int
+ * @retval >=0 Fd of the locked segment, it shall be closed to unlock.
+ * @retval -1 Abnormal fail.
+ * @retval -2 Another process has the lock.
+ * @retval -3 The segment is not found.
+ */
+static int refop_shm_lock(const char *path, bool wait)
+{
+	struct flock fl;
+	int fd = -1;
+
+	fd = open(path, (O_CLOEXEC | O_RDWR | O_NOFOLLOW));
+	if (fd < 0)
+		return (errno == ENOENT) ? -3 : -1;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = 0;
+	fl.l_len = 1;
+
+	while (fcntl(fd, (wait == true) ? F_OFD_SETLKW : F_OFD_SETLK, &fl) < 0) {
+		if (errno == EINTR)
+			continue;
+		(void) close(fd);
+		return (errno == EAGAIN || errno == EACCES) ? -2 : -1;
+	}
+
+	return fd;
+}
+
+/**
+ * Acquire the lock of the segment that the entry maps.  A segment that was removed, or replaced by a
+ * new segment of the same path, is not locked.
+ *
+ * @param [in]	entry	Entry of the mapped segment.
+ * @param [in]	wait	When true, wait for the lock.  Otherwise try once.
+ *
+ * @return int
+ * @retval >=0 Fd of the locked segment, it shall be closed to unlock.
+ * @retval -1 Abnormal fail.
+ * @retval -2 Another process has the lock.
+ * @retval -3 The mapped segment was removed.
+ */
+static int refop_shm_entry_lock(const struct refop_shm_entry *entry, bool wait)
+{
+	struct stat sb;
+	int fd = -1;
+
+	fd = refop_shm_lock(entry->path, wait);
+	if (fd < 0)
+		return fd;
+
+	if (fstat(fd, &sb) < 0) {
+		(void) close(fd);
+		return -1;
+	}
+	if (sb.st_dev != entry->dev || sb.st_ino != entry->ino ||
+	    __atomic_load_n(&entry->head->removed, __ATOMIC_ACQUIRE) != 0) {
+		(void) close(fd);
+		return -3;
+	}
+
+	return fd;
+}
+
+/**
+ * Open and map the cache segment of a handle.  The first user creates and initializes the segment
+ * under the segment lock.  The file has the header only, the value area is mapped beyond the end of
+ * file and publish extends the file, so the segment uses memory for the stored value only.
+ * The entry is changed only when it succeeded.
+ *
+ * @param [in]	entry	Entry that has the segment path.
+ * @param [in]	capacity	Maximum value size of a new segment.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Abnormal fail, or the segment is used by another file.
+ */
+static int refop_shm_map(struct refop_shm_entry *entry, uint64_t capacity)
+{
+	struct refop_shm_header head;
+	struct stat sb;
+	void *map = MAP_FAILED, *wmap = MAP_FAILED;
+	size_t mapsize = 0;
+	int fd = -1, lockfd = -1, ret = -1;
+
+	fd = open(entry->path, (O_CLOEXEC | O_RDWR | O_CREAT | O_NOFOLLOW), (S_IRUSR | S_IWUSR));
+	if (fd < 0)
+		return -1;
+
+	lockfd = refop_shm_lock(entry->path, true);
+	if (lockfd < 0)
+		goto out;
+
+	if (fstat(fd, &sb) < 0)
+		goto out;
+
+	if (sb.st_size == 0) {
+		memset(&head, 0, sizeof(head));
+		head.magic = REFOP_SHM_MAGIC;
+		head.capacity = capacity;
+		head.generation = 1;
+		(void) strncpy(head.name, entry->handle->name, NAME_MAX);
+		if (ftruncate(fd, (off_t) REFOP_SHM_HEADER_SIZE) < 0 ||
+		    pwrite(fd, &head, sizeof(head), 0) != (ssize_t) sizeof(head))
+			goto out;
+	} else {
+		if (pread(fd, &head, sizeof(head), 0) != (ssize_t) sizeof(head))
+			goto out;
+		if (head.magic != REFOP_SHM_MAGIC || strncmp(head.name, entry->handle->name, NAME_MAX) != 0 ||
+		    head.removed != 0 || head.capacity > REFOP_DATA_SIZE_LIMIT_MAX ||
+		    (uint64_t) sb.st_size < REFOP_SHM_HEADER_SIZE)
+			goto out;
+	}
+
+	// Only the published part of the value area is backed by the file, readers do not access beyond it.
+	mapsize = (size_t) (REFOP_SHM_HEADER_SIZE + head.capacity);
+	map = mmap(NULL, mapsize, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto out;
+
+	wmap = mmap(NULL, REFOP_SHM_HEADER_SIZE, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+	if (wmap == MAP_FAILED) {
+		(void) munmap(map, mapsize);
+		goto out;
+	}
+
+	entry->head = (const struct refop_shm_header *) map;
+	entry->whead = (struct refop_shm_header *) wmap;
+	entry->mapsize = mapsize;
+	entry->dev = sb.st_dev;
+	entry->ino = sb.st_ino;
+	ret = 0;
+
+out:
+	if (lockfd >= 0)
+		(void) close(lockfd);
+	(void) close(fd);
+
+	return ret;
+}
+
+/**
+ * Move the entry to the current segment of its path after the mapped segment was removed.  The
+ * exclusive handle lock shall be held.
+ *
+ * @param [in]	entry	Entry of the mapped segment.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Abnormal fail, the entry keeps the removed segment.
+ */
+static int refop_shm_remap(struct refop_shm_entry *entry)
+{
+	const struct refop_shm_header *head = entry->head;
+	struct refop_shm_header *whead = entry->whead;
+	size_t mapsize = entry->mapsize;
+
+	if (refop_shm_map(entry, refop_get_config_handle_size_limit(entry->handle)) < 0)
+		return -1;
+
+	(void) munmap(whead, REFOP_SHM_HEADER_SIZE);
+	(void) munmap((void *) head, mapsize);
+
+	return 0;
+}
+
+/**
+ * Read the value from the cache segment.  It does not lock, the copy is used when the sequence and
+ * the generation are not changed during the copy.  The handle lock shall be held.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Read buffer.
+ * @param [in]	datasize	Read buffer size.
+ * @param [out]	getsize	Read size.
+ * @param [out]	generation	Generation before file read, it is used for refop_shm_publish().
+ *
+ * @return int
+ * @retval  0 The value was read from the segment.
+ * @retval -1 The handle does not use the cache.
+ * @retval -2 No valid value, the value shall be read from files.
+ */
+int refop_shm_get(refop_handle_t handle, uint8_t *data, int64_t datasize, int64_t *getsize,
+		  uint64_t *generation)
+{
+	const struct refop_shm_header *head = NULL;
+	struct refop_shm_entry *entry = NULL;
+	uint64_t seq = 0, gen = 0, size = 0;
+
+	entry = refop_shm_find(handle);
+	if (entry == NULL)
+		return -1;
+
+	head = entry->head;
+	seq = __atomic_load_n(&head->sequence, __ATOMIC_ACQUIRE);
+	gen = __atomic_load_n(&head->generation, __ATOMIC_ACQUIRE);
+	(*generation) = gen;
+	if ((seq & 1) != 0 || __atomic_load_n(&head->valid_generation, __ATOMIC_ACQUIRE) != gen ||
+	    __atomic_load_n(&head->removed, __ATOMIC_ACQUIRE) != 0)
+		return -2;
+
+	size = __atomic_load_n(&head->size, __ATOMIC_ACQUIRE);
+	if (size > head->capacity)
+		return -2;
+	if ((int64_t) size > datasize)
+		size = (uint64_t) datasize;
+	(void) memcpy(data, (const uint8_t *) head + REFOP_SHM_HEADER_SIZE, (size_t) size);
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&head->sequence, __ATOMIC_ACQUIRE) != seq ||
+	    __atomic_load_n(&head->generation, __ATOMIC_ACQUIRE) != gen)
+		return -2;
+
+	(*getsize) = (int64_t) size;
+
+	return 0;
+}
+
+/**
+ * Publish a validated value to the cache segment.  It is skipped when another process has the
+ * segment lock, or a writer changed files after generation was read.  The handle lock shall be held.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	generation	Generation from refop_shm_get() before file read.
+ * @param [in]	data	Validated value.
+ * @param [in]	size	Value size.
+ */
+void refop_shm_publish(refop_handle_t handle, uint64_t generation, const uint8_t *data, int64_t size)
+{
+	struct refop_shm_entry *entry = NULL;
+	struct refop_shm_header *whead = NULL;
+	int fd = -1;
+
+	entry = refop_shm_find(handle);
+	if (entry == NULL || (uint64_t) size > entry->head->capacity)
+		return;
+
+	fd = refop_shm_entry_lock(entry, false);
+	if (fd < 0)
+		return;
+
+	whead = entry->whead;
+	if (whead->generation != generation || whead->valid_generation == generation)
+		goto out;
+
+	// The write extends the segment file when the value is larger than any value before.
+	__atomic_store_n(&whead->sequence, whead->sequence + 1, __ATOMIC_SEQ_CST);
+	if (pwrite(fd, data, (size_t) size, REFOP_SHM_HEADER_SIZE) == (ssize_t) size) {
+		__atomic_store_n(&whead->size, (uint64_t) size, __ATOMIC_RELEASE);
+		__atomic_store_n(&whead->valid_generation, generation, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(&whead->sequence, whead->sequence + 1, __ATOMIC_SEQ_CST);
+
+out:
+	(void) close(fd);
+}
+
+/**
+ * Start a change of files.  The segment lock is held until refop_shm_write_end(), so no value is
+ * published during the change.  The generation is increased, the cached value is invalid.  When the
+ * segment was removed by another handle, the writer moves to the current segment.  The exclusive
+ * handle lock shall be held.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return int
+ * @retval >=0 Fd of the segment lock.
+ * @retval -1 The handle does not use the cache.
+ * @retval -2 The segment lock could not be taken, files shall not be changed.
+ */
+int refop_shm_write_begin(refop_handle_t handle)
+{
+	struct refop_shm_entry *entry = NULL;
+	int fd = -1;
+
+	entry = refop_shm_find(handle);
+	if (entry == NULL)
+		return -1;
+
+	for (int i = 0; i < REFOP_SHM_REMAP_RETRY; i++) {
+		fd = refop_shm_entry_lock(entry, true);
+		if (fd >= 0) {
+			__atomic_store_n(&entry->whead->generation, entry->whead->generation + 1, __ATOMIC_SEQ_CST);
+			return fd;
+		}
+		if (fd != -3)
+			break;
+		(void) refop_shm_remap(entry);
+	}
+
+	return -2;
+}
+
+/**
+ * Remove the cache segment after the data was removed.  The segment is unlinked and marked removed,
+ * so handles of other processes that still map it stop using it and their next write moves to a new
+ * segment.  It shall be called between refop_shm_write_begin() and refop_shm_write_end().
+ *
+ * @param [in]	handle	Refop handle.
+ */
+void refop_shm_remove(refop_handle_t handle)
+{
+	struct refop_shm_entry *entry = NULL;
+
+	entry = refop_shm_find(handle);
+	if (entry == NULL)
+		return;
+
+	__atomic_store_n(&entry->whead->removed, 1, __ATOMIC_SEQ_CST);
+	(void) unlink(entry->path);
+}
+
+/**
+ * End a change of files.  The generation is increased again, so a value that was read during the
+ * change is not published.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	fd	Fd from refop_shm_write_begin().
+ */
+void refop_shm_write_end(refop_handle_t handle, int fd)
+{
+	struct refop_shm_entry *entry = NULL;
+
+	entry = refop_shm_find(handle);
+	if (entry != NULL)
+		__atomic_store_n(&entry->whead->generation, entry->whead->generation + 1, __ATOMIC_SEQ_CST);
+
+	if (fd >= 0)
+		(void) close(fd);
+}
+
+/**
+ * Invalidate the cached value.  It is used by operations that change the value without set.
+ *
+ * @param [in]	handle	Refop handle.
+ */
+void refop_shm_invalidate(refop_handle_t handle)
+{
+	refop_shm_write_end(handle, refop_shm_write_begin(handle));
+}
+
+/**
+ * Attach a handle to its cache segment.
+ *
+ * @param [in]	handle	Refop handle.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+static refop_error_t refop_shm_attach(refop_handle_t handle)
+{
+	struct refop_shm_entry *entry = NULL, **bucket = NULL;
+	char path[PATH_MAX];
+
+	if (refop_shm_path(handle, path) < 0)
+		return REFOP_SYSERROR;
+
+	entry = (struct refop_shm_entry *) refop_calloc(1, sizeof(struct refop_shm_entry) + strlen(path) + 1);
+	if (entry == NULL)
+		return REFOP_SYSERROR;
+
+	entry->handle = handle;
+	(void) strcpy(entry->path, path);
+	if (refop_shm_map(entry, refop_get_config_handle_size_limit(handle)) < 0) {
+		refop_free(entry);
+		return REFOP_SYSERROR;
+	}
+
+	(void) pthread_mutex_lock(&g_refop_shm_lock);
+	bucket = refop_shm_bucket(handle);
+	entry->next = (*bucket);
+	(*bucket) = entry;
+	__atomic_add_fetch(&g_refop_shm_count, 1, __ATOMIC_RELEASE);
+	(void) pthread_mutex_unlock(&g_refop_shm_lock);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * Detach a handle from its cache segment.  The segment is kept for other processes.
+ *
+ * @param [in]	handle	Refop handle.
+ */
+static void refop_shm_detach(refop_handle_t handle)
+{
+	struct refop_shm_entry **pentry = NULL, *entry = NULL;
+
+	(void) pthread_mutex_lock(&g_refop_shm_lock);
+	for (pentry = refop_shm_bucket(handle); (*pentry) != NULL; pentry = &(*pentry)->next) {
+		if ((*pentry)->handle == handle) {
+			entry = (*pentry);
+			(*pentry) = entry->next;
+			__atomic_sub_fetch(&g_refop_shm_count, 1, __ATOMIC_RELEASE);
+			break;
+		}
+	}
+	(void) pthread_mutex_unlock(&g_refop_shm_lock);
+
+	if (entry == NULL)
+		return;
+
+	(void) munmap(entry->whead, REFOP_SHM_HEADER_SIZE);
+	(void) munmap((void *) entry->head, entry->mapsize);
+	refop_free(entry);
+}
+
+/**
+ * The shared memory cache setting function of refop.
+ * With the cache, a get takes the validated value from a segment in /dev/shm that is shared by all
+ * processes, and the files are read and validated only by the first get after a change.  A set, a
+ * remove and a mode change by a handle with the cache invalidate the value, so all writers of the
+ * file shall enable the cache.  A remove also removes the segment, then other handles read the files
+ * until their next write or until the cache is enabled again.
+ *
+ * @param [in]	handle	Refop handle
+ * @param [in]	enable	When true, use the cache.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, or the segment can not be used.
+ */
+refop_error_t refop_set_shm_cache(refop_handle_t handle, bool enable)
+{
+	struct refop_shm_entry *entry = NULL;
+	refop_error_t result = REFOP_SUCCESS;
+
+	if (handle == NULL)
+		return REFOP_ARGERROR;
+
+	// Handles without the cache do not pay for the lock.
+	if (enable == false && refop_shm_find(handle) == NULL)
+		return REFOP_SUCCESS;
+
+	refop_pool_drain(handle);
+	refop_handle_wrlock(handle);
+	if (enable == true) {
+		entry = refop_shm_find(handle);
+		if (entry == NULL)
+			result = refop_shm_attach(handle);
+		else if (__atomic_load_n(&entry->head->removed, __ATOMIC_ACQUIRE) != 0 && refop_shm_remap(entry) < 0)
+			result = REFOP_SYSERROR;
+	} else {
+		refop_shm_detach(handle);
+	}
+	refop_handle_unlock(handle);
+
+	return result;
+}
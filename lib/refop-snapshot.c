@@ -0,0 +1,315 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	refop-snapshot.c
+ * @brief	Lock free snapshot read of thread safe handle
+ */
+#include "fileop.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+#include "static-configurator.h"
+
+#include <sched.h>
+#include <string.h>
+
+/** Next reader counter stripe of a new thread. */
+static unsigned int g_refop_snapshot_next_stripe;
+/** Reader counter stripe of this thread, 0 is not assigned. */
+static __thread unsigned int g_refop_snapshot_stripe;
+
+/**
+ * Get the reader counter stripe of this thread.  Stripes are assigned round robin, so readers in
+ * different threads do not update a same counter.
+ *
+ * @return unsigned int	 Stripe index.
+ */
+static unsigned int refop_snapshot_stripe(void)
+{
+	if (g_refop_snapshot_stripe == 0)
+		g_refop_snapshot_stripe =
+			(__atomic_fetch_add(&g_refop_snapshot_next_stripe, 1, __ATOMIC_RELAXED) &
+			 (REFOP_SNAPSHOT_STRIPES - 1)) + 1;
+
+	return g_refop_snapshot_stripe - 1;
+}
+
+/**
+ * Release a reference of a snapshot.  The snapshot is freed by the last holder.
+ *
+ * @param [in]	snap	Snapshot.
+ */
+static void refop_snapshot_put(struct refop_snapshot *snap)
+{
+	if (__atomic_sub_fetch(&snap->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+		refop_free(snap);
+}
+
+/**
+ * Take a reference of the published snapshot without lock.  A reader is counted in the counter of
+ * current epoch parity while it loads the pointer and increases the reference count, so the
+ * replacer waits for it before the old snapshot is released.
+ *
+ * @param [in]	lock	Lock of thread safe handle.
+ *
+ * @return struct refop_snapshot*	 Referenced snapshot, NULL is not published.
+ */
+static struct refop_snapshot *refop_snapshot_hold(struct refop_handle_lock *lock)
+{
+	struct refop_snapshot *snap = NULL;
+	unsigned long *count = NULL;
+	unsigned int stripe = 0, epoch = 0;
+
+	stripe = refop_snapshot_stripe();
+	for (;;) {
+		epoch = __atomic_load_n(&lock->snapshot_epoch, __ATOMIC_SEQ_CST);
+		count = &lock->readers[epoch & 1][stripe].count;
+		(void) __atomic_add_fetch(count, 1, __ATOMIC_SEQ_CST);
+
+		// The replacer may already wait for the other parity, retry in new parity.
+		if (__atomic_load_n(&lock->snapshot_epoch, __ATOMIC_SEQ_CST) == epoch)
+			break;
+		(void) __atomic_sub_fetch(count, 1, __ATOMIC_RELEASE);
+	}
+
+	snap = __atomic_load_n(&lock->snapshot, __ATOMIC_SEQ_CST);
+	if (snap != NULL)
+		(void) __atomic_add_fetch(&snap->refcount, 1, __ATOMIC_RELAXED);
+
+	(void) __atomic_sub_fetch(count, 1, __ATOMIC_RELEASE);
+
+	return snap;
+}
+
+/**
+ * Replace the published snapshot.  The cache mutex shall be held.  The old snapshot is released
+ * after readers that may have loaded it took their reference, holders keep it until release.
+ *
+ * @param [in]	lock	Lock of thread safe handle.
+ * @param [in]	snap	New snapshot with the reference for the handle, NULL is retire.
+ */
+static void refop_snapshot_replace(struct refop_handle_lock *lock, struct refop_snapshot *snap)
+{
+	struct refop_snapshot *old = NULL;
+	unsigned int epoch = 0;
+
+	old = __atomic_exchange_n(&lock->snapshot, snap, __ATOMIC_SEQ_CST);
+	lock->snapshot_version++;
+	if (old == NULL)
+		return;
+
+	// New readers count in the other parity, readers of this parity finish in a few instructions.
+	epoch = lock->snapshot_epoch;
+	__atomic_store_n(&lock->snapshot_epoch, epoch + 1, __ATOMIC_SEQ_CST);
+	for (int i = 0; i < REFOP_SNAPSHOT_STRIPES; i++) {
+		while (__atomic_load_n(&lock->readers[epoch & 1][i].count, __ATOMIC_ACQUIRE) != 0)
+			(void) sched_yield();
+	}
+
+	refop_snapshot_put(old);
+}
+
+/**
+ * Create a snapshot by copy of data.
+ *
+ * @param [in]	data	Data.
+ * @param [in]	size	Data size.
+ * @param [in]	refcount	Initial reference count.
+ *
+ * @return struct refop_snapshot*	 Snapshot, NULL is no memory.
+ */
+static struct refop_snapshot *refop_snapshot_new(const uint8_t *data, int64_t size, long refcount)
+{
+	struct refop_snapshot *snap = NULL;
+
+	snap = (struct refop_snapshot *) refop_malloc(sizeof(struct refop_snapshot) + (size_t) size);
+	if (snap == NULL)
+		return NULL;
+
+	snap->refcount = refcount;
+	snap->size = size;
+	(void) memcpy(snap->data, data, (size_t) size);
+
+	return snap;
+}
+
+/**
+ * Update the published snapshot by a value that was set.  The handle shall be locked exclusively.
+ * A new snapshot is published only when a snapshot was in use, a handle that is not read by snapshot
+ * does not copy the value.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [in]	data	Data that was set.
+ * @param [in]	size	Data size.
+ */
+void refop_snapshot_update(refop_handle_t handle, const uint8_t *data, int64_t size)
+{
+	struct refop_handle_lock *lock = handle->lock;
+	struct refop_snapshot *snap = NULL;
+
+	if (lock == NULL)
+		return;
+
+	refop_handle_cache_lock(handle);
+	if (lock->snapshot == NULL) {
+		// A concurrent snapshot load read the old value, it shall not be published.
+		lock->snapshot_version++;
+	} else {
+		if (handle->cache_budget == 0 || (uint64_t) size <= handle->cache_budget)
+			snap = refop_snapshot_new(data, size, 1);
+		refop_snapshot_replace(lock, snap);
+	}
+	refop_handle_cache_unlock(handle);
+}
+
+/**
+ * Retire the published snapshot.  It is used by operations that change the value except set.
+ *
+ * @param [in]	handle	Refop handle.
+ */
+void refop_snapshot_retire(refop_handle_t handle)
+{
+	if (handle->lock == NULL)
+		return;
+
+	refop_handle_cache_lock(handle);
+	refop_snapshot_replace(handle->lock, NULL);
+	refop_handle_cache_unlock(handle);
+}
+
+/**
+ * Read the value by get and publish it as a snapshot.  The snapshot is not published when the
+ * value was changed during the get, then it is used by the caller only.  The snapshot is allocated
+ * one byte larger than the last loaded value, and it is doubled up to the size limit while the value
+ * fills it.
+ *
+ * @param [in]	handle	Refop handle.
+ * @param [out]	psnap	Snapshot with the reference for the caller.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_RECOVER This operation was succeeded within recovery.
+ * @retval REFOP_NOENT The target file/directroy was nothing.
+ * @retval REFOP_BROKEN This operation was failed. Because all recovery method was failed.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+static refop_error_t refop_snapshot_load(refop_handle_t handle, struct refop_snapshot **psnap)
+{
+	struct refop_handle_lock *lock = handle->lock;
+	struct refop_snapshot *snap = NULL;
+	refop_error_t result = REFOP_SYSERROR;
+	int64_t limit = 0, bufsize = 0, getsize = 0;
+	uint64_t version = 0;
+
+	refop_handle_cache_lock(handle);
+	version = lock->snapshot_version;
+	// One byte more than the last value tells that an unchanged value fits by one get.
+	bufsize = lock->snapshot_hint + 1;
+	refop_handle_cache_unlock(handle);
+
+	limit = (int64_t) refop_get_config_handle_size_limit(handle);
+	if (bufsize < REFOP_VERIFY_CHUNK_SIZE)
+		bufsize = REFOP_VERIFY_CHUNK_SIZE;
+
+	for (;;) {
+		if (bufsize > limit)
+			bufsize = limit;
+
+		snap = (struct refop_snapshot *) refop_malloc(sizeof(struct refop_snapshot) + (size_t) bufsize);
+		if (snap == NULL)
+			return REFOP_SYSERROR;
+
+		result = refop_get_redundancy_data(handle, snap->data, bufsize, &getsize);
+		if (result != REFOP_SUCCESS && result != REFOP_RECOVER) {
+			refop_free(snap);
+			return result;
+		}
+
+		// A value that fills the buffer may be truncated, it is read again by a larger buffer.
+		if (getsize < bufsize || bufsize == limit)
+			break;
+		refop_free(snap);
+		bufsize = bufsize * 2;
+	}
+	snap->refcount = 1;
+	snap->size = getsize;
+
+	refop_handle_cache_lock(handle);
+	lock->snapshot_hint = getsize;
+	if (lock->snapshot == NULL && lock->snapshot_version == version &&
+	    (handle->cache_budget == 0 || (uint64_t) getsize <= handle->cache_budget)) {
+		snap->refcount++;
+		refop_snapshot_replace(lock, snap);
+	}
+	refop_handle_cache_unlock(handle);
+
+	(*psnap) = snap;
+
+	return result;
+}
+
+/**
+ * Acquire a snapshot of the value of a thread safe handle.  When a snapshot is published, it is
+ * referenced without lock and copy.  Otherwise the value is read and validated by get, then it is
+ * published for following readers.  A set by this handle publishes the new value, a remove and a
+ * mode change retire the snapshot.  The data is valid and immutable until refop_snapshot_release(),
+ * even if the value was changed or the handle was released.
+ * Changes by other handles or other processes are not seen until the snapshot is replaced by this
+ * handle.
+ *
+ * @param [in]	handle	Thread safe refop handle.
+ * @param [out]	snapshot	Acquired snapshot.
+ * @param [out]	data	Data of the snapshot.
+ * @param [out]	size	Data size of the snapshot (byte).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_RECOVER This operation was succeeded within recovery.
+ * @retval REFOP_NOENT The target file/directroy was nothing.
+ * @retval REFOP_BROKEN This operation was failed. Because all recovery method was failed.
+ * @retval REFOP_ARGERROR Argument error, or the handle is not thread safe.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+refop_error_t refop_snapshot_acquire(refop_handle_t handle, refop_snapshot_t *snapshot, const uint8_t **data,
+				     int64_t *size)
+{
+	struct refop_snapshot *snap = NULL;
+	refop_error_t result = REFOP_SUCCESS;
+
+	if (handle == NULL || snapshot == NULL || data == NULL || size == NULL)
+		return REFOP_ARGERROR;
+
+	if (handle->lock == NULL)
+		return REFOP_ARGERROR;
+
+	snap = refop_snapshot_hold(handle->lock);
+	if (snap == NULL) {
+		result = refop_snapshot_load(handle, &snap);
+		if (result != REFOP_SUCCESS && result != REFOP_RECOVER)
+			return result;
+	}
+
+	(*snapshot) = snap;
+	(*data) = snap->data;
+	(*size) = snap->size;
+
+	return result;
+}
+
+/**
+ * Release a snapshot that was acquired by refop_snapshot_acquire().
+ *
+ * @param [in]	snapshot	Snapshot.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_snapshot_release(refop_snapshot_t snapshot)
+{
+	if (snapshot == NULL)
+		return REFOP_ARGERROR;
+
+	refop_snapshot_put(snapshot);
+
+	return REFOP_SUCCESS;
+}
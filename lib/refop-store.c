@@ -0,0 +1,594 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	refop-store.c
+ * @brief	The directory store of the redundancy file operation library
+ */
+#include "fileop.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+#include "static-configurator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/** Suffixes of files that the library makes from a file name, a key shall not end with those. */
+static const char *const c_store_reserved_suffix[] = { ".bk1", ".tmp", ".lck", ".ab",
+						       ".par", ".dlt", ".jnl", ".chk" };
+
+static bool refop_store_key_valid(const char *key, size_t *keylen);
+static struct refop_store_entry *refop_store_find(struct refop_store *st, const char *key, uint32_t hash);
+static int refop_store_entry_get(struct refop_store *st, const char *key, struct refop_store_entry **pentry);
+static void refop_store_rehash(struct refop_store *st);
+static void refop_store_cache_drop(struct refop_store *st, struct refop_store_entry *entry);
+static void refop_store_cache_put(struct refop_store *st, struct refop_store_entry *entry, const uint8_t *data,
+				  int64_t datasize);
+static void refop_store_dir_sync(struct refop_store *st);
+
+/**
+ * The refop store open function.
+ * The store manage many keys in one directory.  Each key is a file of rotation mode that has the key
+ * as file name.  Keys share the directory reference, one directory fd, a bounded LRU value cache and
+ * directory sync of sets that complete together.  The directory is checked once by open, so the first
+ * use of a key does not stat the directory.
+ * The cache assumes that keys of the store are changed only by this store.
+ *
+ * @param [out]	store	Created store
+ * @param [in]	directry	Terget directry
+ * @param [in]	options	Options of keys. NULL is process wide default options.  cache_budget is the
+ *			total size of the value cache, 0 is the default (1 MiB).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_NOENT The target directroy was nothing.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+refop_error_t refop_store_open(refop_store_t *store, const char *directry, const refop_options_t *options)
+{
+	struct refop_store *st = NULL;
+	refop_error_t result = REFOP_SYSERROR;
+	size_t dirlen = 0;
+
+	if (store == NULL || directry == NULL)
+		return REFOP_ARGERROR;
+
+	if (options != NULL && refop_options_valid(options) == false)
+		return REFOP_ARGERROR;
+
+	// file suffix = max 10 byte, / = max 1 byte
+	dirlen = strnlen(directry, PATH_MAX);
+	if (dirlen == 0 || (dirlen + REFOP_STORE_KEY_MAX + 10 + 1) > PATH_MAX)
+		return REFOP_ARGERROR;
+
+	st = (struct refop_store *) refop_calloc(1, sizeof(struct refop_store));
+	if (st == NULL)
+		return REFOP_SYSERROR;
+	st->dirfd = -1;
+
+	st->dirfd = open(directry, (O_CLOEXEC | O_DIRECTORY | O_RDONLY));
+	if (st->dirfd < 0) {
+		if ((errno == EACCES) || (errno == ELOOP) || (errno == ENOENT) || (errno == ENOTDIR))
+			result = REFOP_NOENT;
+		goto error;
+	}
+
+	st->nbuckets = REFOP_STORE_BUCKETS_MIN;
+	st->buckets = (struct refop_store_entry **) refop_calloc(st->nbuckets, sizeof(struct refop_store_entry *));
+	if (st->buckets == NULL)
+		goto error;
+
+	st->dir = refop_dir_get(directry);
+	if (st->dir == NULL)
+		goto error;
+
+	if (options != NULL)
+		st->options = (*options);
+	else
+		refop_get_config_default_options(&st->options);
+
+	// Keys are serialized by the store.
+	st->options.thread_safe = false;
+	st->options.shared = false;
+	st->cache_budget = (st->options.cache_budget != 0) ? st->options.cache_budget : REFOP_STORE_CACHE_DEFAULT;
+
+	(void) pthread_mutex_init(&st->lock, NULL);
+	(void) pthread_mutex_init(&st->sync_lock, NULL);
+	(void) pthread_cond_init(&st->sync_cond, NULL);
+
+	(*store) = st;
+
+	return REFOP_SUCCESS;
+
+error:
+	if (st->dirfd >= 0)
+		(void) close(st->dirfd);
+	refop_free(st->buckets);
+	refop_free(st);
+
+	return result;
+}
+
+/**
+ * The refop store close function.  All keys are released.  No set shall be running.
+ *
+ * @param [in]	store	Store
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_store_close(refop_store_t store)
+{
+	struct refop_store *st = (struct refop_store *) store;
+	struct refop_store_entry *entry = NULL, *next = NULL;
+
+	if (st == NULL)
+		return REFOP_ARGERROR;
+
+	for (size_t i = 0; i < st->nbuckets; i++) {
+		for (entry = st->buckets[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			(void) refop_release_redundancy_handle(entry->handle);
+			(void) pthread_mutex_destroy(&entry->lock);
+			refop_free(entry->cache);
+			refop_free(entry);
+		}
+	}
+
+	(void) pthread_cond_destroy(&st->sync_cond);
+	(void) pthread_mutex_destroy(&st->sync_lock);
+	(void) pthread_mutex_destroy(&st->lock);
+	refop_dir_put(st->dir);
+	(void) close(st->dirfd);
+	refop_free(st->buckets);
+	refop_free(st);
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The refop store data set function.
+ * Sets of different keys run concurrently, and the directory sync of sets that completed together is
+ * done once.  The value is kept in the value cache when it fits the cache budget.
+ *
+ * @param [in]	store	Store
+ * @param [in]	key	Key, it is used as file name.
+ * @param [in]	data	Write data for set data.
+ * @param [in]	datasize	Write data size (byte).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+refop_error_t refop_store_set(refop_store_t store, const char *key, uint8_t *data, int64_t datasize)
+{
+	struct refop_store *st = (struct refop_store *) store;
+	struct refop_store_entry *entry = NULL;
+	refop_error_t result = REFOP_SYSERROR;
+	int ret = -1;
+
+	if (st == NULL || refop_store_key_valid(key, NULL) == false || data == NULL || datasize < 0)
+		return REFOP_ARGERROR;
+
+	ret = refop_store_entry_get(st, key, &entry);
+	if (ret < 0)
+		return (ret == -1) ? REFOP_SYSERROR : REFOP_ARGERROR;
+
+	(void) pthread_mutex_lock(&entry->lock);
+
+	result = refop_set_redundancy_data(entry->handle, data, datasize);
+
+	(void) pthread_mutex_lock(&st->lock);
+	if (result == REFOP_SUCCESS)
+		refop_store_cache_put(st, entry, data, datasize);
+	else
+		refop_store_cache_drop(st, entry);
+	(void) pthread_mutex_unlock(&st->lock);
+
+	(void) pthread_mutex_unlock(&entry->lock);
+
+	if (result == REFOP_SUCCESS && st->options.durability == REFOP_DURABILITY_FULL)
+		refop_store_dir_sync(st);
+
+	return result;
+}
+
+/**
+ * The refop store data get function.
+ * A cached value that fits the buffer is returned without file access.  Otherwise the value is read from the files and it
+ * is cached when whole value was read.
+ *
+ * @param [in]	store	Store
+ * @param [in]	key	Key
+ * @param [out]	data	Buffer for get data.
+ * @param [in]	datasize	Buffer size (byte).
+ * @param [out]	getsize	Read data size (byte).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_RECOVER This operation was succeeded within recovery.
+ * @retval REFOP_NOENT The key was nothing.
+ * @retval REFOP_BROKEN Data of the key was broken.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+refop_error_t refop_store_get(refop_store_t store, const char *key, uint8_t *data, int64_t datasize,
+			      int64_t *getsize)
+{
+	struct refop_store *st = (struct refop_store *) store;
+	struct refop_store_entry *entry = NULL;
+	refop_error_t result = REFOP_SYSERROR;
+	size_t keylen = 0;
+	uint32_t hash = 0;
+	int ret = -1;
+
+	if (st == NULL || refop_store_key_valid(key, &keylen) == false || data == NULL || datasize < 0 ||
+	    getsize == NULL)
+		return REFOP_ARGERROR;
+
+	hash = refop_hash_update(REFOP_HASH_INIT, key, keylen);
+
+	(void) pthread_mutex_lock(&st->lock);
+	entry = refop_store_find(st, key, hash);
+	if (entry != NULL && entry->cache != NULL && entry->cache_size <= datasize) {
+		memcpy(data, entry->cache, (size_t) entry->cache_size);
+		(*getsize) = entry->cache_size;
+
+		// Move to most recently used.
+		refop_store_cache_put(st, entry, NULL, 0);
+		(void) pthread_mutex_unlock(&st->lock);
+		return REFOP_SUCCESS;
+	}
+	(void) pthread_mutex_unlock(&st->lock);
+
+	ret = refop_store_entry_get(st, key, &entry);
+	if (ret < 0)
+		return (ret == -1) ? REFOP_SYSERROR : REFOP_ARGERROR;
+
+	(void) pthread_mutex_lock(&entry->lock);
+
+	result = refop_get_redundancy_data(entry->handle, data, datasize, getsize);
+	if ((result == REFOP_SUCCESS || result == REFOP_RECOVER) && (*getsize) < datasize) {
+		(void) pthread_mutex_lock(&st->lock);
+		refop_store_cache_put(st, entry, data, (*getsize));
+		(void) pthread_mutex_unlock(&st->lock);
+	}
+
+	(void) pthread_mutex_unlock(&entry->lock);
+
+	return result;
+}
+
+/**
+ * The refop store data remove function.
+ *
+ * @param [in]	store	Store
+ * @param [in]	key	Key
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ */
+refop_error_t refop_store_remove(refop_store_t store, const char *key)
+{
+	struct refop_store *st = (struct refop_store *) store;
+	struct refop_store_entry *entry = NULL;
+	refop_error_t result = REFOP_SYSERROR;
+	int ret = -1;
+
+	if (st == NULL || refop_store_key_valid(key, NULL) == false)
+		return REFOP_ARGERROR;
+
+	ret = refop_store_entry_get(st, key, &entry);
+	if (ret < 0)
+		return (ret == -1) ? REFOP_SYSERROR : REFOP_ARGERROR;
+
+	(void) pthread_mutex_lock(&entry->lock);
+
+	result = refop_remove_redundancy_data(entry->handle);
+
+	(void) pthread_mutex_lock(&st->lock);
+	refop_store_cache_drop(st, entry);
+	(void) pthread_mutex_unlock(&st->lock);
+
+	(void) pthread_mutex_unlock(&entry->lock);
+
+	return result;
+}
+
+/**
+ * Key validation.  A key is a file name without suffix.  A key that ends with a suffix of the library
+ * files (".bk1", ".tmp", ".lck", ".gN" and the files of other modes) or the transaction manifest is
+ * invalid, because its file is a file of another key.
+ *
+ * @param [in]	key	Key.
+ * @param [out]	keylen	Key length. NULL is allowed.
+ *
+ * @return bool
+ * @retval true Valid key.
+ * @retval false Invalid key.
+ */
+static bool refop_store_key_valid(const char *key, size_t *keylen)
+{
+	const char *suffix = NULL;
+	size_t len = 0;
+
+	if (key == NULL)
+		return false;
+
+	len = strnlen(key, REFOP_STORE_KEY_MAX + 1);
+	if (len == 0 || len > REFOP_STORE_KEY_MAX || strchr(key, '/') != NULL)
+		return false;
+
+	if (strcmp(key, ".") == 0 || strcmp(key, "..") == 0 || strcmp(key, ".refop-txn") == 0)
+		return false;
+
+	for (size_t i = 0; i < sizeof(c_store_reserved_suffix) / sizeof(c_store_reserved_suffix[0]); i++) {
+		size_t slen = strlen(c_store_reserved_suffix[i]);
+
+		if (len >= slen && strcmp(key + len - slen, c_store_reserved_suffix[i]) == 0)
+			return false;
+	}
+
+	// Ping-pong mode files are ".g0" to ".g15".
+	suffix = strrchr(key, '.');
+	if (suffix != NULL && suffix[1] == 'g' && suffix[2] != '\0' &&
+	    strspn(suffix + 2, "0123456789") == strlen(suffix + 2))
+		return false;
+
+	if (keylen != NULL)
+		(*keylen) = len;
+
+	return true;
+}
+
+/**
+ * Find a key.  The store lock shall be held.
+ *
+ * @param [in]	st	Store.
+ * @param [in]	key	Key.
+ * @param [in]	hash	Hash of the key.
+ *
+ * @return struct refop_store_entry*	 Entry, NULL is not found.
+ */
+static struct refop_store_entry *refop_store_find(struct refop_store *st, const char *key, uint32_t hash)
+{
+	struct refop_store_entry *entry = NULL;
+
+	for (entry = st->buckets[hash & (st->nbuckets - 1)]; entry != NULL; entry = entry->next) {
+		if (entry->hash == hash && strcmp(entry->handle->name, key) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/**
+ * Get the entry of a key.  A new key is interned with its handle, the handle is created out of the
+ * store lock and it does not stat the directory.
+ *
+ * @param [in]	st	Store.
+ * @param [in]	key	Validated key.
+ * @param [out]	pentry	Entry of the key.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 No memory.
+ * @retval -2 Handle creation error.
+ */
+static int refop_store_entry_get(struct refop_store *st, const char *key, struct refop_store_entry **pentry)
+{
+	struct refop_store_entry *entry = NULL, *newentry = NULL;
+	refop_error_t result = REFOP_SYSERROR;
+	uint32_t hash = 0;
+
+	hash = refop_hash_update(REFOP_HASH_INIT, key, strlen(key));
+
+	(void) pthread_mutex_lock(&st->lock);
+	entry = refop_store_find(st, key, hash);
+	(void) pthread_mutex_unlock(&st->lock);
+	if (entry != NULL) {
+		(*pentry) = entry;
+		return 0;
+	}
+
+	newentry = (struct refop_store_entry *) refop_calloc(1, sizeof(struct refop_store_entry));
+	if (newentry == NULL)
+		return -1;
+
+	result = refop_handle_create_nocheck(&newentry->handle, st->dir->path, key, &st->options);
+	if (result != REFOP_SUCCESS) {
+		refop_free(newentry);
+		return (result == REFOP_SYSERROR) ? -1 : -2;
+	}
+	newentry->handle->dir_sync_deferred = true;
+	newentry->hash = hash;
+	(void) pthread_mutex_init(&newentry->lock, NULL);
+
+	(void) pthread_mutex_lock(&st->lock);
+
+	// Another thread may add same key while the handle is created.
+	entry = refop_store_find(st, key, hash);
+	if (entry == NULL) {
+		newentry->next = st->buckets[hash & (st->nbuckets - 1)];
+		st->buckets[hash & (st->nbuckets - 1)] = newentry;
+		st->nkeys++;
+		if (st->nkeys > st->nbuckets)
+			refop_store_rehash(st);
+		entry = newentry;
+		newentry = NULL;
+	}
+
+	(void) pthread_mutex_unlock(&st->lock);
+
+	if (newentry != NULL) {
+		(void) refop_release_redundancy_handle(newentry->handle);
+		(void) pthread_mutex_destroy(&newentry->lock);
+		refop_free(newentry);
+	}
+
+	(*pentry) = entry;
+
+	return 0;
+}
+
+/**
+ * Double the hash buckets.  The store lock shall be held.  When no memory, buckets are not changed.
+ *
+ * @param [in]	st	Store.
+ */
+static void refop_store_rehash(struct refop_store *st)
+{
+	struct refop_store_entry **buckets = NULL, *entry = NULL, *next = NULL;
+	size_t nbuckets = st->nbuckets * 2;
+
+	buckets = (struct refop_store_entry **) refop_calloc(nbuckets, sizeof(struct refop_store_entry *));
+	if (buckets == NULL)
+		return;
+
+	for (size_t i = 0; i < st->nbuckets; i++) {
+		for (entry = st->buckets[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			entry->next = buckets[entry->hash & (nbuckets - 1)];
+			buckets[entry->hash & (nbuckets - 1)] = entry;
+		}
+	}
+
+	refop_free(st->buckets);
+	st->buckets = buckets;
+	st->nbuckets = nbuckets;
+}
+
+/**
+ * Remove the cached value of a key from the cache.  The store lock shall be held.
+ * The value is kept in entry->cache, so caller can put it back.
+ *
+ * @param [in]	st	Store.
+ * @param [in]	entry	Entry.
+ */
+static void refop_store_cache_unlink(struct refop_store *st, struct refop_store_entry *entry)
+{
+	if (entry->lru_prev != NULL)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		st->lru_head = entry->lru_next;
+
+	if (entry->lru_next != NULL)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		st->lru_tail = entry->lru_prev;
+
+	entry->lru_prev = NULL;
+	entry->lru_next = NULL;
+}
+
+/**
+ * Drop the cached value of a key.  The store lock shall be held.
+ *
+ * @param [in]	st	Store.
+ * @param [in]	entry	Entry.
+ */
+static void refop_store_cache_drop(struct refop_store *st, struct refop_store_entry *entry)
+{
+	if (entry->cache == NULL)
+		return;
+
+	refop_store_cache_unlink(st, entry);
+	refop_free(entry->cache);
+	entry->cache = NULL;
+	st->cache_used -= (uint64_t) entry->cache_size;
+	entry->cache_size = 0;
+}
+
+/**
+ * Put a value of a key to the cache as most recently used.  The store lock shall be held.
+ * Least recently used values are dropped until the value fits the budget.
+ * When data is NULL, the current cached value of the entry is moved to most recently used.
+ *
+ * @param [in]	st	Store.
+ * @param [in]	entry	Entry.
+ * @param [in]	data	Value, NULL is current cached value.
+ * @param [in]	datasize	Value size.
+ */
+static void refop_store_cache_put(struct refop_store *st, struct refop_store_entry *entry, const uint8_t *data,
+				  int64_t datasize)
+{
+	uint8_t *cache = NULL;
+
+	if (data == NULL) {
+		if (entry->cache == NULL)
+			return;
+		refop_store_cache_unlink(st, entry);
+	} else {
+		refop_store_cache_drop(st, entry);
+		if ((uint64_t) datasize > st->cache_budget)
+			return;
+
+		while (st->lru_tail != NULL && (st->cache_used + (uint64_t) datasize) > st->cache_budget)
+			refop_store_cache_drop(st, st->lru_tail);
+
+		// Zero size value is cached by one byte buffer.
+		cache = (uint8_t *) refop_malloc((datasize > 0) ? (size_t) datasize : 1);
+		if (cache == NULL)
+			return;
+		memcpy(cache, data, (size_t) datasize);
+		entry->cache = cache;
+		entry->cache_size = datasize;
+		st->cache_used += (uint64_t) datasize;
+	}
+
+	entry->lru_prev = NULL;
+	entry->lru_next = st->lru_head;
+	if (st->lru_head != NULL)
+		st->lru_head->lru_prev = entry;
+	st->lru_head = entry;
+	if (st->lru_tail == NULL)
+		st->lru_tail = entry;
+}
+
+/**
+ * Directory sync of the store.  A set waits until a directory sync that started after its rename was
+ * completed.  The first waiter runs fsync and it covers all sets that finished rename before it, so
+ * sets that complete together share one directory sync.
+ *
+ * @param [in]	st	Store.
+ */
+static void refop_store_dir_sync(struct refop_store *st)
+{
+	uint64_t ticket = 0, target = 0;
+
+	(void) pthread_mutex_lock(&st->sync_lock);
+
+	st->sync_requested++;
+	ticket = st->sync_requested;
+
+	while (st->sync_done < ticket) {
+		if (st->syncing == true) {
+			(void) pthread_cond_wait(&st->sync_cond, &st->sync_lock);
+			continue;
+		}
+
+		st->syncing = true;
+		target = st->sync_requested;
+		(void) pthread_mutex_unlock(&st->sync_lock);
+
+		(void) fsync(st->dirfd);
+
+		(void) pthread_mutex_lock(&st->sync_lock);
+		st->syncing = false;
+		st->sync_done = target;
+		(void) pthread_cond_broadcast(&st->sync_cond);
+	}
+
+	(void) pthread_mutex_unlock(&st->sync_lock);
+}
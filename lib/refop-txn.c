@@ -0,0 +1,672 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	refop-txn.c
+ * @brief	Atomic multi-key transaction of refop handles in one directory
+ */
+#include "fileop.h"
+#include "crc16.h"
+#include "file-util.h"
+#include "librefop.h"
+#include "refop-alloc.h"
+#include "static-configurator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/** File name of the transaction manifest in the directory. */
+const char c_txn_manifest[] = ".refop-txn";
+/** File name of the manifest that is written. */
+const char c_txn_manifest_new[] = ".refop-txn.tmp";
+/** File name of the transaction lock in the directory. */
+const char c_txn_lock[] = ".refop-txn.lck";
+
+/** When true, this thread has the transaction lock, pickup does not recover. */
+static __thread bool g_refop_txn_locked;
+
+/**
+ * Staged value of a transaction.
+ */
+struct refop_txn_entry {
+	struct refop_txn_entry *next; /**< Next staged value */
+	refop_handle_t handle;	      /**< Target handle */
+	int64_t size;		      /**< Data size */
+	uint8_t data[];		      /**< Copy of data */
+};
+
+/**
+ * Transaction.  Values are staged in memory until commit.
+ */
+struct refop_txn {
+	struct refop_txn_entry *head; /**< Oldest staged value */
+	struct refop_txn_entry *tail; /**< Newest staged value */
+	uint32_t count;		      /**< Number of staged values */
+	uint64_t size;		      /**< Size of manifest records */
+};
+
+/**
+ * Make a path of a transaction file in the directory.
+ *
+ * @param [in]	dirpath	Directory path terminated by '/'.
+ * @param [in]	name	Transaction file name.
+ * @param [out]	path	Output buffer, it shall have PATH_MAX byte.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Too long path.
+ */
+static int refop_txn_path(const char *dirpath, const char *name, char *path)
+{
+	int len = snprintf(path, PATH_MAX, "%s%s", dirpath, name);
+
+	return (len < 0 || len >= PATH_MAX) ? -1 : 0;
+}
+
+/**
+ * Acquire the transaction lock of a directory.  Commits and recoveries of a directory in all
+ * processes are serialized by it.
+ *
+ * @param [in]	dirpath	Directory path terminated by '/'.
+ *
+ * @return int
+ * @retval >=0 Fd of the lock file, it shall be released by refop_txn_unlock().
+ * @retval -1 Abnormal fail.
+ */
+static int refop_txn_lock(const char *dirpath)
+{
+	char path[PATH_MAX];
+	struct flock fl;
+	int fd = -1;
+
+	if (refop_txn_path(dirpath, c_txn_lock, path) < 0)
+		return -1;
+
+	fd = open(path, (O_CLOEXEC | O_RDWR | O_CREAT | O_NOFOLLOW), (S_IRUSR | S_IWUSR));
+	if (fd < 0)
+		return -1;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = 0;
+	fl.l_len = 1;
+
+	while (fcntl(fd, F_OFD_SETLKW, &fl) < 0) {
+		if (errno != EINTR) {
+			(void) close(fd);
+			return -1;
+		}
+	}
+	g_refop_txn_locked = true;
+
+	return fd;
+}
+
+/**
+ * Release the transaction lock.
+ *
+ * @param [in]	fd	Fd from refop_txn_lock().
+ */
+static void refop_txn_unlock(int fd)
+{
+	g_refop_txn_locked = false;
+	(void) close(fd);
+}
+
+/**
+ * Sync the file system of the directory.  Values that were applied with deferred syncs are durable
+ * after it, then the manifest may be removed.
+ *
+ * @param [in]	dirpath	Directory path terminated by '/'.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Abnormal fail.
+ */
+static int refop_txn_syncfs(const char *dirpath)
+{
+	int fd = -1, ret = -1;
+
+	fd = open(dirpath, (O_CLOEXEC | O_DIRECTORY | O_NOFOLLOW));
+	if (fd < 0)
+		return -1;
+
+	ret = syncfs(fd);
+	(void) close(fd);
+
+	return ret;
+}
+
+/**
+ * Set the value of one record by a temporary handle that has the options of the committed handle.
+ *
+ * @param [in]	dirpath	Directory path terminated by '/'.
+ * @param [in]	name	File name of the record.
+ * @param [in]	rec	Record.
+ * @param [in]	data	Data of the record.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR The record can not be set by any retry.
+ * @retval REFOP_SYSERROR Internal operation was failed.
+ */
+static refop_error_t refop_txn_apply_record(const char *dirpath, const char *name, const s_refop_txn_record *rec,
+					    uint8_t *data)
+{
+	struct refop_halndle *hndl = NULL;
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+	refop_error_t result = REFOP_SUCCESS;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.size_limit = rec->size_limit;
+	opts.backup_count = rec->backup_count;
+	opts.process_lock = ((rec->flags & REFOP_TXN_FLAG_PROCESS_LOCK) != 0);
+
+	result = refop_handle_create_nocheck(&handle, dirpath, name, &opts);
+	if (result != REFOP_SUCCESS)
+		return result;
+
+	hndl = (struct refop_halndle *) handle;
+	hndl->slot_capacity = rec->slot_capacity;
+	hndl->parity_group = rec->parity_group;
+	hndl->block_checksum = ((rec->flags & REFOP_TXN_FLAG_BLOCK_CHECKSUM) != 0);
+	hndl->compression = ((rec->flags & REFOP_TXN_FLAG_COMPRESSION) != 0);
+	hndl->direct_io = ((rec->flags & REFOP_TXN_FLAG_DIRECT_IO) != 0);
+
+	result = refop_set_redundancy_mode(handle, (refop_mode_t) rec->mode);
+	if (result == REFOP_SUCCESS)
+		result = refop_set_redundancy_data(handle, data, (int64_t) rec->size);
+	(void) refop_release_redundancy_handle(handle);
+
+	return result;
+}
+
+/**
+ * Apply the records of a valid manifest by temporary handles.  Records are checked without apply
+ * first, so broken records do not change any file.
+ *
+ * @param [in]	dirpath	Directory path terminated by '/'.
+ * @param [in]	body	Records.
+ * @param [in]	size	Size of records.
+ * @param [in]	count	Number of records.
+ * @param [in]	apply	When false, records are checked only.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Abnormal fail.
+ * @retval -3 Broken records.
+ */
+static int refop_txn_apply_records(const char *dirpath, uint8_t *body, uint64_t size, uint32_t count,
+				   bool apply)
+{
+	s_refop_txn_record rec;
+	char name[NAME_MAX + 1];
+	refop_error_t result = REFOP_SUCCESS;
+	uint64_t offset = 0;
+	int ret = 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (size - offset < sizeof(rec))
+			return -3;
+		memcpy(&rec, body + offset, sizeof(rec));
+		offset += sizeof(rec);
+		if (rec.name_size == 0 || rec.name_size > NAME_MAX || size - offset < rec.name_size ||
+		    size - offset - rec.name_size < rec.size)
+			return -3;
+		memcpy(name, body + offset, rec.name_size);
+		name[rec.name_size] = '\0';
+		offset += rec.name_size;
+		if (apply == false) {
+			offset += rec.size;
+			continue;
+		}
+
+		// Other records are applied after a failure, a retry sets less values.
+		result = refop_txn_apply_record(dirpath, name, &rec, body + offset);
+		if (result != REFOP_SUCCESS)
+			ret = -1;
+		offset += rec.size;
+	}
+
+	if (offset != size)
+		return -3;
+
+	return ret;
+}
+
+/**
+ * Check the header of a manifest.
+ *
+ * @param [in]	head	Manifest header.
+ * @param [in]	filesize	Size of the manifest file.
+ *
+ * @return int
+ * @retval  0 Valid header.
+ * @retval -1 Invalid header.
+ */
+static int refop_txn_manifest_validation(const s_refop_txn_manifest *head, uint64_t filesize)
+{
+	uint16_t crc16_inv = (uint16_t) ~head->crc16_inv;
+
+	if (head->magic != REFOP_TXN_MAGIC)
+		return -1;
+
+	if (head->crc16 != crc16_inv)
+		return -1;
+
+	if (head->size != filesize - sizeof(s_refop_txn_manifest))
+		return -1;
+
+	return 0;
+}
+
+/**
+ * Finish the manifest of a directory.  A valid manifest was committed, so its values are applied
+ * again (roll forward).  An invalid manifest was not committed, so it is removed and the files keep
+ * old values (roll back).  A committed manifest is kept until all of its records were set, a failed
+ * roll forward is retried by next recovery or commit.  The transaction lock shall be held.
+ *
+ * @param [in]	dir	Shared directory.
+ *
+ * @return int
+ * @retval  0 succeeded, no manifest remains.
+ * @retval -1 Abnormal fail.
+ */
+static int refop_txn_replay(struct refop_dir *dir)
+{
+	s_refop_txn_manifest head;
+	const char *dirpath = dir->path;
+	char path[PATH_MAX], newpath[PATH_MAX];
+	struct stat sb;
+	uint8_t *body = NULL;
+	int fd = -1, ret = -1;
+
+	if (refop_txn_path(dirpath, c_txn_manifest, path) < 0 ||
+	    refop_txn_path(dirpath, c_txn_manifest_new, newpath) < 0)
+		return -1;
+
+	// A manifest that was not renamed was not committed.
+	(void) unlink(newpath);
+
+	fd = open(path, (O_CLOEXEC | O_RDONLY | O_NOFOLLOW));
+	if (fd < 0)
+		return (errno == ENOENT) ? 0 : -1;
+
+	if (fstat(fd, &sb) < 0)
+		goto out;
+
+	// Files were not changed by a broken manifest, it is removed (roll back).
+	if ((uint64_t) sb.st_size < sizeof(head) || safe_pread(fd, &head, sizeof(head), 0) != (ssize_t) sizeof(head))
+		goto remove;
+	if (refop_txn_manifest_validation(&head, (uint64_t) sb.st_size) < 0)
+		goto remove;
+
+	body = (uint8_t *) refop_malloc((size_t) head.size + 1);
+	if (body == NULL) {
+		ret = -1;
+		goto out;
+	}
+	if (safe_pread(fd, body, (size_t) head.size, sizeof(head)) != (ssize_t) head.size ||
+	    crc16(0xffff, body, head.size) != head.crc16)
+		goto remove;
+
+	if (refop_txn_apply_records(dirpath, body, head.size, head.count, false) < 0)
+		goto remove;
+
+	// A committed manifest is applied again (roll forward), then it is removed after sync.
+	refop_sync_defer(true);
+	ret = refop_txn_apply_records(dirpath, body, head.size, head.count, true);
+	refop_sync_defer(false);
+	if (ret < 0 || refop_txn_syncfs(dirpath) < 0) {
+		ret = -1;
+		goto out;
+	}
+
+remove:
+	ret = (unlink(path) < 0 && errno != ENOENT) ? -1 : 0;
+
+out:
+	refop_free(body);
+	(void) close(fd);
+
+	return ret;
+}
+
+/**
+ * Recover the transaction of the handle directory.  It is done once per directory in a process,
+ * before the first pickup, set and remove.  A recovery waits for a commit of another process.
+ * A directory without manifest is not locked, the lock file is created by commits only.
+ *
+ * @param [in]	handle	Refop handle.
+ */
+void refop_txn_recover(refop_handle_t handle)
+{
+	struct refop_dir *dir = handle->dir;
+	char path[PATH_MAX];
+	int fd = -1;
+
+	if (__atomic_load_n(&dir->txn_checked, __ATOMIC_ACQUIRE) == true || g_refop_txn_locked == true)
+		return;
+
+	// A manifest that appears later belongs to a commit in progress, the committer applies it.
+	if (refop_txn_path(dir->path, c_txn_manifest, path) == 0 && access(path, F_OK) < 0 && errno == ENOENT) {
+		__atomic_store_n(&dir->txn_checked, true, __ATOMIC_RELEASE);
+		return;
+	}
+
+	fd = refop_txn_lock(dir->path);
+	if (fd < 0)
+		return;
+
+	// Failed recovery is retried by next operation.
+	if (refop_txn_replay(dir) == 0)
+		__atomic_store_n(&dir->txn_checked, true, __ATOMIC_RELEASE);
+
+	refop_txn_unlock(fd);
+}
+
+/**
+ * Write the manifest of a transaction.  It is the commit point, the manifest and the directory are
+ * synced regardless of durability of handles.
+ *
+ * @param [in]	txn	Transaction.
+ * @param [in]	dirpath	Directory path terminated by '/'.
+ *
+ * @return int
+ * @retval  0 succeeded.
+ * @retval -1 Abnormal fail.
+ */
+static int refop_txn_manifest_write(struct refop_txn *txn, const char *dirpath)
+{
+	s_refop_txn_manifest *head = NULL;
+	s_refop_txn_record rec;
+	struct refop_txn_entry *entry = NULL;
+	struct refop_halndle *hndl = NULL;
+	char path[PATH_MAX], newpath[PATH_MAX];
+	uint8_t *buf = NULL, *p = NULL;
+	size_t total = 0;
+	int fd = -1, ret = -1;
+
+	if (refop_txn_path(dirpath, c_txn_manifest, path) < 0 ||
+	    refop_txn_path(dirpath, c_txn_manifest_new, newpath) < 0)
+		return -1;
+
+	total = sizeof(s_refop_txn_manifest) + (size_t) txn->size;
+	buf = (uint8_t *) refop_malloc(total);
+	if (buf == NULL)
+		return -1;
+
+	p = buf + sizeof(s_refop_txn_manifest);
+	for (entry = txn->head; entry != NULL; entry = entry->next) {
+		hndl = entry->handle;
+		memset(&rec, 0, sizeof(rec));
+		rec.size = (uint64_t) entry->size;
+		rec.size_limit = refop_get_config_handle_size_limit(hndl);
+		rec.slot_capacity = hndl->slot_capacity;
+		rec.name_size = (uint16_t) strlen(hndl->name);
+		rec.mode = (uint8_t) hndl->mode;
+		rec.flags = (uint8_t) ((hndl->block_checksum ? REFOP_TXN_FLAG_BLOCK_CHECKSUM : 0) |
+				       (hndl->compression ? REFOP_TXN_FLAG_COMPRESSION : 0) |
+				       (hndl->direct_io ? REFOP_TXN_FLAG_DIRECT_IO : 0) |
+				       (hndl->process_lock ? REFOP_TXN_FLAG_PROCESS_LOCK : 0));
+		rec.backup_count = hndl->backup_count;
+		rec.parity_group = hndl->parity_group;
+		memcpy(p, &rec, sizeof(rec));
+		p += sizeof(rec);
+		memcpy(p, hndl->name, rec.name_size);
+		p += rec.name_size;
+		memcpy(p, entry->data, (size_t) entry->size);
+		p += entry->size;
+	}
+
+	head = (s_refop_txn_manifest *) buf;
+	head->magic = REFOP_TXN_MAGIC;
+	head->count = txn->count;
+	head->size = txn->size;
+	head->crc16 = crc16(0xffff, buf + sizeof(s_refop_txn_manifest), txn->size);
+	head->crc16_inv = ~head->crc16;
+
+	fd = open(newpath, (O_CLOEXEC | O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW), (S_IRUSR | S_IWUSR));
+	if (fd < 0)
+		goto out;
+	if (safe_write(fd, buf, total) != (ssize_t) total || fdatasync(fd) < 0) {
+		(void) close(fd);
+		(void) unlink(newpath);
+		goto out;
+	}
+	(void) close(fd);
+
+	if (rename(newpath, path) < 0) {
+		(void) unlink(newpath);
+		goto out;
+	}
+
+	fd = open(dirpath, (O_CLOEXEC | O_DIRECTORY | O_NOFOLLOW));
+	if (fd < 0)
+		goto out;
+	ret = fsync(fd);
+	(void) close(fd);
+
+out:
+	refop_free(buf);
+
+	return ret;
+}
+
+/**
+ * Free a transaction and staged values.
+ *
+ * @param [in]	txn	Transaction.
+ */
+static void refop_txn_free(struct refop_txn *txn)
+{
+	struct refop_txn_entry *entry = NULL, *next = NULL;
+
+	for (entry = txn->head; entry != NULL; entry = next) {
+		next = entry->next;
+		refop_free(entry);
+	}
+	refop_free(txn);
+}
+
+/**
+ * The transaction begin function of refop.
+ * Values of several handles in one directory are staged by refop_txn_set() and written together by
+ * refop_txn_commit().  After a crash, all values or no value of a transaction are visible.
+ *
+ * @param [out]	txn	Created transaction.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+refop_error_t refop_txn_begin(refop_txn_t *txn)
+{
+	struct refop_txn *newtxn = NULL;
+
+	if (txn == NULL)
+		return REFOP_ARGERROR;
+
+	newtxn = (struct refop_txn *) refop_calloc(1, sizeof(struct refop_txn));
+	if (newtxn == NULL)
+		return REFOP_SYSERROR;
+
+	(*txn) = newtxn;
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The transaction set function of refop.
+ * The data is copied and staged, files are not changed until commit.  All handles of a transaction
+ * shall be in one directory.  When the handle was already staged, the new data replaces it.
+ *
+ * @param [in]	txn	Transaction.
+ * @param [in]	handle	Refop handle
+ * @param [in]	data	Write data for set data.
+ * @param [in]	datasize	Write data size (byte).
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error, or the handle is in another directory.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory.
+ */
+refop_error_t refop_txn_set(refop_txn_t txn, refop_handle_t handle, uint8_t *data, int64_t datasize)
+{
+	struct refop_txn_entry **pentry = NULL, *entry = NULL, *old = NULL;
+	size_t namelen = 0;
+
+	if (txn == NULL || handle == NULL || data == NULL || datasize < 0)
+		return REFOP_ARGERROR;
+
+	if ((uint64_t) datasize > refop_get_config_handle_size_limit(handle) || handle->dir_sync_deferred == true)
+		return REFOP_ARGERROR;
+
+	if (txn->head != NULL && strcmp(txn->head->handle->dir->path, handle->dir->path) != 0)
+		return REFOP_ARGERROR;
+
+	entry = (struct refop_txn_entry *) refop_malloc(sizeof(struct refop_txn_entry) + (size_t) datasize);
+	if (entry == NULL)
+		return REFOP_SYSERROR;
+
+	entry->next = NULL;
+	entry->handle = handle;
+	entry->size = datasize;
+	memcpy(entry->data, data, (size_t) datasize);
+	namelen = strlen(handle->name);
+
+	for (pentry = &txn->head; (*pentry) != NULL; pentry = &(*pentry)->next) {
+		if ((*pentry)->handle == handle) {
+			old = (*pentry);
+			break;
+		}
+	}
+
+	if (old != NULL) {
+		// The staged value is replaced in place, commit order is kept.
+		entry->next = old->next;
+		(*pentry) = entry;
+		if (txn->tail == old)
+			txn->tail = entry;
+		txn->size -= (uint64_t) old->size;
+		refop_free(old);
+	} else {
+		if (txn->tail != NULL)
+			txn->tail->next = entry;
+		else
+			txn->head = entry;
+		txn->tail = entry;
+		txn->count++;
+		txn->size += sizeof(s_refop_txn_record) + namelen;
+	}
+	txn->size += (uint64_t) datasize;
+
+	return REFOP_SUCCESS;
+}
+
+/**
+ * The transaction commit function of refop.
+ * The staged values are written to one manifest with one sync, that is the commit point.  Then the
+ * values are set to the handles without sync, the file system is synced once and the manifest is
+ * removed.  When the commit is interrupted, the first pickup, set or remove in the directory rolls
+ * the manifest forward (committed) or back (not committed).  The transaction is released in all cases.
+ * Other readers may see values of the transaction before all values were set.
+ *
+ * @param [in]	txn	Transaction.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ * @retval REFOP_SYSERROR Internal operation was failed such as no memory, no disk space and etc.
+ *                        When the manifest was committed, values are set by recovery.  When the
+ *                        manifest of an earlier commit can not be finished, it is kept and nothing
+ *                        of this transaction is written.
+ */
+refop_error_t refop_txn_commit(refop_txn_t txn)
+{
+	struct refop_txn_entry *entry = NULL;
+	refop_error_t result = REFOP_SUCCESS;
+	struct refop_dir *dir = NULL;
+	char path[PATH_MAX];
+	int fd = -1;
+
+	if (txn == NULL)
+		return REFOP_ARGERROR;
+
+	if (txn->head == NULL)
+		goto out;
+
+	// Queued asynchronous operations of the handles are done first, workers may recover the directory.
+	for (entry = txn->head; entry != NULL; entry = entry->next)
+		refop_pool_drain(entry->handle);
+
+	dir = txn->head->handle->dir;
+	fd = refop_txn_lock(dir->path);
+	if (fd < 0) {
+		result = REFOP_SYSERROR;
+		goto out;
+	}
+
+	// A manifest of an interrupted commit is finished first, it is older than this transaction.
+	if (refop_txn_replay(dir) < 0) {
+		result = REFOP_SYSERROR;
+		goto unlock;
+	}
+
+	// No manifest remains, the manifest of this commit is owned by this commit and not by recoveries.
+	__atomic_store_n(&dir->txn_checked, true, __ATOMIC_RELEASE);
+	if (refop_txn_manifest_write(txn, dir->path) < 0) {
+		// The manifest may have been renamed, next recovery finishes it.
+		__atomic_store_n(&dir->txn_checked, false, __ATOMIC_RELEASE);
+		result = REFOP_SYSERROR;
+		goto unlock;
+	}
+
+	// Values are set without the worker pool, this thread has the transaction lock.
+	refop_sync_defer(true);
+	for (entry = txn->head; entry != NULL && result == REFOP_SUCCESS; entry = entry->next)
+		result = refop_op_execute(entry->handle, REFOP_OP_SET, entry->data, entry->size, NULL);
+	refop_sync_defer(false);
+
+	if (result != REFOP_SUCCESS || refop_txn_syncfs(dir->path) < 0 ||
+	    refop_txn_path(dir->path, c_txn_manifest, path) < 0 || unlink(path) < 0) {
+		// The manifest is kept and applied by next recovery.
+		__atomic_store_n(&dir->txn_checked, false, __ATOMIC_RELEASE);
+		result = REFOP_SYSERROR;
+	}
+
+unlock:
+	refop_txn_unlock(fd);
+out:
+	refop_txn_free(txn);
+
+	return result;
+}
+
+/**
+ * The transaction abort function of refop.  Staged values are discarded and the transaction is
+ * released.
+ *
+ * @param [in]	txn	Transaction.
+ *
+ * @return refop_error_t
+ * @retval REFOP_SUCCESS This operation was succeeded.
+ * @retval REFOP_ARGERROR Argument error.
+ */
+refop_error_t refop_txn_abort(refop_txn_t txn)
+{
+	if (txn == NULL)
+		return REFOP_ARGERROR;
+
+	refop_txn_free(txn);
+
+	return REFOP_SUCCESS;
+}
@@ -0,0 +1,120 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	sha256.c
+ * @brief	SHA-256 hash function (FIPS 180-4)
+ *
+ * Single shot implementation for chunk store.  Input is processed by 64 byte blocks and the last
+ * blocks are padded in local buffer.
+ */
+#include "sha256.h"
+
+#include <string.h>
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t sha256_ror(uint32_t v, int n)
+{
+	return (v >> n) | (v << (32 - n));
+}
+
+/**
+ * Process one 64 byte block.
+ */
+static void sha256_block(uint32_t state[8], const uint8_t *block)
+{
+	uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+	int i = 0;
+
+	for (i = 0; i < 16; i++)
+		w[i] = ((uint32_t) block[i * 4] << 24) | ((uint32_t) block[i * 4 + 1] << 16) |
+		       ((uint32_t) block[i * 4 + 2] << 8) | (uint32_t) block[i * 4 + 3];
+
+	for (i = 16; i < 64; i++)
+		w[i] = (sha256_ror(w[i - 2], 17) ^ sha256_ror(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7] +
+		       (sha256_ror(w[i - 15], 7) ^ sha256_ror(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+	e = state[4];
+	f = state[5];
+	g = state[6];
+	h = state[7];
+
+	for (i = 0; i < 64; i++) {
+		t1 = h + (sha256_ror(e, 6) ^ sha256_ror(e, 11) ^ sha256_ror(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] +
+		     w[i];
+		t2 = (sha256_ror(a, 2) ^ sha256_ror(a, 13) ^ sha256_ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+/**
+ * Calculate SHA-256 digest of data.
+ *
+ * @param [in]	data	Input data.
+ * @param [in]	len	Input data size (bytes).
+ * @param [out]	digest	Output digest (32 bytes).
+ */
+void sha256(const uint8_t *data, size_t len, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	uint32_t state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+			      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+	uint8_t tail[128];
+	uint64_t bits = (uint64_t) len * 8;
+	size_t rest = 0, tailsize = 0;
+	int i = 0;
+
+	while (len >= 64) {
+		sha256_block(state, data);
+		data += 64;
+		len -= 64;
+	}
+
+	// Padding: 0x80, zero and 64 bit length in big endian.
+	rest = len;
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, data, rest);
+	tail[rest] = 0x80;
+	tailsize = (rest < 56) ? 64 : 128;
+	for (i = 0; i < 8; i++)
+		tail[tailsize - 1 - i] = (uint8_t)(bits >> (i * 8));
+
+	sha256_block(state, tail);
+	if (tailsize == 128)
+		sha256_block(state, tail + 64);
+
+	for (i = 0; i < 8; i++) {
+		digest[i * 4] = (uint8_t)(state[i] >> 24);
+		digest[i * 4 + 1] = (uint8_t)(state[i] >> 16);
+		digest[i * 4 + 2] = (uint8_t)(state[i] >> 8);
+		digest[i * 4 + 3] = (uint8_t) state[i];
+	}
+}
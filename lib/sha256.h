@@ -0,0 +1,28 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	sha256.h
+ * @brief	SHA-256 hash function (FIPS 180-4)
+ */
+#ifndef REFOP_SHA256_H
+#define REFOP_SHA256_H
+//-----------------------------------------------------------------------------
+#include <stddef.h>
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+#ifdef __cplusplus
+extern "C" {
+#endif
+//-----------------------------------------------------------------------------
+/** Size of SHA-256 digest (bytes). */
+#define SHA256_DIGEST_SIZE (32)
+
+void sha256(const uint8_t *data, size_t len, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+//-----------------------------------------------------------------------------
+#ifdef __cplusplus
+}
+#endif
+//-----------------------------------------------------------------------------
+#endif //#ifndef REFOP_SHA256_H
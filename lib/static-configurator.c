@@ -6,16 +6,72 @@
  */
 
 #include "static-configurator.h"
+#include "fileop.h"
+#include "refop-alloc.h"
 
 
 /** refop static configurator.*/
 
+/** Process wide default options for new handle. */
+static refop_options_t g_refop_default_options = {
+	.size_limit = REFOP_DATA_SIZE_LIMIT_DEFAULT,
+	.durability = REFOP_DURABILITY_FULL,
+	.backup_count = 0,
+	.cache_budget = 0,
+	.io_backend = REFOP_IO_BUFFERED,
+	.thread_safe = false,
+	.process_lock = false,
+	.shared = false,
+};
+
+/** Library allocator, NULL functions are malloc and free of libc.  It is set by refop_set_allocator(). */
+struct refop_allocator g_refop_allocator = {
+	.alloc = NULL,
+	.free = NULL,
+	.ctx = NULL,
+};
+
 /**
- * Getter for the data size limit.
+ * Getter for the data size limit.  It is the default size limit of new handle.
  *
  * @return uint64_t	 Maximum data size.
  */
 uint64_t refop_get_config_data_size_limit(void)
 {
-	return (1 * 1024 * 1024); // 1 MByte;
+	return g_refop_default_options.size_limit;
+}
+
+/**
+ * Getter for the data size limit of a handle.
+ *
+ * @param [in]	handle	Refop handle, NULL is allowed.
+ *
+ * @return uint64_t	 Maximum data size of the handle.
+ */
+uint64_t refop_get_config_handle_size_limit(refop_handle_t handle)
+{
+	if (handle == NULL || handle->size_limit == 0)
+		return refop_get_config_data_size_limit();
+
+	return handle->size_limit;
+}
+
+/**
+ * Getter for the process wide default options.
+ *
+ * @param [out]	options	Copy of default options.
+ */
+void refop_get_config_default_options(refop_options_t *options)
+{
+	(*options) = g_refop_default_options;
+}
+
+/**
+ * Setter for the process wide default options.  Options shall be validated by caller.
+ *
+ * @param [in]	options	New default options.
+ */
+void refop_set_config_default_options(const refop_options_t *options)
+{
+	g_refop_default_options = (*options);
 }
@@ -7,10 +7,14 @@
 #ifndef STATIC_CONFIGURATOR_H
 #define STATIC_CONFIGURATOR_H
 //-----------------------------------------------------------------------------
+#include <librefop.h>
 #include <stdint.h>
 
 
 uint64_t refop_get_config_data_size_limit(void);
+uint64_t refop_get_config_handle_size_limit(refop_handle_t handle);
+void refop_get_config_default_options(refop_options_t *options);
+void refop_set_config_default_options(const refop_options_t *options);
 
 //-----------------------------------------------------------------------------
 #endif //#ifndef STATIC_CONFIGURATOR_H
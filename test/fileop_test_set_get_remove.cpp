@@ -16,6 +16,24 @@ using namespace ::testing;
 
 struct fileop_test_set_get_remove_test : Test, SyscallIOMockBase {};
 
+//--------------------------------------------------------------------------------------------------------
+// Handle without create function, file names are derived from "/tmp/test.bin".
+static refop_handle_t test_handle_alloc(void)
+{
+	refop_handle_t handle = (refop_handle_t)calloc(1, sizeof(struct refop_halndle) + sizeof("test.bin"));
+
+	handle->dir = refop_dir_get("/tmp/");
+	strcpy(handle->name, "test.bin");
+
+	return handle;
+}
+
+static void test_handle_free(refop_handle_t handle)
+{
+	refop_dir_put(handle->dir);
+	free(handle);
+}
+
 //--------------------------------------------------------------------------------------------------------
 // stubs
 int g_refop_new_file_write_ret = 0;
@@ -30,17 +48,169 @@ int refop_file_rotation(refop_handle_t handle)
 	return g_refop_file_rotation_ret;
 }
 
+int refop_file_state_probe(refop_handle_t handle)
+{
+	return 1;
+}
+
 int g_refop_file_pickup_ret = 0;
 int refop_file_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
 {
 	return g_refop_file_pickup_ret;
 }
 
+int refop_pingpong_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	return g_refop_new_file_write_ret;
+}
+
+int refop_pingpong_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return g_refop_file_pickup_ret;
+}
+
+int refop_pingpong_remove(refop_handle_t handle)
+{
+	return 0;
+}
+
+int refop_slot_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	return g_refop_new_file_write_ret;
+}
+
+int refop_slot_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return g_refop_file_pickup_ret;
+}
+
+int refop_slot_remove(refop_handle_t handle)
+{
+	return 0;
+}
+
+int refop_file_get_generation(refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return g_refop_file_pickup_ret;
+}
+
+int refop_pingpong_get_generation(refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return g_refop_file_pickup_ret;
+}
+
+int refop_slot_get_generation(refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return g_refop_file_pickup_ret;
+}
+
+int refop_parity_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	return g_refop_new_file_write_ret;
+}
+
+int refop_parity_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return g_refop_file_pickup_ret;
+}
+
+int refop_parity_remove(refop_handle_t handle)
+{
+	return 0;
+}
+
+int refop_parity_get_generation(refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return g_refop_file_pickup_ret;
+}
+
+int refop_delta_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	return g_refop_new_file_write_ret;
+}
+
+int refop_delta_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return g_refop_file_pickup_ret;
+}
+
+int refop_delta_remove(refop_handle_t handle)
+{
+	return 0;
+}
+
+int refop_delta_get_generation(refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return g_refop_file_pickup_ret;
+}
+
+void refop_delta_reset(refop_handle_t handle)
+{
+}
+
+int refop_journal_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	return g_refop_new_file_write_ret;
+}
+
+int refop_journal_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return g_refop_file_pickup_ret;
+}
+
+int refop_journal_remove(refop_handle_t handle)
+{
+	return 0;
+}
+
+int refop_journal_get_generation(refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return g_refop_file_pickup_ret;
+}
+
+int refop_journal_compact(refop_handle_t handle)
+{
+	return g_refop_file_pickup_ret;
+}
+
+void refop_journal_reset(refop_handle_t handle)
+{
+}
+
+int refop_chunk_write(refop_handle_t handle, uint8_t *data, int64_t bufsize)
+{
+	return g_refop_new_file_write_ret;
+}
+
+int refop_chunk_pickup(refop_handle_t handle, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return g_refop_file_pickup_ret;
+}
+
+int refop_chunk_remove(refop_handle_t handle)
+{
+	return 0;
+}
+
+int refop_chunk_get_generation(refop_handle_t handle, int n, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return g_refop_file_pickup_ret;
+}
+
+int refop_block_get_range(refop_handle_t handle, int64_t offset, uint8_t *data, int64_t len, int64_t *readsize)
+{
+	return g_refop_file_pickup_ret;
+}
+
+void refop_txn_recover(refop_handle_t handle)
+{
+}
+
 //--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_set_get_remove_test, unit_test_refop_set_redundancy_data__arg_error)
 {
 	refop_error_t ret = REFOP_SUCCESS;
-	refop_handle_t handle = (refop_handle_t)calloc(1,sizeof(struct refop_halndle));
+	refop_handle_t handle = test_handle_alloc();
 	uint8_t dmybuf[128];
 
 	//dummy data
@@ -65,13 +235,13 @@ TEST_F(fileop_test_set_get_remove_test, unit_test_refop_set_redundancy_data__arg
 	ret = refop_set_redundancy_data(NULL, dmybuf, 100);
 	ASSERT_EQ(REFOP_ARGERROR, ret);
 
-	free(handle);
+	test_handle_free(handle);
 }
 //--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_set_get_remove_test, unit_test_refop_set_redundancy_data__refop_new_file_write_error)
 {
 	refop_error_t ret = REFOP_SUCCESS;
-	refop_handle_t handle = (refop_handle_t)calloc(1,sizeof(struct refop_halndle));
+	refop_handle_t handle = test_handle_alloc();
 	uint8_t dmybuf[128];
 
 	//stub setup data
@@ -92,13 +262,13 @@ TEST_F(fileop_test_set_get_remove_test, unit_test_refop_set_redundancy_data__ref
 	ret = refop_set_redundancy_data(handle, dmybuf, 100);
 	ASSERT_EQ(REFOP_ARGERROR, ret);
 
-	free(handle);
+	test_handle_free(handle);
 }
 //--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_set_get_remove_test, unit_test_refop_set_redundancy_data__refop_file_rotation_error)
 {
 	refop_error_t ret = REFOP_SUCCESS;
-	refop_handle_t handle = (refop_handle_t)calloc(1,sizeof(struct refop_halndle));
+	refop_handle_t handle = test_handle_alloc();
 	uint8_t dmybuf[128];
 
 	//stub setup data
@@ -124,13 +294,13 @@ TEST_F(fileop_test_set_get_remove_test, unit_test_refop_set_redundancy_data__ref
 	ret = refop_set_redundancy_data(handle, dmybuf, 100);
 	ASSERT_EQ(REFOP_SUCCESS, ret);
 
-	free(handle);
+	test_handle_free(handle);
 }
 //--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_set_get_remove_test, unit_test_refop_get_redundancy_data__arg_error)
 {
 	refop_error_t ret = REFOP_SUCCESS;
-	refop_handle_t handle = (refop_handle_t)calloc(1,sizeof(struct refop_halndle));
+	refop_handle_t handle = test_handle_alloc();
 	uint8_t dmybuf[128];
 	int64_t getsize;
 
@@ -184,13 +354,13 @@ TEST_F(fileop_test_set_get_remove_test, unit_test_refop_get_redundancy_data__arg
 	ret = refop_get_redundancy_data(NULL, dmybuf, 100, &getsize);
 	ASSERT_EQ(REFOP_ARGERROR, ret);
 
-	free(handle);
+	test_handle_free(handle);
 }
 //--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_set_get_remove_test, unit_test_refop_get_redundancy_data__refop_file_pickup_error)
 {
 	refop_error_t ret = REFOP_SUCCESS;
-	refop_handle_t handle = (refop_handle_t)calloc(1,sizeof(struct refop_halndle));
+	refop_handle_t handle = test_handle_alloc();
 	uint8_t dmybuf[128];
 	int64_t getsize;
 
@@ -225,7 +395,7 @@ TEST_F(fileop_test_set_get_remove_test, unit_test_refop_get_redundancy_data__ref
 	ret = refop_get_redundancy_data(handle, dmybuf, 100, &getsize);
 	ASSERT_EQ(REFOP_RECOVER, ret);
 
-	free(handle);
+	test_handle_free(handle);
 }
 
 //--------------------------------------------------------------------------------------------------------
@@ -241,7 +411,7 @@ TEST_F(fileop_test_set_get_remove_test, unit_test_refop_remove_redundancy_data__
 TEST_F(fileop_test_set_get_remove_test, unit_test_refop_remove_redundancy_data__unlink_error)
 {
 	refop_error_t ret = REFOP_SUCCESS;
-	refop_handle_t handle = (refop_handle_t)calloc(1,sizeof(struct refop_halndle));
+	refop_handle_t handle = test_handle_alloc();
 
 	// 3 error
 	// EACCES - EACCES - EACCES
@@ -398,13 +568,13 @@ TEST_F(fileop_test_set_get_remove_test, unit_test_refop_remove_redundancy_data__
 	ret = refop_remove_redundancy_data(handle);
 	ASSERT_EQ(REFOP_SYSERROR, ret);
 
-	free(handle);
+	test_handle_free(handle);
 }
 //--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_set_get_remove_test, unit_test_refop_remove_redundancy_data__unlink_success)
 {
 	refop_error_t ret = REFOP_SUCCESS;
-	refop_handle_t handle = (refop_handle_t)calloc(1,sizeof(struct refop_halndle));
+	refop_handle_t handle = test_handle_alloc();
 
 	// success - success - success
 	EXPECT_CALL(sysiom, unlink(_))
@@ -470,5 +640,5 @@ TEST_F(fileop_test_set_get_remove_test, unit_test_refop_remove_redundancy_data__
 	ret = refop_remove_redundancy_data(handle);
 	ASSERT_EQ(REFOP_SUCCESS, ret);
 
-	free(handle);
+	test_handle_free(handle);
 }
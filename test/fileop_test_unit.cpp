@@ -16,13 +16,31 @@ using namespace ::testing;
 
 struct fileop_test_unit_test : Test, SyscallIOMockBase {};
 
+//--------------------------------------------------------------------------------------------------------
+// Handle without create function, file names are derived from "/tmp/test.bin".
+static refop_handle_t test_handle_alloc(void)
+{
+	refop_handle_t handle = (refop_handle_t)calloc(1, sizeof(struct refop_halndle) + sizeof("test.bin"));
+
+	handle->dir = refop_dir_get("/tmp/");
+	strcpy(handle->name, "test.bin");
+
+	return handle;
+}
+
+static void test_handle_free(refop_handle_t handle)
+{
+	refop_dir_put(handle->dir);
+	free(handle);
+}
+
 //--------------------------------------------------------------------------------------------------------
 //stubs
 ssize_t g_safe_read_ret = 0;
 ssize_t safe_read(int fd, void *buf, size_t count)
 {
 	if (g_safe_read_ret == sizeof(s_refop_file_header)) {
-		refop_header_create((s_refop_file_header*)buf, 100, refop_get_config_data_size_limit()+1);
+		refop_header_create((s_refop_file_header*)buf, 100, (uint64_t)REFOP_DATA_SIZE_LIMIT_MAX+1);
 	}
 	return g_safe_read_ret;
 }
@@ -33,6 +51,46 @@ ssize_t safe_write(int fd, void *buf, size_t count)
 	return g_safe_write_ret;
 }
 
+ssize_t safe_pread(int fd, void *buf, size_t count, off_t offset)
+{
+	return g_safe_read_ret;
+}
+
+int refop_compress_buffer_create(uint8_t *data, int64_t bufsize, uint8_t **pbuf, size_t *total)
+{
+	return 1;
+}
+
+int refop_compress_get_with_validation(int fd, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return -3;
+}
+
+uint8_t *refop_block_buffer_create(uint8_t *data, int64_t bufsize, size_t *total)
+{
+	return NULL;
+}
+
+int refop_block_get_with_validation(int fd, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return -3;
+}
+
+int refop_block_recover(const char *latest, const char *backup, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return -1;
+}
+
+int refop_direct_file_write(refop_handle_t handle, const char *file, uint8_t *data, int64_t bufsize)
+{
+	return -1;
+}
+
+int refop_direct_get_with_validation(int fd, uint8_t *data, int64_t bufsize, int64_t *readsize)
+{
+	return -3;
+}
+
 //--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_unit_test, unit_test_refop_new_file_write__arg_error)
 {
@@ -55,20 +113,20 @@ TEST_F(fileop_test_unit_test, unit_test_refop_new_file_write__arg_error)
 TEST_F(fileop_test_unit_test, unit_test_refop_new_file_write__unlink_error)
 {
 	int ret = -1;
-	refop_handle_t handle = (refop_handle_t)calloc(1,sizeof(struct refop_halndle));
+	refop_handle_t handle = test_handle_alloc();
 	uint8_t dmybuf[128];
 
 	EXPECT_CALL(sysiom, unlink(_)).WillOnce(SetErrnoAndReturn(EACCES, -1));
 	ret = refop_new_file_write(handle, dmybuf, refop_get_config_data_size_limit());
 	ASSERT_EQ(-1, ret);
 
-	free(handle);
+	test_handle_free(handle);
 }
 //--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_unit_test, unit_test_refop_new_file_write__open_error)
 {
 	int ret = -1;
-	refop_handle_t handle = (refop_handle_t)calloc(1,sizeof(struct refop_halndle));
+	refop_handle_t handle = test_handle_alloc();
 	uint8_t *dmybuf = (uint8_t*)calloc(1, refop_get_config_data_size_limit());
 
 	EXPECT_CALL(sysiom, unlink(_)).WillOnce(SetErrnoAndReturn(ENOENT, -1));
@@ -82,13 +140,13 @@ TEST_F(fileop_test_unit_test, unit_test_refop_new_file_write__open_error)
 	ASSERT_EQ(-1, ret);
 
 	free(dmybuf);
-	free(handle);
+	test_handle_free(handle);
 }
 //--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_unit_test, unit_test_refop_new_file_write__safe_write_error)
 {
 	int ret = -1;
-	refop_handle_t handle = (refop_handle_t)calloc(1,sizeof(struct refop_halndle));
+	refop_handle_t handle = test_handle_alloc();
 	uint8_t *dmybuf = (uint8_t*)calloc(1, refop_get_config_data_size_limit());
 
 	//dummy
@@ -119,13 +177,13 @@ TEST_F(fileop_test_unit_test, unit_test_refop_new_file_write__safe_write_error)
 	ASSERT_EQ(0, ret);
 
 	free(dmybuf);
-	free(handle);
+	test_handle_free(handle);
 }
 //--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_unit_test, unit_test_refop_file_rotation__stat_error)
 {
 	int ret = -1;
-	refop_handle_t handle = (refop_handle_t)calloc(1,sizeof(struct refop_halndle));
+	refop_handle_t handle = test_handle_alloc();
 
 	//dummy
 	g_safe_read_ret = 0;
@@ -150,13 +208,13 @@ TEST_F(fileop_test_unit_test, unit_test_refop_file_rotation__stat_error)
 	ret = refop_file_rotation(handle);
 	ASSERT_EQ(-1, ret);
 
-	free(handle);
+	test_handle_free(handle);
 }
 //--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_unit_test, unit_test_refop_file_rotation__open_error)
 {
 	int ret = -1;
-	refop_handle_t handle = (refop_handle_t)calloc(1,sizeof(struct refop_halndle));
+	refop_handle_t handle = test_handle_alloc();
 
 	//dummy
 	g_safe_read_ret = 0;
@@ -174,31 +232,31 @@ TEST_F(fileop_test_unit_test, unit_test_refop_file_rotation__open_error)
 	ret = refop_file_rotation(handle);
 	ASSERT_EQ(0, ret);
 
-	free(handle);
+	test_handle_free(handle);
 }
 //--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_unit_test, unit_test_refop_file_rotation__a1_a2_a3_a4)
 {
 	int ret = -1;
-	refop_handle_t handle = (refop_handle_t)calloc(1,sizeof(struct refop_halndle));
+	refop_handle_t handle = test_handle_alloc();
 
 	//dummy
 	g_safe_read_ret = 0;
 	g_safe_write_ret = 0;
 	g_safe_write_ret = 0;
-	strncpy(handle->backupfile1,"backup1",sizeof(handle->backupfile1));
-	strncpy(handle->latestfile,"latestfile",sizeof(handle->backupfile1));
-	strncpy(handle->newfile,"newfile",sizeof(handle->backupfile1));
+	char latestfile[] = "/tmp/test.bin";
+	char backupfile1[] = "/tmp/test.bin.bk1";
+	char newfile[] = "/tmp/test.bin.tmp";
 
-	// a1 mode
+	// a1 mode, unknown file state is probed by stat, the backup file is replaced by rename
+	handle->file_state = 0;
 	EXPECT_CALL(sysiom, stat(_, _))
 		.WillOnce(Return(0))
 		.WillOnce(Return(0));
-	EXPECT_CALL(sysiom, unlink(handle->backupfile1))
-		.WillOnce(Return(0));
-	EXPECT_CALL(sysiom, rename(handle->latestfile, handle->backupfile1))
+	EXPECT_CALL(sysiom, unlink(StrEq(backupfile1))).Times(0);
+	EXPECT_CALL(sysiom, rename(StrEq(latestfile), StrEq(backupfile1)))
 		.WillOnce(Return(0));
-	EXPECT_CALL(sysiom, rename(handle->newfile, handle->latestfile))
+	EXPECT_CALL(sysiom, rename(StrEq(newfile), StrEq(latestfile)))
 		.WillOnce(Return(0));
 	EXPECT_CALL(sysiom, open(_,_)).WillOnce(Return(100));
 	EXPECT_CALL(sysiom, fsync(100)).WillOnce(Return(0));
@@ -206,15 +264,16 @@ TEST_F(fileop_test_unit_test, unit_test_refop_file_rotation__a1_a2_a3_a4)
 	ret = refop_file_rotation(handle);
 	ASSERT_EQ(0, ret);
 
-	// a2 mode
+	// a2 mode, unknown file state is probed by stat
+	handle->file_state = 0;
 	EXPECT_CALL(sysiom, stat(_, _))
 		.WillOnce(Return(0))
 		.WillOnce(SetErrnoAndReturn(ENOENT, -1));
-	//EXPECT_CALL(sysiom, unlink(handle->backupfile1))
+	//EXPECT_CALL(sysiom, unlink(StrEq(backupfile1)))
 	//	.WillOnce(Return(0));
-	EXPECT_CALL(sysiom, rename(handle->latestfile, handle->backupfile1))
+	EXPECT_CALL(sysiom, rename(StrEq(latestfile), StrEq(backupfile1)))
 		.WillOnce(Return(0));
-	EXPECT_CALL(sysiom, rename(handle->newfile, handle->latestfile))
+	EXPECT_CALL(sysiom, rename(StrEq(newfile), StrEq(latestfile)))
 		.WillOnce(Return(0));
 	EXPECT_CALL(sysiom, open(_,_)).WillOnce(Return(100));
 	EXPECT_CALL(sysiom, fsync(100)).WillOnce(Return(0));
@@ -222,15 +281,16 @@ TEST_F(fileop_test_unit_test, unit_test_refop_file_rotation__a1_a2_a3_a4)
 	ret = refop_file_rotation(handle);
 	ASSERT_EQ(0, ret);
 
-	// a3 mode
+	// a3 mode, unknown file state is probed by stat
+	handle->file_state = 0;
 	EXPECT_CALL(sysiom, stat(_, _))
 		.WillOnce(SetErrnoAndReturn(ENOENT, -1))
 		.WillOnce(Return(0));
-	//EXPECT_CALL(sysiom, unlink(handle->backupfile1))
+	//EXPECT_CALL(sysiom, unlink(StrEq(backupfile1)))
 	//	.WillOnce(Return(0));
-	//EXPECT_CALL(sysiom, rename(handle->latestfile, handle->backupfile1))
+	//EXPECT_CALL(sysiom, rename(StrEq(latestfile), StrEq(backupfile1)))
 	//	.WillOnce(Return(0));
-	EXPECT_CALL(sysiom, rename(handle->newfile, handle->latestfile))
+	EXPECT_CALL(sysiom, rename(StrEq(newfile), StrEq(latestfile)))
 		.WillOnce(Return(0));
 	EXPECT_CALL(sysiom, open(_,_)).WillOnce(Return(100));
 	EXPECT_CALL(sysiom, fsync(100)).WillOnce(Return(0));
@@ -238,15 +298,16 @@ TEST_F(fileop_test_unit_test, unit_test_refop_file_rotation__a1_a2_a3_a4)
 	ret = refop_file_rotation(handle);
 	ASSERT_EQ(0, ret);
 
-	// a4 mode
+	// a4 mode, unknown file state is probed by stat
+	handle->file_state = 0;
 	EXPECT_CALL(sysiom, stat(_, _))
 		.WillOnce(SetErrnoAndReturn(ENOENT, -1))
 		.WillOnce(SetErrnoAndReturn(ENOENT, -1));
-	//EXPECT_CALL(sysiom, unlink(handle->backupfile1))
+	//EXPECT_CALL(sysiom, unlink(StrEq(backupfile1)))
 	//	.WillOnce(Return(0));
-	//EXPECT_CALL(sysiom, rename(handle->latestfile, handle->backupfile1))
+	//EXPECT_CALL(sysiom, rename(StrEq(latestfile), StrEq(backupfile1)))
 	//	.WillOnce(Return(0));
-	EXPECT_CALL(sysiom, rename(handle->newfile, handle->latestfile))
+	EXPECT_CALL(sysiom, rename(StrEq(newfile), StrEq(latestfile)))
 		.WillOnce(Return(0));
 	EXPECT_CALL(sysiom, open(_,_)).WillOnce(Return(100));
 	EXPECT_CALL(sysiom, fsync(100)).WillOnce(Return(0));
@@ -254,7 +315,108 @@ TEST_F(fileop_test_unit_test, unit_test_refop_file_rotation__a1_a2_a3_a4)
 	ret = refop_file_rotation(handle);
 	ASSERT_EQ(0, ret);
 
-	free(handle);
+	test_handle_free(handle);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(fileop_test_unit_test, unit_test_refop_file_rotation__cached_state)
+{
+	int ret = -1;
+	refop_handle_t handle = test_handle_alloc();
+	char latestfile[] = "/tmp/test.bin";
+	char backupfile1[] = "/tmp/test.bin.bk1";
+	char newfile[] = "/tmp/test.bin.tmp";
+
+	// a1 by cached state, no stat, the backup file is replaced by rename
+	handle->file_state = REFOP_FILE_STATE_VALID | REFOP_FILE_STATE_LATEST | REFOP_FILE_STATE_BACKUP;
+	EXPECT_CALL(sysiom, stat(_, _)).Times(0);
+	EXPECT_CALL(sysiom, unlink(StrEq(backupfile1))).Times(0);
+	EXPECT_CALL(sysiom, rename(StrEq(latestfile), StrEq(backupfile1)))
+		.WillOnce(Return(0));
+	EXPECT_CALL(sysiom, rename(StrEq(newfile), StrEq(latestfile)))
+		.WillOnce(Return(0));
+	EXPECT_CALL(sysiom, open(_,_)).WillOnce(Return(100));
+	EXPECT_CALL(sysiom, fsync(100)).WillOnce(Return(0));
+	EXPECT_CALL(sysiom, close(100)).WillOnce(Return(0));
+	ret = refop_file_rotation(handle);
+	ASSERT_EQ(0, ret);
+	ASSERT_EQ(REFOP_FILE_STATE_VALID | REFOP_FILE_STATE_LATEST | REFOP_FILE_STATE_BACKUP, handle->file_state);
+
+	// a2 by cached state, backup does not need unlink
+	handle->file_state = REFOP_FILE_STATE_VALID | REFOP_FILE_STATE_LATEST;
+	EXPECT_CALL(sysiom, stat(_, _)).Times(0);
+	EXPECT_CALL(sysiom, rename(StrEq(latestfile), StrEq(backupfile1)))
+		.WillOnce(Return(0));
+	EXPECT_CALL(sysiom, rename(StrEq(newfile), StrEq(latestfile)))
+		.WillOnce(Return(0));
+	EXPECT_CALL(sysiom, open(_,_)).WillOnce(Return(100));
+	EXPECT_CALL(sysiom, fsync(100)).WillOnce(Return(0));
+	EXPECT_CALL(sysiom, close(100)).WillOnce(Return(0));
+	ret = refop_file_rotation(handle);
+	ASSERT_EQ(0, ret);
+	ASSERT_EQ(REFOP_FILE_STATE_VALID | REFOP_FILE_STATE_LATEST | REFOP_FILE_STATE_BACKUP, handle->file_state);
+
+	// Latest file was removed by another process, fall back to probing (a3), the backup file is kept
+	handle->file_state = REFOP_FILE_STATE_VALID | REFOP_FILE_STATE_LATEST | REFOP_FILE_STATE_BACKUP;
+	EXPECT_CALL(sysiom, unlink(StrEq(backupfile1))).Times(0);
+	EXPECT_CALL(sysiom, rename(StrEq(latestfile), StrEq(backupfile1)))
+		.WillOnce(SetErrnoAndReturn(ENOENT, -1));
+	EXPECT_CALL(sysiom, stat(_, _))
+		.WillOnce(SetErrnoAndReturn(ENOENT, -1))
+		.WillOnce(Return(0));
+	EXPECT_CALL(sysiom, rename(StrEq(newfile), StrEq(latestfile)))
+		.WillOnce(Return(0));
+	EXPECT_CALL(sysiom, open(_,_)).WillOnce(Return(100));
+	EXPECT_CALL(sysiom, fsync(100)).WillOnce(Return(0));
+	EXPECT_CALL(sysiom, close(100)).WillOnce(Return(0));
+	ret = refop_file_rotation(handle);
+	ASSERT_EQ(0, ret);
+	ASSERT_EQ(REFOP_FILE_STATE_VALID | REFOP_FILE_STATE_LATEST | REFOP_FILE_STATE_BACKUP, handle->file_state);
+
+	test_handle_free(handle);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(fileop_test_unit_test, unit_test_refop_file_state_probe)
+{
+	refop_handle_t handle = test_handle_alloc();
+
+	// ac1
+	EXPECT_CALL(sysiom, stat(_, _))
+		.WillOnce(SetErrnoAndReturn(ENOENT, -1))
+		.WillOnce(SetErrnoAndReturn(ENOENT, -1))
+		.WillOnce(SetErrnoAndReturn(ENOENT, -1));
+	ASSERT_EQ(1, refop_file_state_probe(handle));
+	ASSERT_EQ(REFOP_FILE_STATE_VALID, handle->file_state);
+
+	// ac4
+	EXPECT_CALL(sysiom, stat(_, _))
+		.WillOnce(Return(0))
+		.WillOnce(Return(0))
+		.WillOnce(SetErrnoAndReturn(ENOENT, -1));
+	ASSERT_EQ(4, refop_file_state_probe(handle));
+
+	// ac6
+	EXPECT_CALL(sysiom, stat(_, _))
+		.WillOnce(SetErrnoAndReturn(ENOENT, -1))
+		.WillOnce(Return(0))
+		.WillOnce(Return(0));
+	ASSERT_EQ(6, refop_file_state_probe(handle));
+
+	// ac7
+	EXPECT_CALL(sysiom, stat(_, _))
+		.WillOnce(Return(0))
+		.WillOnce(Return(0))
+		.WillOnce(Return(0));
+	ASSERT_EQ(7, refop_file_state_probe(handle));
+	ASSERT_EQ(REFOP_FILE_STATE_VALID | REFOP_FILE_STATE_LATEST | REFOP_FILE_STATE_BACKUP | REFOP_FILE_STATE_NEW,
+		  handle->file_state);
+
+	// Abnormal fail clears the state
+	EXPECT_CALL(sysiom, stat(_, _))
+		.WillOnce(SetErrnoAndReturn(EACCES, -1));
+	ASSERT_EQ(-1, refop_file_state_probe(handle));
+	ASSERT_EQ(0, handle->file_state);
+
+	test_handle_free(handle);
 }
 //--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_unit_test, fileop_test_unit_test_refop_file_get_with_validation__1st_open_error)
@@ -284,6 +446,35 @@ TEST_F(fileop_test_unit_test, fileop_test_unit_test_refop_file_get_with_validati
 	free(pbuf);
 }
 //--------------------------------------------------------------------------------------------------------
+TEST_F(fileop_test_unit_test, unit_test_refop_file_pickup__abnormal_latest)
+{
+	refop_handle_t handle = test_handle_alloc();
+	uint8_t buf[64];
+	int64_t szr = 0;
+
+	// The backup is tried, a latest file that could not be read is never removed.
+	g_safe_read_ret = sizeof(s_refop_file_header);
+	EXPECT_CALL(sysiom, open(_,_))
+		.WillOnce(SetErrnoAndReturn(EACCES, -1))
+		.WillOnce(Return(100));
+	EXPECT_CALL(sysiom, close(100)).WillOnce(Return(0));
+	EXPECT_CALL(sysiom, unlink(_)).Times(0);
+	ASSERT_EQ(-1, refop_file_pickup(handle, buf, sizeof(buf), &szr));
+
+	EXPECT_CALL(sysiom, open(_,_))
+		.WillOnce(SetErrnoAndReturn(EACCES, -1))
+		.WillOnce(SetErrnoAndReturn(ENOENT, -1));
+	ASSERT_EQ(-1, refop_file_pickup(handle, buf, sizeof(buf), &szr));
+
+	EXPECT_CALL(sysiom, open(_,_))
+		.WillOnce(SetErrnoAndReturn(ENOENT, -1))
+		.WillOnce(SetErrnoAndReturn(EACCES, -1));
+	ASSERT_EQ(-1, refop_file_pickup(handle, buf, sizeof(buf), &szr));
+
+	g_safe_read_ret = 0;
+	test_handle_free(handle);
+}
+//--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_unit_test, fileop_test_unit_test_refop_file_get_with_validation__safe_read_error)
 {
 	int ret = -1;
@@ -336,7 +527,7 @@ TEST_F(fileop_test_unit_test, fileop_test_unit_test_refop_file_get_with_validati
 	EXPECT_CALL(sysiom, close(100)).WillOnce(Return(0));
 
 	ret = refop_file_get_with_validation(testfilename, pbuf, sz, &szr);
-	ASSERT_EQ(-4, ret);
+	ASSERT_EQ(-3, ret);
 
 	free(pbuf);
 }
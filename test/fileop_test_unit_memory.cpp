@@ -19,18 +19,36 @@ using namespace ::testing;
 
 struct fileop_test_unit_memory_test : Test, SyscallIOMockBase, MemoryMockBase {};
 
+//--------------------------------------------------------------------------------------------------------
+// Handle without create function, file names are derived from "/tmp/test.bin".
+static refop_handle_t test_handle_alloc(void)
+{
+	refop_handle_t handle = (refop_handle_t)calloc(1, sizeof(struct refop_halndle) + sizeof("test.bin"));
+
+	handle->dir = refop_dir_get("/tmp/");
+	strcpy(handle->name, "test.bin");
+
+	return handle;
+}
+
+static void test_handle_free(refop_handle_t handle)
+{
+	refop_dir_put(handle->dir);
+	free(handle);
+}
+
 //--------------------------------------------------------------------------------------------------------
 TEST_F(fileop_test_unit_memory_test, unit_test_refop_new_file_write__open_error)
 {
 	int ret = -1;
-	refop_handle_t handle = (refop_handle_t)calloc(1,sizeof(struct refop_halndle));
+	refop_handle_t handle = test_handle_alloc();
 	uint8_t *dmybuf = (uint8_t*)calloc(1, refop_get_config_data_size_limit());
 
 	EXPECT_CALL(sysiom, unlink(_)).WillOnce(SetErrnoAndReturn(ENOENT, -1));
-	EXPECT_CALL(memorym, malloc(_)).WillOnce(Return(NULL));
+	EXPECT_CALL(memorym, malloc(_)).WillOnce(Return(nullptr));
 	ret = refop_new_file_write(handle, dmybuf, refop_get_config_data_size_limit());
 	ASSERT_EQ(-1, ret);
 
 	free(dmybuf);
-	free(handle);
+	test_handle_free(handle);
 }
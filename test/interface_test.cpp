@@ -687,3 +687,135 @@ TEST_F(interface_test, interface_test_no_file_f4)
 	free(pbuf);
 	free(prbuf);
 }
+//--------------------------------------------------------------------------------------------------------
+// Interface test for indexed generation get.
+TEST_F(interface_test, interface_test_refop_get_generation)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+
+	//dummy data
+	uint8_t buf[256];
+	int64_t szr = 0;
+
+	//clean up
+	(void)mkdir(directry, 0777);
+	(void)unlink(newfile);
+	(void)unlink(latestfile);
+	(void)unlink(backupfile);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_get_generation(handle, 0, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	memset(buf, 0x01, sizeof(buf));
+	ret = refop_set_redundancy_data(handle, buf, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	memset(buf, 0x02, sizeof(buf));
+	ret = refop_set_redundancy_data(handle, buf, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	memset(buf, 0, sizeof(buf));
+	ret = refop_get_generation(handle, 0, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ((int64_t)sizeof(buf), szr);
+	ASSERT_EQ(0x02, buf[0]);
+
+	ret = refop_get_generation(handle, 1, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0x01, buf[sizeof(buf) - 1]);
+
+	ret = refop_get_generation(handle, 2, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	ret = refop_get_generation(NULL, 0, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+}
+//--------------------------------------------------------------------------------------------------------
+// Cached file state follows changes by another handle (another process).
+TEST_F(interface_test, interface_test_cached_file_state)
+{
+	refop_handle_t handle = NULL, other = NULL;
+	uint8_t buf[64], rbuf[64];
+	int64_t szr = 0;
+
+	//clean up
+	(void)mkdir(directry, 0777);
+	(void)unlink(newfile);
+	(void)unlink(latestfile);
+	(void)unlink(backupfile);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+	ASSERT_EQ(REFOP_FILE_STATE_VALID, handle->file_state);
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&other, directry, file));
+
+	// Latest file was created by other handle, it is kept as backup.
+	memset(buf, 1, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(other, buf, sizeof(buf)));
+	memset(buf, 2, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_FILE_STATE_VALID | REFOP_FILE_STATE_LATEST | REFOP_FILE_STATE_BACKUP, handle->file_state);
+	ASSERT_EQ(0, access(backupfile, F_OK));
+
+	// Files were removed by other handle.
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(other));
+	memset(buf, 3, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_FILE_STATE_VALID | REFOP_FILE_STATE_LATEST, handle->file_state);
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(other, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(0, memcmp(buf, rbuf, sizeof(buf)));
+
+	// Steady state
+	memset(buf, 4, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(other, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(0, memcmp(buf, rbuf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_generation(other, 1, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(3, rbuf[0]);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handle));
+	ASSERT_EQ(REFOP_FILE_STATE_VALID, handle->file_state);
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(other));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+}
+//--------------------------------------------------------------------------------------------------------
+// Cached file state follows files that were removed by recovery, the backup file is kept.
+TEST_F(interface_test, interface_test_cached_file_state_recovered)
+{
+	refop_handle_t handle = NULL;
+	uint8_t buf[64], rbuf[64];
+	int64_t szr = 0;
+
+	//clean up
+	(void)mkdir(directry, 0777);
+	(void)unlink(newfile);
+	(void)unlink(latestfile);
+	(void)unlink(backupfile);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+	memset(buf, 1, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, sizeof(buf)));
+	memset(buf, 2, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, sizeof(buf)));
+
+	// Broken latest file is removed by get.
+	ASSERT_EQ(0, truncate(latestfile, 10));
+	ASSERT_EQ(REFOP_RECOVER, refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(1, rbuf[0]);
+	ASSERT_NE(0, access(latestfile, F_OK));
+
+	memset(buf, 3, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_generation(handle, 1, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(1, rbuf[0]);
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(3, rbuf[0]);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+}
@@ -0,0 +1,243 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_allocator.cpp
+ * @brief	Public interface test fot allocator hooks and static handle
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-allocator.bin";
+static const char latestfile[] = "/tmp/refop-test/test-allocator.bin";
+static const char backupfile[] = "/tmp/refop-test/test-allocator.bin.bk1";
+static const char newfile[] = "/tmp/refop-test/test-allocator.bin.tmp";
+static const char pingpongfile0[] = "/tmp/refop-test/test-allocator.bin.g0";
+static const char pingpongfile1[] = "/tmp/refop-test/test-allocator.bin.g1";
+static const char slotfile[] = "/tmp/refop-test/test-allocator.bin.ab";
+
+/** Counting allocator. */
+struct test_allocator {
+	int allocs;
+	int frees;
+};
+
+static void *test_alloc(size_t size, void *ctx)
+{
+	struct test_allocator *ta = (struct test_allocator *)ctx;
+
+	ta->allocs++;
+	return malloc(size);
+}
+
+static void test_free(void *ptr, void *ctx)
+{
+	struct test_allocator *ta = (struct test_allocator *)ctx;
+
+	ta->frees++;
+	free(ptr);
+}
+
+struct interface_test_allocator : Test {
+	struct test_allocator ta;
+
+	void SetUp() override
+	{
+		memset(&ta, 0, sizeof(ta));
+		ASSERT_EQ(REFOP_SUCCESS, refop_set_allocator(test_alloc, test_free, &ta));
+	}
+	void TearDown() override
+	{
+		(void)refop_set_allocator(NULL, NULL, NULL);
+	}
+};
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, pingpongfile0, pingpongfile1, slotfile, NULL };
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_allocator, interface_test_allocator__arg_error)
+{
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+	uint64_t storage[64];
+	uint8_t scratch[128];
+
+	ASSERT_EQ(REFOP_ARGERROR, refop_set_allocator(test_alloc, NULL, &ta));
+	ASSERT_EQ(REFOP_ARGERROR, refop_set_allocator(NULL, test_free, &ta));
+
+	ASSERT_EQ(0, refop_handle_storage_size(NULL, file));
+	ASSERT_EQ(0, refop_handle_storage_size(directry, NULL));
+	ASSERT_EQ(0, refop_handle_storage_size("", file));
+
+	ASSERT_EQ(REFOP_ARGERROR,
+		  refop_create_redundancy_handle_static(NULL, directry, file, NULL, storage, sizeof(storage), NULL, 0));
+	ASSERT_EQ(REFOP_ARGERROR,
+		  refop_create_redundancy_handle_static(&handle, directry, file, NULL, NULL, sizeof(storage), NULL, 0));
+	// Too small storage
+	ASSERT_EQ(REFOP_ARGERROR,
+		  refop_create_redundancy_handle_static(&handle, directry, file, NULL, storage, 8, NULL, 0));
+	// Misaligned storage
+	ASSERT_EQ(REFOP_ARGERROR, refop_create_redundancy_handle_static(&handle, directry, file, NULL,
+									(uint8_t *)storage + 1, sizeof(storage) - 8,
+									NULL, 0));
+	// Too small scratch
+	ASSERT_EQ(REFOP_ARGERROR, refop_create_redundancy_handle_static(&handle, directry, file, NULL, storage,
+									sizeof(storage), scratch, sizeof(scratch)));
+	// Static handle could not be shared
+	memset(&opts, 0, sizeof(opts));
+	opts.shared = true;
+	ASSERT_EQ(REFOP_ARGERROR, refop_create_redundancy_handle_static(&handle, directry, file, &opts, storage,
+									sizeof(storage), NULL, 0));
+	ASSERT_EQ(REFOP_NOENT, refop_create_redundancy_handle_static(&handle, "/tmp/refop-test-noent/", file, NULL,
+								      storage, sizeof(storage), NULL, 0));
+
+	ASSERT_EQ(0, ta.allocs);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_allocator, interface_test_allocator__heap_handle_balance)
+{
+	refop_handle_t handle = NULL;
+	refop_error_t ret = REFOP_SUCCESS;
+	int64_t sz = 64 * 1024, szr = 0;
+	uint8_t *pbuf = NULL, *rbuf = NULL;
+
+	cleanup_files(directry, testfiles);
+
+	pbuf = (uint8_t *)malloc(sz);
+	rbuf = (uint8_t *)malloc(sz);
+	create_data(pbuf, sz, 7);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_LT(0, ta.allocs);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_slot_capacity(handle, sz));
+
+	// Every mode and format use the allocator.
+	for (int mode = 0; mode < 3; mode++) {
+		ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(handle, (refop_mode_t)mode));
+		ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, pbuf, sz));
+		ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, sz, &szr));
+		ASSERT_EQ(sz, szr);
+		ASSERT_EQ(0, memcmp(pbuf, rbuf, sz));
+	}
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(handle, REFOP_MODE_ROTATION));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_compression(handle, true));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, pbuf, sz));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, sz, &szr));
+	ASSERT_EQ(0, memcmp(pbuf, rbuf, sz));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	ASSERT_EQ(ta.allocs, ta.frees);
+
+	free(rbuf);
+	free(pbuf);
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_allocator, interface_test_allocator__static_handle_zero_malloc)
+{
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+	refop_error_t ret = REFOP_SUCCESS;
+	int64_t sz = 16 * 1024, szr = 0;
+	uint64_t storage[64];
+	uint8_t *pbuf = NULL, *rbuf = NULL, *scratch = NULL;
+	size_t scratch_size = 0;
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.size_limit = 32 * 1024;
+
+	ASSERT_GE(sizeof(storage), refop_handle_storage_size(directry, file));
+	scratch_size = refop_handle_scratch_size(&opts);
+	ASSERT_EQ(opts.size_limit + REFOP_SCRATCH_HEADER_SIZE, scratch_size);
+
+	pbuf = (uint8_t *)malloc(sz);
+	rbuf = (uint8_t *)malloc(sz);
+	scratch = (uint8_t *)malloc(scratch_size);
+
+	ret = refop_create_redundancy_handle_static(&handle, directry, file, &opts, storage, sizeof(storage), scratch,
+						    scratch_size);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ((void *)storage, (void *)handle);
+	ASSERT_EQ(0, strcmp(handle->dir->path, directry));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_slot_capacity(handle, sz));
+
+	for (int mode = 0; mode < 3; mode++) {
+		ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(handle, (refop_mode_t)mode));
+		for (int i = 0; i < 3; i++) {
+			create_data(pbuf, sz, (uint8_t)(mode * 3 + i));
+			ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, pbuf, sz - i));
+			ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, sz, &szr));
+			ASSERT_EQ(sz - i, szr);
+			ASSERT_EQ(0, memcmp(pbuf, rbuf, sz - i));
+
+			// Smaller buffer than data is verified by streaming.
+			ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, 100, &szr));
+			ASSERT_EQ(100, szr);
+			ASSERT_EQ(0, memcmp(pbuf, rbuf, 100));
+		}
+	}
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	ASSERT_EQ(0, ta.allocs);
+	ASSERT_EQ(0, ta.frees);
+
+	free(scratch);
+	free(rbuf);
+	free(pbuf);
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_allocator, interface_test_allocator__static_handle_without_scratch)
+{
+	refop_handle_t handle = NULL;
+	refop_error_t ret = REFOP_SUCCESS;
+	int64_t sz = 1024, szr = 0;
+	refop_options_t opts;
+	uint64_t storage[64];
+	uint8_t pbuf[1024], rbuf[1024];
+
+	cleanup_files(directry, testfiles);
+	create_data(pbuf, sz, 3);
+
+	// Shared of the default options is not applied to static handle.
+	memset(&opts, 0, sizeof(opts));
+	opts.shared = true;
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_default_options(&opts));
+
+	ret = refop_create_redundancy_handle_static(&handle, "/tmp/refop-test", file, NULL, storage, sizeof(storage),
+						    NULL, 0);
+	(void)refop_set_default_options(NULL);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, strcmp(handle->dir->path, directry));
+	ASSERT_FALSE(handle->shared);
+	ASSERT_EQ(nullptr, handle->lock);
+
+	// Write buffer is allocated by the allocator.
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, pbuf, sz));
+	ASSERT_EQ(1, ta.allocs);
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, sz, &szr));
+	ASSERT_EQ(0, memcmp(pbuf, rbuf, sz));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	ASSERT_EQ(ta.allocs, ta.frees);
+
+	cleanup_files(directry, testfiles);
+}
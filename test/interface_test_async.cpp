@@ -0,0 +1,598 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_async.cpp
+ * @brief	Public interface test fot asynchronous operations
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_async : Test {
+	void TearDown() override
+	{
+		(void)refop_pool_configure(0, 0);
+	}
+};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test-async/";
+static const char file[] = "test-async.bin";
+static const char latestfile[] = "/tmp/refop-test-async/test-async.bin";
+static const char backupfile[] = "/tmp/refop-test-async/test-async.bin.bk1";
+static const char newfile[] = "/tmp/refop-test-async/test-async.bin.tmp";
+static const char lockfile[] = "/tmp/refop-test-async/test-async.bin.lck";
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = {
+	newfile,
+	latestfile,
+	backupfile,
+	lockfile,
+	"/tmp/refop-test-async/test-async0.bin",
+	"/tmp/refop-test-async/test-async0.bin.bk1",
+	"/tmp/refop-test-async/test-async1.bin",
+	"/tmp/refop-test-async/test-async1.bin.bk1",
+	"/tmp/refop-test-async/test-async2.bin",
+	"/tmp/refop-test-async/test-async2.bin.bk1",
+	"/tmp/refop-test-async/test-async3.bin",
+	"/tmp/refop-test-async/test-async3.bin.bk1",
+	NULL,
+};
+//--------------------------------------------------------------------------------------------------------
+// Take the writer lock as another process does.
+static int hold_lock(void)
+{
+	struct flock fl;
+	int fd = -1;
+
+	fd = open(lockfile, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return -1;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = 0;
+	fl.l_len = 1;
+	if (fcntl(fd, F_OFD_SETLK, &fl) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_async, interface_test_async__arg_error)
+{
+	refop_handle_t handle = NULL;
+	refop_future_t future = NULL;
+	uint8_t buf[16];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	memset(buf, 0, sizeof(buf));
+
+	ASSERT_EQ(REFOP_ARGERROR, refop_pool_configure(-1, 0));
+	ASSERT_EQ(REFOP_ARGERROR, refop_pool_configure(REFOP_POOL_THREADS_MAX + 1, 0));
+	ASSERT_EQ(REFOP_ARGERROR, refop_pool_configure(0, -1));
+	ASSERT_EQ(REFOP_ARGERROR, refop_pool_configure(0, REFOP_POOL_DEPTH_MAX + 1));
+
+	ASSERT_EQ(REFOP_ARGERROR, refop_set_redundancy_data_async(NULL, buf, sizeof(buf), &future));
+	ASSERT_EQ(REFOP_ARGERROR, refop_get_redundancy_data_async(NULL, buf, sizeof(buf), &szr, &future));
+	ASSERT_EQ(REFOP_ARGERROR, refop_remove_redundancy_data_async(NULL, &future));
+	ASSERT_EQ(REFOP_ARGERROR, refop_verify_redundancy_data_async(NULL, &future));
+	ASSERT_EQ(REFOP_ARGERROR, refop_verify_redundancy_data(NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_future_wait(NULL, -1));
+	ASSERT_EQ(REFOP_ARGERROR, refop_future_poll(NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_future_set_callback(NULL, NULL, NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_future_release(NULL));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+	ASSERT_EQ(REFOP_ARGERROR, refop_set_redundancy_data_async(handle, NULL, sizeof(buf), &future));
+	ASSERT_EQ(REFOP_ARGERROR, refop_set_redundancy_data_async(handle, buf, -1, &future));
+	ASSERT_EQ(REFOP_ARGERROR, refop_get_redundancy_data_async(handle, NULL, sizeof(buf), &szr, &future));
+	ASSERT_EQ(REFOP_ARGERROR, refop_get_redundancy_data_async(handle, buf, -1, &szr, &future));
+	ASSERT_EQ(REFOP_ARGERROR, refop_get_redundancy_data_async(handle, buf, sizeof(buf), NULL, &future));
+	ASSERT_EQ(REFOP_ARGERROR, refop_get_redundancy_data_async(handle, buf, sizeof(buf), &szr, NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_verify_redundancy_data_async(handle, NULL));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data_async(handle, buf, sizeof(buf), &future));
+	ASSERT_EQ(REFOP_ARGERROR, refop_future_wait(future, -2));
+	ASSERT_EQ(REFOP_ARGERROR, refop_future_set_callback(future, NULL, NULL));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_wait(future, -1));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_release(future));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_async, interface_test_async__operations)
+{
+	refop_handle_t handle = NULL;
+	refop_future_t future = NULL;
+	uint8_t buf[512], rbuf[512];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+	ASSERT_EQ(REFOP_NOENT, refop_verify_redundancy_data(handle));
+
+	memset(buf, 0x11, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data_async(handle, buf, sizeof(buf), &future));
+	// Data is copied, the buffer can be reused.
+	memset(buf, 0x22, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_wait(future, -1));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_poll(future));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_release(future));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_verify_redundancy_data_async(handle, &future));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_wait(future, 1000));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_release(future));
+
+	memset(rbuf, 0, sizeof(rbuf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data_async(handle, rbuf, sizeof(rbuf), &szr, &future));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_wait(future, -1));
+	ASSERT_EQ((int64_t)sizeof(rbuf), szr);
+	ASSERT_EQ(0x11, rbuf[0]);
+	ASSERT_EQ(0x11, rbuf[sizeof(rbuf) - 1]);
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_release(future));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data_async(handle, &future));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_wait(future, -1));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_release(future));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_verify_redundancy_data_async(handle, &future));
+	ASSERT_EQ(REFOP_NOENT, refop_future_wait(future, -1));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_release(future));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_async, interface_test_async__fifo)
+{
+	refop_handle_t handle = NULL;
+	refop_future_t futures[32];
+	uint8_t buf[64], rbufs[32][64];
+	int64_t szrs[32];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_pool_configure(4, 0));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+
+	// Each get follows the set before it, even with many workers.
+	for (int i = 0; i < 32; i++) {
+		memset(buf, i, sizeof(buf));
+		ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data_async(handle, buf, sizeof(buf), NULL));
+		ASSERT_EQ(REFOP_SUCCESS,
+			  refop_get_redundancy_data_async(handle, rbufs[i], sizeof(rbufs[i]), &szrs[i], &futures[i]));
+	}
+	for (int i = 0; i < 32; i++) {
+		ASSERT_EQ(REFOP_SUCCESS, refop_future_wait(futures[i], -1));
+		ASSERT_EQ(i, rbufs[i][0]);
+		ASSERT_EQ(REFOP_SUCCESS, refop_future_release(futures[i]));
+	}
+
+	// A synchronous get waits for queued sets.
+	for (int i = 0; i < 16; i++) {
+		memset(buf, 100 + i, sizeof(buf));
+		ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data_async(handle, buf, sizeof(buf), NULL));
+	}
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, buf, sizeof(buf), &szr));
+	ASSERT_EQ(115, buf[0]);
+
+	// Release waits for queued operations.
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data_async(handle, NULL));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	ASSERT_NE(0, access(latestfile, F_OK));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_async, interface_test_async__batch)
+{
+	refop_handle_t handle = NULL, other = NULL;
+	refop_options_t opts;
+	refop_batch_t batch = NULL;
+	refop_batch_op_t ops[6];
+	uint8_t buf[64], obuf[32], rbuf[64], orbuf[64];
+	int64_t szr = 0, oszr = 0;
+	int fd = -1;
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.process_lock = true;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle, directry, file, &opts));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&other, directry, "test-async0.bin"));
+
+	memset(ops, 0, sizeof(ops));
+	ASSERT_EQ(REFOP_ARGERROR, refop_batch_submit(NULL, 1, &batch));
+	ASSERT_EQ(REFOP_ARGERROR, refop_batch_submit(ops, 0, &batch));
+	ASSERT_EQ(REFOP_ARGERROR, refop_batch_submit(ops, 1, NULL));
+	// No handle
+	ASSERT_EQ(REFOP_ARGERROR, refop_batch_submit(ops, 1, &batch));
+	ops[0].handle = handle;
+	ops[0].type = (refop_batch_type_t)(REFOP_BATCH_VERIFY + 1);
+	ASSERT_EQ(REFOP_ARGERROR, refop_batch_submit(ops, 1, &batch));
+	ASSERT_EQ(REFOP_ARGERROR, refop_batch_wait(NULL, -1));
+	ASSERT_EQ(REFOP_ARGERROR, refop_batch_poll(NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_batch_release(NULL));
+
+	// Operations of a handle are done in array order, other handles are not ordered.
+	memset(buf, 0x41, sizeof(buf));
+	memset(obuf, 0x42, sizeof(obuf));
+	ops[0] = { REFOP_BATCH_SET, handle, buf, sizeof(buf), NULL, REFOP_SYSERROR };
+	ops[1] = { REFOP_BATCH_SET, other, obuf, sizeof(obuf), NULL, REFOP_SYSERROR };
+	ops[2] = { REFOP_BATCH_GET, handle, rbuf, sizeof(rbuf), &szr, REFOP_SYSERROR };
+	ops[3] = { REFOP_BATCH_GET, other, orbuf, sizeof(orbuf), &oszr, REFOP_SYSERROR };
+	ops[4] = { REFOP_BATCH_REMOVE, other, NULL, 0, NULL, REFOP_SYSERROR };
+	ops[5] = { REFOP_BATCH_VERIFY, other, NULL, 0, NULL, REFOP_SYSERROR };
+
+	// The writer lock of handle keeps the batch running, results are not set.
+	fd = hold_lock();
+	ASSERT_LE(0, fd);
+	ASSERT_EQ(REFOP_SUCCESS, refop_batch_submit(ops, 6, &batch));
+	ASSERT_EQ(REFOP_ARGERROR, refop_batch_wait(batch, -2));
+	ASSERT_EQ(REFOP_BUSY, refop_batch_poll(batch));
+	ASSERT_EQ(REFOP_BUSY, refop_batch_wait(batch, 50));
+	ASSERT_EQ(REFOP_SYSERROR, ops[0].result);
+
+	close(fd);
+	ASSERT_EQ(REFOP_SUCCESS, refop_batch_wait(batch, -1));
+	ASSERT_EQ(REFOP_SUCCESS, refop_batch_poll(batch));
+	ASSERT_EQ(REFOP_SUCCESS, ops[0].result);
+	ASSERT_EQ(REFOP_SUCCESS, ops[1].result);
+	ASSERT_EQ(REFOP_SUCCESS, ops[2].result);
+	ASSERT_EQ((int64_t)sizeof(buf), szr);
+	ASSERT_EQ(0, memcmp(buf, rbuf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, ops[3].result);
+	ASSERT_EQ((int64_t)sizeof(obuf), oszr);
+	ASSERT_EQ(0, memcmp(obuf, orbuf, sizeof(obuf)));
+	ASSERT_EQ(REFOP_SUCCESS, ops[4].result);
+	ASSERT_EQ(REFOP_NOENT, ops[5].result);
+	ASSERT_EQ(REFOP_SUCCESS, refop_batch_release(batch));
+
+	// A released batch is still done.
+	ops[0] = { REFOP_BATCH_REMOVE, handle, NULL, 0, NULL, REFOP_SYSERROR };
+	ASSERT_EQ(REFOP_SUCCESS, refop_batch_submit(ops, 1, &batch));
+	ASSERT_EQ(REFOP_SUCCESS, refop_batch_release(batch));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	ASSERT_NE(0, access(latestfile, F_OK));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(other));
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+struct async_submit_arg {
+	refop_handle_t handle;
+	volatile bool submitted;
+};
+
+static void *async_submit_thread(void *arg)
+{
+	struct async_submit_arg *sa = (struct async_submit_arg *)arg;
+	uint8_t buf[32];
+
+	memset(buf, 3, sizeof(buf));
+	(void)refop_set_redundancy_data_async(sa->handle, buf, sizeof(buf), NULL);
+	sa->submitted = true;
+
+	return NULL;
+}
+
+TEST_F(interface_test_async, interface_test_async__backpressure)
+{
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+	refop_future_t future1 = NULL, future2 = NULL;
+	struct async_submit_arg sa;
+	pthread_t thread;
+	uint8_t buf[32];
+	int64_t szr = 0;
+	int fd = -1;
+
+	cleanup_files(directry, testfiles);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_pool_configure(1, 2));
+	memset(&opts, 0, sizeof(opts));
+	opts.process_lock = true;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle, directry, file, &opts));
+
+	// The worker waits for the writer lock.
+	fd = hold_lock();
+	ASSERT_LE(0, fd);
+	memset(buf, 1, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data_async(handle, buf, sizeof(buf), &future1));
+	memset(buf, 2, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data_async(handle, buf, sizeof(buf), &future2));
+	ASSERT_EQ(REFOP_BUSY, refop_future_poll(future1));
+	ASSERT_EQ(REFOP_BUSY, refop_future_wait(future2, 50));
+
+	// Queue is full, next operation waits.
+	sa.handle = handle;
+	sa.submitted = false;
+	ASSERT_EQ(0, pthread_create(&thread, NULL, async_submit_thread, &sa));
+	usleep(100 * 1000);
+	ASSERT_FALSE(sa.submitted);
+
+	close(fd);
+	ASSERT_EQ(0, pthread_join(thread, NULL));
+	ASSERT_TRUE(sa.submitted);
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_wait(future1, -1));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_wait(future2, -1));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_release(future1));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_release(future2));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, buf, sizeof(buf), &szr));
+	ASSERT_EQ(3, buf[0]);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+struct async_callback_arg {
+	int calls;
+	refop_error_t result;
+	refop_future_t future;
+};
+
+static void async_callback(refop_future_t future, refop_error_t result, void *ctx)
+{
+	struct async_callback_arg *ca = (struct async_callback_arg *)ctx;
+
+	ca->calls++;
+	ca->result = result;
+	ca->future = future;
+}
+
+TEST_F(interface_test_async, interface_test_async__callback)
+{
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+	refop_future_t future = NULL;
+	struct async_callback_arg ca;
+	uint8_t buf[32];
+	int fd = -1;
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.process_lock = true;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle, directry, file, &opts));
+
+	// Callback by worker.
+	fd = hold_lock();
+	ASSERT_LE(0, fd);
+	memset(&ca, 0, sizeof(ca));
+	memset(buf, 1, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data_async(handle, buf, sizeof(buf), &future));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_set_callback(future, async_callback, &ca));
+	ASSERT_EQ(REFOP_ARGERROR, refop_future_set_callback(future, async_callback, &ca));
+	close(fd);
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_wait(future, -1));
+	// Wait can return before the callback, reconfigure joins the worker.
+	ASSERT_EQ(REFOP_SUCCESS, refop_pool_configure(0, 0));
+	ASSERT_EQ(1, ca.calls);
+	ASSERT_EQ(REFOP_SUCCESS, ca.result);
+	ASSERT_EQ(future, ca.future);
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_release(future));
+
+	// Callback of completed operation is called at once.
+	memset(&ca, 0, sizeof(ca));
+	ASSERT_EQ(REFOP_SUCCESS, refop_verify_redundancy_data_async(handle, &future));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_wait(future, -1));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_set_callback(future, async_callback, &ca));
+	ASSERT_EQ(1, ca.calls);
+	ASSERT_EQ(REFOP_SUCCESS, ca.result);
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_release(future));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+struct async_resubmit_arg {
+	refop_handle_t handle;
+	int entered;
+	refop_error_t result;
+	refop_future_t future;
+};
+
+// Submit next operation after reconfiguration started.
+static void async_resubmit(refop_future_t future, refop_error_t result, void *ctx)
+{
+	struct async_resubmit_arg *ra = (struct async_resubmit_arg *)ctx;
+
+	(void)future;
+	(void)result;
+	__atomic_store_n(&ra->entered, 1, __ATOMIC_RELEASE);
+	usleep(100 * 1000);
+	ra->result = refop_verify_redundancy_data_async(ra->handle, &ra->future);
+}
+
+TEST_F(interface_test_async, interface_test_async__callback_configure)
+{
+	refop_future_t future = NULL;
+	struct async_resubmit_arg ra;
+	uint8_t buf[32];
+
+	cleanup_files(directry, testfiles);
+
+	memset(&ra, 0, sizeof(ra));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&ra.handle, directry, file));
+	memset(buf, 1, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data_async(ra.handle, buf, sizeof(buf), &future));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_set_callback(future, async_resubmit, &ra));
+	while (__atomic_load_n(&ra.entered, __ATOMIC_ACQUIRE) == 0)
+		usleep(1000);
+
+	// Reconfiguration does not wait for the callback that submits while the pool is stopped.
+	ASSERT_EQ(REFOP_SUCCESS, refop_pool_configure(0, 0));
+	ASSERT_EQ(REFOP_SUCCESS, ra.result);
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_poll(ra.future));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_release(ra.future));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_release(future));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(ra.handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(ra.handle));
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_async, interface_test_async__many_handles)
+{
+	refop_handle_t handles[4];
+	refop_future_t futures[4][16];
+	uint8_t buf[256], rbuf[256];
+	int64_t szr = 0;
+	char name[32];
+
+	cleanup_files(directry, testfiles);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_pool_configure(4, 8));
+	for (int h = 0; h < 4; h++) {
+		snprintf(name, sizeof(name), "test-async%d.bin", h);
+		ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handles[h], directry, name));
+	}
+
+	for (int i = 0; i < 16; i++) {
+		for (int h = 0; h < 4; h++) {
+			memset(buf, h * 16 + i, sizeof(buf));
+			ASSERT_EQ(REFOP_SUCCESS,
+				  refop_set_redundancy_data_async(handles[h], buf, sizeof(buf), &futures[h][i]));
+		}
+	}
+
+	for (int h = 0; h < 4; h++) {
+		for (int i = 0; i < 16; i++) {
+			ASSERT_EQ(REFOP_SUCCESS, refop_future_wait(futures[h][i], -1));
+			ASSERT_EQ(REFOP_SUCCESS, refop_future_release(futures[h][i]));
+		}
+		ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handles[h], rbuf, sizeof(rbuf), &szr));
+		ASSERT_EQ(h * 16 + 15, rbuf[0]);
+		ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handles[h]));
+		ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handles[h]));
+	}
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_async, interface_test_async__coalesce)
+{
+	refop_handle_t handle = NULL, reader = NULL;
+	refop_future_t futures[100];
+	uint8_t buf[128], rbuf[128];
+	int64_t szr = 0;
+	refop_future_t future = NULL;
+
+	cleanup_files(directry, testfiles);
+
+	ASSERT_EQ(REFOP_ARGERROR, refop_set_coalesce_window(NULL, 100));
+	ASSERT_EQ(REFOP_ARGERROR, refop_flush_redundancy_data(NULL));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&reader, directry, file));
+	ASSERT_EQ(REFOP_ARGERROR, refop_set_coalesce_window(handle, -1));
+	ASSERT_EQ(REFOP_ARGERROR, refop_set_coalesce_window(handle, REFOP_COALESCE_WINDOW_MAX + 1));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_coalesce_window(handle, 60 * 1000));
+	ASSERT_EQ(REFOP_SUCCESS, refop_flush_redundancy_data(handle));
+
+	// Sets in a window replace each other without file write.
+	for (int i = 0; i < 100; i++) {
+		memset(buf, i, sizeof(buf));
+		ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data_async(handle, buf, sizeof(buf), &futures[i]));
+	}
+	ASSERT_EQ(REFOP_BUSY, refop_future_poll(futures[0]));
+	ASSERT_EQ(REFOP_NOENT, refop_get_redundancy_data(reader, rbuf, sizeof(rbuf), &szr));
+
+	// Gets return the pending value.
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ((int64_t)sizeof(rbuf), szr);
+	ASSERT_EQ(99, rbuf[0]);
+	memset(rbuf, 0, sizeof(rbuf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data_async(handle, rbuf, sizeof(rbuf), &szr, &future));
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_poll(future));
+	ASSERT_EQ(99, rbuf[0]);
+	ASSERT_EQ(REFOP_SUCCESS, refop_future_release(future));
+
+	// Flush writes the newest value once, and completes all replaced sets.
+	ASSERT_EQ(REFOP_SUCCESS, refop_flush_redundancy_data(handle));
+	for (int i = 0; i < 100; i++) {
+		ASSERT_EQ(REFOP_SUCCESS, refop_future_wait(futures[i], -1));
+		ASSERT_EQ(REFOP_SUCCESS, refop_future_release(futures[i]));
+	}
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(reader, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(99, rbuf[0]);
+	ASSERT_EQ(REFOP_NOENT, refop_get_generation(reader, 1, rbuf, sizeof(rbuf), &szr));
+
+	// Release writes the pending value.
+	memset(buf, 7, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data_async(handle, buf, sizeof(buf), NULL));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(reader, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(7, rbuf[0]);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(reader));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(reader));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_async, interface_test_async__coalesce_window)
+{
+	refop_handle_t handle = NULL, reader = NULL;
+	uint8_t buf[128], rbuf[128];
+	int64_t szr = 0;
+	int64_t start = 0;
+
+	cleanup_files(directry, testfiles);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&reader, directry, file));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_coalesce_window(handle, 200));
+
+	// One write per window.
+	start = refop_lock_clock_ms();
+	for (int i = 0; i < 50; i++) {
+		memset(buf, i, sizeof(buf));
+		ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data_async(handle, buf, sizeof(buf), NULL));
+	}
+	while (refop_get_redundancy_data(reader, rbuf, sizeof(rbuf), &szr) == REFOP_NOENT)
+		usleep(10 * 1000);
+	ASSERT_LE(150, refop_lock_clock_ms() - start);
+	ASSERT_EQ(49, rbuf[0]);
+	ASSERT_EQ(REFOP_NOENT, refop_get_generation(reader, 1, rbuf, sizeof(rbuf), &szr));
+
+	// A synchronous operation writes the pending value first.
+	memset(buf, 60, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data_async(handle, buf, sizeof(buf), NULL));
+	memset(buf, 61, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(reader, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(61, rbuf[0]);
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_generation(reader, 1, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(60, rbuf[0]);
+
+	// Disable writes the pending value.
+	memset(buf, 62, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data_async(handle, buf, sizeof(buf), NULL));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_coalesce_window(handle, 0));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(62, rbuf[0]);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(reader));
+}
@@ -0,0 +1,314 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_block.cpp
+ * @brief	Public interface test fot refop block checksum format
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+#include "file-util.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_block : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-block.bin";
+static const char latestfile[] = "/tmp/refop-test/test-block.bin";
+static const char backupfile[] = "/tmp/refop-test/test-block.bin.bk1";
+static const char newfile[] = "/tmp/refop-test/test-block.bin.tmp";
+
+// 3 full blocks and 1 partial block
+static const int64_t datasize = REFOP_BLOCK_SIZE * 3 + 100;
+// header + 4 entry crc table
+static const off_t dataoffset = sizeof(s_refop_file_header_v3) + sizeof(uint16_t) * 4;
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, NULL };
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_block, interface_test_block__arg_error)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t buf[128];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	ret = refop_set_block_checksum(NULL, true);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_get_redundancy_range(NULL, 0, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+	ret = refop_get_redundancy_range(handle, -1, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+	ret = refop_get_redundancy_range(handle, 0, NULL, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+	ret = refop_get_redundancy_range(handle, 0, buf, -1, &szr);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+	ret = refop_get_redundancy_range(handle, 0, buf, sizeof(buf), NULL);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	ret = refop_get_redundancy_range(handle, 0, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_block, interface_test_block_set_get_range__success)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t *wbuf = (uint8_t *)malloc(datasize);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize);
+	s_refop_file_header_v3 head;
+	int64_t szr = 0;
+	int fd = -1;
+
+	cleanup_files(directry, testfiles);
+	create_data(wbuf, datasize, 1);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_block_checksum(handle, true);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	fd = open(latestfile, O_RDONLY);
+	ASSERT_LE(0, fd);
+	ASSERT_EQ(sizeof(head), safe_read(fd, &head, sizeof(head)));
+	(void)close(fd);
+	ASSERT_EQ(0, refop_header_v3_validation(&head));
+	ASSERT_EQ(datasize, head.size);
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(datasize, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, datasize));
+
+	// Cross the block boundary
+	ret = refop_get_redundancy_range(handle, REFOP_BLOCK_SIZE - 10, rbuf, 300, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(300, szr);
+	ASSERT_EQ(0, memcmp(wbuf + REFOP_BLOCK_SIZE - 10, rbuf, 300));
+
+	// Tail of data
+	ret = refop_get_redundancy_range(handle, datasize - 50, rbuf, 300, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(50, szr);
+	ASSERT_EQ(0, memcmp(wbuf + datasize - 50, rbuf, 50));
+
+	// Out of data
+	ret = refop_get_redundancy_range(handle, datasize, rbuf, 300, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, szr);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// Broken block of the latest file is recovered by same block of the backup file.
+TEST_F(interface_test_block, interface_test_block_merge__recover)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t *wbuf = (uint8_t *)malloc(datasize);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize);
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	create_data(wbuf, datasize, 1);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_block_checksum(handle, true);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// Update block 2 only
+	wbuf[REFOP_BLOCK_SIZE * 2 + 5] = ~wbuf[REFOP_BLOCK_SIZE * 2 + 5];
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// Break block 0 of latest file
+	ASSERT_EQ(0, breakfile_data(latestfile, dataoffset + 10));
+
+	ret = refop_get_redundancy_range(handle, REFOP_BLOCK_SIZE * 2, rbuf, REFOP_BLOCK_SIZE, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(REFOP_BLOCK_SIZE, szr);
+	ASSERT_EQ(0, memcmp(wbuf + REFOP_BLOCK_SIZE * 2, rbuf, REFOP_BLOCK_SIZE));
+
+	ret = refop_get_redundancy_range(handle, 0, rbuf, 100, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(100, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, 100));
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(datasize, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, datasize));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// A short buffer gets the head of verified data, and missing blocks of a short file are merged.
+TEST_F(interface_test_block, interface_test_block_merge__short_file)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t *wbuf = (uint8_t *)malloc(datasize);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize);
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	create_data(wbuf, datasize, 2);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_block_checksum(handle, true);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// Update block 0 only
+	wbuf[5] = ~wbuf[5];
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_get_redundancy_data(handle, rbuf, 100, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(100, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, 100));
+
+	// Lost block 2 and 3 of latest file
+	ASSERT_EQ(0, truncate(latestfile, dataoffset + REFOP_BLOCK_SIZE * 2));
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(datasize, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, datasize));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// Broken block that was changed from the backup file could not merge, backup file is used.
+TEST_F(interface_test_block, interface_test_block_merge__fallback_backup)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t *wbuf1 = (uint8_t *)malloc(datasize);
+	uint8_t *wbuf2 = (uint8_t *)malloc(datasize);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize);
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	create_data(wbuf1, datasize, 1);
+	create_data(wbuf2, datasize, 1);
+	wbuf2[REFOP_BLOCK_SIZE * 2 + 5] = ~wbuf2[REFOP_BLOCK_SIZE * 2 + 5];
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_block_checksum(handle, true);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_set_redundancy_data(handle, wbuf1, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_data(handle, wbuf2, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// Break block 2 of latest file
+	ASSERT_EQ(0, breakfile_data(latestfile, dataoffset + REFOP_BLOCK_SIZE * 2 + 10));
+
+	ret = refop_get_redundancy_range(handle, REFOP_BLOCK_SIZE * 2, rbuf, REFOP_BLOCK_SIZE, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(REFOP_BLOCK_SIZE, szr);
+	ASSERT_EQ(0, memcmp(wbuf1 + REFOP_BLOCK_SIZE * 2, rbuf, REFOP_BLOCK_SIZE));
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(datasize, szr);
+	ASSERT_EQ(0, memcmp(wbuf1, rbuf, datasize));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf1);
+	free(wbuf2);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// Legacy backup file is usable for block merge and legacy latest file support range read.
+TEST_F(interface_test_block, interface_test_block_legacy_format)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t *wbuf = (uint8_t *)malloc(datasize);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize);
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	create_data(wbuf, datasize, 1);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_get_redundancy_range(handle, 10, rbuf, 100, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(100, szr);
+	ASSERT_EQ(0, memcmp(wbuf + 10, rbuf, 100));
+
+	ret = refop_set_block_checksum(handle, true);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ASSERT_EQ(0, breakfile_data(latestfile, dataoffset + REFOP_BLOCK_SIZE + 10));
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(datasize, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, datasize));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+}
@@ -0,0 +1,331 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_chunk.cpp
+ * @brief	Public interface test fot refop chunk mode
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <set>
+#include <string>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_chunk : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-chunk.bin";
+static const char latestfile[] = "/tmp/refop-test/test-chunk.bin";
+static const char backupfile[] = "/tmp/refop-test/test-chunk.bin.bk1";
+static const char newfile[] = "/tmp/refop-test/test-chunk.bin.tmp";
+static const char chunkdir[] = "/tmp/refop-test/test-chunk.bin.chk";
+
+//--------------------------------------------------------------------------------------------------------
+static std::set<std::string> chunk_files(void)
+{
+	std::set<std::string> names;
+	struct dirent *ent = NULL;
+	DIR *dp = NULL;
+
+	dp = opendir(chunkdir);
+	if (dp == NULL)
+		return names;
+
+	while ((ent = readdir(dp)) != NULL) {
+		if (ent->d_name[0] != '.')
+			names.insert(ent->d_name);
+	}
+	(void)closedir(dp);
+
+	return names;
+}
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, NULL };
+//--------------------------------------------------------------------------------------------------------
+static void cleanup_chunk_files(void)
+{
+	cleanup_files(directry, testfiles);
+	for (const std::string &name : chunk_files())
+		(void)unlink((std::string(chunkdir) + "/" + name).c_str());
+	(void)rmdir(chunkdir);
+}
+//--------------------------------------------------------------------------------------------------------
+// Content defined chunking needs data without short period.
+static void create_random_data(uint8_t *pbuf, int64_t sz, uint32_t seed)
+{
+	uint32_t v = seed * 2654435761U + 1;
+
+	for (int64_t i = 0; i < sz; i++) {
+		v = v * 1103515245U + 12345U;
+		pbuf[i] = (uint8_t)(v >> 16);
+	}
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_chunk, interface_test_chunk_set_get__success)
+{
+	const int64_t sizes[] = { 1, REFOP_CHUNK_MIN, REFOP_CHUNK_MIN + 1, 100000, 1024 * 1024 };
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	int64_t sz = 1024 * 1024, szr = 0;
+	uint8_t *wbuf = (uint8_t *)malloc(sz);
+	uint8_t *rbuf = (uint8_t *)malloc(sz + 10);
+
+	cleanup_chunk_files();
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_CHUNK);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_get_redundancy_data(handle, rbuf, sz, &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		create_random_data(wbuf, sizes[i], (uint32_t)i);
+		ret = refop_set_redundancy_data(handle, wbuf, sizes[i]);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+
+		memset(rbuf, 0, sz + 10);
+		ret = refop_get_redundancy_data(handle, rbuf, sz + 10, &szr);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+		ASSERT_EQ(sizes[i], szr);
+		ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+	}
+
+	// Small buffer
+	ret = refop_get_redundancy_data(handle, rbuf, 10000, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(10000, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	// Over size limit
+	ret = refop_set_redundancy_data(handle, wbuf, sz + 1);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+	cleanup_chunk_files();
+}
+//--------------------------------------------------------------------------------------------------------
+// Partial change write only chunks around the change, and the backup generation is kept.
+TEST_F(interface_test_chunk, interface_test_chunk_dedup)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	int64_t sz = 512 * 1024, szr = 0;
+	uint8_t *wbuf = (uint8_t *)malloc(sz);
+	uint8_t *rbuf = (uint8_t *)malloc(sz);
+	std::set<std::string> first, second;
+	size_t added = 0;
+
+	cleanup_chunk_files();
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_CHUNK);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	create_random_data(wbuf, sz, 1);
+	ret = refop_set_redundancy_data(handle, wbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	first = chunk_files();
+	ASSERT_LT(8u, first.size());
+
+	// Insert 100 bytes to the middle.
+	memmove(wbuf + 200100, wbuf + 200000, sz - 200100);
+	create_random_data(wbuf + 200000, 100, 2);
+	ret = refop_set_redundancy_data(handle, wbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	second = chunk_files();
+
+	for (const std::string &name : second) {
+		if (first.count(name) == 0)
+			added++;
+	}
+	ASSERT_LE(1u, added);
+	ASSERT_GE(3u, added);
+
+	ret = refop_get_redundancy_data(handle, rbuf, sz, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(sz, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	create_random_data(wbuf, sz, 1);
+	ret = refop_get_generation(handle, 1, rbuf, sz, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(sz, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+	cleanup_chunk_files();
+}
+//--------------------------------------------------------------------------------------------------------
+// Chunks that are not referenced by the latest and the backup are collected.
+TEST_F(interface_test_chunk, interface_test_chunk_collect)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	int64_t sz = 100000;
+	uint8_t *wbuf = (uint8_t *)malloc(sz);
+	std::set<std::string> only;
+
+	cleanup_chunk_files();
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_CHUNK);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	create_random_data(wbuf, sz, 30);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, wbuf, sz));
+	only = chunk_files();
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handle));
+	ASSERT_NE(0, access(chunkdir, F_OK));
+
+	for (uint32_t seed = 10; seed < 13; seed++) {
+		create_random_data(wbuf, sz, seed);
+		ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, wbuf, sz));
+	}
+
+	// Leftover of interrupted write.
+	ASSERT_EQ(0, close(open((std::string(chunkdir) + "/0123.tmp").c_str(), O_CREAT | O_WRONLY, 0600)));
+
+	create_random_data(wbuf, sz, 30);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, wbuf, sz));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, wbuf, sz));
+	ASSERT_EQ(only, chunk_files());
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	cleanup_chunk_files();
+}
+//--------------------------------------------------------------------------------------------------------
+// Broken chunk of the latest is recovered from the backup, broken shared chunk is not recoverable.
+TEST_F(interface_test_chunk, interface_test_chunk_broken)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	int64_t sz = 200000, szr = 0;
+	uint8_t *wbuf = (uint8_t *)malloc(sz);
+	uint8_t *rbuf = (uint8_t *)malloc(sz);
+	std::set<std::string> first, second;
+	std::string changed, shared;
+
+	cleanup_chunk_files();
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_CHUNK);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	create_random_data(wbuf, sz, 5);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, wbuf, sz));
+	first = chunk_files();
+
+	create_random_data(wbuf + 100000, 10, 6);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, wbuf, sz));
+	second = chunk_files();
+
+	for (const std::string &name : second) {
+		if (first.count(name) == 0)
+			changed = name;
+		else
+			shared = name;
+	}
+	ASSERT_FALSE(changed.empty());
+	ASSERT_FALSE(shared.empty());
+
+	// Changed chunk
+	ASSERT_EQ(0, breakfile_data((std::string(chunkdir) + "/" + changed).c_str(), 0));
+	ret = refop_get_redundancy_data(handle, rbuf, sz, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	create_random_data(wbuf, sz, 5);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	ret = refop_get_generation(handle, 0, rbuf, sz, &szr);
+	ASSERT_EQ(REFOP_BROKEN, ret);
+
+	// Next set rewrite the broken chunk.
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, wbuf, sz));
+	ret = refop_get_redundancy_data(handle, rbuf, sz, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	// Shared chunk
+	ASSERT_EQ(0, unlink((std::string(chunkdir) + "/" + shared).c_str()));
+	ret = refop_get_redundancy_data(handle, rbuf, sz, &szr);
+	ASSERT_EQ(REFOP_BROKEN, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+	cleanup_chunk_files();
+}
+//--------------------------------------------------------------------------------------------------------
+// Broken manifest is recovered from the backup manifest.
+TEST_F(interface_test_chunk, interface_test_chunk_broken_manifest)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	int64_t sz = 50000, szr = 0;
+	uint8_t *wbuf = (uint8_t *)malloc(sz);
+	uint8_t *rbuf = (uint8_t *)malloc(sz);
+
+	cleanup_chunk_files();
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_CHUNK);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	create_random_data(wbuf, sz, 7);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, wbuf, sz));
+	create_random_data(rbuf, sz, 8);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, rbuf, sz));
+
+	ASSERT_EQ(0, breakfile_data(latestfile, 40));
+	ret = refop_get_redundancy_data(handle, rbuf, sz, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(sz, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	ret = refop_remove_redundancy_data(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_NE(0, access(chunkdir, F_OK));
+	ret = refop_get_redundancy_data(handle, rbuf, sz, &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+	cleanup_chunk_files();
+}
+//--------------------------------------------------------------------------------------------------------
@@ -0,0 +1,259 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_compress.cpp
+ * @brief	Public interface test fot refop compression
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+#include "file-util.h"
+#include "lz-codec.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_compress : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-compress.bin";
+static const char latestfile[] = "/tmp/refop-test/test-compress.bin";
+static const char backupfile[] = "/tmp/refop-test/test-compress.bin.bk1";
+static const char newfile[] = "/tmp/refop-test/test-compress.bin.tmp";
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, NULL };
+//--------------------------------------------------------------------------------------------------------
+static uint32_t read_version(const char *file)
+{
+	s_refop_file_header head;
+	int fd = -1;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	if (safe_read(fd, &head, sizeof(head)) != sizeof(head))
+		head.version = 0;
+	(void)close(fd);
+
+	return head.version;
+}
+//--------------------------------------------------------------------------------------------------------
+// Config like text with many repeats
+static void create_text_data(uint8_t *pbuf, int64_t sz, int seed)
+{
+	int64_t pos = 0;
+	char line[64];
+
+	while (pos < sz) {
+		int len = snprintf(line, sizeof(line), "{\"key%d\": %d, \"value\": \"setting\"},\n", (int)(pos % 97), seed);
+		for (int i = 0; i < len && pos < sz; i++)
+			pbuf[pos++] = (uint8_t)line[i];
+	}
+}
+//--------------------------------------------------------------------------------------------------------
+static void create_random_data(uint8_t *pbuf, int64_t sz, uint32_t seed)
+{
+	for (int64_t i = 0; i < sz; i++) {
+		seed = seed * 1103515245 + 12345;
+		pbuf[i] = (uint8_t)(seed >> 16);
+	}
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_compress, interface_test_compress_lz_codec)
+{
+	const int64_t sizes[] = { 1, 12, 13, 64, 300, 4096, 70000, 1024 * 1024 };
+	int64_t csize = 0, dsize = 0;
+	uint8_t *src = (uint8_t *)malloc(1024 * 1024);
+	uint8_t *cbuf = (uint8_t *)malloc(1024 * 1024 * 2);
+	uint8_t *dbuf = (uint8_t *)malloc(1024 * 1024);
+
+	for (auto sz : sizes) {
+		// zero filled
+		memset(src, 0, sz);
+		csize = lz_compress(src, sz, cbuf, 1024 * 1024 * 2);
+		ASSERT_LT(0, csize);
+		dsize = lz_decompress(cbuf, csize, dbuf, sz);
+		ASSERT_EQ(sz, dsize);
+		ASSERT_EQ(0, memcmp(src, dbuf, sz));
+
+		// text
+		create_text_data(src, sz, 1);
+		csize = lz_compress(src, sz, cbuf, 1024 * 1024 * 2);
+		ASSERT_LT(0, csize);
+		dsize = lz_decompress(cbuf, csize, dbuf, sz);
+		ASSERT_EQ(sz, dsize);
+		ASSERT_EQ(0, memcmp(src, dbuf, sz));
+
+		// random
+		create_random_data(src, sz, 2);
+		csize = lz_compress(src, sz, cbuf, 1024 * 1024 * 2);
+		ASSERT_LT(0, csize);
+		dsize = lz_decompress(cbuf, csize, dbuf, sz);
+		ASSERT_EQ(sz, dsize);
+		ASSERT_EQ(0, memcmp(src, dbuf, sz));
+	}
+
+	// Output buffer too small
+	create_random_data(src, 4096, 3);
+	ASSERT_EQ(-1, lz_compress(src, 4096, cbuf, 4000));
+	csize = lz_compress(src, 4096, cbuf, 1024 * 1024 * 2);
+	ASSERT_EQ(-1, lz_decompress(cbuf, csize, dbuf, 4000));
+
+	// Malformed data, invalid offset
+	cbuf[0] = 0x10;
+	cbuf[1] = 'a';
+	cbuf[2] = 0x10;
+	cbuf[3] = 0x00;
+	ASSERT_EQ(-1, lz_decompress(cbuf, 4, dbuf, 4096));
+
+	free(src);
+	free(cbuf);
+	free(dbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_compress, interface_test_compress__arg_error)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+
+	ret = refop_set_compression(NULL, true);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_compress, interface_test_compress_set_get__success)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	int64_t sz = 64 * 1024, szr = 0;
+	uint8_t *wbuf = (uint8_t *)malloc(sz);
+	uint8_t *rbuf = (uint8_t *)malloc(sz);
+	struct stat sb;
+
+	cleanup_files(directry, testfiles);
+	create_text_data(wbuf, sz, 10);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_compression(handle, true);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_set_redundancy_data(handle, wbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ASSERT_EQ(REFOP_FILE_HEADER_VERSION_V5, read_version(latestfile));
+	ASSERT_EQ(0, stat(latestfile, &sb));
+	ASSERT_GT(sz / 4, sb.st_size);
+
+	ret = refop_get_redundancy_data(handle, rbuf, sz, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(sz, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, sz));
+
+	// Smaller read buffer
+	memset(rbuf, 0, sz);
+	ret = refop_get_redundancy_data(handle, rbuf, 100, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(100, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, 100));
+
+	// Range read is served by full read
+	ret = refop_get_redundancy_range(handle, 1000, rbuf, 100, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(100, szr);
+	ASSERT_EQ(0, memcmp(wbuf + 1000, rbuf, 100));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// Small or incompressible data is written without compression.
+TEST_F(interface_test_compress, interface_test_compress_no_gain)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	int64_t sz = 4096, szr = 0;
+	uint8_t *wbuf = (uint8_t *)malloc(sz);
+	uint8_t *rbuf = (uint8_t *)malloc(sz);
+
+	cleanup_files(directry, testfiles);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_compression(handle, true);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	create_random_data(wbuf, sz, 4);
+	ret = refop_set_redundancy_data(handle, wbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(REFOP_FILE_HEADER_VERSION_V1, read_version(latestfile));
+
+	ret = refop_get_redundancy_data(handle, rbuf, sz, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(sz, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, sz));
+
+	memset(wbuf, 0, sz);
+	ret = refop_set_redundancy_data(handle, wbuf, REFOP_COMPRESS_MIN_SIZE - 1);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(REFOP_FILE_HEADER_VERSION_V1, read_version(latestfile));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// Broken compressed data is detected by crc before decompression, and backup file is used.
+TEST_F(interface_test_compress, interface_test_compress_broken__recover)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	int64_t sz = 16 * 1024, szr = 0;
+	uint8_t *wbuf1 = (uint8_t *)malloc(sz);
+	uint8_t *wbuf2 = (uint8_t *)malloc(sz);
+	uint8_t *rbuf = (uint8_t *)malloc(sz);
+
+	cleanup_files(directry, testfiles);
+	create_text_data(wbuf1, sz, 1);
+	create_text_data(wbuf2, sz, 2);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_compression(handle, true);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_set_redundancy_data(handle, wbuf1, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_data(handle, wbuf2, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ASSERT_EQ(0, breakfile_data(latestfile, sizeof(s_refop_file_header_v5) + 10));
+
+	ret = refop_get_redundancy_data(handle, rbuf, sz, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(sz, szr);
+	ASSERT_EQ(0, memcmp(wbuf1, rbuf, sz));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf1);
+	free(wbuf2);
+	free(rbuf);
+}
@@ -0,0 +1,266 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_container.cpp
+ * @brief	Public interface test fot refop container
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+#include "../lib/refop-container.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_container : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-container.bin";
+static const char containerfile0[] = "/tmp/refop-test/test-container.bin.g0";
+static const char containerfile1[] = "/tmp/refop-test/test-container.bin.g1";
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { containerfile0, containerfile1, NULL };
+//--------------------------------------------------------------------------------------------------------
+static void make_key(char *key, size_t len, int i)
+{
+	(void)snprintf(key, len, "key-%04d", i);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_container, interface_test_container_set_commit_get__success)
+{
+	refop_container_t container = NULL;
+	refop_error_t ret = REFOP_SUCCESS;
+	uint8_t value[64], readbuf[64];
+	int64_t getsize = 0;
+	char key[32];
+
+	cleanup_files(directry, testfiles);
+
+	ret = refop_container_open(&container, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// Empty container
+	ret = refop_container_get(container, "nothing", readbuf, sizeof(readbuf), &getsize);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	// Staged values are visible before commit, nothing is written.
+	for (int i = 0; i < 100; i++) {
+		make_key(key, sizeof(key), i);
+		memset(value, i, sizeof(value));
+		ret = refop_container_set(container, key, value, (i % 60) + 1);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+	}
+	ret = refop_container_get(container, "key-0042", readbuf, sizeof(readbuf), &getsize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ((42 % 60) + 1, getsize);
+	ASSERT_EQ(-1, access(containerfile0, F_OK));
+
+	ret = refop_container_commit(container);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, access(containerfile0, F_OK));
+	ASSERT_EQ(-1, access(containerfile1, F_OK));
+
+	for (int i = 0; i < 100; i++) {
+		make_key(key, sizeof(key), i);
+		memset(value, i, sizeof(value));
+		ret = refop_container_get(container, key, readbuf, sizeof(readbuf), &getsize);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+		ASSERT_EQ((i % 60) + 1, getsize);
+		ASSERT_EQ(0, memcmp(value, readbuf, getsize));
+	}
+
+	// Small buffer
+	ret = refop_container_get(container, "key-0050", readbuf, 4, &getsize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(4, getsize);
+
+	ret = refop_container_close(container);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// Reopen
+	ret = refop_container_open(&container, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	for (int i = 0; i < 100; i++) {
+		make_key(key, sizeof(key), i);
+		memset(value, i, sizeof(value));
+		ret = refop_container_get(container, key, readbuf, sizeof(readbuf), &getsize);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+		ASSERT_EQ((i % 60) + 1, getsize);
+		ASSERT_EQ(0, memcmp(value, readbuf, getsize));
+	}
+	ret = refop_container_close(container);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_container, interface_test_container_update_delete)
+{
+	refop_container_t container = NULL;
+	refop_error_t ret = REFOP_SUCCESS;
+	uint8_t value[16], readbuf[16];
+	int64_t getsize = 0;
+
+	cleanup_files(directry, testfiles);
+
+	ret = refop_container_open(&container, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	memset(value, 0xa1, sizeof(value));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_set(container, "alpha", value, sizeof(value)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_set(container, "beta", value, sizeof(value)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_set(container, "gamma", value, sizeof(value)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_commit(container));
+
+	// Update, delete and add in one batch.
+	memset(value, 0xb2, sizeof(value));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_set(container, "alpha", value, 8));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_delete(container, "beta"));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_set(container, "delta", value, sizeof(value)));
+
+	// Staged delete hides committed value.
+	ret = refop_container_get(container, "beta", readbuf, sizeof(readbuf), &getsize);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_commit(container));
+	ASSERT_EQ(0, access(containerfile1, F_OK));
+
+	ret = refop_container_get(container, "alpha", readbuf, sizeof(readbuf), &getsize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(8, getsize);
+	ASSERT_EQ(0, memcmp(value, readbuf, getsize));
+
+	ret = refop_container_get(container, "beta", readbuf, sizeof(readbuf), &getsize);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	memset(value, 0xa1, sizeof(value));
+	ret = refop_container_get(container, "gamma", readbuf, sizeof(readbuf), &getsize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(value, readbuf, getsize));
+
+	ret = refop_container_get(container, "delta", readbuf, sizeof(readbuf), &getsize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// Delete of not existing key is not error.
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_delete(container, "epsilon"));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_commit(container));
+
+	ret = refop_container_close(container);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_container, interface_test_container_close_discard)
+{
+	refop_container_t container = NULL;
+	refop_error_t ret = REFOP_SUCCESS;
+	uint8_t value[16], readbuf[16];
+	int64_t getsize = 0;
+
+	cleanup_files(directry, testfiles);
+
+	memset(value, 0x5a, sizeof(value));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_open(&container, directry, file));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_set(container, "keep", value, sizeof(value)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_commit(container));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_set(container, "lost", value, sizeof(value)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_close(container));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_open(&container, directry, file));
+	ret = refop_container_get(container, "keep", readbuf, sizeof(readbuf), &getsize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_container_get(container, "lost", readbuf, sizeof(readbuf), &getsize);
+	ASSERT_EQ(REFOP_NOENT, ret);
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_close(container));
+
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_container, interface_test_container_broken_recover)
+{
+	refop_container_t container = NULL;
+	refop_error_t ret = REFOP_SUCCESS;
+	uint8_t value[32], readbuf[32];
+	int64_t getsize = 0;
+
+	cleanup_files(directry, testfiles);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_open(&container, directry, file));
+	memset(value, 0x11, sizeof(value));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_set(container, "item", value, sizeof(value)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_commit(container));
+	memset(value, 0x22, sizeof(value));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_set(container, "item", value, sizeof(value)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_commit(container));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_close(container));
+
+	// Break newest container file, previous batch is used.
+	ASSERT_EQ(0, breakfile_data(containerfile1, sizeof(s_refop_file_header_v2) + 30));
+
+	ret = refop_container_open(&container, directry, file);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	memset(value, 0x11, sizeof(value));
+	ret = refop_container_get(container, "item", readbuf, sizeof(readbuf), &getsize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(value, readbuf, getsize));
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_close(container));
+
+	// Break both files.
+	ASSERT_EQ(0, breakfile_data(containerfile0, sizeof(s_refop_file_header_v2) + 30));
+	ret = refop_container_open(&container, directry, file);
+	ASSERT_EQ(REFOP_BROKEN, ret);
+
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_container, interface_test_container_arg_error)
+{
+	refop_container_t container = NULL;
+	uint8_t value[16];
+	int64_t getsize = 0;
+	char longkey[REFOP_CONTAINER_KEY_MAX + 2];
+
+	cleanup_files(directry, testfiles);
+
+	memset(longkey, 'k', sizeof(longkey) - 1);
+	longkey[sizeof(longkey) - 1] = '\0';
+	memset(value, 0, sizeof(value));
+
+	ASSERT_EQ(REFOP_ARGERROR, refop_container_open(NULL, directry, file));
+	ASSERT_EQ(REFOP_ARGERROR, refop_container_open(&container, NULL, file));
+	ASSERT_EQ(REFOP_NOENT, refop_container_open(&container, "/tmp/refop-test-nothing/", file));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_open(&container, directry, file));
+	ASSERT_EQ(REFOP_ARGERROR, refop_container_set(NULL, "key", value, sizeof(value)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_container_set(container, NULL, value, sizeof(value)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_container_set(container, "", value, sizeof(value)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_container_set(container, longkey, value, sizeof(value)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_container_set(container, "key", NULL, sizeof(value)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_container_delete(container, NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_container_get(container, "key", value, sizeof(value), NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_container_get(container, NULL, value, sizeof(value), &getsize));
+	ASSERT_EQ(REFOP_ARGERROR, refop_container_commit(NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_container_close(NULL));
+
+	// Nothing to commit
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_commit(container));
+	ASSERT_EQ(-1, access(containerfile0, F_OK));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_container_close(container));
+
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
@@ -0,0 +1,428 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_delta.cpp
+ * @brief	Public interface test fot refop delta mode
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_delta : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-delta.bin";
+static const char latestfile[] = "/tmp/refop-test/test-delta.bin";
+static const char backupfile[] = "/tmp/refop-test/test-delta.bin.bk1";
+static const char newfile[] = "/tmp/refop-test/test-delta.bin.tmp";
+static const char deltafile[] = "/tmp/refop-test/test-delta.bin.dlt";
+
+static const int64_t datasize = 200 * 1024;
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, deltafile, NULL };
+//--------------------------------------------------------------------------------------------------------
+static off_t file_size(const char *file)
+{
+	struct stat sb;
+
+	if (stat(file, &sb) < 0)
+		return -1;
+
+	return sb.st_size;
+}
+//--------------------------------------------------------------------------------------------------------
+static refop_handle_t create_delta_handle(void)
+{
+	refop_handle_t handle = NULL;
+
+	if (refop_create_redundancy_handle(&handle, directry, file) != REFOP_SUCCESS)
+		return NULL;
+	if (refop_set_redundancy_mode(handle, REFOP_MODE_DELTA) != REFOP_SUCCESS)
+		return NULL;
+
+	return handle;
+}
+//--------------------------------------------------------------------------------------------------------
+// Small edit is stored as delta record, and other handle can reconstruct it.
+TEST_F(interface_test_delta, interface_test_delta_set_get__success)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL, handle2 = NULL;
+	uint8_t *wbuf = (uint8_t *)malloc(datasize + 100);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize + 100);
+	int64_t szr = 0;
+	off_t keyframe_size = 0;
+
+	cleanup_files(directry, testfiles);
+	create_data(wbuf, datasize + 100, 1);
+
+	handle = create_delta_handle();
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	// keyframe
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	keyframe_size = file_size(latestfile);
+	ASSERT_EQ((off_t)(datasize + sizeof(s_refop_file_header)), keyframe_size);
+
+	// delta
+	wbuf[100] = ~wbuf[100];
+	wbuf[150000] = ~wbuf[150000];
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(keyframe_size, file_size(latestfile));
+	ASSERT_NE(0, access(backupfile, F_OK));
+	ASSERT_GT(200, file_size(deltafile));
+
+	// grow
+	ret = refop_set_redundancy_data(handle, wbuf, datasize + 100);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// shrink
+	wbuf[10] = ~wbuf[10];
+	ret = refop_set_redundancy_data(handle, wbuf, datasize - 100);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_NE(0, access(backupfile, F_OK));
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize + 100, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(datasize - 100, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	handle2 = create_delta_handle();
+	ASSERT_NE(nullptr, handle2);
+	ret = refop_get_redundancy_data(handle2, rbuf, datasize + 100, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(datasize - 100, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	ret = refop_remove_redundancy_data(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_NE(0, access(deltafile, F_OK));
+	ASSERT_NE(0, access(latestfile, F_OK));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_release_redundancy_handle(handle2);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// Delta chain is bounded, and large change is written as keyframe.
+TEST_F(interface_test_delta, interface_test_delta_keyframe)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t *wbuf = (uint8_t *)malloc(datasize);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize);
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	create_data(wbuf, datasize, 2);
+
+	handle = create_delta_handle();
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	for (int i = 0; i < REFOP_DELTA_CHAIN_MAX; i++) {
+		wbuf[i * 10] = ~wbuf[i * 10];
+		ret = refop_set_redundancy_data(handle, wbuf, datasize);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+	}
+	ASSERT_LT(0, file_size(deltafile));
+	ASSERT_NE(0, access(backupfile, F_OK));
+
+	// Chain is full, next set is keyframe.
+	wbuf[5] = ~wbuf[5];
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, file_size(deltafile));
+	ASSERT_EQ(0, access(backupfile, F_OK));
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, datasize));
+
+	// Large change is keyframe.
+	wbuf[5] = ~wbuf[5];
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_LT(0, file_size(deltafile));
+	create_data(wbuf, datasize, 3);
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, file_size(deltafile));
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, datasize));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// Broken delta record is dropped and previous generation is returned.
+TEST_F(interface_test_delta, interface_test_delta_broken__recover)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t *wbuf1 = (uint8_t *)malloc(datasize);
+	uint8_t *wbuf2 = (uint8_t *)malloc(datasize);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize);
+	int64_t szr = 0;
+	off_t first_record = 0;
+
+	cleanup_files(directry, testfiles);
+	create_data(wbuf1, datasize, 4);
+
+	handle = create_delta_handle();
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_set_redundancy_data(handle, wbuf1, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	wbuf1[1000] = ~wbuf1[1000];
+	ret = refop_set_redundancy_data(handle, wbuf1, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	first_record = file_size(deltafile);
+
+	memcpy(wbuf2, wbuf1, datasize);
+	wbuf2[2000] = ~wbuf2[2000];
+	ret = refop_set_redundancy_data(handle, wbuf2, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ASSERT_EQ(0, breakfile_data(deltafile, first_record + sizeof(s_refop_file_header_v6) + 2));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	handle = create_delta_handle();
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(0, memcmp(wbuf1, rbuf, datasize));
+
+	// New record replace broken record.
+	ret = refop_set_redundancy_data(handle, wbuf2, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(first_record * 2, file_size(deltafile));
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf2, rbuf, datasize));
+
+	// Broken keyframe without backup keyframe is not recoverable.
+	ASSERT_EQ(0, breakfile_data(latestfile, sizeof(s_refop_file_header) + 10));
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_BROKEN, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf1);
+	free(wbuf2);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// The writing handle reads the cached generation, and a broken newest record is still detected.
+TEST_F(interface_test_delta, interface_test_delta_cached_get)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t *wbuf1 = (uint8_t *)malloc(datasize);
+	uint8_t *wbuf2 = (uint8_t *)malloc(datasize);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize);
+	int64_t szr = 0;
+	off_t first_record = 0;
+
+	cleanup_files(directry, testfiles);
+	create_data(wbuf1, datasize, 7);
+
+	handle = create_delta_handle();
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_set_redundancy_data(handle, wbuf1, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	wbuf1[100] = ~wbuf1[100];
+	ret = refop_set_redundancy_data(handle, wbuf1, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	first_record = file_size(deltafile);
+
+	memcpy(wbuf2, wbuf1, datasize);
+	wbuf2[200] = ~wbuf2[200];
+	ret = refop_set_redundancy_data(handle, wbuf2, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(datasize, szr);
+	ASSERT_EQ(0, memcmp(wbuf2, rbuf, datasize));
+
+	// Short buffer gets the head of the cached generation.
+	ret = refop_get_redundancy_data(handle, rbuf, 1000, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(1000, szr);
+	ASSERT_EQ(0, memcmp(wbuf2, rbuf, 1000));
+
+	ASSERT_EQ(0, breakfile_data(deltafile, first_record + sizeof(s_refop_file_header_v6) + 2));
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(0, memcmp(wbuf1, rbuf, datasize));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf1);
+	free(wbuf2);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// Delta records of old keyframe are ignored, it happen by power loss before truncate.
+TEST_F(interface_test_delta, interface_test_delta_stale_records)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t *wbuf = (uint8_t *)malloc(datasize);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize);
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	create_data(wbuf, datasize, 5);
+
+	handle = create_delta_handle();
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	wbuf[1] = ~wbuf[1];
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, rename(deltafile, "/tmp/refop-test/test-delta.save"));
+
+	create_data(wbuf, datasize, 6);
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, rename("/tmp/refop-test/test-delta.save", deltafile));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	handle = create_delta_handle();
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, datasize));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// A value larger than the size limit of a handle is not reconstructed by the handle, and it is kept.
+TEST_F(interface_test_delta, interface_test_delta_size_limit)
+{
+	refop_handle_t large = NULL, normal = NULL;
+	refop_options_t opts;
+	int64_t sz = 2 * 1024 * 1024, szr = 0;
+	uint8_t *wbuf = (uint8_t *)malloc(sz);
+	uint8_t *rbuf = (uint8_t *)malloc(sz);
+	off_t dsize = 0;
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.size_limit = 8 * 1024 * 1024;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&large, directry, file, &opts));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(large, REFOP_MODE_DELTA));
+
+	create_data(wbuf, sz, 3);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(large, wbuf, sz));
+	wbuf[10] = ~wbuf[10];
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(large, wbuf, sz));
+	dsize = file_size(deltafile);
+	ASSERT_LT(0, dsize);
+
+	normal = create_delta_handle();
+	ASSERT_NE(nullptr, normal);
+	ASSERT_EQ(REFOP_SYSERROR, refop_get_redundancy_data(normal, rbuf, REFOP_DATA_SIZE_LIMIT_DEFAULT, &szr));
+	ASSERT_EQ(dsize, file_size(deltafile));
+	ASSERT_EQ(0, access(latestfile, F_OK));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(large, rbuf, sz, &szr));
+	ASSERT_EQ(sz, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, sz));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(large));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(normal));
+
+	free(wbuf);
+	free(rbuf);
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_delta, interface_test_delta_get_generation)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t *wbuf = (uint8_t *)malloc(datasize);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize);
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	memset(wbuf, 0, datasize);
+
+	handle = create_delta_handle();
+	ASSERT_NE(nullptr, handle);
+
+	// keyframe 0 and 1, delta 2 and 3
+	for (int i = 0; i < 4; i++) {
+		if (i == 1)
+			memset(wbuf, 0xff, datasize);
+		wbuf[0] = (uint8_t)i;
+		ret = refop_set_redundancy_data(handle, wbuf, datasize);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+	}
+
+	for (int n = 0; n < 4; n++) {
+		ret = refop_get_generation(handle, n, rbuf, datasize, &szr);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+		ASSERT_EQ(datasize, szr);
+		ASSERT_EQ((uint8_t)(3 - n), rbuf[0]);
+	}
+
+	ret = refop_get_generation(handle, 4, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+}
@@ -0,0 +1,205 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_direct.cpp
+ * @brief	Public interface test fot refop direct I/O format
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_direct : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-direct.bin";
+static const char latestfile[] = "/tmp/refop-test/test-direct.bin";
+static const char backupfile[] = "/tmp/refop-test/test-direct.bin.bk1";
+static const char newfile[] = "/tmp/refop-test/test-direct.bin.tmp";
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, NULL };
+//--------------------------------------------------------------------------------------------------------
+static off_t file_size(const char *file)
+{
+	struct stat sb;
+
+	if (stat(file, &sb) < 0)
+		return -1;
+
+	return sb.st_size;
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_direct, interface_test_direct__arg_error)
+{
+	ASSERT_EQ(REFOP_ARGERROR, refop_set_direct_io(NULL, true));
+}
+//--------------------------------------------------------------------------------------------------------
+// Header page and data tail are aligned for any data size.
+TEST_F(interface_test_direct, interface_test_direct_set_get__success)
+{
+	const int64_t sizes[] = { 1, 100, REFOP_DIRECT_ALIGN - 1, REFOP_DIRECT_ALIGN, REFOP_DIRECT_ALIGN + 1,
+				  256 * 1024 + 7 };
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	int64_t sz = 256 * 1024 + 7, szr = 0;
+	uint8_t *wbuf = (uint8_t *)malloc(sz);
+	uint8_t *rbuf = (uint8_t *)malloc(sz + 10);
+	s_refop_file_header_v7 head;
+	int fd = -1;
+
+	cleanup_files(directry, testfiles);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_direct_io(handle, true);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		create_data(wbuf, sizes[i], (uint8_t)i);
+		ret = refop_set_redundancy_data(handle, wbuf, sizes[i]);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+
+		ASSERT_EQ(0, file_size(latestfile) % REFOP_DIRECT_ALIGN);
+		ASSERT_EQ(REFOP_DIRECT_ALIGN + ((sizes[i] + REFOP_DIRECT_ALIGN - 1) / REFOP_DIRECT_ALIGN) * REFOP_DIRECT_ALIGN,
+			  file_size(latestfile));
+
+		memset(rbuf, 0, sz + 10);
+		ret = refop_get_redundancy_data(handle, rbuf, sz + 10, &szr);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+		ASSERT_EQ(sizes[i], szr);
+		ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+	}
+
+	fd = open(latestfile, O_RDONLY);
+	ASSERT_LE(0, fd);
+	ASSERT_EQ((ssize_t)sizeof(head), read(fd, &head, sizeof(head)));
+	(void)close(fd);
+	ASSERT_EQ(REFOP_FILE_HEADER_VERSION_V7, head.version);
+	ASSERT_EQ((uint32_t)REFOP_DIRECT_ALIGN, head.data_offset);
+
+	// Small buffer
+	ret = refop_get_redundancy_data(handle, rbuf, 10, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(10, szr);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+// Direct I/O format and legacy format are read regardless of the setting.
+TEST_F(interface_test_direct, interface_test_direct_mixed_format)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t wbuf[1000], rbuf[1000];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	create_data(wbuf, sizeof(wbuf), 1);
+	ret = refop_set_redundancy_data(handle, wbuf, sizeof(wbuf));
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_set_direct_io(handle, true);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	create_data(wbuf, sizeof(wbuf), 2);
+	ret = refop_set_redundancy_data(handle, wbuf, sizeof(wbuf));
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_set_direct_io(handle, false);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	// Backup is legacy format.
+	create_data(wbuf, sizeof(wbuf), 1);
+	ret = refop_get_generation(handle, 1, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+// Broken data and broken header page are recovered from backup.
+TEST_F(interface_test_direct, interface_test_direct_broken__recover)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t wbuf[10000], rbuf[10000];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_direct_io(handle, true);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// broken data
+	create_data(wbuf, sizeof(wbuf), 1);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, wbuf, sizeof(wbuf)));
+	create_data(rbuf, sizeof(rbuf), 2);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, rbuf, sizeof(rbuf)));
+	ASSERT_EQ(0, breakfile_data(latestfile, REFOP_DIRECT_ALIGN + 5000));
+
+	ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	// broken header
+	cleanup_files(directry, testfiles);
+	create_data(wbuf, sizeof(wbuf), 3);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, wbuf, sizeof(wbuf)));
+	create_data(rbuf, sizeof(rbuf), 4);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, rbuf, sizeof(rbuf)));
+	ASSERT_EQ(0, breakfile_data(latestfile, 40));
+
+	ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	// truncated tail
+	cleanup_files(directry, testfiles);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, wbuf, sizeof(wbuf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, rbuf, sizeof(rbuf)));
+	ASSERT_EQ(0, truncate(latestfile, REFOP_DIRECT_ALIGN * 2));
+
+	ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
@@ -0,0 +1,399 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_journal.cpp
+ * @brief	Public interface test fot refop journal mode
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_journal : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-journal.bin";
+static const char latestfile[] = "/tmp/refop-test/test-journal.bin";
+static const char backupfile[] = "/tmp/refop-test/test-journal.bin.bk1";
+static const char newfile[] = "/tmp/refop-test/test-journal.bin.tmp";
+static const char journalfile[] = "/tmp/refop-test/test-journal.bin.jnl";
+
+static const int64_t datasize = 64;
+static const off_t recordsize = (off_t)(sizeof(s_refop_file_header_v6) + datasize);
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, journalfile, NULL };
+//--------------------------------------------------------------------------------------------------------
+static off_t file_size(const char *file)
+{
+	struct stat sb;
+
+	if (stat(file, &sb) < 0)
+		return -1;
+
+	return sb.st_size;
+}
+//--------------------------------------------------------------------------------------------------------
+static refop_handle_t create_journal_handle(void)
+{
+	refop_handle_t handle = NULL;
+
+	if (refop_create_redundancy_handle(&handle, directry, file) != REFOP_SUCCESS)
+		return NULL;
+	if (refop_set_redundancy_mode(handle, REFOP_MODE_JOURNAL) != REFOP_SUCCESS)
+		return NULL;
+
+	return handle;
+}
+//--------------------------------------------------------------------------------------------------------
+// First set write base file, and following sets append records only.
+TEST_F(interface_test_journal, interface_test_journal_set_get__success)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL, handle2 = NULL;
+	uint8_t wbuf[datasize], rbuf[datasize];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	handle = create_journal_handle();
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	// base file
+	create_data(wbuf, datasize, 0);
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ((off_t)(datasize + sizeof(s_refop_file_header)), file_size(latestfile));
+	ASSERT_NE(0, access(journalfile, F_OK));
+
+	// journal records
+	for (int i = 1; i <= 10; i++) {
+		create_data(wbuf, datasize, (uint8_t)i);
+		ret = refop_set_redundancy_data(handle, wbuf, datasize);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+		ASSERT_EQ(recordsize * i, file_size(journalfile));
+
+		ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+		ASSERT_EQ(datasize, szr);
+		ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+	}
+	ASSERT_NE(0, access(backupfile, F_OK));
+
+	// Other handle replay the journal.
+	handle2 = create_journal_handle();
+	ASSERT_NE(nullptr, handle2);
+	ret = refop_get_redundancy_data(handle2, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	// Small buffer
+	ret = refop_get_redundancy_data(handle2, rbuf, 10, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(10, szr);
+
+	// Generation
+	create_data(wbuf, datasize, 8);
+	ret = refop_get_generation(handle2, 2, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+	create_data(wbuf, datasize, 0);
+	ret = refop_get_generation(handle2, 10, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+	ret = refop_get_generation(handle2, 11, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	ret = refop_remove_redundancy_data(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_NE(0, access(journalfile, F_OK));
+	ASSERT_NE(0, access(latestfile, F_OK));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_release_redundancy_handle(handle2);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+}
+//--------------------------------------------------------------------------------------------------------
+// Full journal and explicit compaction write new base file.
+TEST_F(interface_test_journal, interface_test_journal_compact)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t wbuf[datasize], rbuf[datasize];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	handle = create_journal_handle();
+	ASSERT_NE(nullptr, handle);
+
+	for (int i = 0; i <= REFOP_JOURNAL_RECORDS_MAX; i++) {
+		create_data(wbuf, datasize, (uint8_t)i);
+		ret = refop_set_redundancy_data(handle, wbuf, datasize);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+	}
+	ASSERT_EQ(recordsize * REFOP_JOURNAL_RECORDS_MAX, file_size(journalfile));
+	ASSERT_NE(0, access(backupfile, F_OK));
+
+	// Next set compact the journal to new base file.
+	create_data(wbuf, datasize, 0xaa);
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, file_size(journalfile));
+	ASSERT_EQ(0, access(backupfile, F_OK));
+
+	ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	// Explicit compaction
+	create_data(wbuf, datasize, 0xbb);
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(recordsize, file_size(journalfile));
+
+	ret = refop_compact_journal(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, file_size(journalfile));
+
+	ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	// Nothing to compact
+	ret = refop_compact_journal(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+// Torn tail record is dropped, previous record is returned.
+TEST_F(interface_test_journal, interface_test_journal_broken_tail)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t wbuf[datasize], rbuf[datasize];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	handle = create_journal_handle();
+	ASSERT_NE(nullptr, handle);
+
+	for (int i = 0; i < 4; i++) {
+		create_data(wbuf, datasize, (uint8_t)i);
+		ret = refop_set_redundancy_data(handle, wbuf, datasize);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+	}
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// Break data of third record (newest).
+	ASSERT_EQ(0, breakfile_data(journalfile, recordsize * 2 + sizeof(s_refop_file_header_v6) + 5));
+
+	handle = create_journal_handle();
+	ASSERT_NE(nullptr, handle);
+	create_data(wbuf, datasize, 2);
+	ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	// New record overwrite broken tail.
+	create_data(wbuf, datasize, 0x55);
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(recordsize * 3, file_size(journalfile));
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	handle = create_journal_handle();
+	ASSERT_NE(nullptr, handle);
+	ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+// Records of old base file are ignored.
+TEST_F(interface_test_journal, interface_test_journal_stale_records)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t wbuf[datasize], rbuf[datasize];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	handle = create_journal_handle();
+	ASSERT_NE(nullptr, handle);
+	for (int i = 0; i < 3; i++) {
+		create_data(wbuf, datasize, (uint8_t)i);
+		ret = refop_set_redundancy_data(handle, wbuf, datasize);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+	}
+
+	// Base file is overwritten by other mode, records remain in the journal.
+	create_data(wbuf, datasize, 0x77);
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_ROTATION);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ASSERT_EQ(recordsize * 2, file_size(journalfile));
+
+	handle = create_journal_handle();
+	ASSERT_NE(nullptr, handle);
+	ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+// A record larger than the size limit of a handle is not replayed by the handle, and it is kept.
+TEST_F(interface_test_journal, interface_test_journal_size_limit)
+{
+	refop_handle_t large = NULL, normal = NULL;
+	refop_options_t opts;
+	int64_t sz = 2 * 1024 * 1024, szr = 0;
+	uint8_t *wbuf = (uint8_t *)malloc(sz);
+	uint8_t *rbuf = (uint8_t *)malloc(sz);
+	off_t jsize = 0;
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.size_limit = 8 * 1024 * 1024;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&large, directry, file, &opts));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(large, REFOP_MODE_JOURNAL));
+
+	create_data(wbuf, sz, 3);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(large, wbuf, datasize));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(large, wbuf, sz));
+	jsize = file_size(journalfile);
+
+	normal = create_journal_handle();
+	ASSERT_NE(nullptr, normal);
+	ASSERT_EQ(REFOP_SYSERROR, refop_get_redundancy_data(normal, rbuf, REFOP_DATA_SIZE_LIMIT_DEFAULT, &szr));
+	ASSERT_EQ(jsize, file_size(journalfile));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(large, rbuf, sz, &szr));
+	ASSERT_EQ(sz, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, sz));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(large));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(normal));
+
+	free(wbuf);
+	free(rbuf);
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+static size_t g_max_alloc = 0;
+
+static void *max_alloc(size_t size, void *ctx)
+{
+	(void)ctx;
+	if (size > g_max_alloc)
+		g_max_alloc = size;
+	return malloc(size);
+}
+
+static void max_free(void *ptr, void *ctx)
+{
+	(void)ctx;
+	free(ptr);
+}
+//--------------------------------------------------------------------------------------------------------
+// Replay memory follows the stored values, not the size limit of the handle.
+TEST_F(interface_test_journal, interface_test_journal_replay_memory)
+{
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+	uint8_t wbuf[datasize], rbuf[datasize];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.size_limit = REFOP_DATA_SIZE_LIMIT_MAX;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle, directry, file, &opts));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(handle, REFOP_MODE_JOURNAL));
+	for (int i = 0; i < 3; i++) {
+		create_data(wbuf, datasize, (uint8_t)i);
+		ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, wbuf, datasize));
+	}
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+
+	g_max_alloc = 0;
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_allocator(max_alloc, max_free, NULL));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle, directry, file, &opts));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(handle, REFOP_MODE_JOURNAL));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, datasize, &szr));
+	ASSERT_EQ(datasize, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, datasize));
+	ASSERT_EQ(REFOP_SUCCESS, refop_compact_journal(handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, datasize, &szr));
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, datasize));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+
+	(void)refop_set_allocator(NULL, NULL, NULL);
+	ASSERT_GT((size_t)(64 * 1024), g_max_alloc);
+
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_journal, interface_test_journal_arg_error)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+
+	cleanup_files(directry, testfiles);
+
+	ret = refop_compact_journal(NULL);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// Not journal mode
+	ret = refop_compact_journal(handle);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_JOURNAL);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_compact_journal(handle);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+}
+//--------------------------------------------------------------------------------------------------------
@@ -0,0 +1,281 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_options.cpp
+ * @brief	Public interface test fot refop handle options
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_options : Test {
+	void TearDown() override
+	{
+		(void)refop_set_default_options(NULL);
+	}
+};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-options.bin";
+static const char file2[] = "test-options2.bin";
+static const char latestfile[] = "/tmp/refop-test/test-options.bin";
+static const char backupfile[] = "/tmp/refop-test/test-options.bin.bk1";
+static const char newfile[] = "/tmp/refop-test/test-options.bin.tmp";
+static const char latestfile2[] = "/tmp/refop-test/test-options2.bin";
+static const char backupfile2[] = "/tmp/refop-test/test-options2.bin.bk1";
+static const char deltafile[] = "/tmp/refop-test/test-options.bin.dlt";
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, latestfile2, backupfile2, deltafile, NULL };
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_options, interface_test_options__arg_error)
+{
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.size_limit = (uint64_t)REFOP_DATA_SIZE_LIMIT_MAX + 1;
+	ASSERT_EQ(REFOP_ARGERROR, refop_create_redundancy_handle_ex(&handle, directry, file, &opts));
+	ASSERT_EQ(REFOP_ARGERROR, refop_set_default_options(&opts));
+
+	memset(&opts, 0, sizeof(opts));
+	opts.durability = (refop_durability_t)3;
+	ASSERT_EQ(REFOP_ARGERROR, refop_create_redundancy_handle_ex(&handle, directry, file, &opts));
+
+	memset(&opts, 0, sizeof(opts));
+	opts.backup_count = REFOP_BACKUP_COUNT_MAX + 1;
+	ASSERT_EQ(REFOP_ARGERROR, refop_create_redundancy_handle_ex(&handle, directry, file, &opts));
+	opts.backup_count = -1;
+	ASSERT_EQ(REFOP_ARGERROR, refop_set_default_options(&opts));
+
+	memset(&opts, 0, sizeof(opts));
+	opts.io_backend = (refop_io_backend_t)2;
+	ASSERT_EQ(REFOP_ARGERROR, refop_create_redundancy_handle_ex(&handle, directry, file, &opts));
+
+	ASSERT_EQ(REFOP_ARGERROR, refop_create_redundancy_handle_ex(NULL, directry, file, NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_get_default_options(NULL));
+}
+//--------------------------------------------------------------------------------------------------------
+// Large limit for one handle, other handle keep default limit.
+TEST_F(interface_test_options, interface_test_options_size_limit)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t large = NULL, normal = NULL, small = NULL;
+	refop_options_t opts;
+	int64_t sz = 3 * 1024 * 1024, szr = 0;
+	uint8_t *wbuf = (uint8_t *)malloc(sz);
+	uint8_t *rbuf = (uint8_t *)malloc(sz);
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.size_limit = 4 * 1024 * 1024;
+	ret = refop_create_redundancy_handle_ex(&large, directry, file, &opts);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	opts.size_limit = 1000;
+	ret = refop_create_redundancy_handle_ex(&small, directry, file2, &opts);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_create_redundancy_handle(&normal, directry, file2);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	create_data(wbuf, sz, 1);
+	ret = refop_set_redundancy_data(large, wbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_data(large, wbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_get_redundancy_data(large, rbuf, sz, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(sz, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	ret = refop_set_redundancy_data(normal, wbuf, sz);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+	ret = refop_set_redundancy_data(normal, wbuf, REFOP_DATA_SIZE_LIMIT_DEFAULT);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_set_redundancy_data(small, wbuf, 1001);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+	ret = refop_set_redundancy_data(small, wbuf, 1000);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_get_redundancy_data(small, rbuf, sz, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(1000, szr);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(large));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(normal));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(small));
+
+	free(wbuf);
+	free(rbuf);
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+// A file of a handle with larger limit is valid for a handle with the default limit.
+TEST_F(interface_test_options, interface_test_options_size_limit_reader)
+{
+	refop_handle_t large = NULL, normal = NULL;
+	refop_options_t opts;
+	int64_t sz = 2 * 1024 * 1024, szr = 0;
+	uint8_t *wbuf = (uint8_t *)malloc(sz);
+	uint8_t *rbuf = (uint8_t *)malloc(sz);
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.size_limit = 8 * 1024 * 1024;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&large, directry, file, &opts));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&normal, directry, file));
+
+	create_data(wbuf, sz, 7);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(large, wbuf, sz));
+
+	// The head of value is read, the file is not removed as broken.
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(normal, rbuf, REFOP_DATA_SIZE_LIMIT_DEFAULT, &szr));
+	ASSERT_EQ(REFOP_DATA_SIZE_LIMIT_DEFAULT, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+	ASSERT_EQ(0, access(latestfile, F_OK));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(large, rbuf, sz, &szr));
+	ASSERT_EQ(sz, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, sz));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(large));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(normal));
+
+	free(wbuf);
+	free(rbuf);
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+// Process wide default is applied to new handles.
+TEST_F(interface_test_options, interface_test_options_default)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+	int64_t sz = 2 * 1024 * 1024;
+	uint8_t *wbuf = (uint8_t *)calloc(1, sz);
+
+	cleanup_files(directry, testfiles);
+
+	ret = refop_get_default_options(&opts);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ((uint64_t)REFOP_DATA_SIZE_LIMIT_DEFAULT, opts.size_limit);
+	ASSERT_EQ(REFOP_DURABILITY_FULL, opts.durability);
+
+	opts.size_limit = sz;
+	opts.durability = REFOP_DURABILITY_DATA;
+	ret = refop_set_default_options(&opts);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(REFOP_DURABILITY_DATA, handle->durability);
+	ret = refop_set_redundancy_data(handle, wbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+
+	// Reset to built-in default, existing files are still readable.
+	ret = refop_set_default_options(NULL);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_get_default_options(&opts);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ((uint64_t)REFOP_DATA_SIZE_LIMIT_DEFAULT, opts.size_limit);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_data(handle, wbuf, sz);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+
+	free(wbuf);
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+// Other options are applied to handle settings.
+TEST_F(interface_test_options, interface_test_options_apply)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+	int64_t sz = 100000, szr = 0;
+	uint8_t *wbuf = (uint8_t *)malloc(sz);
+	uint8_t *rbuf = (uint8_t *)malloc(sz);
+	s_refop_file_header_v7 head;
+	struct stat sb;
+	int fd = -1;
+
+	cleanup_files(directry, testfiles);
+
+	// I/O backend and durability
+	memset(&opts, 0, sizeof(opts));
+	opts.io_backend = REFOP_IO_DIRECT;
+	opts.durability = REFOP_DURABILITY_NONE;
+	ret = refop_create_redundancy_handle_ex(&handle, directry, file, &opts);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	create_data(wbuf, sz, 1);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, wbuf, sz));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, sz, &szr));
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+	fd = open(latestfile, O_RDONLY);
+	ASSERT_LE(0, fd);
+	ASSERT_EQ((ssize_t)sizeof(head), read(fd, &head, sizeof(head)));
+	(void)close(fd);
+	ASSERT_EQ(REFOP_FILE_HEADER_VERSION_V7, head.version);
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	cleanup_files(directry, testfiles);
+
+	// Cache budget, delta mode keep delta records without cached value.
+	memset(&opts, 0, sizeof(opts));
+	opts.cache_budget = 1000;
+	ret = refop_create_redundancy_handle_ex(&handle, directry, file, &opts);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(handle, REFOP_MODE_DELTA));
+
+	for (int i = 0; i < 4; i++) {
+		wbuf[i * 1000] = (uint8_t)i;
+		ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, wbuf, sz));
+		ASSERT_NE(nullptr, handle->delta);
+		ASSERT_EQ(NULL, handle->delta->value);
+	}
+	ASSERT_EQ(0, stat(deltafile, &sb));
+	ASSERT_GT(sz, sb.st_size);
+	ASSERT_EQ(3, handle->delta->chain);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, sz, &szr));
+	ASSERT_EQ(sz, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	cleanup_files(directry, testfiles);
+
+	// Backup count
+	memset(&opts, 0, sizeof(opts));
+	opts.backup_count = 3;
+	ret = refop_create_redundancy_handle_ex(&handle, directry, file, &opts);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(3, handle->backup_count);
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+
+	free(wbuf);
+	free(rbuf);
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
@@ -0,0 +1,226 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_parity.cpp
+ * @brief	Public interface test fot refop parity mode
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_parity : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-parity.bin";
+static const char newfile[] = "/tmp/refop-test/test-parity.bin.tmp";
+static const char parityfile[] = "/tmp/refop-test/test-parity.bin.par";
+
+// 8 full blocks and 1 partial block, 3 parity groups by default setting
+static const int64_t datasize = REFOP_BLOCK_SIZE * 8 + 100;
+// header + 12 entry crc table
+static const off_t dataoffset = sizeof(s_refop_file_header_v4) + sizeof(uint16_t) * 12;
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, parityfile, NULL };
+//--------------------------------------------------------------------------------------------------------
+static refop_handle_t create_parity_handle(void)
+{
+	refop_handle_t handle = NULL;
+
+	if (refop_create_redundancy_handle(&handle, directry, file) != REFOP_SUCCESS)
+		return NULL;
+	if (refop_set_redundancy_mode(handle, REFOP_MODE_PARITY) != REFOP_SUCCESS)
+		return NULL;
+
+	return handle;
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_parity, interface_test_parity_refop_set_parity_overhead__arg_error)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+
+	cleanup_files(directry, testfiles);
+
+	ret = refop_set_parity_overhead(NULL, 25);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	handle = create_parity_handle();
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_set_parity_overhead(handle, 4);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+	ret = refop_set_parity_overhead(handle, 51);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+	ret = refop_set_parity_overhead(handle, 10);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_parity, interface_test_parity_set_get__success)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t *wbuf = (uint8_t *)malloc(datasize);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize);
+	int64_t szr = 0;
+	struct stat sb;
+
+	cleanup_files(directry, testfiles);
+	create_data(wbuf, datasize, 3);
+
+	handle = create_parity_handle();
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// Data is stored once, parity overhead is 3 blocks.
+	ASSERT_EQ(0, stat(parityfile, &sb));
+	ASSERT_EQ(dataoffset * 2 + datasize + REFOP_BLOCK_SIZE * 3, sb.st_size);
+	ASSERT_NE(0, access(newfile, F_OK));
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(datasize, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, datasize));
+
+	ret = refop_get_generation(handle, 1, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	ret = refop_remove_redundancy_data(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_NE(0, access(parityfile, F_OK));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// One broken block per parity group is reconstructed.
+TEST_F(interface_test_parity, interface_test_parity_reconstruct__recover)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t *wbuf = (uint8_t *)malloc(datasize);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize);
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	create_data(wbuf, datasize, 5);
+
+	handle = create_parity_handle();
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// block 1 (group 0), block 6 (group 1) and block 8 (group 2, partial block)
+	ASSERT_EQ(0, breakfile_data(parityfile, dataoffset + REFOP_BLOCK_SIZE * 1 + 11));
+	ASSERT_EQ(0, breakfile_data(parityfile, dataoffset + REFOP_BLOCK_SIZE * 6 + 4095));
+	ASSERT_EQ(0, breakfile_data(parityfile, dataoffset + REFOP_BLOCK_SIZE * 8 + 99));
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(datasize, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, datasize));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// Two broken blocks in same parity group are unrecoverable.
+TEST_F(interface_test_parity, interface_test_parity_reconstruct__broken)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t *wbuf = (uint8_t *)malloc(datasize);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize);
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	create_data(wbuf, datasize, 7);
+
+	handle = create_parity_handle();
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ASSERT_EQ(0, breakfile_data(parityfile, dataoffset + REFOP_BLOCK_SIZE * 4 + 1));
+	ASSERT_EQ(0, breakfile_data(parityfile, dataoffset + REFOP_BLOCK_SIZE * 5 + 1));
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_BROKEN, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// Broken header is recovered by the copy at end of file, and parity overhead is changeable.
+TEST_F(interface_test_parity, interface_test_parity_header__recover)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t *wbuf = (uint8_t *)malloc(datasize);
+	uint8_t *rbuf = (uint8_t *)malloc(datasize);
+	int64_t szr = 0;
+	struct stat sb;
+
+	cleanup_files(directry, testfiles);
+	create_data(wbuf, datasize, 9);
+
+	handle = create_parity_handle();
+	ASSERT_NE(nullptr, handle);
+
+	// 10 percent, 1 parity block for 9 blocks.
+	ret = refop_set_parity_overhead(handle, 10);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_set_redundancy_data(handle, wbuf, datasize);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ASSERT_EQ(0, stat(parityfile, &sb));
+	ASSERT_EQ((off_t)(sizeof(s_refop_file_header_v4) + sizeof(uint16_t) * 10) * 2 + datasize + REFOP_BLOCK_SIZE,
+		  sb.st_size);
+
+	ASSERT_EQ(0, breakfile_data(parityfile, 20));
+
+	ret = refop_get_redundancy_data(handle, rbuf, datasize, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_EQ(datasize, szr);
+	ASSERT_EQ(0, memcmp(wbuf, rbuf, datasize));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(wbuf);
+	free(rbuf);
+}
@@ -0,0 +1,419 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_pingpong.cpp
+ * @brief	Public interface test fot refop ping-pong mode
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+#include "file-util.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_pingpong : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-pingpong.bin";
+static const char latestfile[] = "/tmp/refop-test/test-pingpong.bin";
+static const char backupfile[] = "/tmp/refop-test/test-pingpong.bin.bk1";
+static const char newfile[] = "/tmp/refop-test/test-pingpong.bin.tmp";
+static const char slotfile0[] = "/tmp/refop-test/test-pingpong.bin.g0";
+static const char slotfile1[] = "/tmp/refop-test/test-pingpong.bin.g1";
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, slotfile0, slotfile1, NULL };
+//--------------------------------------------------------------------------------------------------------
+static int read_generation(const char *file, uint64_t *generation)
+{
+	s_refop_file_header_v2 head;
+	int fd = -1;
+	ssize_t size = 0;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	size = safe_read(fd, &head, sizeof(head));
+	(void)close(fd);
+	if (size != sizeof(head))
+		return -1;
+
+	(*generation) = head.generation;
+
+	return 0;
+}
+//--------------------------------------------------------------------------------------------------------
+static bool check_data(uint8_t *pbuf, int64_t sz, uint8_t val)
+{
+	for (int64_t i = 0; i < sz; i++) {
+		if (pbuf[i] != val)
+			return false;
+	}
+	return true;
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_pingpong, interface_test_pingpong_refop_set_redundancy_mode__arg_error)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+
+	cleanup_files(directry, testfiles);
+
+	ret = refop_set_redundancy_mode(NULL, REFOP_MODE_PINGPONG);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_set_redundancy_mode(handle, (refop_mode_t)100);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_PINGPONG);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+}
+//--------------------------------------------------------------------------------------------------------
+// Two fixed files are overwritten alternately and generation number is increased.
+TEST_F(interface_test_pingpong, interface_test_pingpong_set_get__success)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	struct stat sb;
+	uint64_t gen0 = 0, gen1 = 0;
+	uint8_t *pbuf = NULL;
+	int64_t sz = 64 * 1024;
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	pbuf = (uint8_t*)malloc(sz);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_PINGPONG);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_get_redundancy_data(handle, pbuf, sz, &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	memset(pbuf, 0x11, sz);
+	ret = refop_set_redundancy_data(handle, pbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, read_generation(slotfile0, &gen0));
+	ASSERT_EQ(1u, gen0);
+	ASSERT_EQ(-1, stat(slotfile1, &sb));
+
+	memset(pbuf, 0x22, sz);
+	ret = refop_set_redundancy_data(handle, pbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, read_generation(slotfile1, &gen1));
+	ASSERT_EQ(2u, gen1);
+
+	memset(pbuf, 0x33, sz / 2);
+	ret = refop_set_redundancy_data(handle, pbuf, sz / 2);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, read_generation(slotfile0, &gen0));
+	ASSERT_EQ(3u, gen0);
+	ASSERT_EQ(0, stat(slotfile0, &sb));
+	ASSERT_EQ((off_t)(sz / 2 + sizeof(s_refop_file_header_v2)), sb.st_size);
+
+	// There are no rotation files.
+	ASSERT_EQ(-1, stat(latestfile, &sb));
+	ASSERT_EQ(-1, stat(backupfile, &sb));
+	ASSERT_EQ(-1, stat(newfile, &sb));
+
+	memset(pbuf, 0, sz);
+	ret = refop_get_redundancy_data(handle, pbuf, sz, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(sz / 2, szr);
+	ASSERT_TRUE(check_data(pbuf, szr, 0x33));
+
+	// Smaller buffer than data
+	memset(pbuf, 0, sz);
+	ret = refop_get_redundancy_data(handle, pbuf, 100, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(100, szr);
+	ASSERT_TRUE(check_data(pbuf, szr, 0x33));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(pbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// New handle continue generation number from existing files.
+TEST_F(interface_test_pingpong, interface_test_pingpong_generation_continue)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint64_t gen = 0;
+	uint8_t *pbuf = NULL;
+	int64_t sz = 4 * 1024;
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	pbuf = (uint8_t*)malloc(sz);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_PINGPONG);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	for (int i = 0; i < 5; i++) {
+		memset(pbuf, i, sz);
+		ret = refop_set_redundancy_data(handle, pbuf, sz);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+	}
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// gen5 is in slot 0
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_PINGPONG);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_get_redundancy_data(handle, pbuf, sz, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_TRUE(check_data(pbuf, szr, 4));
+
+	memset(pbuf, 0x55, sz);
+	ret = refop_set_redundancy_data(handle, pbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, read_generation(slotfile1, &gen));
+	ASSERT_EQ(6u, gen);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(pbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+// Broken newest file is recovered from older file, and next write overwrite broken file.
+TEST_F(interface_test_pingpong, interface_test_pingpong_recover)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint64_t gen = 0;
+	uint8_t *pbuf = NULL;
+	int64_t sz = 4 * 1024;
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	pbuf = (uint8_t*)malloc(sz);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_PINGPONG);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	memset(pbuf, 0xa1, sz);
+	ret = refop_set_redundancy_data(handle, pbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	memset(pbuf, 0xa2, sz);
+	ret = refop_set_redundancy_data(handle, pbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// break data block of newest (slot 1)
+	ASSERT_EQ(0, breakfile_data(slotfile1, sizeof(s_refop_file_header_v2) + 10));
+	ret = refop_get_redundancy_data(handle, pbuf, sz, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_TRUE(check_data(pbuf, szr, 0xa1));
+
+	// Next write shall overwrite broken file, valid older file is kept.
+	memset(pbuf, 0xa3, sz);
+	ret = refop_set_redundancy_data(handle, pbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, read_generation(slotfile1, &gen));
+	ASSERT_EQ(3u, gen);
+	ASSERT_EQ(0, read_generation(slotfile0, &gen));
+	ASSERT_EQ(1u, gen);
+
+	ret = refop_get_redundancy_data(handle, pbuf, sz, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_TRUE(check_data(pbuf, szr, 0xa3));
+
+	// break header of newest (slot 1)
+	ASSERT_EQ(0, breakfile_data(slotfile1, 0));
+	ret = refop_get_redundancy_data(handle, pbuf, sz, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_TRUE(check_data(pbuf, szr, 0xa1));
+
+	// break both
+	ASSERT_EQ(0, breakfile_data(slotfile0, sizeof(s_refop_file_header_v2)));
+	ret = refop_get_redundancy_data(handle, pbuf, sz, &szr);
+	ASSERT_EQ(REFOP_BROKEN, ret);
+
+	// A new handle can write after all files were broken.
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_PINGPONG);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	memset(pbuf, 0xa4, sz);
+	ret = refop_set_redundancy_data(handle, pbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_get_redundancy_data(handle, pbuf, sz, &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_TRUE(check_data(pbuf, szr, 0xa4));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(pbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_pingpong, interface_test_pingpong_remove)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	struct stat sb;
+	uint8_t *pbuf = NULL;
+	int64_t sz = 1024;
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	pbuf = (uint8_t*)malloc(sz);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_PINGPONG);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	memset(pbuf, 0x5a, sz);
+	ret = refop_set_redundancy_data(handle, pbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_data(handle, pbuf, sz);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_remove_redundancy_data(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(-1, stat(slotfile0, &sb));
+	ASSERT_EQ(-1, stat(slotfile1, &sb));
+
+	ret = refop_get_redundancy_data(handle, pbuf, sz, &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	free(pbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_pingpong, interface_test_pingpong_refop_set_backup_count__arg_error)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+
+	cleanup_files(directry, testfiles);
+
+	ret = refop_set_backup_count(NULL, 2);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_set_backup_count(handle, 0);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+	ret = refop_set_backup_count(handle, REFOP_BACKUP_COUNT_MAX + 1);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+	ret = refop_set_backup_count(handle, REFOP_BACKUP_COUNT_MAX);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+}
+//--------------------------------------------------------------------------------------------------------
+// N backup generations are kept as ring, and each generation is readable by index.
+TEST_F(interface_test_pingpong, interface_test_pingpong_generation_history)
+{
+	static const char slotfile2[] = "/tmp/refop-test/test-pingpong.bin.g2";
+	static const char slotfile3[] = "/tmp/refop-test/test-pingpong.bin.g3";
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint64_t gen = 0;
+	uint8_t buf[512];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	(void)unlink(slotfile2);
+	(void)unlink(slotfile3);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_mode(handle, REFOP_MODE_PINGPONG);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_backup_count(handle, 3);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_get_generation(handle, 0, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	// gen1..gen6 : g0=gen5, g1=gen6, g2=gen3, g3=gen4
+	for (int i = 1; i <= 6; i++) {
+		memset(buf, i, sizeof(buf));
+		ret = refop_set_redundancy_data(handle, buf, sizeof(buf));
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+	}
+	ASSERT_EQ(0, read_generation(slotfile1, &gen));
+	ASSERT_EQ(6u, gen);
+	ASSERT_EQ(0, read_generation(slotfile2, &gen));
+	ASSERT_EQ(3u, gen);
+
+	for (int n = 0; n < 4; n++) {
+		ret = refop_get_generation(handle, n, buf, sizeof(buf), &szr);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+		ASSERT_EQ((int64_t)sizeof(buf), szr);
+		ASSERT_TRUE(check_data(buf, szr, 6 - n));
+	}
+	ret = refop_get_generation(handle, 4, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+	ret = refop_get_generation(handle, -1, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	// Two newest generations are broken, the 3rd generation is recovered.
+	ASSERT_EQ(0, breakfile_data(slotfile1, sizeof(s_refop_file_header_v2)));
+	ASSERT_EQ(0, breakfile_data(slotfile0, sizeof(s_refop_file_header_v2)));
+	ret = refop_get_generation(handle, 0, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_BROKEN, ret);
+	ret = refop_get_redundancy_data(handle, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_TRUE(check_data(buf, szr, 4));
+
+	// Next write overwrite a broken file, valid history is kept.
+	memset(buf, 7, sizeof(buf));
+	ret = refop_set_redundancy_data(handle, buf, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, read_generation(slotfile0, &gen));
+	ASSERT_EQ(7u, gen);
+	ret = refop_get_redundancy_data(handle, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_TRUE(check_data(buf, szr, 7));
+	ret = refop_get_generation(handle, 2, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_TRUE(check_data(buf, szr, 4));
+
+	ret = refop_remove_redundancy_data(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_get_generation(handle, 0, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+}
@@ -0,0 +1,201 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_process_lock.cpp
+ * @brief	Public interface test fot cross-process writer lock
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_process_lock : Test {
+	void TearDown() override
+	{
+		(void)refop_set_default_options(NULL);
+	}
+};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-process-lock.bin";
+static const char latestfile[] = "/tmp/refop-test/test-process-lock.bin";
+static const char backupfile[] = "/tmp/refop-test/test-process-lock.bin.bk1";
+static const char newfile[] = "/tmp/refop-test/test-process-lock.bin.tmp";
+static const char lockfile[] = "/tmp/refop-test/test-process-lock.bin.lck";
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, lockfile, NULL };
+//--------------------------------------------------------------------------------------------------------
+// Take the writer lock as another writer does.  OFD locks of separate open conflict in one process.
+static int hold_lock(void)
+{
+	struct flock fl;
+	int fd = -1;
+
+	fd = open(lockfile, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return -1;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = 0;
+	fl.l_len = 1;
+	if (fcntl(fd, F_OFD_SETLK, &fl) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_process_lock, interface_test_process_lock__arg_error)
+{
+	refop_handle_t handle = NULL;
+	uint8_t buf[16];
+
+	cleanup_files(directry, testfiles);
+	memset(buf, 0, sizeof(buf));
+
+	ASSERT_EQ(REFOP_ARGERROR, refop_try_set_redundancy_data(NULL, buf, sizeof(buf), 0));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+	ASSERT_FALSE(handle->process_lock);
+	ASSERT_EQ(REFOP_ARGERROR, refop_try_set_redundancy_data(handle, NULL, sizeof(buf), 0));
+	ASSERT_EQ(REFOP_ARGERROR, refop_try_set_redundancy_data(handle, buf, -1, 0));
+	ASSERT_EQ(REFOP_ARGERROR, refop_try_set_redundancy_data(handle, buf, sizeof(buf), -1));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_process_lock, interface_test_process_lock__busy)
+{
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+	uint8_t buf[256], rbuf[256];
+	int64_t szr = 0;
+	int64_t start = 0;
+	int fd = -1;
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.process_lock = true;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle, directry, file, &opts));
+	ASSERT_TRUE(handle->process_lock);
+
+	memset(buf, 1, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, sizeof(buf)));
+	ASSERT_EQ(0, access(lockfile, F_OK));
+
+	fd = hold_lock();
+	ASSERT_LE(0, fd);
+
+	// Writer fails with busy, reader is not blocked.
+	memset(buf, 2, sizeof(buf));
+	ASSERT_EQ(REFOP_BUSY, refop_try_set_redundancy_data(handle, buf, sizeof(buf), 0));
+	start = refop_lock_clock_ms();
+	ASSERT_EQ(REFOP_BUSY, refop_try_set_redundancy_data(handle, buf, sizeof(buf), 50));
+	ASSERT_LE(50, refop_lock_clock_ms() - start);
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(1, rbuf[0]);
+
+	close(fd);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_try_set_redundancy_data(handle, buf, sizeof(buf), 0));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(2, rbuf[0]);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_process_lock, interface_test_process_lock__try_without_option)
+{
+	refop_handle_t handle = NULL;
+	uint8_t buf[64];
+	int fd = -1;
+
+	cleanup_files(directry, testfiles);
+	memset(buf, 3, sizeof(buf));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+
+	fd = hold_lock();
+	ASSERT_LE(0, fd);
+	ASSERT_EQ(REFOP_BUSY, refop_try_set_redundancy_data(handle, buf, sizeof(buf), 0));
+	// A set without the option does not wait.
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, sizeof(buf)));
+	close(fd);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_try_set_redundancy_data(handle, buf, sizeof(buf), 0));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_process_lock, interface_test_process_lock__blocking_writer_in_child)
+{
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+	uint8_t buf[128], rbuf[128];
+	int64_t szr = 0;
+	int fd = -1, status = 0;
+	pid_t pid = -1;
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.process_lock = true;
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_default_options(&opts));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+	ASSERT_TRUE(handle->process_lock);
+
+	memset(buf, 4, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, sizeof(buf)));
+
+	fd = hold_lock();
+	ASSERT_LE(0, fd);
+
+	pid = fork();
+	ASSERT_LE(0, pid);
+	if (pid == 0) {
+		// Fork shares the open file description, so the child shall not keep the held lock.
+		close(fd);
+		memset(buf, 5, sizeof(buf));
+		_exit((refop_set_redundancy_data(handle, buf, sizeof(buf)) == REFOP_SUCCESS) ? 0 : 1);
+	}
+
+	// Child writer waits for the lock.
+	usleep(100 * 1000);
+	ASSERT_EQ(0, waitpid(pid, &status, WNOHANG));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(4, rbuf[0]);
+
+	close(fd);
+	ASSERT_EQ(pid, waitpid(pid, &status, 0));
+	ASSERT_TRUE(WIFEXITED(status));
+	ASSERT_EQ(0, WEXITSTATUS(status));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(5, rbuf[0]);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	cleanup_files(directry, testfiles);
+}
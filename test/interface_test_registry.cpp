@@ -0,0 +1,185 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_registry.cpp
+ * @brief	Public interface test fot shared handle registry
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+//dummy data
+static const char directry[] = "/tmp/refop-test-registry/";
+static const char directry_noslash[] = "/tmp/refop-test-registry";
+static const char file[] = "test-registry.bin";
+static const char file2[] = "test-registry2.bin";
+static const char latestfile[] = "/tmp/refop-test-registry/test-registry.bin";
+static const char backupfile[] = "/tmp/refop-test-registry/test-registry.bin.bk1";
+static const char newfile[] = "/tmp/refop-test-registry/test-registry.bin.tmp";
+
+/** Counting allocator. */
+static int g_allocs = 0;
+
+static void *test_alloc(size_t size, void *ctx)
+{
+	g_allocs++;
+	return malloc(size);
+}
+
+static void test_free(void *ptr, void *ctx)
+{
+	free(ptr);
+}
+
+struct interface_test_registry : Test {
+	void TearDown() override
+	{
+		(void)refop_set_default_options(NULL);
+		(void)refop_set_allocator(NULL, NULL, NULL);
+	}
+};
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, NULL };
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_registry, interface_test_registry__same_key)
+{
+	refop_handle_t handle1 = NULL, handle2 = NULL, handle3 = NULL, handle4 = NULL, handle5 = NULL;
+	refop_options_t opts;
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.shared = true;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle1, directry, file, &opts));
+	ASSERT_TRUE(handle1->shared);
+	// Shared handle is always thread safe.
+	ASSERT_NE(nullptr, handle1->lock);
+
+	// "/dir" and "/dir/" are same key.
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle2, directry_noslash, file, &opts));
+	ASSERT_EQ(handle1, handle2);
+
+	// Other file and not shared handle are separate.
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle3, directry, file2, &opts));
+	ASSERT_NE(handle1, handle3);
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle4, directry, file));
+	ASSERT_NE(handle1, handle4);
+	ASSERT_FALSE(handle4->shared);
+
+	// Process wide default
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_default_options(&opts));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle5, directry, file));
+	ASSERT_EQ(handle1, handle5);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle5));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle4));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle3));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle2));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle1));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_registry, interface_test_registry__refcount)
+{
+	refop_handle_t handle1 = NULL, handle2 = NULL;
+	refop_options_t opts;
+	uint8_t buf[128], rbuf[128];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.shared = true;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle1, directry, file, &opts));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle2, directry, file, &opts));
+	ASSERT_EQ(handle1, handle2);
+
+	// Settings and data are shared.
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(handle1, REFOP_MODE_PINGPONG));
+	ASSERT_EQ(REFOP_MODE_PINGPONG, handle2->mode);
+	memset(buf, 9, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle1, buf, sizeof(buf)));
+
+	// First release keeps the handle for the other user.
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle1));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle2, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ((int64_t)sizeof(buf), szr);
+	ASSERT_EQ(0, memcmp(buf, rbuf, sizeof(buf)));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handle2));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle2));
+
+	// Last release removed the key, new handle starts from default settings.
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle1, directry, file, &opts));
+	ASSERT_EQ(REFOP_MODE_ROTATION, handle1->mode);
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle1));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_registry, interface_test_registry__lookup_without_stat_and_malloc)
+{
+	refop_handle_t handle1 = NULL, handle2 = NULL;
+	refop_options_t opts;
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.shared = true;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle1, directry, file, &opts));
+
+	// Lookup of known key does not check the directory and does not allocate.
+	ASSERT_EQ(0, rmdir(directry));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_allocator(test_alloc, test_free, NULL));
+	g_allocs = 0;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle2, directry, file, &opts));
+	ASSERT_EQ(handle1, handle2);
+	ASSERT_EQ(0, g_allocs);
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle2));
+
+	// Unknown key is checked.
+	ASSERT_EQ(REFOP_NOENT, refop_create_redundancy_handle_ex(&handle2, directry, file2, &opts));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle1));
+	(void)refop_set_allocator(NULL, NULL, NULL);
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_registry, interface_test_registry__many_keys)
+{
+	static const int count = 300;
+	refop_handle_t handles[count], handle = NULL;
+	refop_options_t opts;
+	char name[32];
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.shared = true;
+
+	// Registry grows over the initial buckets, every key is still found.
+	for (int i = 0; i < count; i++) {
+		snprintf(name, sizeof(name), "test-registry-%d.bin", i);
+		ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handles[i], directry, name, &opts));
+	}
+	for (int i = 0; i < count; i++) {
+		snprintf(name, sizeof(name), "test-registry-%d.bin", i);
+		ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle, directry, name, &opts));
+		ASSERT_EQ(handles[i], handle);
+		ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	}
+
+	for (int i = 0; i < count; i++)
+		ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handles[i]));
+}
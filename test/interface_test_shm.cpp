@@ -0,0 +1,226 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_shm.cpp
+ * @brief	Public interface test fot shared memory cache
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_shm : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test-shm/";
+static const char file[] = "test-shm.bin";
+static const char latestfile[] = "/tmp/refop-test-shm/test-shm.bin";
+static const char backupfile[] = "/tmp/refop-test-shm/test-shm.bin.bk1";
+static const char newfile[] = "/tmp/refop-test-shm/test-shm.bin.tmp";
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, NULL };
+//--------------------------------------------------------------------------------------------------------
+static void cleanup_segment(refop_handle_t handle)
+{
+	char path[PATH_MAX];
+
+	if (refop_shm_path(handle, path) == 0)
+		(void)unlink(path);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_shm, interface_test_shm__arg_error)
+{
+	refop_handle_t handle = NULL;
+
+	cleanup_files(directry, testfiles);
+
+	ASSERT_EQ(REFOP_ARGERROR, refop_set_shm_cache(NULL, true));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_shm_cache(handle, false));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_shm_cache(handle, true));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_shm_cache(handle, true));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_shm_cache(handle, false));
+	cleanup_segment(handle);
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_shm, interface_test_shm__shared_value)
+{
+	refop_handle_t writer = NULL, reader = NULL;
+	uint8_t buf[512], rbuf[512];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	// Two handles have own segment mapping and lock, as two processes do.
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&writer, directry, file));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&reader, directry, file));
+	cleanup_segment(writer);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_shm_cache(writer, true));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_shm_cache(reader, true));
+
+	ASSERT_EQ(REFOP_NOENT, refop_get_redundancy_data(reader, rbuf, sizeof(rbuf), &szr));
+
+	memset(buf, 0x11, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(writer, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(writer, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(sizeof(buf), szr);
+
+	// The published value is read without files.
+	cleanup_files(directry, testfiles);
+	memset(rbuf, 0, sizeof(rbuf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(reader, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(sizeof(buf), szr);
+	ASSERT_EQ(0, memcmp(buf, rbuf, sizeof(buf)));
+
+	// Smaller buffer gets the head of the value.
+	memset(rbuf, 0, sizeof(rbuf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(reader, rbuf, 100, &szr));
+	ASSERT_EQ(100, szr);
+	ASSERT_EQ(0x11, rbuf[99]);
+	ASSERT_EQ(0, rbuf[100]);
+
+	// A set invalidates the value, next get reads files and publishes new value.
+	memset(buf, 0x22, 200);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(writer, buf, 200));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(reader, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(200, szr);
+	ASSERT_EQ(0, memcmp(buf, rbuf, 200));
+	cleanup_files(directry, testfiles);
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(writer, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(200, szr);
+	ASSERT_EQ(0x22, rbuf[0]);
+
+	// A remove invalidates the value.
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(writer));
+	ASSERT_EQ(REFOP_NOENT, refop_get_redundancy_data(reader, rbuf, sizeof(rbuf), &szr));
+
+	// A handle without the cache reads files.
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(writer, buf, 200));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(reader, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_shm_cache(reader, false));
+	cleanup_files(directry, testfiles);
+	ASSERT_EQ(REFOP_NOENT, refop_get_redundancy_data(reader, rbuf, sizeof(rbuf), &szr));
+
+	cleanup_segment(writer);
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(reader));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(writer));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_shm, interface_test_shm__segment_lifecycle)
+{
+	refop_handle_t writer = NULL, reader = NULL;
+	uint8_t buf[300], rbuf[512];
+	char path[PATH_MAX];
+	struct stat sb;
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&writer, directry, file));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&reader, directry, file));
+	ASSERT_EQ(0, refop_shm_path(writer, path));
+	cleanup_segment(writer);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_shm_cache(writer, true));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_shm_cache(reader, true));
+
+	// The segment holds the header page and the published value, not the size limit.
+	memset(buf, 0x33, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(writer, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(writer, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(0, stat(path, &sb));
+	ASSERT_EQ(4096 + sizeof(buf), sb.st_size);
+
+	// A remove removes the segment, the reader uses files.
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(writer));
+	ASSERT_NE(0, access(path, F_OK));
+	ASSERT_EQ(REFOP_NOENT, refop_get_redundancy_data(reader, rbuf, sizeof(rbuf), &szr));
+
+	// Next set makes a new segment, the reader moves to it by enable.
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(writer, buf, 100));
+	ASSERT_EQ(0, access(path, F_OK));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_shm_cache(reader, true));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(reader, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(100, szr);
+	cleanup_files(directry, testfiles);
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(writer, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(100, szr);
+	ASSERT_EQ(0, memcmp(buf, rbuf, 100));
+
+	// Without the segment lock, files are not changed.
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(writer, buf, 100));
+	ASSERT_EQ(0, unlink(path));
+	ASSERT_EQ(0, mkdir(path, 0700));
+	memset(buf, 0x44, sizeof(buf));
+	ASSERT_EQ(REFOP_SYSERROR, refop_set_redundancy_data(writer, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SYSERROR, refop_remove_redundancy_data(writer));
+	ASSERT_EQ(0, rmdir(path));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_shm_cache(reader, false));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(reader, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(100, szr);
+	ASSERT_EQ(0x33, rbuf[0]);
+
+	cleanup_files(directry, testfiles);
+	cleanup_segment(writer);
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(reader));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(writer));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_shm, interface_test_shm__other_process)
+{
+	refop_handle_t handle = NULL;
+	uint8_t buf[256], rbuf[256];
+	int64_t szr = 0;
+	int status = 0;
+	pid_t pid = -1;
+
+	cleanup_files(directry, testfiles);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+	cleanup_segment(handle);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_shm_cache(handle, true));
+
+	memset(buf, 0x33, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr));
+	cleanup_files(directry, testfiles);
+
+	pid = fork();
+	ASSERT_LE(0, pid);
+	if (pid == 0) {
+		refop_handle_t child = NULL;
+		uint8_t cbuf[256];
+		int64_t csz = 0;
+
+		// A new handle of another process maps the segment that was published by the parent.
+		if (refop_create_redundancy_handle(&child, directry, file) != REFOP_SUCCESS ||
+		    refop_set_shm_cache(child, true) != REFOP_SUCCESS)
+			_exit(1);
+		if (refop_get_redundancy_data(child, cbuf, sizeof(cbuf), &csz) != REFOP_SUCCESS ||
+		    csz != (int64_t)sizeof(cbuf) || cbuf[0] != 0x33 || cbuf[255] != 0x33)
+			_exit(2);
+		_exit(0);
+	}
+
+	ASSERT_EQ(pid, waitpid(pid, &status, 0));
+	ASSERT_TRUE(WIFEXITED(status));
+	ASSERT_EQ(0, WEXITSTATUS(status));
+
+	cleanup_segment(handle);
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+}
@@ -0,0 +1,308 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_slot.cpp
+ * @brief	Public interface test fot refop A/B slot mode
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+#include "file-util.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_slot : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-slot.bin";
+static const char latestfile[] = "/tmp/refop-test/test-slot.bin";
+static const char backupfile[] = "/tmp/refop-test/test-slot.bin.bk1";
+static const char newfile[] = "/tmp/refop-test/test-slot.bin.tmp";
+static const char slotfile[] = "/tmp/refop-test/test-slot.bin.ab";
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, slotfile, NULL };
+//--------------------------------------------------------------------------------------------------------
+static int read_generation(const char *file, off_t offset, uint64_t *generation)
+{
+	s_refop_file_header_v2 head;
+	int fd = -1;
+	ssize_t size = 0;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	size = safe_pread(fd, &head, sizeof(head), offset);
+	(void)close(fd);
+	if (size != sizeof(head))
+		return -1;
+
+	(*generation) = head.generation;
+
+	return 0;
+}
+//--------------------------------------------------------------------------------------------------------
+static bool check_data(uint8_t *pbuf, int64_t sz, uint8_t val)
+{
+	for (int64_t i = 0; i < sz; i++) {
+		if (pbuf[i] != val)
+			return false;
+	}
+	return true;
+}
+//--------------------------------------------------------------------------------------------------------
+static refop_handle_t create_slot_handle(int64_t capacity)
+{
+	refop_handle_t handle = NULL;
+
+	if (refop_create_redundancy_handle(&handle, directry, file) != REFOP_SUCCESS)
+		return NULL;
+	(void)refop_set_redundancy_mode(handle, REFOP_MODE_SLOT);
+	if (capacity > 0)
+		(void)refop_set_slot_capacity(handle, capacity);
+
+	return handle;
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_slot, interface_test_slot_refop_set_slot_capacity__arg_error)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t buf[REFOP_SLOT_ALIGN * 2];
+
+	cleanup_files(directry, testfiles);
+
+	ret = refop_set_slot_capacity(NULL, 100);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	handle = create_slot_handle(0);
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_set_slot_capacity(handle, 0);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+	ret = refop_set_slot_capacity(handle, -1);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+	ret = refop_set_slot_capacity(handle, refop_get_config_data_size_limit() + 1);
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	// No capacity, could not create slot file.
+	ret = refop_set_redundancy_data(handle, buf, sizeof(buf));
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	// Larger than capacity (capacity is rounded up to slot alignment)
+	ret = refop_set_slot_capacity(handle, 64);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_set_redundancy_data(handle, buf, sizeof(buf));
+	ASSERT_EQ(REFOP_ARGERROR, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+}
+//--------------------------------------------------------------------------------------------------------
+// Slots are overwritten alternately and the file extent is never changed.
+TEST_F(interface_test_slot, interface_test_slot_set_get__success)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	struct stat sb;
+	off_t filesize = 0, stride = 0;
+	uint64_t gen = 0;
+	uint8_t buf[256];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	handle = create_slot_handle(sizeof(buf));
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_get_redundancy_data(handle, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	memset(buf, 0x11, sizeof(buf));
+	ret = refop_set_redundancy_data(handle, buf, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ASSERT_EQ(0, stat(slotfile, &sb));
+	filesize = sb.st_size;
+	stride = filesize / 2;
+	ASSERT_EQ(0, stride % REFOP_SLOT_ALIGN);
+	ASSERT_EQ(0, read_generation(slotfile, 0, &gen));
+	ASSERT_EQ(1u, gen);
+
+	memset(buf, 0x22, sizeof(buf));
+	ret = refop_set_redundancy_data(handle, buf, 100);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, read_generation(slotfile, stride, &gen));
+	ASSERT_EQ(2u, gen);
+
+	memset(buf, 0x33, sizeof(buf));
+	ret = refop_set_redundancy_data(handle, buf, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, read_generation(slotfile, 0, &gen));
+	ASSERT_EQ(3u, gen);
+
+	ASSERT_EQ(0, stat(slotfile, &sb));
+	ASSERT_EQ(filesize, sb.st_size);
+	ASSERT_EQ(-1, stat(latestfile, &sb));
+	ASSERT_EQ(-1, stat(backupfile, &sb));
+	ASSERT_EQ(-1, stat(newfile, &sb));
+
+	memset(buf, 0, sizeof(buf));
+	ret = refop_get_redundancy_data(handle, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ((int64_t)sizeof(buf), szr);
+	ASSERT_TRUE(check_data(buf, szr, 0x33));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// A new handle does not need capacity for existing slot file.
+	handle = create_slot_handle(0);
+	ASSERT_NE(nullptr, handle);
+
+	ret = refop_get_redundancy_data(handle, buf, 16, &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(16, szr);
+	ASSERT_TRUE(check_data(buf, szr, 0x33));
+
+	memset(buf, 0x44, sizeof(buf));
+	ret = refop_set_redundancy_data(handle, buf, 10);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, read_generation(slotfile, stride, &gen));
+	ASSERT_EQ(4u, gen);
+
+	ret = refop_get_redundancy_data(handle, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(10, szr);
+	ASSERT_TRUE(check_data(buf, szr, 0x44));
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+}
+//--------------------------------------------------------------------------------------------------------
+// Broken newest slot is recovered from older slot, and next write overwrite broken slot.
+TEST_F(interface_test_slot, interface_test_slot_recover)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	struct stat sb;
+	off_t stride = 0;
+	uint64_t gen = 0;
+	uint8_t buf[512];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	handle = create_slot_handle(sizeof(buf));
+	ASSERT_NE(nullptr, handle);
+
+	memset(buf, 0xa1, sizeof(buf));
+	ret = refop_set_redundancy_data(handle, buf, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	memset(buf, 0xa2, sizeof(buf));
+	ret = refop_set_redundancy_data(handle, buf, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ASSERT_EQ(0, stat(slotfile, &sb));
+	stride = sb.st_size / 2;
+
+	// break data of newest slot (slot 1)
+	ASSERT_EQ(0, breakfile_data(slotfile, stride + sizeof(s_refop_file_header_v2) + 1));
+	ret = refop_get_redundancy_data(handle, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_RECOVER, ret);
+	ASSERT_TRUE(check_data(buf, szr, 0xa1));
+
+	memset(buf, 0xa3, sizeof(buf));
+	ret = refop_set_redundancy_data(handle, buf, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(0, read_generation(slotfile, stride, &gen));
+	ASSERT_EQ(3u, gen);
+	ASSERT_EQ(0, read_generation(slotfile, 0, &gen));
+	ASSERT_EQ(1u, gen);
+
+	ret = refop_get_redundancy_data(handle, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_TRUE(check_data(buf, szr, 0xa3));
+
+	// break header of newest slot (slot 1) and data of older slot (slot 0)
+	ASSERT_EQ(0, breakfile_data(slotfile, stride + 4));
+	ASSERT_EQ(0, breakfile_data(slotfile, sizeof(s_refop_file_header_v2)));
+	ret = refop_get_redundancy_data(handle, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_BROKEN, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_slot, interface_test_slot_remove)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	struct stat sb;
+	uint8_t buf[64];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	handle = create_slot_handle(sizeof(buf));
+	ASSERT_NE(nullptr, handle);
+
+	memset(buf, 0x5a, sizeof(buf));
+	ret = refop_set_redundancy_data(handle, buf, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	ret = refop_remove_redundancy_data(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(-1, stat(slotfile, &sb));
+
+	ret = refop_get_redundancy_data(handle, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_slot, interface_test_slot_refop_get_generation)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t buf[64];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	handle = create_slot_handle(sizeof(buf));
+	ASSERT_NE(nullptr, handle);
+
+	for (int i = 1; i <= 3; i++) {
+		memset(buf, i, sizeof(buf));
+		ret = refop_set_redundancy_data(handle, buf, sizeof(buf));
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+	}
+
+	ret = refop_get_generation(handle, 0, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_TRUE(check_data(buf, szr, 3));
+	ret = refop_get_generation(handle, 1, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_TRUE(check_data(buf, szr, 2));
+	ret = refop_get_generation(handle, 2, buf, sizeof(buf), &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+}
@@ -0,0 +1,287 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_snapshot.cpp
+ * @brief	Public interface test fot snapshot read
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_snapshot : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test-snapshot/";
+static const char file[] = "test-snapshot.bin";
+static const char latestfile[] = "/tmp/refop-test-snapshot/test-snapshot.bin";
+static const char backupfile[] = "/tmp/refop-test-snapshot/test-snapshot.bin.bk1";
+static const char newfile[] = "/tmp/refop-test-snapshot/test-snapshot.bin.tmp";
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, NULL };
+//--------------------------------------------------------------------------------------------------------
+static refop_handle_t create_thread_safe_handle(void)
+{
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+
+	(void)refop_get_default_options(&opts);
+	opts.thread_safe = true;
+	if (refop_create_redundancy_handle_ex(&handle, directry, file, &opts) != REFOP_SUCCESS)
+		return NULL;
+
+	return handle;
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_snapshot, interface_test_snapshot__arg_error)
+{
+	refop_handle_t handle = NULL;
+	refop_snapshot_t snapshot = NULL;
+	const uint8_t *data = NULL;
+	int64_t size = 0;
+
+	cleanup_files(directry, testfiles);
+
+	ASSERT_EQ(REFOP_ARGERROR, refop_snapshot_acquire(NULL, &snapshot, &data, &size));
+	ASSERT_EQ(REFOP_ARGERROR, refop_snapshot_release(NULL));
+
+	handle = create_thread_safe_handle();
+	ASSERT_NE(nullptr, handle);
+	ASSERT_EQ(REFOP_ARGERROR, refop_snapshot_acquire(handle, NULL, &data, &size));
+	ASSERT_EQ(REFOP_ARGERROR, refop_snapshot_acquire(handle, &snapshot, NULL, &size));
+	ASSERT_EQ(REFOP_ARGERROR, refop_snapshot_acquire(handle, &snapshot, &data, NULL));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+
+	// A handle without thread_safe option does not have snapshot.
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+	ASSERT_EQ(REFOP_ARGERROR, refop_snapshot_acquire(handle, &snapshot, &data, &size));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_snapshot, interface_test_snapshot__publish)
+{
+	refop_handle_t handle = NULL;
+	refop_snapshot_t snap1 = NULL, snap2 = NULL, snap3 = NULL;
+	const uint8_t *data1 = NULL, *data2 = NULL, *data3 = NULL;
+	int64_t size = 0;
+	uint8_t buf[256];
+
+	cleanup_files(directry, testfiles);
+
+	handle = create_thread_safe_handle();
+	ASSERT_NE(nullptr, handle);
+	ASSERT_EQ(REFOP_NOENT, refop_snapshot_acquire(handle, &snap1, &data1, &size));
+
+	memset(buf, 0x11, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, sizeof(buf)));
+
+	// First acquire reads the file, then the published snapshot is shared.
+	ASSERT_EQ(REFOP_SUCCESS, refop_snapshot_acquire(handle, &snap1, &data1, &size));
+	ASSERT_EQ(sizeof(buf), size);
+	ASSERT_EQ(0, memcmp(buf, data1, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_snapshot_acquire(handle, &snap2, &data2, &size));
+	ASSERT_EQ(snap1, snap2);
+	ASSERT_EQ(data1, data2);
+	ASSERT_EQ(REFOP_SUCCESS, refop_snapshot_release(snap2));
+
+	// A set publishes new value, old snapshot is kept until release.
+	memset(buf, 0x22, 100);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, 100));
+	ASSERT_EQ(REFOP_SUCCESS, refop_snapshot_acquire(handle, &snap3, &data3, &size));
+	ASSERT_NE(snap1, snap3);
+	ASSERT_EQ(100, size);
+	ASSERT_EQ(0, memcmp(buf, data3, 100));
+	for (int i = 0; i < (int)sizeof(buf); i++)
+		ASSERT_EQ(0x11, data1[i]);
+	ASSERT_EQ(REFOP_SUCCESS, refop_snapshot_release(snap1));
+
+	// The snapshot outlives the handle.
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	ASSERT_EQ(0, memcmp(buf, data3, 100));
+	ASSERT_EQ(REFOP_SUCCESS, refop_snapshot_release(snap3));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_snapshot, interface_test_snapshot__retire)
+{
+	refop_handle_t handle = NULL;
+	refop_snapshot_t snapshot = NULL;
+	const uint8_t *data = NULL;
+	int64_t size = 0;
+	uint8_t buf[64];
+
+	cleanup_files(directry, testfiles);
+
+	handle = create_thread_safe_handle();
+	ASSERT_NE(nullptr, handle);
+
+	memset(buf, 0x33, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_snapshot_acquire(handle, &snapshot, &data, &size));
+	ASSERT_EQ(REFOP_SUCCESS, refop_snapshot_release(snapshot));
+
+	// Remove retires the snapshot.
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handle));
+	ASSERT_EQ(REFOP_NOENT, refop_snapshot_acquire(handle, &snapshot, &data, &size));
+
+	// A mode change retires the snapshot, the value is read by the new mode.
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_snapshot_acquire(handle, &snapshot, &data, &size));
+	ASSERT_EQ(REFOP_SUCCESS, refop_snapshot_release(snapshot));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(handle, REFOP_MODE_PINGPONG));
+	ASSERT_EQ(REFOP_NOENT, refop_snapshot_acquire(handle, &snapshot, &data, &size));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(handle, REFOP_MODE_ROTATION));
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+}
+//--------------------------------------------------------------------------------------------------------
+struct snapshot_reader_ctx {
+	refop_handle_t handle;
+	volatile bool stop;
+	int errors;
+	long reads;
+};
+
+// Every set writes one byte value, so a snapshot shall have same byte in all data.
+static void *snapshot_reader(void *arg)
+{
+	struct snapshot_reader_ctx *ctx = (struct snapshot_reader_ctx *)arg;
+	refop_snapshot_t snapshot = NULL;
+	const uint8_t *data = NULL;
+	int64_t size = 0;
+	int errors = 0;
+	long reads = 0;
+
+	while (__atomic_load_n(&ctx->stop, __ATOMIC_ACQUIRE) == false) {
+		if (refop_snapshot_acquire(ctx->handle, &snapshot, &data, &size) != REFOP_SUCCESS) {
+			errors++;
+			continue;
+		}
+		for (int64_t i = 1; i < size; i++) {
+			if (data[i] != data[0]) {
+				errors++;
+				break;
+			}
+		}
+		(void)refop_snapshot_release(snapshot);
+		reads++;
+	}
+
+	__atomic_add_fetch(&ctx->errors, errors, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&ctx->reads, reads, __ATOMIC_RELAXED);
+
+	return NULL;
+}
+//--------------------------------------------------------------------------------------------------------
+static size_t g_max_alloc = 0;
+
+static void *max_alloc(size_t size, void *ctx)
+{
+	(void)ctx;
+	if (size > g_max_alloc)
+		g_max_alloc = size;
+	return malloc(size);
+}
+
+static void max_free(void *ptr, void *ctx)
+{
+	(void)ctx;
+	free(ptr);
+}
+//--------------------------------------------------------------------------------------------------------
+// Snapshot memory follows the value, not the size limit of the handle.
+TEST_F(interface_test_snapshot, interface_test_snapshot__load_memory)
+{
+	refop_handle_t writer = NULL, handle = NULL;
+	refop_snapshot_t snapshot = NULL;
+	const uint8_t *data = NULL;
+	refop_options_t opts;
+	uint8_t buf[10000];
+	int64_t size = 0;
+
+	cleanup_files(directry, testfiles);
+
+	// A value larger than the first buffer.
+	create_data(buf, sizeof(buf), 5);
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&writer, directry, file));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(writer, buf, sizeof(buf)));
+
+	g_max_alloc = 0;
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_allocator(max_alloc, max_free, NULL));
+
+	memset(&opts, 0, sizeof(opts));
+	opts.size_limit = REFOP_DATA_SIZE_LIMIT_MAX;
+	opts.thread_safe = true;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle, directry, file, &opts));
+	ASSERT_EQ(REFOP_SUCCESS, refop_snapshot_acquire(handle, &snapshot, &data, &size));
+	ASSERT_EQ(sizeof(buf), size);
+	ASSERT_EQ(0, memcmp(buf, data, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_snapshot_release(snapshot));
+
+	// A value that is smaller than the last one after retire.
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(writer, buf, 100));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(handle, REFOP_MODE_ROTATION));
+	ASSERT_EQ(REFOP_SUCCESS, refop_snapshot_acquire(handle, &snapshot, &data, &size));
+	ASSERT_EQ(100, size);
+	ASSERT_EQ(0, memcmp(buf, data, 100));
+	ASSERT_EQ(REFOP_SUCCESS, refop_snapshot_release(snapshot));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+
+	(void)refop_set_allocator(NULL, NULL, NULL);
+	ASSERT_GT((size_t)(64 * 1024), g_max_alloc);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(writer));
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_snapshot, interface_test_snapshot__concurrent)
+{
+	struct snapshot_reader_ctx ctx;
+	pthread_t tid[8];
+	uint8_t buf[1024];
+
+	cleanup_files(directry, testfiles);
+
+	ctx.handle = create_thread_safe_handle();
+	ASSERT_NE(nullptr, ctx.handle);
+	ctx.stop = false;
+	ctx.errors = 0;
+	ctx.reads = 0;
+
+	memset(buf, 0, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(ctx.handle, buf, sizeof(buf)));
+
+	for (int i = 0; i < 8; i++)
+		ASSERT_EQ(0, pthread_create(&tid[i], NULL, snapshot_reader, &ctx));
+
+	for (int n = 1; n <= 50; n++) {
+		memset(buf, n, sizeof(buf));
+		ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(ctx.handle, buf, sizeof(buf)));
+		if (n % 10 == 0)
+			ASSERT_EQ(REFOP_SUCCESS, refop_set_lazy_upgrade(ctx.handle, false));
+	}
+
+	__atomic_store_n(&ctx.stop, true, __ATOMIC_RELEASE);
+	for (int i = 0; i < 8; i++)
+		pthread_join(tid[i], NULL);
+
+	ASSERT_EQ(0, ctx.errors);
+	ASSERT_LT(0, ctx.reads);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(ctx.handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(ctx.handle));
+}
@@ -0,0 +1,281 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_store.cpp
+ * @brief	Public interface test fot refop store
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+#include "../lib/refop-store.c"
+}
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_store : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test-store/";
+static const char nodirectry[] = "/tmp/refop-test-store-noent/";
+
+//--------------------------------------------------------------------------------------------------------
+static void cleanup_key(const char *key)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s%s", directry, key);
+	(void)unlink(path);
+	snprintf(path, sizeof(path), "%s%s.bk1", directry, key);
+	(void)unlink(path);
+	snprintf(path, sizeof(path), "%s%s.tmp", directry, key);
+	(void)unlink(path);
+}
+//--------------------------------------------------------------------------------------------------------
+static void cleanup_keys(int nkeys)
+{
+	char key[32];
+
+	(void)mkdir(directry, 0777);
+	for (int i = 0; i < nkeys; i++) {
+		snprintf(key, sizeof(key), "key%d", i);
+		cleanup_key(key);
+	}
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_store, interface_test_store__arg_error)
+{
+	refop_store_t store = NULL;
+	refop_options_t opts;
+	uint8_t buf[16];
+	int64_t szr = 0;
+	char longkey[REFOP_STORE_KEY_MAX + 2];
+
+	cleanup_keys(1);
+	memset(buf, 0, sizeof(buf));
+
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_open(NULL, directry, NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_open(&store, NULL, NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_open(&store, "", NULL));
+	memset(&opts, 0, sizeof(opts));
+	opts.backup_count = 100;
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_open(&store, directry, &opts));
+	ASSERT_EQ(REFOP_NOENT, refop_store_open(&store, nodirectry, NULL));
+
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_close(NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(NULL, "key0", buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_get(NULL, "key0", buf, sizeof(buf), &szr));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_remove(NULL, "key0"));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_open(&store, directry, NULL));
+
+	memset(longkey, 'a', sizeof(longkey));
+	longkey[sizeof(longkey) - 1] = '\0';
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(store, NULL, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(store, "", buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(store, ".", buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(store, "..", buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(store, "a/b", buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(store, longkey, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(store, "key0.bk1", buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(store, "key0.tmp", buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(store, "key0.lck", buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(store, "key0.g12", buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(store, "key0.jnl", buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(store, ".refop-txn", buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_get(store, "key0.ab", buf, sizeof(buf), &szr));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_remove(store, "key0.par"));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(store, "key0", NULL, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_set(store, "key0", buf, -1));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_get(store, "key0", NULL, sizeof(buf), &szr));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_get(store, "key0", buf, -1, &szr));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_get(store, "key0", buf, sizeof(buf), NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_store_remove(store, "a/b"));
+
+	ASSERT_EQ(REFOP_NOENT, refop_store_get(store, "key0", buf, sizeof(buf), &szr));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_close(store));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_store, interface_test_store__many_keys)
+{
+	refop_store_t store = NULL;
+	uint8_t buf[64], rbuf[64];
+	int64_t szr = 0;
+	char key[32];
+	const int nkeys = 200;
+
+	cleanup_keys(nkeys);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_open(&store, directry, NULL));
+	for (int i = 0; i < nkeys; i++) {
+		snprintf(key, sizeof(key), "key%d", i);
+		memset(buf, i & 0xff, sizeof(buf));
+		ASSERT_EQ(REFOP_SUCCESS, refop_store_set(store, key, buf, sizeof(buf) - (i % 7)));
+	}
+	// Keys are interned once, buckets grow with keys.
+	ASSERT_EQ((size_t)nkeys, store->nkeys);
+	ASSERT_LE(store->nkeys, store->nbuckets);
+	ASSERT_EQ((unsigned int)nkeys + 1, store->dir->refcount);
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_close(store));
+
+	// Reopened store read from files.
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_open(&store, directry, NULL));
+	for (int i = 0; i < nkeys; i++) {
+		snprintf(key, sizeof(key), "key%d", i);
+		memset(rbuf, 0xee, sizeof(rbuf));
+		ASSERT_EQ(REFOP_SUCCESS, refop_store_get(store, key, rbuf, sizeof(rbuf), &szr));
+		ASSERT_EQ((int64_t)(sizeof(buf) - (i % 7)), szr);
+		ASSERT_EQ(i & 0xff, rbuf[0]);
+		ASSERT_EQ(i & 0xff, rbuf[szr - 1]);
+	}
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_close(store));
+
+	cleanup_keys(nkeys);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_store, interface_test_store__cache)
+{
+	refop_store_t store = NULL;
+	uint8_t buf[128], rbuf[128];
+	int64_t szr = 0;
+
+	cleanup_keys(1);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_open(&store, directry, NULL));
+	memset(buf, 0x5a, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_set(store, "key0", buf, sizeof(buf)));
+	ASSERT_EQ(sizeof(buf), store->cache_used);
+
+	// Cached value is read without files.
+	cleanup_key("key0");
+	memset(rbuf, 0, sizeof(rbuf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_get(store, "key0", rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ((int64_t)sizeof(buf), szr);
+	ASSERT_EQ(0, memcmp(buf, rbuf, sizeof(buf)));
+
+	// Small buffer is not served from cache.
+	ASSERT_EQ(REFOP_NOENT, refop_store_get(store, "key0", rbuf, sizeof(rbuf) - 1, &szr));
+
+	// Remove drops cached value.
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_set(store, "key0", buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_remove(store, "key0"));
+	ASSERT_EQ(0u, store->cache_used);
+	ASSERT_EQ(REFOP_NOENT, refop_store_get(store, "key0", rbuf, sizeof(rbuf), &szr));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_close(store));
+	cleanup_keys(1);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_store, interface_test_store__lru)
+{
+	refop_store_t store = NULL;
+	refop_options_t opts;
+	uint8_t buf[100], rbuf[100];
+	int64_t szr = 0;
+
+	cleanup_keys(4);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.cache_budget = 300;
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_open(&store, directry, &opts));
+
+	memset(buf, 1, sizeof(buf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_set(store, "key0", buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_set(store, "key1", buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_set(store, "key2", buf, sizeof(buf)));
+	ASSERT_EQ(300u, store->cache_used);
+
+	// key0 is used, so key1 is least recently used.
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_get(store, "key0", rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_set(store, "key3", buf, sizeof(buf)));
+	ASSERT_EQ(300u, store->cache_used);
+
+	cleanup_key("key0");
+	cleanup_key("key1");
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_get(store, "key0", rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(REFOP_NOENT, refop_store_get(store, "key1", rbuf, sizeof(rbuf), &szr));
+
+	// Value over the budget is not cached.
+	uint8_t large[400];
+	memset(large, 2, sizeof(large));
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_set(store, "key2", large, sizeof(large)));
+	ASSERT_EQ(200u, store->cache_used);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_close(store));
+	cleanup_keys(4);
+}
+//--------------------------------------------------------------------------------------------------------
+struct store_thread_arg {
+	refop_store_t store;
+	int id;
+	int loops;
+	refop_error_t result;
+};
+
+static void *store_set_thread(void *arg)
+{
+	struct store_thread_arg *ta = (struct store_thread_arg *)arg;
+	uint8_t buf[256];
+	char key[32];
+
+	ta->result = REFOP_SUCCESS;
+	snprintf(key, sizeof(key), "key%d", ta->id);
+	for (int i = 0; i < ta->loops; i++) {
+		memset(buf, i & 0xff, sizeof(buf));
+		if (refop_store_set(ta->store, key, buf, sizeof(buf)) != REFOP_SUCCESS)
+			ta->result = REFOP_SYSERROR;
+	}
+
+	return NULL;
+}
+
+TEST_F(interface_test_store, interface_test_store__concurrent_set)
+{
+	refop_store_t store = NULL;
+	pthread_t threads[8];
+	struct store_thread_arg args[8];
+	uint8_t rbuf[256];
+	int64_t szr = 0;
+	char key[32];
+
+	cleanup_keys(8);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_open(&store, directry, NULL));
+	for (int i = 0; i < 8; i++) {
+		args[i].store = store;
+		args[i].id = i;
+		args[i].loops = 20;
+		ASSERT_EQ(0, pthread_create(&threads[i], NULL, store_set_thread, &args[i]));
+	}
+	for (int i = 0; i < 8; i++) {
+		ASSERT_EQ(0, pthread_join(threads[i], NULL));
+		ASSERT_EQ(REFOP_SUCCESS, args[i].result);
+	}
+
+	// Every set was covered by a directory sync.
+	ASSERT_EQ(160u, store->sync_requested);
+	ASSERT_EQ(store->sync_requested, store->sync_done);
+	ASSERT_EQ(8u, store->nkeys);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_close(store));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_open(&store, directry, NULL));
+	for (int i = 0; i < 8; i++) {
+		snprintf(key, sizeof(key), "key%d", i);
+		ASSERT_EQ(REFOP_SUCCESS, refop_store_get(store, key, rbuf, sizeof(rbuf), &szr));
+		ASSERT_EQ(19, rbuf[0]);
+	}
+	ASSERT_EQ(REFOP_SUCCESS, refop_store_close(store));
+
+	cleanup_keys(8);
+}
@@ -0,0 +1,170 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_thread.cpp
+ * @brief	Public interface test fot thread safe handle
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_thread : Test {
+	void TearDown() override
+	{
+		(void)refop_set_default_options(NULL);
+	}
+};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-thread.bin";
+static const char latestfile[] = "/tmp/refop-test/test-thread.bin";
+static const char backupfile[] = "/tmp/refop-test/test-thread.bin.bk1";
+static const char newfile[] = "/tmp/refop-test/test-thread.bin.tmp";
+static const char pingpongfile0[] = "/tmp/refop-test/test-thread.bin.g0";
+static const char pingpongfile1[] = "/tmp/refop-test/test-thread.bin.g1";
+static const char slotfile[] = "/tmp/refop-test/test-thread.bin.ab";
+
+#define TEST_READERS (4)
+#define TEST_WRITES (40)
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, pingpongfile0, pingpongfile1, slotfile, NULL };
+//--------------------------------------------------------------------------------------------------------
+static bool check_data(const uint8_t *pbuf, int64_t sz)
+{
+	uint8_t seed = pbuf[0];
+
+	for (int64_t i = 1; i < sz; i++) {
+		if (pbuf[i] != (uint8_t)((i * 13) + seed))
+			return false;
+	}
+	return true;
+}
+//--------------------------------------------------------------------------------------------------------
+// One writer and some readers use one handle.  Every get shall return a complete generation.
+static void stress(refop_mode_t mode)
+{
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+	std::vector<std::thread> readers;
+	std::atomic<bool> done(false);
+	std::atomic<int> errors(0), reads(0);
+	int64_t sz = 8 * 1024;
+	uint8_t *pbuf = NULL;
+
+	cleanup_files(directry, testfiles);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.thread_safe = true;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&handle, directry, file, &opts));
+	ASSERT_NE(nullptr, handle->lock);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_slot_capacity(handle, sz));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(handle, mode));
+
+	pbuf = (uint8_t *)malloc(sz);
+	create_data(pbuf, sz, 0);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, pbuf, sz));
+
+	for (int i = 0; i < TEST_READERS; i++) {
+		readers.emplace_back([&]() {
+			uint8_t *rbuf = (uint8_t *)malloc(sz);
+			int64_t szr = 0;
+
+			while (done.load() == false) {
+				if (refop_get_redundancy_data(handle, rbuf, sz, &szr) != REFOP_SUCCESS || szr != sz ||
+				    check_data(rbuf, sz) == false)
+					errors++;
+				reads++;
+			}
+			free(rbuf);
+		});
+	}
+
+	for (int i = 1; i <= TEST_WRITES; i++) {
+		create_data(pbuf, sz, (uint8_t)i);
+		if (refop_set_redundancy_data(handle, pbuf, sz) != REFOP_SUCCESS)
+			errors++;
+	}
+	done = true;
+
+	for (auto &t : readers)
+		t.join();
+
+	ASSERT_EQ(0, errors.load());
+	ASSERT_LT(0, reads.load());
+
+	// Last generation is visible.
+	memset(pbuf, 0, sz);
+	int64_t szr = 0;
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(handle, pbuf, sz, &szr));
+	ASSERT_EQ((uint8_t)TEST_WRITES, pbuf[0]);
+	ASSERT_TRUE(check_data(pbuf, sz));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(handle));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+	free(pbuf);
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_thread, interface_test_thread__option)
+{
+	refop_handle_t handle = NULL;
+	refop_options_t opts;
+
+	cleanup_files(directry, testfiles);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+	ASSERT_EQ(nullptr, handle->lock);
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+
+	// Process wide default
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_default_options(&opts));
+	ASSERT_FALSE(opts.thread_safe);
+	opts.thread_safe = true;
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_default_options(&opts));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+	ASSERT_NE(nullptr, handle->lock);
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_thread, interface_test_thread__stress_rotation)
+{
+	stress(REFOP_MODE_ROTATION);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_thread, interface_test_thread__stress_pingpong)
+{
+	stress(REFOP_MODE_PINGPONG);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_thread, interface_test_thread__stress_slot)
+{
+	stress(REFOP_MODE_SLOT);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_thread, interface_test_thread__stress_journal)
+{
+	static const char journalfile[] = "/tmp/refop-test/test-thread.bin.jnl";
+
+	(void)unlink(journalfile);
+	stress(REFOP_MODE_JOURNAL);
+	(void)unlink(journalfile);
+}
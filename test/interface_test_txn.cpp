@@ -0,0 +1,418 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_txn.cpp
+ * @brief	Public interface test fot multi-key transaction
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+#include "../lib/crc16.h"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_txn : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test-txn/";
+static const char otherdir[] = "/tmp/refop-test-txn-other/";
+static const char file_a[] = "test-txn-a.bin";
+static const char file_b[] = "test-txn-b.bin";
+static const char manifest[] = "/tmp/refop-test-txn/.refop-txn";
+static const char manifest_new[] = "/tmp/refop-test-txn/.refop-txn.tmp";
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = {
+	"/tmp/refop-test-txn/test-txn-a.bin",
+	"/tmp/refop-test-txn/test-txn-a.bin.bk1",
+	"/tmp/refop-test-txn/test-txn-a.bin.tmp",
+	"/tmp/refop-test-txn/test-txn-b.bin",
+	"/tmp/refop-test-txn/test-txn-b.bin.bk1",
+	"/tmp/refop-test-txn/test-txn-b.bin.tmp",
+	"/tmp/refop-test-txn/test-txn-b.bin.g0",
+	"/tmp/refop-test-txn/test-txn-b.bin.g1",
+	manifest,
+	manifest_new,
+	"/tmp/refop-test-txn/.refop-txn.lck",
+	NULL,
+};
+//--------------------------------------------------------------------------------------------------------
+// Write a manifest as an interrupted commit left it.
+static int write_manifest(const char *path, const uint8_t *a, uint64_t asize, const uint8_t *b, uint64_t bsize,
+			  bool broken)
+{
+	s_refop_txn_manifest head;
+	s_refop_txn_record rec;
+	uint8_t body[4096];
+	size_t offset = 0;
+	int fd = -1;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.size = asize;
+	rec.name_size = strlen(file_a);
+	rec.mode = REFOP_MODE_ROTATION;
+	memcpy(body + offset, &rec, sizeof(rec));
+	offset += sizeof(rec);
+	memcpy(body + offset, file_a, rec.name_size);
+	offset += rec.name_size;
+	memcpy(body + offset, a, asize);
+	offset += asize;
+
+	rec.size = bsize;
+	rec.name_size = strlen(file_b);
+	rec.mode = REFOP_MODE_PINGPONG;
+	memcpy(body + offset, &rec, sizeof(rec));
+	offset += sizeof(rec);
+	memcpy(body + offset, file_b, rec.name_size);
+	offset += rec.name_size;
+	memcpy(body + offset, b, bsize);
+	offset += bsize;
+
+	head.magic = REFOP_TXN_MAGIC;
+	head.count = 2;
+	head.size = offset;
+	head.crc16 = crc16(0xffff, body, offset);
+	head.crc16_inv = ~head.crc16;
+
+	// A torn manifest lost its tail.
+	if (broken == true)
+		offset -= 10;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return -1;
+	if (write(fd, &head, sizeof(head)) != (ssize_t)sizeof(head) || write(fd, body, offset) != (ssize_t)offset) {
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	return 0;
+}
+//--------------------------------------------------------------------------------------------------------
+static void set_old_values(uint8_t *abuf, uint8_t *bbuf, int64_t size)
+{
+	refop_handle_t a = NULL, b = NULL;
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&a, directry, file_a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&b, directry, file_b));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(b, REFOP_MODE_PINGPONG));
+	memset(abuf, 0x01, size);
+	memset(bbuf, 0x02, size);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(a, abuf, size));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(b, bbuf, size));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(b));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_txn, interface_test_txn__arg_error)
+{
+	refop_handle_t a = NULL, other = NULL;
+	refop_txn_t txn = NULL;
+	uint8_t buf[16];
+
+	cleanup_files(directry, testfiles);
+	(void)mkdir(otherdir, 0777);
+	memset(buf, 0, sizeof(buf));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&a, directry, file_a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&other, otherdir, file_b));
+
+	ASSERT_EQ(REFOP_ARGERROR, refop_txn_begin(NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_txn_commit(NULL));
+	ASSERT_EQ(REFOP_ARGERROR, refop_txn_abort(NULL));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_begin(&txn));
+	ASSERT_EQ(REFOP_ARGERROR, refop_txn_set(NULL, a, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_txn_set(txn, NULL, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_txn_set(txn, a, NULL, sizeof(buf)));
+	ASSERT_EQ(REFOP_ARGERROR, refop_txn_set(txn, a, buf, -1));
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_set(txn, a, buf, sizeof(buf)));
+
+	// All handles of a transaction are in one directory.
+	ASSERT_EQ(REFOP_ARGERROR, refop_txn_set(txn, other, buf, sizeof(buf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_abort(txn));
+
+	// Empty transaction does nothing.
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_begin(&txn));
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_commit(txn));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(other));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_txn, interface_test_txn__commit)
+{
+	refop_handle_t a = NULL, b = NULL;
+	refop_txn_t txn = NULL;
+	uint8_t abuf[300], bbuf[200], rbuf[512];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&a, directry, file_a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&b, directry, file_b));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(b, REFOP_MODE_PINGPONG));
+
+	memset(abuf, 0x11, sizeof(abuf));
+	memset(bbuf, 0x22, sizeof(bbuf));
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_begin(&txn));
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_set(txn, a, abuf, 100));
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_set(txn, b, bbuf, sizeof(bbuf)));
+
+	// Files are not changed until commit, and the last staged value of a handle is used.
+	ASSERT_EQ(REFOP_NOENT, refop_get_redundancy_data(a, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_set(txn, a, abuf, sizeof(abuf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_commit(txn));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(a, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(sizeof(abuf), szr);
+	ASSERT_EQ(0, memcmp(abuf, rbuf, sizeof(abuf)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(b, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(sizeof(bbuf), szr);
+	ASSERT_EQ(0, memcmp(bbuf, rbuf, sizeof(bbuf)));
+
+	// The manifest is removed after all values were set.
+	ASSERT_NE(0, access(manifest, F_OK));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(b));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(b));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_txn, interface_test_txn__roll_forward)
+{
+	refop_handle_t a = NULL, b = NULL;
+	uint8_t abuf[128], bbuf[128], anew[64], bnew[96], rbuf[256];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	set_old_values(abuf, bbuf, sizeof(abuf));
+
+	// A committed manifest, values were not set before crash.
+	memset(anew, 0x31, sizeof(anew));
+	memset(bnew, 0x32, sizeof(bnew));
+	ASSERT_EQ(0, write_manifest(manifest, anew, sizeof(anew), bnew, sizeof(bnew), false));
+
+	// First pickup in the directory rolls all values forward.
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&a, directry, file_a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(a, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(sizeof(anew), szr);
+	ASSERT_EQ(0, memcmp(anew, rbuf, sizeof(anew)));
+	ASSERT_NE(0, access(manifest, F_OK));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&b, directry, file_b));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(b, REFOP_MODE_PINGPONG));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(b, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(sizeof(bnew), szr);
+	ASSERT_EQ(0, memcmp(bnew, rbuf, sizeof(bnew)));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(b));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(b));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_txn, interface_test_txn__roll_back)
+{
+	refop_handle_t a = NULL, b = NULL;
+	uint8_t abuf[128], bbuf[128], anew[64], bnew[96], rbuf[256];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+	set_old_values(abuf, bbuf, sizeof(abuf));
+
+	// A torn manifest and a manifest that was not renamed were not committed.
+	memset(anew, 0x41, sizeof(anew));
+	memset(bnew, 0x42, sizeof(bnew));
+	ASSERT_EQ(0, write_manifest(manifest, anew, sizeof(anew), bnew, sizeof(bnew), true));
+	ASSERT_EQ(0, write_manifest(manifest_new, anew, sizeof(anew), bnew, sizeof(bnew), false));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&b, directry, file_b));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(b, REFOP_MODE_PINGPONG));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(b, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(sizeof(bbuf), szr);
+	ASSERT_EQ(0, memcmp(bbuf, rbuf, sizeof(bbuf)));
+	ASSERT_NE(0, access(manifest, F_OK));
+	ASSERT_NE(0, access(manifest_new, F_OK));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&a, directry, file_a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(a, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(sizeof(abuf), szr);
+	ASSERT_EQ(0, memcmp(abuf, rbuf, sizeof(abuf)));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(b));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(b));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_txn, interface_test_txn__roll_forward_options)
+{
+	refop_handle_t a = NULL;
+	refop_options_t opts;
+	s_refop_txn_manifest head;
+	s_refop_txn_record rec;
+	const uint64_t size = 2 * 1024 * 1024;
+	uint8_t *body = NULL, *rbuf = NULL;
+	struct stat sb;
+	size_t offset = 0;
+	int64_t szr = 0;
+	int fd = -1;
+
+	cleanup_files(directry, testfiles);
+
+	// A committed value over the default size limit by a compression handle.
+	body = (uint8_t *)malloc(sizeof(rec) + sizeof(file_a) + size);
+	rbuf = (uint8_t *)malloc(size);
+	ASSERT_NE(nullptr, body);
+	ASSERT_NE(nullptr, rbuf);
+	memset(&rec, 0, sizeof(rec));
+	rec.size = size;
+	rec.size_limit = 4 * 1024 * 1024;
+	rec.name_size = strlen(file_a);
+	rec.mode = REFOP_MODE_ROTATION;
+	rec.flags = REFOP_TXN_FLAG_COMPRESSION;
+	memcpy(body + offset, &rec, sizeof(rec));
+	offset += sizeof(rec);
+	memcpy(body + offset, file_a, rec.name_size);
+	offset += rec.name_size;
+	memset(body + offset, 0x51, size);
+	offset += size;
+
+	head.magic = REFOP_TXN_MAGIC;
+	head.count = 1;
+	head.size = offset;
+	head.crc16 = crc16(0xffff, body, offset);
+	head.crc16_inv = ~head.crc16;
+	fd = open(manifest, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	ASSERT_LE(0, fd);
+	ASSERT_EQ((ssize_t)sizeof(head), write(fd, &head, sizeof(head)));
+	ASSERT_EQ((ssize_t)offset, write(fd, body, offset));
+	close(fd);
+
+	// The roll forward uses the size limit and the format of the committed handle.
+	memset(&opts, 0, sizeof(opts));
+	opts.size_limit = 4 * 1024 * 1024;
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle_ex(&a, directry, file_a, &opts));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(a, rbuf, size, &szr));
+	ASSERT_EQ(size, szr);
+	ASSERT_EQ(0, memcmp(body + sizeof(rec) + rec.name_size, rbuf, size));
+	ASSERT_NE(0, access(manifest, F_OK));
+	ASSERT_EQ(0, stat("/tmp/refop-test-txn/test-txn-a.bin", &sb));
+	ASSERT_GT(size, (uint64_t)sb.st_size);
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(a));
+	free(body);
+	free(rbuf);
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_txn, interface_test_txn__stuck_manifest)
+{
+	refop_handle_t a = NULL, b = NULL;
+	refop_txn_t txn = NULL;
+	uint8_t abuf[128], bbuf[128], anew[64], rbuf[256];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	// Files of b can not be written, so the committed manifest can not be rolled forward.
+	memset(abuf, 0x61, sizeof(abuf));
+	memset(bbuf, 0x62, sizeof(bbuf));
+	ASSERT_EQ(0, mkdir("/tmp/refop-test-txn/test-txn-b.bin.g0", 0777));
+	ASSERT_EQ(0, mkdir("/tmp/refop-test-txn/test-txn-b.bin.g1", 0777));
+	ASSERT_EQ(0, write_manifest(manifest, abuf, sizeof(abuf), bbuf, sizeof(bbuf), false));
+
+	// Commits fail and the manifest is kept while a record of it is not set.
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&a, directry, file_a));
+	memset(anew, 0x63, sizeof(anew));
+	for (int i = 0; i < 5; i++) {
+		ASSERT_EQ(REFOP_SUCCESS, refop_txn_begin(&txn));
+		ASSERT_EQ(REFOP_SUCCESS, refop_txn_set(txn, a, anew, sizeof(anew)));
+		ASSERT_EQ(REFOP_SYSERROR, refop_txn_commit(txn));
+		ASSERT_EQ(0, access(manifest, F_OK));
+	}
+
+	// The value of the manifest was set to a, no value of failed commits was written.
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(a, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(sizeof(abuf), szr);
+	ASSERT_EQ(0, memcmp(abuf, rbuf, sizeof(abuf)));
+	ASSERT_EQ(0, access(manifest, F_OK));
+
+	// Next access finishes the manifest when b can be written.
+	ASSERT_EQ(0, rmdir("/tmp/refop-test-txn/test-txn-b.bin.g0"));
+	ASSERT_EQ(0, rmdir("/tmp/refop-test-txn/test-txn-b.bin.g1"));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(a, rbuf, sizeof(rbuf), &szr));
+	ASSERT_NE(0, access(manifest, F_OK));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&b, directry, file_b));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(b, REFOP_MODE_PINGPONG));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(b, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(sizeof(bbuf), szr);
+	ASSERT_EQ(0, memcmp(bbuf, rbuf, sizeof(bbuf)));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_begin(&txn));
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_set(txn, a, anew, sizeof(anew)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_commit(txn));
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(a, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(sizeof(anew), szr);
+	ASSERT_EQ(0, memcmp(anew, rbuf, sizeof(anew)));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(b));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(b));
+}
+//--------------------------------------------------------------------------------------------------------
+// Queued asynchronous sets recover the manifest by workers, those are done before the commit.
+TEST_F(interface_test_txn, interface_test_txn__commit_async)
+{
+	refop_handle_t a = NULL;
+	refop_txn_t txn = NULL;
+	refop_future_t futures[8];
+	uint8_t abuf[128], bbuf[128], aset[64], anew[96], rbuf[256];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	memset(abuf, 0x71, sizeof(abuf));
+	memset(bbuf, 0x72, sizeof(bbuf));
+	memset(aset, 0x73, sizeof(aset));
+	memset(anew, 0x74, sizeof(anew));
+	ASSERT_EQ(0, write_manifest(manifest, abuf, sizeof(abuf), bbuf, sizeof(bbuf), false));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&a, directry, file_a));
+	for (int i = 0; i < 8; i++)
+		ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data_async(a, aset, sizeof(aset), &futures[i]));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_begin(&txn));
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_set(txn, a, anew, sizeof(anew)));
+	ASSERT_EQ(REFOP_SUCCESS, refop_txn_commit(txn));
+	ASSERT_NE(0, access(manifest, F_OK));
+
+	for (int i = 0; i < 8; i++) {
+		ASSERT_EQ(REFOP_SUCCESS, refop_future_wait(futures[i], -1));
+		ASSERT_EQ(REFOP_SUCCESS, refop_future_release(futures[i]));
+	}
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_get_redundancy_data(a, rbuf, sizeof(rbuf), &szr));
+	ASSERT_EQ(sizeof(anew), szr);
+	ASSERT_EQ(0, memcmp(anew, rbuf, sizeof(anew)));
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_remove_redundancy_data(a));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(a));
+	cleanup_files(directry, testfiles);
+}
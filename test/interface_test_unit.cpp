@@ -143,17 +143,23 @@ TEST_F(interface_test_unit, interface_test_unit_refop_create_redundancy_handle__
 	char resultstr[] = "/tmp/test.bin";
 	char resultstr_bk1[] = "/tmp/test.bin.bk1";
 	char resultstr_new[] = "/tmp/test.bin.tmp";
+	char path[PATH_MAX];
 
+	// Rotation files are probed once by handle creation.
+	EXPECT_CALL(sysiom, stat(HasSubstr("test"), _)).WillRepeatedly(SetErrnoAndReturn(ENOENT, -1));
 	//short directry string
 	EXPECT_CALL(sysiom, stat(directry, _)).WillOnce(Return(0));
 	ret = refop_create_redundancy_handle(&handle, directry, file);
 	ASSERT_EQ(REFOP_SUCCESS, ret);
 	//data check
 	hndl = (struct refop_halndle *)handle;
-	ASSERT_EQ(0, strcmp(hndl->latestfile,resultstr));
-	ASSERT_EQ(0, strcmp(hndl->backupfile1,resultstr_bk1));
-	ASSERT_EQ(0, strcmp(hndl->newfile,resultstr_new));
-	ASSERT_EQ(0, strcmp(hndl->basedir,directry2));
+	ASSERT_EQ(0, refop_handle_path(handle, "", path));
+	ASSERT_EQ(0, strcmp(path,resultstr));
+	ASSERT_EQ(0, refop_handle_path(handle, c_bk1_suffix, path));
+	ASSERT_EQ(0, strcmp(path,resultstr_bk1));
+	ASSERT_EQ(0, refop_handle_path(handle, c_new_suffix, path));
+	ASSERT_EQ(0, strcmp(path,resultstr_new));
+	ASSERT_EQ(0, strcmp(hndl->dir->path,directry2));
 	ret = refop_release_redundancy_handle(handle);
 	ASSERT_EQ(REFOP_SUCCESS, ret);
 
@@ -163,14 +169,61 @@ TEST_F(interface_test_unit, interface_test_unit_refop_create_redundancy_handle__
 	ASSERT_EQ(REFOP_SUCCESS, ret);
 	//data check
 	hndl = (struct refop_halndle *)handle;
-	ASSERT_EQ(0, strcmp(hndl->latestfile,resultstr));
-	ASSERT_EQ(0, strcmp(hndl->backupfile1,resultstr_bk1));
-	ASSERT_EQ(0, strcmp(hndl->newfile,resultstr_new));
-	ASSERT_EQ(0, strcmp(hndl->basedir,directry2));
+	ASSERT_EQ(0, refop_handle_path(handle, "", path));
+	ASSERT_EQ(0, strcmp(path,resultstr));
+	ASSERT_EQ(0, refop_handle_path(handle, c_bk1_suffix, path));
+	ASSERT_EQ(0, strcmp(path,resultstr_bk1));
+	ASSERT_EQ(0, refop_handle_path(handle, c_new_suffix, path));
+	ASSERT_EQ(0, strcmp(path,resultstr_new));
+	ASSERT_EQ(0, strcmp(hndl->dir->path,directry2));
 	ret = refop_release_redundancy_handle(handle);
 	ASSERT_EQ(REFOP_SUCCESS, ret);
 }
 //--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_unit, interface_test_unit_refop_create_redundancy_handle__shared_dir)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle1 = NULL, handle2 = NULL, handle3 = NULL;
+
+	//dummy data
+	char directry[] = "/tmp";
+	char directry2[] = "/tmp/";
+	char directry3[] = "/var/tmp";
+	char file[] = "test.bin";
+	char file2[] = "test2.bin";
+
+	// Handle has no path buffer, per handle memory is small.
+	ASSERT_GT((size_t)100, sizeof(struct refop_halndle));
+
+	EXPECT_CALL(sysiom, stat(_, _))
+		.WillOnce(Return(0))
+		.WillOnce(Return(0))
+		.WillOnce(Return(0));
+	// Rotation files are probed once by handle creation.
+	EXPECT_CALL(sysiom, stat(HasSubstr("test"), _)).WillRepeatedly(SetErrnoAndReturn(ENOENT, -1));
+	ret = refop_create_redundancy_handle(&handle1, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_create_redundancy_handle(&handle2, directry2, file2);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_create_redundancy_handle(&handle3, directry3, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	// "/tmp" and "/tmp/" are same directory reference.
+	ASSERT_EQ(handle1->dir, handle2->dir);
+	ASSERT_EQ(2u, handle1->dir->refcount);
+	ASSERT_NE(handle1->dir, handle3->dir);
+	ASSERT_EQ(0, strcmp(handle1->name, file));
+	ASSERT_EQ(0, strcmp(handle2->name, file2));
+
+	ret = refop_release_redundancy_handle(handle1);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(1u, handle2->dir->refcount);
+	ret = refop_release_redundancy_handle(handle2);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ret = refop_release_redundancy_handle(handle3);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+}
+//--------------------------------------------------------------------------------------------------------
 TEST_F(interface_test_unit, interface_test_unit_refop_release_redundancy_handle__all)
 {
 	struct refop_halndle *hndl;
@@ -185,6 +238,8 @@ TEST_F(interface_test_unit, interface_test_unit_refop_release_redundancy_handle_
 	char resultstr_bk1[] = "/tmp/test.bin.bk1";
 	char resultstr_new[] = "/tmp/test.bin.tmp";
 
+	// Rotation files are probed once by handle creation.
+	EXPECT_CALL(sysiom, stat(HasSubstr("test"), _)).WillRepeatedly(SetErrnoAndReturn(ENOENT, -1));
 	//short directry string
 	EXPECT_CALL(sysiom, stat(directry, _)).WillOnce(Return(0));
 	ret = refop_create_redundancy_handle(&handle, directry, file);
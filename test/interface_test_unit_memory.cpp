@@ -34,7 +34,7 @@ TEST_F(interface_test_unit_memory_test, interface_test_unit_memory_test_refop_cr
 
 	//short directry string
 	EXPECT_CALL(sysiom, stat(directry, _)).WillOnce(Return(0));
-	EXPECT_CALL(memorym, malloc(_)).WillOnce(Return(NULL));
+	EXPECT_CALL(memorym, malloc(_)).WillOnce(Return(nullptr));
 	ret = refop_create_redundancy_handle(&handle, directry, file);
 	ASSERT_EQ(REFOP_SYSERROR, ret);
 }
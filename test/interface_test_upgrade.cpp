@@ -0,0 +1,139 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_upgrade.cpp
+ * @brief	Public interface test fot refop lazy upgrade
+ */
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Test Terget files ---------------------------------------
+extern "C" {
+#include "../lib/libredundancyfileop.c"
+}
+#include "interface_test_utils.h"
+
+// Test Terget files ---------------------------------------
+using namespace ::testing;
+
+struct interface_test_upgrade : Test {};
+
+//dummy data
+static const char directry[] = "/tmp/refop-test/";
+static const char file[] = "test-upgrade.bin";
+static const char latestfile[] = "/tmp/refop-test/test-upgrade.bin";
+static const char backupfile[] = "/tmp/refop-test/test-upgrade.bin.bk1";
+static const char newfile[] = "/tmp/refop-test/test-upgrade.bin.tmp";
+static const char pingpongfile0[] = "/tmp/refop-test/test-upgrade.bin.g0";
+static const char pingpongfile1[] = "/tmp/refop-test/test-upgrade.bin.g1";
+static const char slotfile[] = "/tmp/refop-test/test-upgrade.bin.ab";
+static const char parityfile[] = "/tmp/refop-test/test-upgrade.bin.par";
+
+//--------------------------------------------------------------------------------------------------------
+static const char *const testfiles[] = { newfile, latestfile, backupfile, pingpongfile0, pingpongfile1, slotfile, parityfile, NULL };
+//--------------------------------------------------------------------------------------------------------
+static void write_rotation_data(uint8_t *pbuf, int64_t sz, bool compression)
+{
+	refop_handle_t handle = NULL;
+
+	ASSERT_EQ(REFOP_SUCCESS, refop_create_redundancy_handle(&handle, directry, file));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_compression(handle, compression));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, pbuf, sz));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_data(handle, pbuf, sz));
+	ASSERT_EQ(REFOP_SUCCESS, refop_release_redundancy_handle(handle));
+}
+//--------------------------------------------------------------------------------------------------------
+TEST_F(interface_test_upgrade, interface_test_upgrade__arg_error)
+{
+	ASSERT_EQ(REFOP_ARGERROR, refop_set_lazy_upgrade(NULL, true));
+}
+//--------------------------------------------------------------------------------------------------------
+// Rotation mode data is read by other mode until first set, and removed by first set.
+TEST_F(interface_test_upgrade, interface_test_upgrade_modes)
+{
+	const refop_mode_t modes[] = { REFOP_MODE_PINGPONG, REFOP_MODE_SLOT, REFOP_MODE_PARITY };
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t wbuf[5000], rbuf[5000];
+	int64_t szr = 0;
+
+	for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		cleanup_files(directry, testfiles);
+
+		create_data(wbuf, sizeof(wbuf), (uint8_t)i);
+		write_rotation_data(wbuf, sizeof(wbuf), (i == 1));
+
+		ret = refop_create_redundancy_handle(&handle, directry, file);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+		ret = refop_set_redundancy_mode(handle, modes[i]);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+		ret = refop_set_slot_capacity(handle, 8192);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+
+		// Without lazy upgrade, other mode does not read rotation mode files.
+		ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+		ASSERT_EQ(REFOP_NOENT, ret);
+
+		ret = refop_set_lazy_upgrade(handle, true);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+		ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+		ASSERT_EQ((int64_t)sizeof(wbuf), szr);
+		ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+		ASSERT_EQ(0, access(latestfile, F_OK));
+
+		// First set upgrade the data.
+		create_data(wbuf, sizeof(wbuf), (uint8_t)(i + 100));
+		ret = refop_set_redundancy_data(handle, wbuf, sizeof(wbuf));
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+		ASSERT_NE(0, access(latestfile, F_OK));
+		ASSERT_NE(0, access(backupfile, F_OK));
+
+		ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+		ASSERT_EQ(0, memcmp(wbuf, rbuf, szr));
+
+		ret = refop_release_redundancy_handle(handle);
+		ASSERT_EQ(REFOP_SUCCESS, ret);
+	}
+
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
+// Remove operation remove old data too.
+TEST_F(interface_test_upgrade, interface_test_upgrade_remove)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	refop_handle_t handle = NULL;
+	uint8_t wbuf[100], rbuf[100];
+	int64_t szr = 0;
+
+	cleanup_files(directry, testfiles);
+
+	create_data(wbuf, sizeof(wbuf), 1);
+	write_rotation_data(wbuf, sizeof(wbuf), false);
+
+	ret = refop_create_redundancy_handle(&handle, directry, file);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_redundancy_mode(handle, REFOP_MODE_PINGPONG));
+	ASSERT_EQ(REFOP_SUCCESS, refop_set_lazy_upgrade(handle, true));
+
+	ret = refop_remove_redundancy_data(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+	ASSERT_NE(0, access(latestfile, F_OK));
+	ASSERT_NE(0, access(backupfile, F_OK));
+
+	ret = refop_get_redundancy_data(handle, rbuf, sizeof(rbuf), &szr);
+	ASSERT_EQ(REFOP_NOENT, ret);
+
+	ret = refop_release_redundancy_handle(handle);
+	ASSERT_EQ(REFOP_SUCCESS, ret);
+
+	cleanup_files(directry, testfiles);
+}
+//--------------------------------------------------------------------------------------------------------
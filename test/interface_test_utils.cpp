@@ -0,0 +1,45 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_utils.cpp
+ * @brief	Common helpers of public interface tests
+ */
+#include "interface_test_utils.h"
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//--------------------------------------------------------------------------------------------------------
+// Create the test directory and remove fixture files, files is terminated by NULL.
+void cleanup_files(const char *dir, const char *const files[])
+{
+	(void)mkdir(dir, 0777);
+	for (int i = 0; files[i] != NULL; i++)
+		(void)unlink(files[i]);
+}
+//--------------------------------------------------------------------------------------------------------
+// Invert one byte of a file.
+int breakfile_data(const char *file, off_t offset)
+{
+	uint8_t val = 0;
+	int fd = -1;
+
+	fd = open(file, O_RDWR);
+	if (fd < 0)
+		return -1;
+
+	(void)pread(fd, &val, 1, offset);
+	val = ~val;
+	(void)pwrite(fd, &val, 1, offset);
+	(void)close(fd);
+
+	return 0;
+}
+//--------------------------------------------------------------------------------------------------------
+// Fill test data, a different seed makes different data.
+void create_data(uint8_t *pbuf, int64_t sz, uint8_t seed)
+{
+	for (int64_t i = 0; i < sz; i++)
+		pbuf[i] = (uint8_t)((i * 13) + seed);
+}
@@ -0,0 +1,19 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	interface_test_utils.h
+ * @brief	Common helpers of public interface tests
+ */
+#ifndef REFOP_INTERFACE_TEST_UTILS_H
+#define REFOP_INTERFACE_TEST_UTILS_H
+//-----------------------------------------------------------------------------
+#include <stdint.h>
+#include <sys/types.h>
+
+//-----------------------------------------------------------------------------
+void cleanup_files(const char *dir, const char *const files[]);
+int breakfile_data(const char *file, off_t offset);
+void create_data(uint8_t *pbuf, int64_t sz, uint8_t seed);
+
+//-----------------------------------------------------------------------------
+#endif //#ifndef REFOP_INTERFACE_TEST_UTILS_H
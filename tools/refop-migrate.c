@@ -0,0 +1,539 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @file	refop-migrate.c
+ * @brief	Format migration tool for librefop data files
+ *
+ * This tool walk a directory tree, validate every librefop data file of rotation mode and rewrite it
+ * in the target format or mode by the library (crash safe rotation).  Files are processed by worker
+ * threads in parallel.
+ */
+#include "librefop.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/** Initial read buffer size, it grows up to the size limit for larger values. */
+#define MIGRATE_BUFFER_SIZE (1 * 1024 * 1024)
+/** Maximum number of worker threads. */
+#define MIGRATE_THREADS_MAX (64)
+
+/** Magic code and header version of librefop data file. */
+#define MIGRATE_HEADER_MAGIC ((uint32_t) 0x96962323)
+#define MIGRATE_VERSION_V1 ((uint32_t) 0x00000001)
+#define MIGRATE_VERSION_V3 ((uint32_t) 0x00000003)
+#define MIGRATE_VERSION_V5 ((uint32_t) 0x00000005)
+#define MIGRATE_VERSION_V7 ((uint32_t) 0x00000007)
+
+typedef enum migrate_format {
+	MIGRATE_FORMAT_LEGACY = 0,
+	MIGRATE_FORMAT_BLOCK,
+	MIGRATE_FORMAT_COMPRESS,
+	MIGRATE_FORMAT_DIRECT,
+} migrate_format_t;
+
+struct migrate_target {
+	char dir[PATH_MAX];  /**< Directory of data file */
+	char name[NAME_MAX + 1]; /**< Data file name (without suffix) */
+};
+
+struct migrate_buffer {
+	uint8_t *data; /**< Read buffer */
+	int64_t size;  /**< Read buffer size */
+};
+
+struct migrate_context {
+	struct migrate_target *targets; /**< Found data files */
+	size_t ntargets;		/**< Number of found data files */
+	size_t ctargets;		/**< Capacity of targets */
+	size_t next;			/**< Next index for worker (atomic) */
+	migrate_format_t format;	/**< Target format */
+	refop_mode_t mode;		/**< Target mode */
+	int64_t size_limit;		/**< Size limit of source and target handles */
+	bool dry_run;			/**< Validate only */
+	bool force;			/**< Rewrite files in target format */
+	bool verbose;			/**< Print every file */
+	size_t migrated;		/**< Result counter (atomic) */
+	size_t skipped;			/**< Result counter (atomic) */
+	size_t broken;			/**< Result counter (atomic) */
+	size_t failed;			/**< Result counter (atomic) */
+};
+
+static const char *c_skip_suffix[] = { ".tmp", ".ab", ".par", ".dlt", ".jnl", NULL };
+
+/**
+ * Check suffix of file name.
+ */
+static bool migrate_has_suffix(const char *name, const char *suffix)
+{
+	size_t len = strlen(name), slen = strlen(suffix);
+
+	return (len > slen && strcmp(name + len - slen, suffix) == 0);
+}
+
+/**
+ * Check ping-pong file name (<name>.g<n>).
+ */
+static bool migrate_is_pingpong(const char *name)
+{
+	const char *p = strrchr(name, '.');
+
+	if (p == NULL || p[1] != 'g' || p[2] == '\0')
+		return false;
+
+	for (p += 2; *p != '\0'; p++) {
+		if (*p < '0' || *p > '9')
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Check delta file, journal file or chunk directory of the data file.
+ */
+static bool migrate_has_companion(const char *dir, const char *name)
+{
+	static const char *suffix[] = { ".dlt", ".jnl", ".chk", NULL };
+	char path[PATH_MAX];
+
+	for (int i = 0; suffix[i] != NULL; i++) {
+		(void) snprintf(path, sizeof(path), "%s/%s%s", dir, name, suffix[i]);
+		if (access(path, F_OK) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Read header version of librefop data file.
+ *
+ * @return Header version, 0 is not librefop data file.
+ */
+static uint32_t migrate_file_version(const char *path)
+{
+	uint32_t head[3] = { 0 };
+	int fd = -1;
+
+	fd = open(path, (O_CLOEXEC | O_RDONLY | O_NOFOLLOW));
+	if (fd < 0)
+		return 0;
+
+	if (pread(fd, head, sizeof(head), 0) != (ssize_t) sizeof(head))
+		head[0] = 0;
+	(void) close(fd);
+
+	if (head[0] != MIGRATE_HEADER_MAGIC || head[1] != (uint32_t)(~head[2]))
+		return 0;
+
+	return head[1];
+}
+
+/**
+ * Add a data file to target list.  Duplicated targets are removed by migrate_unique().
+ */
+static int migrate_add_target(struct migrate_context *ctx, const char *dir, const char *name)
+{
+	struct migrate_target *targets = NULL;
+
+	if (ctx->ntargets == ctx->ctargets) {
+		targets = (struct migrate_target *) realloc(ctx->targets,
+							    sizeof(struct migrate_target) * (ctx->ctargets + 256));
+		if (targets == NULL)
+			return -1;
+		ctx->targets = targets;
+		ctx->ctargets += 256;
+	}
+
+	(void) snprintf(ctx->targets[ctx->ntargets].dir, PATH_MAX, "%s", dir);
+	(void) snprintf(ctx->targets[ctx->ntargets].name, NAME_MAX + 1, "%s", name);
+	ctx->ntargets++;
+
+	return 0;
+}
+
+static int migrate_target_compare(const void *a, const void *b)
+{
+	const struct migrate_target *ta = (const struct migrate_target *) a;
+	const struct migrate_target *tb = (const struct migrate_target *) b;
+	int ret = strcmp(ta->dir, tb->dir);
+
+	return (ret != 0) ? ret : strcmp(ta->name, tb->name);
+}
+
+/**
+ * Sort target list and remove duplicated target.  Latest file and backup file are one target.
+ */
+static void migrate_unique(struct migrate_context *ctx)
+{
+	size_t n = 0;
+
+	if (ctx->ntargets == 0)
+		return;
+
+	qsort(ctx->targets, ctx->ntargets, sizeof(struct migrate_target), migrate_target_compare);
+
+	for (size_t i = 1; i < ctx->ntargets; i++) {
+		if (migrate_target_compare(&ctx->targets[n], &ctx->targets[i]) != 0) {
+			n++;
+			if (n != i)
+				ctx->targets[n] = ctx->targets[i];
+		}
+	}
+	ctx->ntargets = n + 1;
+}
+
+/**
+ * Walk directory tree and collect data files of rotation mode.
+ */
+static int migrate_scan(struct migrate_context *ctx, const char *dir)
+{
+	char path[PATH_MAX], name[NAME_MAX + 1];
+	struct dirent *ent = NULL;
+	struct stat sb;
+	bool skip = false;
+	DIR *dp = NULL;
+	int ret = 0;
+
+	dp = opendir(dir);
+	if (dp == NULL) {
+		fprintf(stderr, "refop-migrate: %s: %s\n", dir, strerror(errno));
+		return -1;
+	}
+
+	while ((ent = readdir(dp)) != NULL) {
+		if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+			continue;
+
+		if (snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name) >= (int) sizeof(path))
+			continue;
+		if (lstat(path, &sb) < 0)
+			continue;
+
+		if (S_ISDIR(sb.st_mode)) {
+			// Chunk directory of chunk mode has no data file.
+			if (migrate_has_suffix(ent->d_name, ".chk"))
+				continue;
+			if (migrate_scan(ctx, path) < 0)
+				ret = -1;
+			continue;
+		}
+		if (!S_ISREG(sb.st_mode))
+			continue;
+
+		// Files of other modes and temporary file are not migration source.
+		skip = migrate_is_pingpong(ent->d_name);
+		for (int i = 0; c_skip_suffix[i] != NULL; i++) {
+			if (migrate_has_suffix(ent->d_name, c_skip_suffix[i]))
+				skip = true;
+		}
+		if (skip == true || migrate_file_version(path) == 0)
+			continue;
+
+		(void) snprintf(name, sizeof(name), "%s", ent->d_name);
+		if (migrate_has_suffix(name, ".bk1"))
+			name[strlen(name) - 4] = '\0';
+
+		// Base file of delta, journal and chunk mode is bound to its records, it shall not be rewritten.
+		if (migrate_has_companion(dir, name) == true)
+			continue;
+
+		if (migrate_add_target(ctx, dir, name) < 0) {
+			ret = -1;
+			break;
+		}
+	}
+
+	(void) closedir(dp);
+
+	return ret;
+}
+
+/**
+ * Check the latest file is already target format.
+ */
+static bool migrate_is_target_format(struct migrate_context *ctx, const char *path)
+{
+	static const uint32_t versions[] = { MIGRATE_VERSION_V1, MIGRATE_VERSION_V3, MIGRATE_VERSION_V5,
+					     MIGRATE_VERSION_V7 };
+
+	if (ctx->mode != REFOP_MODE_ROTATION)
+		return false;
+
+	return (migrate_file_version(path) == versions[ctx->format]);
+}
+
+/**
+ * Create a handle with the size limit of migration.
+ */
+static refop_error_t migrate_handle_create(struct migrate_context *ctx, const struct migrate_target *target,
+					   refop_handle_t *handle)
+{
+	refop_options_t opts;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.size_limit = (uint64_t) ctx->size_limit;
+
+	return refop_create_redundancy_handle_ex(handle, target->dir, target->name, &opts);
+}
+
+/**
+ * Read the value by normal get.  The buffer grows while the value fills it.  A value that fills the
+ * buffer of the size limit may be truncated, it is not migrated.
+ *
+ * @return refop_error_t	 Result of get, REFOP_ARGERROR is larger than the size limit, REFOP_SYSERROR is
+ *				 no memory.
+ */
+static refop_error_t migrate_read(struct migrate_context *ctx, refop_handle_t src, struct migrate_buffer *buf,
+				  int64_t *size)
+{
+	refop_error_t ret = REFOP_SUCCESS;
+	uint8_t *data = NULL;
+	int64_t next = 0;
+
+	for (;;) {
+		ret = refop_get_redundancy_data(src, buf->data, buf->size, size);
+		if ((ret != REFOP_SUCCESS && ret != REFOP_RECOVER) || (*size) < buf->size)
+			return ret;
+
+		if (buf->size >= ctx->size_limit)
+			return REFOP_ARGERROR;
+
+		next = (buf->size > ctx->size_limit / 2) ? ctx->size_limit : buf->size * 2;
+		data = (uint8_t *) realloc(buf->data, (size_t) next);
+		if (data == NULL)
+			return REFOP_SYSERROR;
+		buf->data = data;
+		buf->size = next;
+	}
+}
+
+/**
+ * Validate and rewrite one data file.
+ */
+static void migrate_one(struct migrate_context *ctx, const struct migrate_target *target, struct migrate_buffer *buf)
+{
+	refop_handle_t src = NULL, dst = NULL;
+	refop_error_t ret = REFOP_SUCCESS;
+	int64_t size = 0;
+	const char *result = "migrated";
+	size_t *counter = &ctx->migrated;
+	char path[PATH_MAX];
+
+	// A path that does not fit could not be checked, it is not migrated.
+	if (snprintf(path, sizeof(path), "%s/%s", target->dir, target->name) >= (int) sizeof(path)) {
+		result = "path too long";
+		counter = &ctx->failed;
+		goto out;
+	}
+
+	if (migrate_handle_create(ctx, target, &src) != REFOP_SUCCESS) {
+		result = "failed";
+		counter = &ctx->failed;
+		goto out;
+	}
+
+	// Validate by normal get, broken latest file is recovered from backup file.
+	ret = migrate_read(ctx, src, buf, &size);
+	if (ret == REFOP_ARGERROR || ret == REFOP_SYSERROR) {
+		result = (ret == REFOP_ARGERROR) ? "too large" : "failed";
+		counter = &ctx->failed;
+		goto out;
+	} else if (ret != REFOP_SUCCESS && ret != REFOP_RECOVER) {
+		result = "broken";
+		counter = &ctx->broken;
+		goto out;
+	}
+
+	if ((ret == REFOP_SUCCESS && ctx->force == false && migrate_is_target_format(ctx, path) == true) ||
+	    ctx->dry_run == true) {
+		result = (ctx->dry_run == true) ? "valid" : "skipped";
+		counter = &ctx->skipped;
+		goto out;
+	}
+
+	if (migrate_handle_create(ctx, target, &dst) != REFOP_SUCCESS) {
+		result = "failed";
+		counter = &ctx->failed;
+		goto out;
+	}
+
+	// Target handle remove old files after first set of other mode.
+	(void) refop_set_redundancy_mode(dst, ctx->mode);
+	(void) refop_set_lazy_upgrade(dst, true);
+	(void) refop_set_block_checksum(dst, ctx->format == MIGRATE_FORMAT_BLOCK);
+	(void) refop_set_compression(dst, ctx->format == MIGRATE_FORMAT_COMPRESS);
+	(void) refop_set_direct_io(dst, ctx->format == MIGRATE_FORMAT_DIRECT);
+
+	if (refop_set_redundancy_data(dst, buf->data, size) != REFOP_SUCCESS) {
+		result = "failed";
+		counter = &ctx->failed;
+	}
+
+out:
+	if (ctx->verbose == true || counter == &ctx->broken || counter == &ctx->failed)
+		printf("%s/%s: %s\n", target->dir, target->name, result);
+
+	__atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+
+	if (dst != NULL)
+		(void) refop_release_redundancy_handle(dst);
+	if (src != NULL)
+		(void) refop_release_redundancy_handle(src);
+}
+
+/**
+ * Worker thread.  Each worker take next target by atomic counter.
+ */
+static void *migrate_worker(void *arg)
+{
+	struct migrate_context *ctx = (struct migrate_context *) arg;
+	struct migrate_buffer buf;
+	size_t index = 0;
+
+	buf.size = (ctx->size_limit < MIGRATE_BUFFER_SIZE) ? ctx->size_limit : MIGRATE_BUFFER_SIZE;
+	buf.data = (uint8_t *) malloc((size_t) buf.size);
+	if (buf.data == NULL)
+		return NULL;
+
+	while ((index = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED)) < ctx->ntargets)
+		migrate_one(ctx, &ctx->targets[index], &buf);
+
+	free(buf.data);
+
+	return NULL;
+}
+
+static void migrate_usage(void)
+{
+	fprintf(stderr,
+		"Usage: refop-migrate [options] directory...\n"
+		"  -f, --format=FORMAT  target format of rotation mode: legacy, block, compress, direct (default legacy)\n"
+		"  -m, --mode=MODE      target mode: rotation, pingpong, parity (default rotation)\n"
+		"  -j, --jobs=N         number of worker threads (default number of CPUs)\n"
+		"  -s, --size-limit=N   largest value size in bytes, up to 1 GiB (default 1 MiB, the library default)\n"
+		"  -n, --dry-run        validate only\n"
+		"  -F, --force          rewrite files that are already in target format\n"
+		"  -v, --verbose        print result of every file\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option options[] = {
+		{ "format", required_argument, NULL, 'f' }, { "mode", required_argument, NULL, 'm' },
+		{ "jobs", required_argument, NULL, 'j' },   { "size-limit", required_argument, NULL, 's' },
+		{ "dry-run", no_argument, NULL, 'n' },	    { "force", no_argument, NULL, 'F' },
+		{ "verbose", no_argument, NULL, 'v' },	    { "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+	struct migrate_context ctx;
+	pthread_t threads[MIGRATE_THREADS_MAX];
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt = 0, nthreads = 0, ret = 0;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.format = MIGRATE_FORMAT_LEGACY;
+	ctx.mode = REFOP_MODE_ROTATION;
+	ctx.size_limit = REFOP_DATA_SIZE_LIMIT_DEFAULT;
+
+	while ((opt = getopt_long(argc, argv, "f:m:j:s:nFvh", options, NULL)) != -1) {
+		switch (opt) {
+		case 'f':
+			if (strcmp(optarg, "legacy") == 0)
+				ctx.format = MIGRATE_FORMAT_LEGACY;
+			else if (strcmp(optarg, "block") == 0)
+				ctx.format = MIGRATE_FORMAT_BLOCK;
+			else if (strcmp(optarg, "compress") == 0)
+				ctx.format = MIGRATE_FORMAT_COMPRESS;
+			else if (strcmp(optarg, "direct") == 0)
+				ctx.format = MIGRATE_FORMAT_DIRECT;
+			else {
+				migrate_usage();
+				return 2;
+			}
+			break;
+		case 'm':
+			if (strcmp(optarg, "rotation") == 0)
+				ctx.mode = REFOP_MODE_ROTATION;
+			else if (strcmp(optarg, "pingpong") == 0)
+				ctx.mode = REFOP_MODE_PINGPONG;
+			else if (strcmp(optarg, "parity") == 0)
+				ctx.mode = REFOP_MODE_PARITY;
+			else {
+				migrate_usage();
+				return 2;
+			}
+			break;
+		case 'j':
+			jobs = strtol(optarg, NULL, 10);
+			break;
+		case 's':
+			ctx.size_limit = strtoll(optarg, NULL, 10);
+			if (ctx.size_limit <= 0 || ctx.size_limit > REFOP_DATA_SIZE_LIMIT_MAX) {
+				migrate_usage();
+				return 2;
+			}
+			break;
+		case 'n':
+			ctx.dry_run = true;
+			break;
+		case 'F':
+			ctx.force = true;
+			break;
+		case 'v':
+			ctx.verbose = true;
+			break;
+		default:
+			migrate_usage();
+			return 2;
+		}
+	}
+
+	if (optind >= argc) {
+		migrate_usage();
+		return 2;
+	}
+
+	if (jobs < 1)
+		jobs = 1;
+	if (jobs > MIGRATE_THREADS_MAX)
+		jobs = MIGRATE_THREADS_MAX;
+
+	for (int i = optind; i < argc; i++) {
+		if (migrate_scan(&ctx, argv[i]) < 0)
+			ret = 1;
+	}
+	migrate_unique(&ctx);
+
+	for (nthreads = 0; nthreads < jobs && (size_t) nthreads < ctx.ntargets; nthreads++) {
+		if (pthread_create(&threads[nthreads], NULL, migrate_worker, &ctx) != 0)
+			break;
+	}
+	if (nthreads == 0)
+		migrate_worker(&ctx);
+	for (int i = 0; i < nthreads; i++)
+		(void) pthread_join(threads[i], NULL);
+
+	printf("refop-migrate: %zu files, %zu migrated, %zu skipped, %zu broken, %zu failed\n", ctx.ntargets,
+	       ctx.migrated, ctx.skipped, ctx.broken, ctx.failed);
+
+	free(ctx.targets);
+
+	if (ctx.broken > 0 || ctx.failed > 0)
+		ret = 1;
+
+	return ret;
+}
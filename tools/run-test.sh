@@ -9,4 +9,24 @@
 ./test/interface_test_unit
 ./test/interface_test_filebreak
 ./test/interface_test_unit_memory
-
+./test/interface_test_pingpong
+./test/interface_test_slot
+./test/interface_test_block
+./test/interface_test_parity
+./test/interface_test_compress
+./test/interface_test_delta
+./test/interface_test_container
+./test/interface_test_journal
+./test/interface_test_direct
+./test/interface_test_upgrade
+./test/interface_test_chunk
+./test/interface_test_options
+./test/interface_test_allocator
+./test/interface_test_thread
+./test/interface_test_process_lock
+./test/interface_test_registry
+./test/interface_test_store
+./test/interface_test_async
+./test/interface_test_snapshot
+./test/interface_test_shm
+./test/interface_test_txn